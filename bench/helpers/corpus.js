@@ -0,0 +1,122 @@
+import fs from 'node:fs'
+import os from 'node:os'
+import path from 'node:path'
+import { EncoderBuilder } from '../../lib/api.js'
+
+/**
+ * Streams used by the benchmarks. Each one covers a different case: the usual CD audio, high
+ * resolution audio, mono, multichannel, and small blocks (lots of frames, so lots of callbacks).
+ */
+const definitions = [
+  {
+    bitsPerSample: 16, channels: 2, sampleRate: 44100, blocksize: 4096, seconds: 30,
+  },
+  {
+    bitsPerSample: 24, channels: 2, sampleRate: 96000, blocksize: 4096, seconds: 15,
+  },
+  {
+    bitsPerSample: 16, channels: 1, sampleRate: 44100, blocksize: 1152, seconds: 30,
+  },
+  {
+    bitsPerSample: 24, channels: 6, sampleRate: 48000, blocksize: 4096, seconds: 10,
+  },
+  {
+    bitsPerSample: 16, channels: 2, sampleRate: 44100, blocksize: 576, seconds: 10,
+  },
+]
+
+/**
+ * Generates the same samples every time for the same parameters: a couple of tones per channel
+ * plus some noise from a xorshift32 generator, so the encoder has something to work with but the
+ * result does not depend on the machine.
+ * @returns {Buffer} Interleaved 32 bit samples.
+ */
+const generatePcm = ({
+  bitsPerSample, channels, sampleRate, seconds,
+}) => {
+  const samples = sampleRate * seconds
+  const buffer = Buffer.alloc(samples * channels * 4)
+  const view = new Int32Array(buffer.buffer, buffer.byteOffset, samples * channels)
+  const amplitude = 2 ** (bitsPerSample - 1) - 1
+  // eslint-disable-next-line no-bitwise
+  let state = (0x464C4143 ^ (bitsPerSample << 16) ^ (channels << 8) ^ sampleRate) >>> 0
+  const nextNoise = () => {
+    /* eslint-disable no-bitwise */
+    state ^= state << 13
+    state >>>= 0
+    state ^= state >>> 17
+    state ^= state << 5
+    state >>>= 0
+    /* eslint-enable no-bitwise */
+    return state / 2 ** 31 - 1
+  }
+
+  for (let i = 0; i < samples; i += 1) {
+    const t = i / sampleRate
+    for (let ch = 0; ch < channels; ch += 1) {
+      const tones = 0.3 * Math.sin(2 * Math.PI * (220 + 110 * ch) * t)
+        + 0.2 * Math.sin(2 * Math.PI * (1760 + 55 * ch) * t * (1 + t / seconds))
+      view[i * channels + ch] = Math.round((tones + 0.01 * nextNoise()) * amplitude)
+    }
+  }
+
+  return buffer
+}
+
+const encodeFile = (definition, pcm, file) => {
+  const encoder = new EncoderBuilder()
+    .setBitsPerSample(definition.bitsPerSample)
+    .setChannels(definition.channels)
+    .setSampleRate(definition.sampleRate)
+    .setBlocksize(definition.blocksize)
+    .setCompressionLevel(5)
+    .setTotalSamplesEstimate(definition.sampleRate * definition.seconds)
+    .buildWithFile(file)
+  if (!encoder.processInterleaved(pcm)) {
+    throw new Error(`Could not encode ${file}: ${encoder.getResolvedStateString()}`)
+  }
+
+  encoder.finish()
+}
+
+/**
+ * @typedef {object} CorpusEntry
+ * @property {string} name Name of the stream, which contains all the parameters.
+ * @property {{ bitsPerSample: number, channels: number, sampleRate: number,
+ *   blocksize: number, seconds: number }} params Parameters of the stream.
+ * @property {number} samples Samples per channel.
+ * @property {Buffer} pcm Interleaved 32 bit samples.
+ * @property {string} flacPath Path to the same audio encoded as FLAC.
+ */
+
+/**
+ * Generates the corpora in a temporary folder.
+ * @param {{ quick?: boolean }} options With `quick`, the streams are 10 times shorter.
+ * @returns {{ entries: CorpusEntry[], directory: string, cleanup: () => void }}
+ */
+const createCorpus = ({ quick = false } = {}) => {
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'flac-bindings-bench-'))
+  const entries = definitions.map((definition) => {
+    const params = { ...definition, seconds: quick ? definition.seconds / 10 : definition.seconds }
+    const name = `${params.bitsPerSample}bit-${params.channels}ch-${params.sampleRate}hz`
+      + `-bs${params.blocksize}-${params.seconds}s`
+    const pcm = generatePcm(params)
+    const flacPath = path.join(directory, `${name}.flac`)
+    encodeFile(params, pcm, flacPath)
+    return {
+      name,
+      params,
+      samples: params.sampleRate * params.seconds,
+      pcm,
+      flacPath,
+    }
+  })
+
+  return {
+    entries,
+    directory,
+    cleanup: () => fs.rmSync(directory, { recursive: true, force: true }),
+  }
+}
+
+export default createCorpus
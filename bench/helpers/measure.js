@@ -0,0 +1,32 @@
+/**
+ * Runs `fn` several times and returns the timing stats in milliseconds. The first runs are not
+ * measured, so the JIT, the file system cache and the CPU frequency are warmed up.
+ * @param {() => unknown | Promise<unknown>} fn Function to measure
+ * @param {{ iterations: number, warmup?: number }} options How many times to run it
+ */
+const measure = async (fn, { iterations, warmup = Math.max(Math.floor(iterations / 10), 1) }) => {
+  for (let i = 0; i < warmup; i += 1) {
+    // eslint-disable-next-line no-await-in-loop
+    await fn()
+  }
+
+  const times = []
+  for (let i = 0; i < iterations; i += 1) {
+    const start = process.hrtime.bigint()
+    // eslint-disable-next-line no-await-in-loop
+    await fn()
+    times.push(Number(process.hrtime.bigint() - start) / 1e6)
+  }
+
+  times.sort((a, b) => a - b)
+  const total = times.reduce((sum, time) => sum + time, 0)
+  return {
+    iterations,
+    meanMs: total / iterations,
+    minMs: times[0],
+    medianMs: times[Math.floor(iterations / 2)],
+    p95Ms: times[Math.min(Math.floor(iterations * 0.95), iterations - 1)],
+  }
+}
+
+export default measure
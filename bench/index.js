@@ -0,0 +1,96 @@
+import fs from 'node:fs'
+import os from 'node:os'
+import { configure, fns, format } from '../lib/api.js'
+import createCorpus from './helpers/corpus.js'
+import asyncOverheadSuite from './suites/async-overhead.js'
+import codecSuite from './suites/codec.js'
+import fnsSuite from './suites/fns.js'
+import metadataSuite from './suites/metadata.js'
+
+const suites = {
+  codec: codecSuite,
+  fns: fnsSuite,
+  metadata: metadataSuite,
+  'async-overhead': asyncOverheadSuite,
+}
+
+const usage = `Usage: npm run bench -- [options]
+  --quick             Shorter corpora and fewer iterations, to check that everything works
+  --iterations <n>    Measured runs of every case (by default 10, or 3 with --quick)
+  --suites <a,b>      Suites to run (${Object.keys(suites).join(', ')})
+  --output <file>     Writes the JSON results into a file instead of the standard output
+`
+
+const parseArgs = (args) => {
+  const options = { quick: false, iterations: null, suites: Object.keys(suites), output: null }
+  for (let i = 0; i < args.length; i += 1) {
+    switch (args[i]) {
+      case '--quick':
+        options.quick = true
+        break
+      case '--iterations':
+        options.iterations = parseInt(args[i += 1], 10)
+        break
+      case '--suites':
+        options.suites = args[i += 1].split(',')
+        break
+      case '--output':
+        options.output = args[i += 1]
+        break
+      default:
+        process.stderr.write(usage)
+        process.exit(args[i] === '--help' ? 0 : 1)
+    }
+  }
+
+  const unknownSuite = options.suites.find((name) => !(name in suites))
+  if (unknownSuite) {
+    throw new Error(`Unknown suite ${unknownSuite}`)
+  }
+
+  options.iterations ??= options.quick ? 3 : 10
+  if (!(options.iterations > 0)) {
+    throw new Error('--iterations must be a positive number')
+  }
+
+  return options
+}
+
+const options = parseArgs(process.argv.slice(2))
+const packageJson = JSON.parse(fs.readFileSync(new URL('../package.json', import.meta.url)))
+
+process.stderr.write('Generating corpora...\n')
+const corpus = createCorpus({ quick: options.quick })
+const results = []
+try {
+  for (const name of options.suites) {
+    process.stderr.write(`Running ${name}...\n`)
+    // eslint-disable-next-line no-await-in-loop
+    results.push(...await suites[name](corpus, options))
+  }
+} finally {
+  corpus.cleanup()
+}
+
+// everything needed to know if two runs can be compared
+const report = {
+  version: packageJson.version,
+  libflac: format.VERSION_STRING,
+  kernels: fns.kernels,
+  threads: configure().threads,
+  node: process.versions.node,
+  platform: process.platform,
+  arch: process.arch,
+  cpu: os.cpus()[0]?.model ?? null,
+  date: new Date().toISOString(),
+  quick: options.quick,
+  iterations: options.iterations,
+  results,
+}
+
+const json = `${JSON.stringify(report, null, 2)}\n`
+if (options.output) {
+  fs.writeFileSync(options.output, json)
+} else {
+  process.stdout.write(json)
+}
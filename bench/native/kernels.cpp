@@ -0,0 +1,145 @@
+#include "../../src/utils/sample_kernels.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Micro-benchmark of the sample conversion kernels, without going through N-API. Prints the
+// results as JSON with the same shape as the JS suite, so both can be tracked together.
+
+using namespace flac_bindings;
+
+struct Result {
+  std::string name;
+  uint64_t samples;
+  uint32_t iterations;
+  double meanMs;
+  double minMs;
+  double medianMs;
+};
+
+static uint32_t nextRandom(uint32_t& state) {
+  // xorshift32, the same generator used to build the JS corpora
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static Result measure(
+  const char* name,
+  uint64_t samples,
+  uint32_t iterations,
+  const std::function<void()>& fn) {
+  using clock = std::chrono::steady_clock;
+  std::vector<double> times;
+  times.reserve(iterations);
+
+  // warm up caches and the CPU frequency before measuring
+  for (uint32_t i = 0; i < std::max(iterations / 10, 1u); i += 1) {
+    fn();
+  }
+
+  for (uint32_t i = 0; i < iterations; i += 1) {
+    auto start = clock::now();
+    fn();
+    auto end = clock::now();
+    times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  std::sort(times.begin(), times.end());
+  double total = 0;
+  for (auto time: times) {
+    total += time;
+  }
+
+  return {name, samples, iterations, total / iterations, times.front(), times[times.size() / 2]};
+}
+
+int main(int argc, char** argv) {
+  uint64_t samples = 1 << 20;
+  uint32_t iterations = 100;
+  for (int i = 1; i < argc; i += 1) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      samples = 1 << 16;
+      iterations = 20;
+    }
+  }
+
+  const uint64_t channels = 2;
+  const uint64_t total = samples * channels;
+  std::vector<int32_t> in32(total), out32(total);
+  std::vector<char> in24(total * 3), out24(total * 3), in16(total * 2);
+  std::vector<float> inFloat(total), outFloat(total);
+  std::vector<int32_t> planar[channels];
+
+  uint32_t seed = 0x464C4143;
+  for (uint64_t i = 0; i < total; i += 1) {
+    auto value = (int32_t) nextRandom(seed) >> 8;
+    in32[i] = value;
+    inFloat[i] = value / 8388608.0f;
+  }
+  convertSamples((const char*) in32.data(), 4, in24.data(), 3, total);
+  convertSamples(in24.data(), 3, in16.data(), 2, total);
+  for (uint64_t ch = 0; ch < channels; ch += 1) {
+    planar[ch].resize(samples);
+    for (uint64_t i = 0; i < samples; i += 1) {
+      planar[ch][i] = in32[i * channels + ch];
+    }
+  }
+
+  const char* planarIn[channels];
+  char* planarOut[channels];
+  for (uint64_t ch = 0; ch < channels; ch += 1) {
+    planarIn[ch] = (const char*) planar[ch].data();
+    planarOut[ch] = (char*) planar[ch].data();
+  }
+
+  std::vector<Result> results;
+  results.push_back(measure("convert 24 to 32", total, iterations, [&]() {
+    convertSamples(in24.data(), 3, (char*) out32.data(), 4, total);
+  }));
+  results.push_back(measure("convert 32 to 24", total, iterations, [&]() {
+    convertSamples((const char*) in32.data(), 4, out24.data(), 3, total);
+  }));
+  results.push_back(measure("convert 16 to 32", total, iterations, [&]() {
+    convertSamples(in16.data(), 2, (char*) out32.data(), 4, total);
+  }));
+  results.push_back(measure("interleave 2x32", total, iterations, [&]() {
+    interleaveSamples(planarIn, 4, (char*) out32.data(), 4, channels, samples);
+  }));
+  results.push_back(measure("deinterleave 2x32", total, iterations, [&]() {
+    deinterleaveSamples((const char*) in32.data(), 4, planarOut, 4, channels, samples);
+  }));
+  results.push_back(measure("int32 to float", total, iterations, [&]() {
+    samplesToFloat((const char*) in32.data(), 4, 24, (char*) outFloat.data(), total);
+  }));
+  results.push_back(measure("float to int32", total, iterations, [&]() {
+    samplesFromFloat((const char*) inFloat.data(), (char*) out32.data(), 4, 24, false, total);
+  }));
+  results.push_back(measure("float to int32 (dither)", total, iterations, [&]() {
+    samplesFromFloat((const char*) inFloat.data(), (char*) out32.data(), 4, 24, true, total);
+  }));
+
+  printf("{\n  \"kernels\": \"%s\",\n  \"results\": [\n", sampleKernelsName());
+  for (size_t i = 0; i < results.size(); i += 1) {
+    const auto& r = results[i];
+    printf(
+      "    {\"suite\": \"native\", \"name\": \"%s\", \"samples\": %llu, \"iterations\": %u, "
+      "\"meanMs\": %.6f, \"minMs\": %.6f, \"medianMs\": %.6f, \"samplesPerSecond\": %.0f}%s\n",
+      r.name.c_str(),
+      (unsigned long long) r.samples,
+      r.iterations,
+      r.meanMs,
+      r.minMs,
+      r.medianMs,
+      r.samples / (r.medianMs / 1000.0),
+      i + 1 < results.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+  return EXIT_SUCCESS;
+}
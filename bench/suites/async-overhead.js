@@ -0,0 +1,79 @@
+import fs from 'node:fs'
+import { DecoderBuilder, _testAsync as testAsync } from '../../lib/api.js'
+import measure from '../helpers/measure.js'
+
+// _testAsync calls the progress callback once for every digit
+const testAsyncCallbacks = 10
+
+/**
+ * Decodes a file from memory with a read callback that gives `chunkSize` bytes every time, and
+ * counts how many callbacks were called.
+ */
+const decodeWithReadCallbacks = async (data, chunkSize) => {
+  let position = 0
+  let callbacks = 0
+  const read = (buffer) => {
+    callbacks += 1
+    const bytes = Math.min(buffer.length, chunkSize, data.length - position)
+    data.copy(buffer, 0, position, position + bytes)
+    position += bytes
+    return { bytes, returnValue: bytes === 0 ? 1 : 0 }
+  }
+  const write = () => {
+    callbacks += 1
+    return 0
+  }
+
+  const decoder = await new DecoderBuilder()
+    .buildWithStreamAsync(read, null, null, null, null, write, null, () => {})
+  await decoder.processUntilEndOfStreamAsync()
+  await decoder.finishAsync()
+  return callbacks
+}
+
+/**
+ * Cost of going from the background thread to JS and back in AsyncBackgroundTask. The decoder
+ * cases are measured with the file read in small and big chunks: the difference between both is
+ * mostly the cost of the extra callbacks.
+ */
+const asyncOverheadSuite = async (corpus, { iterations }) => {
+  const results = []
+  const cases = [
+    ['testAsync sync callback', () => testAsync('resolve', () => {})],
+    ['testAsync async callback', () => testAsync('resolve', () => Promise.resolve())],
+  ]
+  for (const [name, fn] of cases) {
+    // eslint-disable-next-line no-await-in-loop
+    const stats = await measure(fn, { iterations: iterations * 10 })
+    results.push({
+      suite: 'async-overhead',
+      name,
+      ...stats,
+      callbacks: testAsyncCallbacks,
+      perCallbackUs: (stats.medianMs * 1000) / testAsyncCallbacks,
+    })
+  }
+
+  const entry = corpus.entries.find(({ params }) => params.blocksize < 1152) ?? corpus.entries[0]
+  const data = fs.readFileSync(entry.flacPath)
+  for (const chunkSize of [1024, 64 * 1024]) {
+    let callbacks = 0
+    // eslint-disable-next-line no-await-in-loop
+    const stats = await measure(async () => {
+      callbacks = await decodeWithReadCallbacks(data, chunkSize)
+    }, { iterations })
+    results.push({
+      suite: 'async-overhead',
+      name: `decode stream async (read chunks of ${chunkSize} bytes)`,
+      corpus: entry.name,
+      params: entry.params,
+      ...stats,
+      callbacks,
+      perCallbackUs: (stats.medianMs * 1000) / callbacks,
+    })
+  }
+
+  return results
+}
+
+export default asyncOverheadSuite
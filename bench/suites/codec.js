@@ -0,0 +1,82 @@
+import path from 'node:path'
+import { DecoderBuilder, EncoderBuilder } from '../../lib/api.js'
+import measure from '../helpers/measure.js'
+
+const noop = () => {}
+const writeContinue = () => 0
+
+const decodeSync = (entry) => {
+  const decoder = new DecoderBuilder().buildWithFile(entry.flacPath, writeContinue, null, noop)
+  decoder.processUntilEndOfStream()
+  decoder.finish()
+}
+
+const decodeAsync = async (entry) => {
+  const decoder = await new DecoderBuilder()
+    .buildWithFileAsync(entry.flacPath, writeContinue, null, noop)
+  await decoder.processUntilEndOfStreamAsync()
+  await decoder.finishAsync()
+}
+
+const decodeAsyncBatched = async (entry) => {
+  const decoder = await new DecoderBuilder()
+    .setWriteBatch({ frames: 64 })
+    .buildWithFileAsync(entry.flacPath, writeContinue, null, noop)
+  await decoder.processUntilEndOfStreamAsync()
+  await decoder.finishAsync()
+}
+
+const createEncoderBuilder = ({ params }) => new EncoderBuilder()
+  .setBitsPerSample(params.bitsPerSample)
+  .setChannels(params.channels)
+  .setSampleRate(params.sampleRate)
+  .setBlocksize(params.blocksize)
+  .setCompressionLevel(5)
+
+const encodeSync = (entry, output) => {
+  const encoder = createEncoderBuilder(entry).buildWithFile(output)
+  encoder.processInterleaved(entry.pcm)
+  encoder.finish()
+}
+
+const encodeAsync = async (entry, output) => {
+  const encoder = await createEncoderBuilder(entry).buildWithFileAsync(output)
+  await encoder.processInterleavedAsync(entry.pcm)
+  await encoder.finishAsync()
+}
+
+/**
+ * Throughput of decoding and encoding every stream of the corpus, using the synchronous and the
+ * asynchronous API. The callbacks do nothing, so the results are the cost of libFLAC plus the
+ * cost of the bindings.
+ */
+const codecSuite = async (corpus, { iterations }) => {
+  const cases = [
+    ['decode sync', (entry) => decodeSync(entry)],
+    ['decode async', (entry) => decodeAsync(entry)],
+    ['decode async (write batch of 64 frames)', (entry) => decodeAsyncBatched(entry)],
+    ['encode sync', (entry, output) => encodeSync(entry, output)],
+    ['encode async', (entry, output) => encodeAsync(entry, output)],
+  ]
+
+  const results = []
+  for (const entry of corpus.entries) {
+    const output = path.join(corpus.directory, `${entry.name}.out.flac`)
+    for (const [name, fn] of cases) {
+      // eslint-disable-next-line no-await-in-loop
+      const stats = await measure(() => fn(entry, output), { iterations })
+      results.push({
+        suite: 'codec',
+        name,
+        corpus: entry.name,
+        params: entry.params,
+        ...stats,
+        samplesPerSecond: entry.samples / (stats.medianMs / 1000),
+      })
+    }
+  }
+
+  return results
+}
+
+export default codecSuite
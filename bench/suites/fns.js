@@ -0,0 +1,63 @@
+import { fns } from '../../lib/api.js'
+import measure from '../helpers/measure.js'
+
+/**
+ * Throughput of the `fns` conversion functions, using preallocated outputs so the allocations
+ * are not measured. Only the stereo streams of the corpus are used, the kernels do not depend
+ * on anything else.
+ */
+const fnsSuite = async (corpus, { iterations }) => {
+  const results = []
+  for (const entry of corpus.entries.filter(({ params }) => params.channels === 2)) {
+    const { channels, bitsPerSample } = entry.params
+    const count = entry.samples * channels
+    const packed = fns.convertSampleFormat({ buffer: entry.pcm, inBps: 4, outBps: 3 })
+    const floats = fns.convertSampleFormat({
+      buffer: entry.pcm, outFloat: true, bitsPerSample,
+    })
+    const planar = fns.unzipAudio({ buffer: entry.pcm, channels })
+    const output = Buffer.alloc(count * 4)
+    const planarOutput = planar.map((buffer) => Buffer.alloc(buffer.length))
+
+    const cases = [
+      ['convertSampleFormat 24 to 32', () => fns.convertSampleFormat({
+        buffer: packed, inBps: 3, outBps: 4, output,
+      })],
+      ['convertSampleFormat 32 to 24', () => fns.convertSampleFormat({
+        buffer: entry.pcm, inBps: 4, outBps: 3, output,
+      })],
+      ['convertSampleFormat int to float', () => fns.convertSampleFormat({
+        buffer: entry.pcm, outFloat: true, bitsPerSample, output,
+      })],
+      ['convertSampleFormat float to int', () => fns.convertSampleFormat({
+        buffer: floats, inFloat: true, bitsPerSample, output,
+      })],
+      ['convertSampleFormat float to int (dither)', () => fns.convertSampleFormat({
+        buffer: floats, inFloat: true, bitsPerSample, dither: true, output,
+      })],
+      ['zipAudio', () => fns.zipAudio({
+        buffers: planar, samples: entry.samples, output,
+      })],
+      ['unzipAudio', () => fns.unzipAudio({
+        buffer: entry.pcm, channels, output: planarOutput,
+      })],
+    ]
+
+    for (const [name, fn] of cases) {
+      // eslint-disable-next-line no-await-in-loop
+      const stats = await measure(fn, { iterations })
+      results.push({
+        suite: 'fns',
+        name,
+        corpus: entry.name,
+        params: entry.params,
+        ...stats,
+        samplesPerSecond: count / (stats.medianMs / 1000),
+      })
+    }
+  }
+
+  return results
+}
+
+export default fnsSuite
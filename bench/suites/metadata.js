@@ -0,0 +1,109 @@
+import fs from 'node:fs'
+import path from 'node:path'
+import {
+  Chain,
+  SimpleIterator,
+  format,
+  metadata,
+  metadata0,
+} from '../../lib/api.js'
+import measure from '../helpers/measure.js'
+
+const findVorbisComment = (chain) => {
+  const iterator = chain.createIterator()
+  do {
+    if (iterator.getBlockType() === format.MetadataType.VORBIS_COMMENT) {
+      return iterator.getBlock()
+    }
+  } while (iterator.next())
+
+  return null
+}
+
+/**
+ * Copies the first file of the corpus and gives it some tags and padding, so the reads have
+ * more than one block to go through and the writes can be done in place.
+ */
+const prepareFile = (corpus) => {
+  const file = path.join(corpus.directory, 'metadata.flac')
+  fs.copyFileSync(corpus.entries[0].flacPath, file)
+
+  const chain = new Chain()
+  chain.read(file)
+  const comments = findVorbisComment(chain)
+  for (let i = 0; i < 32; i += 1) {
+    comments.appendComment(`TAG${i}=${'value '.repeat(i + 1)}`)
+  }
+  comments.appendComment('BENCH=0000')
+  const iterator = chain.createIterator()
+  while (iterator.next()) {
+    // the padding goes at the end
+  }
+  iterator.insertBlockAfter(new metadata.PaddingMetadata(8192))
+  chain.write(true, false)
+  return file
+}
+
+const writeInPlace = (chain, i) => {
+  // same length every time, so it always fits in place
+  findVorbisComment(chain).replaceComment(`BENCH=${String(i % 10000).padStart(4, '0')}`, true)
+}
+
+/**
+ * Latency of reading and writing the metadata of a file using the three levels of the API.
+ */
+const metadataSuite = async (corpus, { iterations }) => {
+  const file = prepareFile(corpus)
+  let writes = 0
+  const cases = [
+    ['level 0: getStreaminfo', () => metadata0.getStreaminfo(file)],
+    ['level 0: getStreaminfoAsync', () => metadata0.getStreaminfoAsync(file)],
+    ['level 0: getTags', () => metadata0.getTags(file)],
+    ['level 0: getTagsAsync', () => metadata0.getTagsAsync(file)],
+    ['level 1: read all blocks', () => {
+      const iterator = new SimpleIterator()
+      iterator.init(file, true)
+      return [...iterator]
+    }],
+    ['level 1: read all blocks async', async () => {
+      const iterator = new SimpleIterator()
+      await iterator.initAsync(file, true)
+      const blocks = []
+      for await (const block of iterator) {
+        blocks.push(block)
+      }
+      return blocks
+    }],
+    ['level 2: read', () => new Chain().read(file)],
+    ['level 2: readAsync', () => new Chain().readAsync(file)],
+    ['level 2: read (mmap)', () => new Chain().read(file, { mmap: true })],
+    ['level 2: write in place', () => {
+      const chain = new Chain()
+      chain.read(file)
+      writeInPlace(chain, writes += 1)
+      chain.write(true, false)
+    }],
+    ['level 2: writeAsync in place', async () => {
+      const chain = new Chain()
+      await chain.readAsync(file)
+      writeInPlace(chain, writes += 1)
+      await chain.writeAsync(true, false)
+    }],
+  ]
+
+  const results = []
+  for (const [name, fn] of cases) {
+    // eslint-disable-next-line no-await-in-loop
+    const stats = await measure(fn, { iterations })
+    results.push({
+      suite: 'metadata',
+      name,
+      corpus: corpus.entries[0].name,
+      ...stats,
+    })
+  }
+
+  return results
+}
+
+export default metadataSuite
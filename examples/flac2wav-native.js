@@ -0,0 +1,28 @@
+import { DecoderBuilder } from 'flac-bindings/api'
+import createArgs from './_args.js'
+
+const args = createArgs(import.meta.url)
+
+// first argument is the flac file to decode
+// second argument is the wav where the decoded flac will be writen
+// unlike flac2wav.js, the samples are written into the WAV from the decoder thread, so it does
+// not need the wav package and the audio never goes through JS.
+
+const decoder = await new DecoderBuilder()
+  .setWavOutput({
+    path: args[1] || 'out.wav',
+    // uncomment to convert the samples into another bit depth
+    // bitsPerSample: 16,
+  })
+  .buildWithFileAsync(args[0] || 'some.flac', null, null, (errorCode) => {
+    console.error(`Decoder error ${errorCode}`)
+  })
+
+const start = Date.now()
+if (!await decoder.processUntilEndOfStreamAsync()) {
+  console.error(decoder.getResolvedStateString())
+}
+
+// the header of the WAV is completed here, any error writing the file is thrown here too
+await decoder.finishAsync()
+console.log(`Done in ${((Date.now() - start) / 1000).toFixed(2)}s`)
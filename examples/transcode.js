@@ -0,0 +1,25 @@
+import { transcode } from 'flac-bindings/api'
+import createArgs from './_args.js'
+
+const args = createArgs(import.meta.url)
+
+// first argument is the input file, second argument is the output file
+// the formats are guessed from the extensions (flac, oga/ogg, wav, raw/pcm): it can convert a FLAC
+// into a WAV, a WAV into a FLAC, or re-encode a FLAC with other options.
+// everything runs in a background thread, the audio never goes through JS.
+
+const result = await transcode({
+  input: args[0] || 'in.flac',
+  output: args[1] || 'out.wav',
+  // only used if the output is FLAC
+  encoderOptions: {
+    compressionLevel: 8,
+  },
+  progress: ({ samples, totalSamples }) => {
+    const percentage = totalSamples ? (samples / totalSamples) * 100 : 0
+    process.stdout.write(`\r[${percentage.toFixed(1)}%] ${samples} samples`)
+  },
+})
+
+process.stdout.write('\n')
+console.log(result)
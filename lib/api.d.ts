@@ -23,6 +23,59 @@ export class DecoderBuilder {
   setMetadataIgnore(type: metadata.MetadataTypes): DecoderBuilder;
   setMetadataIgnoreApplication(applicationId: Buffer): DecoderBuilder;
   setMetadataIgnoreAll(): DecoderBuilder;
+  /**
+   * Enables (or disables if `null`) the batching of decoded frames when using the **asynchronous**
+   * API. Instead of calling the write callback for every frame, up to `frames` frames are decoded
+   * and sent in one call, reducing the number of jumps between the decoder thread and JS. When
+   * enabled, the write callback receives an array of frames (with header and footer only) and
+   * one buffer per channel containing the samples of all frames, one after another. Any pending
+   * frames are sent before the asynchronous operation finishes.
+   * While JS handles a batch, {@link Decoder#processUntilEndOfStreamAsync} does not keep a thread
+   * waiting for it, so many decoders can run at the same time with a few threads.
+   * @param options Batch options or `null` to disable it.
+   */
+  setWriteBatch(options: Decoder.WriteBatchOptions | null): DecoderBuilder;
+  /**
+   * Changes what the write callback receives as frame, to avoid creating objects for every frame:
+   *
+   * - `full` (default): a new frozen {@link Frame} object for every frame.
+   * - `shared`: the same {@link Frame} object for every frame, updated in place before each call.
+   *   The `subframes` are built when read, and can only be read inside the write callback (or
+   *   before the first `await` of an asynchronous one). Keep a copy of the fields if they are
+   *   needed later.
+   * - `packed`: a reused `Float64Array` with {@link Decoder.PackedFrameField} numbers per frame.
+   *   In batches, the fields of every frame are one after another.
+   * @param mode How the frames are given to the write callback.
+   */
+  setFrameDescriptor(mode: Decoder.FrameDescriptor): DecoderBuilder;
+  /**
+   * Makes the decoder write the samples into a ring in a `SharedArrayBuffer` (or disables it if
+   * `null`), instead of calling the write callback, which can be `null` when building the decoder.
+   * The positions of the ring are in `state` (see {@link Decoder.SharedOutputField}): the decoder
+   * advances the write position after writing a frame, and waits until there is enough space
+   * for the next one. Consumers in any thread read the samples between the read and the write
+   * positions and then advance the read position using `Atomics.store`.
+   *
+   * The positions are counted in samples per channel and wrap around at 2^32, so the number of
+   * available samples is `(write - read) >>> 0` and the index in the ring is
+   * `position & (capacity - 1)`. The decoder cannot wake up threads sleeping in `Atomics.wait`,
+   * so consumers should wait with a short timeout.
+   * @param options Shared output options or `null` to disable it.
+   */
+  setSharedOutput(options: Decoder.SharedOutputOptions | null): DecoderBuilder;
+  /**
+   * Makes the decoder write the samples into a WAV file (or disables it if `null`), instead of
+   * calling the write callback, which can be `null` when building the decoder. The samples are
+   * interleaved and packed in the thread that decodes, so they never go through JS. The file is
+   * created with the format of the first frame, and its header is completed when the decoder is
+   * finished. If the total samples are not in the STREAMINFO, or the file grows beyond 4GiB, it
+   * becomes an RF64 file.
+   *
+   * Cannot be used together with {@link DecoderBuilder#setSharedOutput}. Errors writing the file
+   * make the decoder fail, and are thrown by `finish()` or `finishAsync()`.
+   * @param options WAV output options or `null` to disable it.
+   */
+  setWavOutput(options: Decoder.WavOutputOptions | null): DecoderBuilder;
 
   /**
    * Builds a {@link Decoder} using a stream input. The decoder can only use **synchronous**
@@ -32,7 +85,7 @@ export class DecoderBuilder {
    * @param tellCallback Tell callback
    * @param lengthCallback Length callback
    * @param eofCallback End Of File callback
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback
    */
@@ -42,7 +95,7 @@ export class DecoderBuilder {
     tellCallback: Decoder.TellCallback | null,
     lengthCallback: Decoder.LengthCallback | null,
     eofCallback: Decoder.EOFCallback | null,
-    writeCallback: Decoder.WriteCallback,
+    writeCallback: Decoder.WriteCallback | null,
     metadataCallback: Decoder.MetadataCallback | null,
     errorCallback: Decoder.ErrorCallback
   ): Decoder;
@@ -54,7 +107,7 @@ export class DecoderBuilder {
    * @param tellCallback Tell callback
    * @param lengthCallback Length callback
    * @param eofCallback End Of File callback
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback (mndatory)
    */
@@ -64,7 +117,7 @@ export class DecoderBuilder {
     tellCallback: Decoder.TellCallback | null,
     lengthCallback: Decoder.LengthCallback | null,
     eofCallback: Decoder.EOFCallback | null,
-    writeCallback: Decoder.WriteCallback,
+    writeCallback: Decoder.WriteCallback | null,
     metadataCallback: Decoder.MetadataCallback | null,
     errorCallback: Decoder.ErrorCallback
   ): Decoder;
@@ -72,29 +125,33 @@ export class DecoderBuilder {
    * Builds a {@link Decoder} using a `.flac` file from the file system. The decoder can only
    * use **synchronous** methods.
    * @param path Path to the file in the file system
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback (mandatory)
+   * @param options File options
    */
   buildWithFile(
     path: string,
-    writeCallback: Decoder.WriteCallback,
+    writeCallback: Decoder.WriteCallback | null,
     metadataCallback: Decoder.MetadataCallback | null,
-    errorCallback: Decoder.ErrorCallback
+    errorCallback: Decoder.ErrorCallback,
+    options?: Decoder.FileOptions
   ): Decoder;
   /**
    * Builds a {@link Decoder} using an `.ogg` file containing FLAC from the file system. The decoder
    * can only use **synchronous** methods.
    * @param path Path to the file in the file system
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback (mandatory)
+   * @param options File options
    */
   buildWithOggFile(
     path: string,
-    writeCallback: Decoder.WriteCallback,
+    writeCallback: Decoder.WriteCallback | null,
     metadataCallback: Decoder.MetadataCallback | null,
-    errorCallback: Decoder.ErrorCallback
+    errorCallback: Decoder.ErrorCallback,
+    options?: Decoder.FileOptions
   ): Decoder;
 
   /**
@@ -105,7 +162,7 @@ export class DecoderBuilder {
    * @param tellCallback Tell callback
    * @param lengthCallback Length callback
    * @param eofCallback End Of File callback
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback
    */
@@ -115,7 +172,7 @@ export class DecoderBuilder {
     tellCallback: Decoder.TellCallbackAsync | null,
     lengthCallback: Decoder.LengthCallbackAsync | null,
     eofCallback: Decoder.EOFCallbackAsync | null,
-    writeCallback: Decoder.WriteCallbackAsync,
+    writeCallback: Decoder.WriteCallbackAsync | Decoder.WriteBatchCallbackAsync | null,
     metadataCallback: Decoder.MetadataCallbackAsync | null,
     errorCallback: Decoder.ErrorCallbackAsync
   ): Promise<Decoder>;
@@ -127,7 +184,7 @@ export class DecoderBuilder {
    * @param tellCallback Tell callback
    * @param lengthCallback Length callback
    * @param eofCallback End Of File callback
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback (mndatory)
    */
@@ -137,7 +194,7 @@ export class DecoderBuilder {
     tellCallback: Decoder.TellCallbackAsync | null,
     lengthCallback: Decoder.LengthCallbackAsync | null,
     eofCallback: Decoder.EOFCallbackAsync | null,
-    writeCallback: Decoder.WriteCallbackAsync,
+    writeCallback: Decoder.WriteCallbackAsync | Decoder.WriteBatchCallbackAsync | null,
     metadataCallback: Decoder.MetadataCallbackAsync | null,
     errorCallback: Decoder.ErrorCallbackAsync
   ): Promise<Decoder>;
@@ -145,29 +202,66 @@ export class DecoderBuilder {
    * Builds a {@link Decoder} using a `.flac` file from the file system. The decoder can only
    * use **asynchronous** methods.
    * @param path Path to the file in the file system
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback (mandatory)
+   * @param options File options
    */
   buildWithFileAsync(
     path: string,
-    writeCallback: Decoder.WriteCallbackAsync,
+    writeCallback: Decoder.WriteCallbackAsync | Decoder.WriteBatchCallbackAsync | null,
     metadataCallback: Decoder.MetadataCallbackAsync | null,
-    errorCallback: Decoder.ErrorCallbackAsync
+    errorCallback: Decoder.ErrorCallbackAsync,
+    options?: Decoder.FileOptions
   ): Promise<Decoder>;
   /**
    * Builds a {@link Decoder} using an `.ogg` file containing FLAC from the file system. The decoder
    * can only use **asynchronous** methods.
    * @param path Path to the file in the file system
-   * @param writeCallback Write callback (mandatory)
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
    * @param metadataCallback Metadata callback
    * @param errorCallback Decoder error callback (mandatory)
+   * @param options File options
    */
   buildWithOggFileAsync(
     path: string,
-    writeCallback: Decoder.WriteCallbackAsync,
+    writeCallback: Decoder.WriteCallbackAsync | Decoder.WriteBatchCallbackAsync | null,
     metadataCallback: Decoder.MetadataCallbackAsync | null,
-    errorCallback: Decoder.ErrorCallbackAsync
+    errorCallback: Decoder.ErrorCallbackAsync,
+    options?: Decoder.FileOptions
+  ): Promise<Decoder>;
+  /**
+   * Builds a {@link Decoder} whose input is pushed from JS using {@link Decoder#feed} or
+   * {@link Decoder#feedAsync}, instead of using a read callback. The data is stored in a native
+   * buffer from where the decoder reads without calling JS. The decoder can only use
+   * **asynchronous** methods, and they will wait for more data when the buffer is empty until
+   * {@link Decoder#feedEnd} is called.
+   * {@link Decoder#processUntilEndOfStreamAsync} gives its thread back while the buffer is empty,
+   * and decodes again as soon as there is data or the feed has ended. Data fed after the decoder
+   * has reached the end of the stream is discarded.
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
+   * @param metadataCallback Metadata callback
+   * @param errorCallback Decoder error callback (mandatory)
+   * @param bufferSize Size of the feed buffer in bytes (by default 256KiB)
+   */
+  buildWithFeedAsync(
+    writeCallback: Decoder.WriteCallbackAsync | Decoder.WriteBatchCallbackAsync | null,
+    metadataCallback: Decoder.MetadataCallbackAsync | null,
+    errorCallback: Decoder.ErrorCallbackAsync,
+    bufferSize?: number,
+  ): Promise<Decoder>;
+  /**
+   * Same as {@link DecoderBuilder#buildWithFeedAsync} but for Ogg/FLAC streams.
+   * @param writeCallback Write callback (mandatory, unless there is a shared output)
+   * @param metadataCallback Metadata callback
+   * @param errorCallback Decoder error callback (mandatory)
+   * @param bufferSize Size of the feed buffer in bytes (by default 256KiB)
+   */
+  buildWithOggFeedAsync(
+    writeCallback: Decoder.WriteCallbackAsync | Decoder.WriteBatchCallbackAsync | null,
+    metadataCallback: Decoder.MetadataCallbackAsync | null,
+    errorCallback: Decoder.ErrorCallbackAsync,
+    bufferSize?: number,
   ): Promise<Decoder>;
 }
 
@@ -204,6 +298,42 @@ export abstract class Decoder {
   seekAbsoluteAsync(position: number | bigint): Promise<boolean>;
   getDecodePositionAsync(): Promise<number | bigint | null>;
 
+  /**
+   * Returns the frame index of the decoder, serialized, so it can be given back in the
+   * `frameIndex` option for the same file. In `incremental` mode it only contains the frames
+   * decoded so far.
+   * @returns The index, or `null` if the decoder has been built without the `frameIndex` option.
+   */
+  getFrameIndex(): Buffer | null;
+
+  /**
+   * Copies as much data as possible into the feed buffer, without waiting. Only available when the
+   * decoder has been built using {@link DecoderBuilder#buildWithFeedAsync} or
+   * {@link DecoderBuilder#buildWithOggFeedAsync}.
+   * @param buffer The encoded data.
+   * @returns The number of bytes copied, which can be less than the buffer length if the feed
+   * buffer is full. Once the decoder has reached the end of the stream, the data is discarded
+   * and all of it is counted as copied.
+   */
+  feed(buffer: Buffer): number;
+  /**
+   * Copies all the data into the feed buffer. If it does not fit, the rest will be copied as soon
+   * as the decoder reads data from it. Only available when the decoder has been built using
+   * {@link DecoderBuilder#buildWithFeedAsync} or {@link DecoderBuilder#buildWithOggFeedAsync}.
+   * > **Note**: if no asynchronous process method is running, the promise will not resolve until
+   * > one reads from the feed.
+   * @param buffer The encoded data.
+   * @returns A promise that resolves when all the data has been copied, or when it has been
+   * discarded because the decoder has reached the end of the stream. It rejects if
+   * {@link Decoder#processUntilEndOfStreamAsync} fails or the decoder is finished before that.
+   */
+  feedAsync(buffer: Buffer): Promise<void>;
+  /**
+   * Marks the end of the data of the feed. After the decoder reads the remaining data, it will
+   * reach the end of the stream.
+   */
+  feedEnd(): void;
+
   static readonly State: Decoder.State;
   static readonly StateString: ReverseEnum<Decoder.State>;
   static readonly InitStatus: Decoder.InitStatus;
@@ -334,6 +464,123 @@ declare namespace Decoder {
    */
   type WriteCallbackAsync = (frame: Frame, buffers: Buffer[]) => PerhapsAsync<WriteCallbackReturnType>;
 
+  type FrameDescriptor = 'full' | 'shared' | 'packed';
+
+  /**
+   * Position of the fields of a frame in the `Float64Array` given to the write callback when
+   * {@link DecoderBuilder#setFrameDescriptor} is `packed`. Every frame has 9 fields.
+   */
+  const enum PackedFrameField {
+    Blocksize = 0,
+    SampleRate = 1,
+    Channels = 2,
+    ChannelAssignment = 3,
+    BitsPerSample = 4,
+    /** The frame number, or the sample number if `IsSampleNumber` is `1`. */
+    Number = 5,
+    IsSampleNumber = 6,
+    HeaderCrc = 7,
+    FooterCrc = 8,
+  }
+
+  interface SharedOutputOptions {
+    /**
+     * Ring where the samples are written, backed by a `SharedArrayBuffer`. With an `Int32Array`,
+     * the samples are stored as they come from the decoder. With a `Float32Array`, they are
+     * scaled to the [-1, 1) range. Its length must be `channels * capacity`, where `capacity` is a
+     * power of two.
+     */
+    data: Int32Array | Float32Array;
+    /**
+     * Positions and flags of the ring, backed by a `SharedArrayBuffer`, with at least 3 elements.
+     * @see SharedOutputField
+     */
+    state: Int32Array;
+    /** Channels of the stream, every frame with a different number of channels fails. */
+    channels: number;
+    /**
+     * If `true`, the ring is split in one region of `capacity` samples per channel. By default,
+     * the samples are interleaved.
+     */
+    planar?: boolean;
+  }
+
+  interface WavOutputOptions {
+    /** Path of the WAV file, it is overwritten if it exists. */
+    path: string;
+    /**
+     * Bits per sample of the WAV file, the samples are scaled if it is different from the bits
+     * per sample of the stream. By default, the same as the stream.
+     */
+    bitsPerSample?: number;
+  }
+
+  /** Elements of the `state` array of {@link SharedOutputOptions}. */
+  const enum SharedOutputField {
+    /** Samples written by the decoder, only updated by the decoder. */
+    WritePosition = 0,
+    /** Samples read by the consumers, only updated by the consumers. */
+    ReadPosition = 1,
+    /** Bit set of {@link SharedOutputFlag}. */
+    Flags = 2,
+  }
+
+  const enum SharedOutputFlag {
+    /** Set by the decoder when it is finished. */
+    Ended = 1,
+    /** Set by a consumer to make the decoder fail the next write. */
+    Cancelled = 2,
+  }
+
+  interface FileOptions {
+    /**
+     * Reads the file from a memory map instead of using `read` and `seek` calls for every chunk.
+     * The file must not be truncated while the decoder is using it.
+     */
+    mmap?: boolean;
+    /**
+     * Keeps the offset of every frame of the file, so seeks decode the target frame directly
+     * instead of searching it by bisection. Implies `mmap`, and is only available for FLAC files
+     * (not Ogg).
+     *  - `true`: the index is built when the decoder is built, in memory.
+     *  - `string`: path to a file where the index is stored. If the file contains an index for
+     *    the same file, it is used as is, if not, it is built and saved there.
+     *  - `Buffer`: an index from {@link Decoder#getFrameIndex}. It is built again if it does not
+     *    belong to the file.
+     */
+    frameIndex?: boolean | string | Buffer;
+    /**
+     * How the frame index is built:
+     *  - `scan` (default): by reading the frame headers of the whole file, without decoding them.
+     *  - `incremental`: with the frames as they are decoded. Seeks outside the indexed frames use
+     *    the libFLAC search. The index file is saved when the decoder is finished.
+     */
+    frameIndexMode?: 'scan' | 'incremental';
+  }
+
+  interface WriteBatchOptions {
+    /** Maximum number of frames to send in one call to the write callback. */
+    frames: number;
+    /**
+     * Maximum number of samples (per channel) to send in one call to the write callback. By
+     * default there is no limit other than the number of frames.
+     */
+    maxSamples?: number;
+  }
+  /**
+   * Function that will be called when the decoder has decoded a batch of frames. Only used when
+   * {@link DecoderBuilder#setWriteBatch} has been enabled.
+   *  > **Note**: The buffers are valid only inside the callback. If you need to use them outside the callback,
+   *    use `buffers.map(b => Buffer.from(b))` to make a copy of all of them.
+   * @param frames The header and footer of each {@link Frame} in the batch.
+   * @param buffers PCM data of all frames for each channel ordered by channel assignment.
+   * @returns The {@link WriteStatus}.
+   */
+  type WriteBatchCallbackAsync = (
+    frames: Array<Omit<Frame, 'subframes'>>,
+    buffers: Buffer[],
+  ) => PerhapsAsync<WriteCallbackReturnType>;
+
   /**
    * Function that will be called when a metadata block has been read. The metadata object will only
    * be valid inside the callback. If a copy is needed, clone the object with {@link Metadata#clone}.
@@ -593,6 +840,47 @@ export class EncoderBuilder {
     file: string,
     progressCbk: Encoder.ProgressCallbackAsync | null | undefined
   ): Promise<Encoder>;
+  /**
+   * Builds a {@link Encoder} whose output is taken from JS using {@link Encoder#drain} or
+   * {@link Encoder#drainAsync}, instead of using a write callback. The encoded data is stored in a
+   * native buffer without calling JS, and the encoder only waits when the buffer is full. The
+   * encoder can only use **asynchronous** methods.
+   * > **Note**: the output is not seekable, so the STREAMINFO block is not rewritten at the end.
+   * @param metadataCbk Metadata callback
+   * @param bufferSize Size of the output buffer in bytes (by default 256KiB)
+   */
+  buildWithDrainAsync(
+    metadataCbk?: Encoder.MetadataCallbackAsync | null,
+    bufferSize?: number,
+  ): Promise<Encoder>;
+  /**
+   * Same as {@link EncoderBuilder#buildWithDrainAsync} but for Ogg/FLAC streams.
+   * @param metadataCbk Metadata callback
+   * @param bufferSize Size of the output buffer in bytes (by default 256KiB)
+   */
+  buildWithOggDrainAsync(
+    metadataCbk?: Encoder.MetadataCallbackAsync | null,
+    bufferSize?: number,
+  ): Promise<Encoder>;
+  /**
+   * Builds a {@link Encoder} that reads the samples from a WAV (RIFF, RF64 or Wave64) or AIFF
+   * file and writes into a `.flac` file, both in the file system. The channels, bits per sample,
+   * sample rate and total samples estimate are taken from the header of the input. Use
+   * {@link Encoder#processInputAsync} to encode the file, and then finish the encoder. The encoder
+   * can only use **asynchronous** methods. Can overwrite existing files.
+   *
+   * If the input has a channel mask that is not the default for FLAC, it is stored in a
+   * `WAVEFORMATEXTENSIBLE_CHANNEL_MASK` tag, like the `flac` CLI does, unless metadata has been
+   * set with {@link EncoderBuilder#setMetadata}.
+   * @param input Path of the WAV or AIFF file
+   * @param output Path in the file system where the output is going to be stored
+   * @param progressCbk Progress callback
+   */
+  buildFromWavFileAsync(
+    input: string,
+    output: string,
+    progressCbk?: Encoder.ProgressCallbackAsync | null,
+  ): Promise<Encoder>;
 }
 
 /**
@@ -638,6 +926,45 @@ export abstract class Encoder {
   finishAsync(): Promise<EncoderBuilder | null>;
   processAsync(buffers: Buffer[], samples: Number): Promise<boolean>;
   processInterleavedAsync(buffer: Buffer, samples?: Number | null): Promise<boolean>;
+  /**
+   * Encodes the samples that other threads write into a ring in a `SharedArrayBuffer`, without
+   * going through the main thread. The encoder takes the samples between the read and the write
+   * positions of `state` (see {@link Decoder.SharedOutputField}) and advances the read position,
+   * until the producer sets the `Ended` flag and the ring is empty. The producer advances the
+   * write position using `Atomics.store`, and can set the `Cancelled` flag to stop the encoder.
+   *
+   * The positions are counted in samples per channel and wrap around at 2^32, like in
+   * {@link DecoderBuilder#setSharedOutput}. The encoder polls the ring, so producers do not need
+   * to notify it.
+   * @param options The ring with the samples.
+   * @returns A promise with `true` when all samples have been encoded, or `false` if the ring
+   * has been cancelled or the encoder failed.
+   */
+  processSharedInputAsync(options: Encoder.SharedInputOptions): Promise<boolean>;
+  /**
+   * Encodes all the samples of the input file, reading them in big blocks in the background. Only
+   * available when the encoder has been built using {@link EncoderBuilder#buildFromWavFileAsync}.
+   * @returns A promise with `true` when all samples have been encoded, or `false` if the encoder
+   * failed. Rejects if the input cannot be read.
+   */
+  processInputAsync(): Promise<boolean>;
+
+  /**
+   * Takes all the encoded data available in the output buffer, without waiting. Only available
+   * when the encoder has been built using {@link EncoderBuilder#buildWithDrainAsync} or
+   * {@link EncoderBuilder#buildWithOggDrainAsync}.
+   * @returns The encoded data (can be empty), or `null` if the encoder has finished and all data
+   * has been taken.
+   */
+  drain(): Buffer | null;
+  /**
+   * Same as {@link Encoder#drain}, but waits until there is some encoded data available.
+   * > **Note**: the output buffer must be drained while the encoder is working, or it will wait
+   * > forever when the buffer is full.
+   * @returns A promise with the encoded data, or `null` if the encoder has finished and all data
+   * has been taken.
+   */
+  drainAsync(): Promise<Buffer | null>;
 
   static readonly State: Encoder.State;
   static readonly StateString: ReverseEnum<Encoder.State>;
@@ -823,6 +1150,26 @@ declare namespace Encoder {
     ERROR: 1;
     UNSUPPORTED: 2;
   }
+
+  interface SharedInputOptions {
+    /**
+     * Ring with the samples, backed by a `SharedArrayBuffer`. With an `Int32Array`, the samples
+     * must be in the range of the bits per sample of the encoder. With a `Float32Array`, they
+     * must be in the [-1, 1] range, and are converted to integers before encoding. Its length
+     * must be `channels * capacity`, where `capacity` is a power of two.
+     */
+    data: Int32Array | Float32Array;
+    /**
+     * Positions and flags of the ring, backed by a `SharedArrayBuffer`, with at least 3 elements.
+     * Uses the same layout as {@link Decoder.SharedOutputField}.
+     */
+    state: Int32Array;
+    /**
+     * If `true`, the ring is split in one region of `capacity` samples per channel. By default,
+     * the samples are interleaved.
+     */
+    planar?: boolean;
+  }
 }
 
 
@@ -1235,6 +1582,37 @@ declare namespace metadata0 {
   function getPicture(path: string, type: number, maxWidth?: number, maxHeight?: number, maxDepth?: number, maxColors?: number): metadata.PictureMetadata | null;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level0.html#ga0c9cd22296400c8ce16ee1db011342cb */
   function getPictureAsync(path: string, type: number, maxWidth?: number, maxHeight?: number, maxDepth?: number, maxColors?: number): Promise<metadata.PictureMetadata | null>;
+
+  interface ScanMetadataOptions {
+    /** Types of the blocks to read, by default all of them. The rest are skipped. */
+    types?: metadata.MetadataTypes[];
+    /** Number of files read at the same time, by default and at most the number of CPUs. */
+    concurrency?: number;
+    /** Maximum number of files in each batch, by default `64`. */
+    batchSize?: number;
+  }
+
+  interface ScanMetadataResult {
+    /** Position of the file in the `paths` array. */
+    index: number;
+    path: string;
+    /** The blocks of the requested types, in the same order as in the file. */
+    blocks: metadata.AnyMetadata[];
+    /** Set if the file could not be read, `blocks` is empty then. */
+    error?: string;
+  }
+
+  /**
+   * Reads the metadata blocks of many files, using several threads, each file opened only once.
+   * The results come in batches, in the order the files are finished (not in the order of
+   * `paths`). A file that cannot be read does not stop the scan, its result has an `error`.
+   * @param paths Paths to the FLAC files.
+   * @param options Options for the scan.
+   */
+  function scanMetadata(
+    paths: string[],
+    options?: ScanMetadataOptions,
+  ): AsyncIterableIterator<ScanMetadataResult[]>;
 }
 
 
@@ -1299,7 +1677,13 @@ export class SimpleIterator implements Iterable<metadata.AnyMetadata>, AsyncIter
   /**
    * Returns an async iterator that iterates over the metadata blocks.
    */
-  [Symbol.asyncIterator]: () => AsyncIterator<metadata.AnyMetadata>;
+  /**
+   * Iterates over all blocks asynchronously, from the first one. Each jump to the thread pool
+   * reads up to `prefetch` blocks (8 by default), so the position of the iterator may be ahead
+   * of the last block returned.
+   * @param prefetch Blocks to read at once.
+   */
+  [Symbol.asyncIterator]: (prefetch?: number) => AsyncIterator<metadata.AnyMetadata>;
 
   static Status: SimpleIterator.Status;
   static StatusString: ReverseEnum<SimpleIterator.Status>;
@@ -1334,13 +1718,13 @@ export class Chain {
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#ga8e74773f8ca2bb2bc0b56a65ca0299f4 */
   status(): EnumValues<Chain.Status>;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#ga5a4f2056c30f78af5a79f6b64d5bfdcd */
-  read(path: string): void;
+  read(path: string, options?: Chain.ReadOptions): void;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#ga5a4f2056c30f78af5a79f6b64d5bfdcd */
-  readAsync(path: string): Promise<void>;
+  readAsync(path: string, options?: Chain.ReadOptions): Promise<void>;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#ga3995010aab28a483ad9905669e5c4954 */
-  readOgg(path: string): void;
+  readOgg(path: string, options?: Chain.ReadOptions): void;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#ga3995010aab28a483ad9905669e5c4954 */
-  readOggAsync(path: string): Promise<void>;
+  readOggAsync(path: string, options?: Chain.ReadOptions): Promise<void>;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#ga595f55b611ed588d4d55a9b2eb9d2add */
   readWithCallbacks(callbacks: Chain.IOCallbacks): Promise<void>;
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#gaccc2f991722682d3c31d36f51985066c */
@@ -1405,6 +1789,14 @@ export class Iterator implements Iterable<metadata.AnyMetadata> {
 
 
 declare namespace Chain {
+  interface ReadOptions {
+    /**
+     * Reads the metadata from a memory map of the file instead of using `read` and `seek` calls.
+     * The chain can still be written with {@link Chain#write} and {@link Chain#writeAsync}.
+     */
+    mmap?: boolean;
+  }
+
   /** @see https://xiph.org/flac/api/group__flac__metadata__level2.html#gafe2a924893b0800b020bea8160fd4531 */
   interface Status {
     OK: 0;
@@ -1480,6 +1872,12 @@ declare namespace Chain {
 
 
 declare namespace fns {
+  /**
+   * The set of vectorized conversion kernels selected for this CPU: `x86-64-v4` (AVX-512),
+   * `x86-64-v3` (AVX2), `x86-64-v2` (SSE4), `neon` or `scalar`.
+   */
+  const kernels: string;
+
   interface ZipAudioOptions {
     /** The number of samples in the buffers. */
     samples: number | bigint;
@@ -1489,6 +1887,28 @@ declare namespace fns {
     inBps?: 1 | 2 | 3 | 4;
     /** The output bytes per sample (by default 4) */
     outBps?: 1 | 2 | 3 | 4;
+    /**
+     * If `true`, the input samples are 32 bit floats in the range [-1, 1), and `inBps` is
+     * ignored.
+     */
+    inFloat?: boolean;
+    /**
+     * If `true`, the output samples are 32 bit floats in the range [-1, 1), and `outBps` is
+     * ignored.
+     */
+    outFloat?: boolean;
+    /**
+     * When converting from or to float, the number of bits of the integer samples, used to
+     * scale them (by default `inBps * 8` or `outBps * 8`).
+     */
+    bitsPerSample?: number;
+    /** When converting from float to integer, adds TPDF dither before rounding. */
+    dither?: boolean;
+    /**
+     * Buffer where to write the interleaved audio instead of allocating a new one. Must be at
+     * least `samples * outBps * buffers.length` bytes long and cannot overlap any input buffer.
+     */
+    output?: Buffer;
   }
 
   /**
@@ -1498,7 +1918,7 @@ declare namespace fns {
    * them there are. The channels is determined by the number of buffers inside `buffers`.
    * @param opts The parameters to the function.
    * @see ZipAudioOptions The options interface.
-   * @returns An interleaved PCM audio buffer.
+   * @returns An interleaved PCM audio buffer (`output` or a view of it, if given).
    */
   function zipAudio(opts: ZipAudioOptions): Buffer;
 
@@ -1516,6 +1936,28 @@ declare namespace fns {
     inBps?: 1 | 2 | 3 | 4;
     /** The output bytes per sample (by default 4) */
     outBps?: 1 | 2 | 3 | 4;
+    /**
+     * If `true`, the input samples are 32 bit floats in the range [-1, 1), and `inBps` is
+     * ignored.
+     */
+    inFloat?: boolean;
+    /**
+     * If `true`, the output samples are 32 bit floats in the range [-1, 1), and `outBps` is
+     * ignored.
+     */
+    outFloat?: boolean;
+    /**
+     * When converting from or to float, the number of bits of the integer samples, used to
+     * scale them (by default `inBps * 8` or `outBps * 8`).
+     */
+    bitsPerSample?: number;
+    /** When converting from float to integer, adds TPDF dither before rounding. */
+    dither?: boolean;
+    /**
+     * Buffers (one per channel) where to write the audio instead of allocating new ones. Each
+     * must be at least `samples * outBps` bytes long and cannot overlap the input buffer.
+     */
+    output?: Buffer[];
   }
 
   /**
@@ -1523,7 +1965,7 @@ declare namespace fns {
    * per channel), and optionally converting from one sample format to another.
    * @param opts The parameters to the function
    * @see UnzipAudioOptions The options interface.
-   * @returns A non interleaved array of PCM audio buffers.
+   * @returns A non interleaved array of PCM audio buffers (`output` or views of them, if given).
    */
   function unzipAudio(opts: UnzipAudioOptions): Buffer[];
 
@@ -1539,16 +1981,377 @@ declare namespace fns {
     inBps?: 1 | 2 | 3 | 4;
     /** The output bytes per sample (by default 4) */
     outBps?: 1 | 2 | 3 | 4;
+    /**
+     * If `true`, the input samples are 32 bit floats in the range [-1, 1), and `inBps` is
+     * ignored.
+     */
+    inFloat?: boolean;
+    /**
+     * If `true`, the output samples are 32 bit floats in the range [-1, 1), and `outBps` is
+     * ignored.
+     */
+    outFloat?: boolean;
+    /**
+     * When converting from or to float, the number of bits of the integer samples, used to
+     * scale them (by default `inBps * 8` or `outBps * 8`).
+     */
+    bitsPerSample?: number;
+    /** When converting from float to integer, adds TPDF dither before rounding. */
+    dither?: boolean;
+    /**
+     * Buffer where to write the converted audio instead of allocating a new one. Must be at
+     * least `samples * outBps` bytes long. It can be `buffer` itself if `outBps <= inBps`, to
+     * convert in place.
+     */
+    output?: Buffer;
   }
 
   /**
    * Converts some PCM audio from one sample format to another. The number of samples is
    * determined by `buffer.byteLength / inBps` if `samples` is not defined.
+   *
+   * If `output` is given, the result is written there and the returned buffer is `output` (or
+   * a view of the written part if it is bigger than needed).
    */
   function convertSampleFormat(opts: ConvertSampleFormatOptions): Buffer;
 }
 
 
+/**
+ * Instrumentation of the native side of the bindings, disabled by default. The stats are shared
+ * by the whole process (all workers included), and while disabled nothing is recorded except the
+ * number of async tasks.
+ */
+declare namespace stats {
+  /**
+   * Latencies recorded in a histogram. All times are in microseconds. The percentiles have an
+   * error below 12.5%, and the values may be slightly off if taken while something is running.
+   */
+  interface Histogram {
+    count: number | bigint;
+    mean: number;
+    max: number;
+    p50: number;
+    p90: number;
+    p99: number;
+    p999: number;
+  }
+
+  interface Snapshot {
+    /** True if the stats are being recorded. */
+    enabled: boolean;
+    /** Async tasks alive (queued, running or waiting for its promise to be resolved). */
+    activeTasks: number;
+    /** Async tasks running in a thread of the pool. */
+    runningTasks: number;
+    /** Number of calls from a background thread to JS. */
+    callbacks: number | bigint;
+    decodedSamples: number | bigint;
+    encodedSamples: number | bigint;
+    /**
+     * Bytes given to the decoders through read callbacks, `feed()` or a memory map. Files opened
+     * by libFLAC itself are not counted.
+     */
+    bytesRead: number | bigint;
+    /**
+     * Bytes written by the encoders through write callbacks or the output ring. Files written by
+     * libFLAC itself are not counted.
+     */
+    bytesWritten: number | bigint;
+    /** From a background thread sending a callback to JS until the answer comes back. */
+    callbackRoundTrip: Histogram;
+    /** From an async task being created until a thread of the pool starts running it. */
+    queueWait: Histogram;
+    /**
+     * Time inside libFLAC process and seek calls of decoders, without the time waiting for JS
+     * in async calls. In sync calls, the time of the JS callbacks is included.
+     */
+    decoderProcess: Histogram;
+    /**
+     * Time inside libFLAC process calls of encoders, without the time waiting for JS in async
+     * calls. In sync calls, the time of the JS callbacks is included.
+     */
+    encoderProcess: Histogram;
+  }
+
+  /** Starts recording stats. */
+  function enable(): void;
+  /** Stops recording stats. The recorded ones are kept. */
+  function disable(): void;
+  function isEnabled(): boolean;
+  /** Sets to zero all histograms and counters. The number of tasks is not changed. */
+  function reset(): void;
+  /** Returns a copy of the current stats. */
+  function snapshot(): Snapshot;
+}
+
+
+declare namespace decodeFile {
+  interface DecodeFileOptions {
+    /**
+     * The output bytes per sample. By default is the minimum amount of bytes that can hold a
+     * sample of the stream (`bitsPerSample / 8` rounded up).
+     */
+    outBps?: 1 | 2 | 3 | 4;
+    /** If `true` (by default) the audio is returned in one interleaved buffer. */
+    interleaved?: boolean;
+    /** Set it to `true` if the file is an Ogg/FLAC file. */
+    isOggStream?: boolean;
+    /**
+     * If `true`, the decoded audio is checked against the MD5 signature of the `STREAMINFO`
+     * block (if it has one), and the promise rejects if they are different. `outBps` must be
+     * big enough to hold the samples without losing bits.
+     */
+    verifyMd5?: boolean;
+  }
+
+  interface ParallelDecodeFileOptions extends Omit<DecodeFileOptions, 'isOggStream'> {
+    /**
+     * Number of threads used to decode, by default and at most the number of CPUs. Values above
+     * 1024 are rejected.
+     */
+    threads?: number;
+  }
+
+  interface DecodeFileResult {
+    /** The number of samples (per channel) that have been decoded. */
+    samples: number;
+    channels: number;
+    bitsPerSample: number;
+    sampleRate: number;
+    /** The bytes per sample of the output PCM audio. */
+    outBps: 1 | 2 | 3 | 4;
+  }
+
+  interface InterleavedDecodeFileResult extends DecodeFileResult {
+    /** The decoded PCM audio, interleaved. */
+    buffer: Buffer;
+  }
+
+  interface NonInterleavedDecodeFileResult extends DecodeFileResult {
+    /** The decoded PCM audio, one buffer per channel. */
+    buffers: Buffer[];
+  }
+}
+
+/**
+ * Decodes a whole FLAC file into PCM audio in a background thread, without calling any JS
+ * function while decoding. The output buffer is allocated using the total samples found in the
+ * `STREAMINFO` block.
+ * @param path Path to the FLAC file.
+ * @param options Options for the decoding.
+ * @returns A promise resolving to the decoded PCM audio and some info about it.
+ */
+export function decodeFile(
+  path: string,
+  options?: decodeFile.DecodeFileOptions & { interleaved?: true },
+): Promise<decodeFile.InterleavedDecodeFileResult>;
+export function decodeFile(
+  path: string,
+  options: decodeFile.DecodeFileOptions & { interleaved: false },
+): Promise<decodeFile.NonInterleavedDecodeFileResult>;
+
+/**
+ * Like {@link decodeFile}, but the file is split into ranges of samples that are decoded at the
+ * same time by several threads, each one writing into its own part of the output buffer. The
+ * ranges start at seek points if the file has a `SEEKTABLE`. The total samples must be in the
+ * `STREAMINFO` block, if not the file is decoded by one thread. Ogg/FLAC files are not supported.
+ * @param path Path to the FLAC file.
+ * @param options Options for the decoding.
+ * @returns A promise resolving to the decoded PCM audio and some info about it.
+ */
+export function parallelDecodeFile(
+  path: string,
+  options?: decodeFile.ParallelDecodeFileOptions & { interleaved?: true },
+): Promise<decodeFile.InterleavedDecodeFileResult>;
+export function parallelDecodeFile(
+  path: string,
+  options: decodeFile.ParallelDecodeFileOptions & { interleaved: false },
+): Promise<decodeFile.NonInterleavedDecodeFileResult>;
+
+declare namespace transcode {
+  /**
+   * Format of a file: FLAC, Ogg/FLAC, WAV with integer samples, AIFF or raw PCM (signed little
+   * endian integer samples, without any header). When reading, `wav` also accepts RF64 and
+   * Wave64 files, and `aiff` is only valid for the input.
+   */
+  type TranscodeFormat = 'flac' | 'ogg' | 'wav' | 'aiff' | 'raw';
+
+  interface TranscodeEncoderOptions {
+    compressionLevel?: number;
+    blocksize?: number;
+    verify?: boolean;
+    doMidSideStereo?: boolean;
+    looseMidSideStereo?: boolean;
+    apodization?: string;
+    maxLpcOrder?: number;
+    qlpCoeffPrecision?: number;
+    doQlpCoeffPrecSearch?: boolean;
+    doExhaustiveModelSearch?: boolean;
+    minResidualPartitionOrder?: number;
+    maxResidualPartitionOrder?: number;
+    oggSerialNumber?: number;
+  }
+
+  interface TranscodeProgress {
+    /** The number of samples (per channel) that have been written. */
+    samples: number;
+    /** The number of samples (per channel) of the input, or `0` if unknown. */
+    totalSamples: number;
+  }
+
+  interface TranscodeOptions {
+    /** Path to the input file. */
+    input: string;
+    /** Path to the output file. */
+    output: string;
+    /** Format of the input, by default guessed from the extension of the file. */
+    inputFormat?: TranscodeFormat;
+    /** Format of the output, by default guessed from the extension of the file. */
+    outputFormat?: TranscodeFormat;
+    /** Format of the input when it is raw PCM (mandatory in that case). */
+    rawFormat?: {
+      channels: number;
+      bitsPerSample: number;
+      sampleRate: number;
+    };
+    /** Options for the encoder when the output is FLAC or Ogg/FLAC. */
+    encoderOptions?: TranscodeEncoderOptions;
+    /**
+     * Called from time to time with the progress. The conversion waits until it returns (or the
+     * promise returned resolves), and stops if it throws.
+     */
+    progress?: (progress: TranscodeProgress) => void | Promise<void>;
+    /** Minimum time between calls to `progress`, in milliseconds. By default is `500`. */
+    progressInterval?: number;
+  }
+
+  interface TranscodeResult {
+    /** The number of samples (per channel) that have been written. */
+    samples: number;
+    channels: number;
+    bitsPerSample: number;
+    sampleRate: number;
+  }
+}
+
+/**
+ * Converts a file from one format to another in a background thread: the audio goes from the
+ * decoder (or PCM reader) to the encoder (or PCM writer) without going through JS, using the
+ * same buffers for the whole file. The output has the same channels, bits per sample and sample
+ * rate as the input. Only the audio is converted, metadata blocks and WAV chunks are not copied.
+ * @param options Files, formats and options of the conversion.
+ * @returns A promise resolving to some info about the audio written.
+ */
+export function transcode(
+  options: transcode.TranscodeOptions,
+): Promise<transcode.TranscodeResult>;
+
+declare namespace buildSeekTable {
+  interface BuildSeekTableOptions {
+    /**
+     * Samples (per channel) between seek points. By default a point every 10 seconds, like
+     * `flac -S 10s`.
+     */
+    spacingSamples?: number;
+    /** Keeps the access and modification times of the file. By default is `false`. */
+    preserveFileStats?: boolean;
+  }
+
+  interface BuildSeekTableResult {
+    /** The number of frames found in the file. */
+    frames: number;
+    /** The number of seek points written. */
+    points: number;
+    /**
+     * `true` if the whole file had to be rewritten, because the seek table did not fit in the
+     * metadata and padding blocks.
+     */
+    rewritten: boolean;
+  }
+}
+
+/**
+ * Writes a SEEKTABLE with the real offsets into an existing FLAC file (not Ogg), replacing the
+ * current one if any. The frames are found by reading their headers (checking their CRC-8),
+ * without decoding them, so it takes as long as reading the file. The table is written using a
+ * {@link Chain} with padding, so the file is only rewritten if the padding is not enough.
+ * @param path Path to the FLAC file.
+ * @param options Options for the seek table.
+ * @returns A promise resolving to some info about the seek table written.
+ */
+export function buildSeekTable(
+  path: string,
+  options?: buildSeekTable.BuildSeekTableOptions,
+): Promise<buildSeekTable.BuildSeekTableResult>;
+
+declare namespace ParallelEncoder {
+  interface ParallelEncoderOptions {
+    /** Number of channels of the audio, by default `2`. */
+    channels?: number;
+    /** Bits per sample of the audio, by default `16`. */
+    bitsPerSample?: number;
+    /** Sample rate of the audio, by default `44100`. */
+    sampleRate?: number;
+    /** Compression level, by default `5`. */
+    compressionLevel?: number;
+    /** Samples per frame. By default is the one chosen by the compression level. */
+    blocksize?: number;
+    /** Number of threads used to encode, by default the number of CPUs. */
+    threads?: number;
+    /**
+     * Samples (per channel) encoded by a thread at once. It is rounded up to a multiple of the
+     * blocksize. By default is `blocksize * 64`.
+     */
+    segmentSamples?: number;
+    /**
+     * Samples (per channel) between seek points. By default is 10 seconds. Set it to `0` to not
+     * write the `SEEKTABLE`.
+     */
+    seekPointSpacing?: number;
+    /**
+     * Expected total samples (per channel), used to reserve space for the seek points. By
+     * default reserves space for 1 hour of audio. If there is not enough space, seek points are
+     * discarded evenly.
+     */
+    totalSamplesEstimate?: number;
+  }
+}
+
+/**
+ * Encodes audio into a FLAC file using several threads. The audio is split into segments of
+ * whole frames, each one encoded by its own encoder, and written in order. The `STREAMINFO`
+ * (including the MD5) and `SEEKTABLE` are written when finished. No other metadata block is
+ * written, use {@link Chain} or {@link Iterator} to add them later.
+ */
+export class ParallelEncoder {
+  /**
+   * @param path Path to the output file. It is created when the first samples are processed.
+   * @param options Format of the audio and encoding options.
+   * @throws {Error} If the options are not valid for the encoder.
+   */
+  constructor(path: string, options: ParallelEncoder.ParallelEncoderOptions);
+
+  /** Number of threads used to encode. */
+  readonly threads: number;
+  /** Samples per frame. */
+  readonly blocksize: number;
+
+  /**
+   * Queues interleaved audio to be encoded. The audio is copied, so the buffer can be reused
+   * once the promise is resolved. The promise waits if the threads are too far behind.
+   * @param buffer Interleaved audio with 32 bit signed integer samples.
+   * @param samples Number of samples (per channel) in the buffer, by default all of them.
+   * @returns A promise that resolves to `true`, or rejects if the encoding failed.
+   */
+  processInterleavedAsync(buffer: Buffer, samples?: number): Promise<boolean>;
+  /**
+   * Encodes the remaining audio, waits for all threads and writes the header of the file.
+   * @returns A promise that resolves to `true`, or rejects if the encoding failed.
+   */
+  finishAsync(): Promise<boolean>;
+}
+
 /** @see https://xiph.org/flac/api/structFLAC____FrameHeader.html */
 export interface Header {
   blocksize: number;
@@ -1609,6 +2412,25 @@ export interface Frame {
 }
 
 
+interface ConfigureOptions {
+  /**
+   * Number of threads where the asynchronous functions run. A long task (like decoding a whole
+   * file) holds one thread while running, even when waiting for the JS callbacks. By default, the
+   * number of CPUs (at least 4).
+   */
+  threads?: number;
+}
+
+/**
+ * Changes the configuration of the library. The configuration is shared by the whole process
+ * (all workers included). If the number of threads is reduced, the extra threads stop once they
+ * finish their current task.
+ * @param options The options to change, the rest are kept as they are.
+ * @returns The current configuration.
+ */
+export function configure(options?: ConfigureOptions): Required<ConfigureOptions>;
+
+
 export function _testAsync(
   mode: 'reject' | 'exception' | 'resolve',
   progress: (char: string) => Promise<void> | void,
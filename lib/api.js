@@ -7,6 +7,7 @@ export const {
   napiVersion,
   EncoderBuilder,
   Encoder,
+  ParallelEncoder,
   DecoderBuilder,
   Decoder,
   format,
@@ -16,4 +17,10 @@ export const {
   Chain,
   Iterator,
   fns,
+  stats,
+  decodeFile,
+  parallelDecodeFile,
+  transcode,
+  buildSeekTable,
+  configure,
 } = bindings({ bindings: 'flac-bindings.node', module_root: moduleRoot })
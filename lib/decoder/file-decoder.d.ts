@@ -5,6 +5,8 @@ import { BaseDecoder, DecoderOptions, DecoderPosition } from './interfaces.js'
 export interface FileDecoderOptions extends DecoderOptions {
   /** The file to decode from */
   file: string
+  /** If set to true, the file is read from a memory map instead of using read calls */
+  mmap?: boolean
 }
 
 /**
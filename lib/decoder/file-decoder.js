@@ -7,11 +7,14 @@ class FileDecoder extends Readable {
   constructor(options = {}) {
     super(options)
     this._debug = debug('flac:decoder:file')
-    this._builder = new flac.DecoderBuilder()
+    // only some fields of the header are read, so there is no need for a new object per frame
+    this._builder = new flac.DecoderBuilder().setFrameDescriptor('shared')
     this._dec = undefined
     this._oggStream = options.isOggStream || false
     this._outputAs32 = options.outputAs32 || false
+    this._outputAsFloat = options.outputAsFloat || false
     this._file = options.file
+    this._fileOptions = { mmap: options.mmap || false }
     this._processedSamples = 0
     this._failed = false
 
@@ -67,7 +70,7 @@ class FileDecoder extends Readable {
   }
 
   getOutputBitsPerSample() {
-    if (this._outputAs32) {
+    if (this._outputAs32 || this._outputAsFloat) {
       return 32
     }
 
@@ -122,6 +125,7 @@ class FileDecoder extends Readable {
               this._writeCbk.bind(this),
               this._metadataCbk.bind(this),
               this._errorCbk.bind(this),
+              this._fileOptions,
             )
           } else {
             this._debug('Initializing for FLAC')
@@ -130,6 +134,7 @@ class FileDecoder extends Readable {
               this._writeCbk.bind(this),
               this._metadataCbk.bind(this),
               this._errorCbk.bind(this),
+              this._fileOptions,
             )
           }
         } catch (error) {
@@ -163,7 +168,13 @@ class FileDecoder extends Readable {
 
   _writeCbk(frame, buffers) {
     const outBps = this.getOutputBitsPerSample() / 8
-    const buff = flac.fns.zipAudio({ samples: frame.header.blocksize, outBps, buffers })
+    const buff = flac.fns.zipAudio({
+      samples: frame.header.blocksize,
+      outBps,
+      outFloat: this._outputAsFloat,
+      bitsPerSample: frame.header.bitsPerSample,
+      buffers,
+    })
 
     this._processedSamples += frame.header.blocksize
     this.push(buff)
@@ -179,6 +190,7 @@ class FileDecoder extends Readable {
         bitDepth: metadata.bitsPerSample,
         bitsPerSample: metadata.bitsPerSample,
         is32bit: this._outputAs32,
+        isFloat: this._outputAsFloat,
         sampleRate: metadata.sampleRate,
         totalSamples: metadata.totalSamples,
       })
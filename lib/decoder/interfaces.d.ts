@@ -16,6 +16,12 @@ export interface DecoderOptions {
   * output will be `bitsPerSample` bit.
   **/
   outputAs32?: boolean
+  /**
+  * If set to `true`, samples will be 32 bit floats in the range [-1, 1),
+  * scaled using the bits per sample of the stream. Takes precedence over
+  * `outputAs32`.
+  **/
+  outputAsFloat?: boolean
 }
 
 export interface DecoderPosition {
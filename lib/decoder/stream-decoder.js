@@ -1,4 +1,3 @@
-/* eslint-disable no-await-in-loop */
 import debug from 'debug'
 import stream from 'stream'
 import * as flac from '../api.js'
@@ -12,11 +11,12 @@ class StreamDecoder extends stream.Transform {
       encoding: undefined,
     })
     this._debug = debug('flac:decoder:stream')
-    this._builder = new flac.DecoderBuilder()
+    // only some fields of the header are read, so there is no need for a new object per frame
+    this._builder = new flac.DecoderBuilder().setFrameDescriptor('shared')
     this._dec = null
     this._oggStream = options.isOggStream || false
     this._outputAs32 = options.outputAs32 || false
-    this._chunks = []
+    this._outputAsFloat = options.outputAsFloat || false
     this._processedSamples = 0
 
     if (this._oggStream && !flac.format.API_SUPPORTS_OGG_FLAC) {
@@ -67,7 +67,7 @@ class StreamDecoder extends stream.Transform {
   }
 
   getOutputBitsPerSample() {
-    if (this._outputAs32) {
+    if (this._outputAs32 || this._outputAsFloat) {
       return 32
     }
 
@@ -107,24 +107,14 @@ class StreamDecoder extends stream.Transform {
         try {
           if (this._oggStream) {
             this._debug('Initializing for Ogg/FLAC')
-            this._dec = await this._builder.buildWithOggStreamAsync(
-              this._readCbk.bind(this),
-              null,
-              null,
-              null,
-              null,
+            this._dec = await this._builder.buildWithOggFeedAsync(
               this._writeCbk.bind(this),
               this._metadataCbk.bind(this),
               this._errorCbk.bind(this),
             )
           } else {
             this._debug('Initializing for FLAC')
-            this._dec = await this._builder.buildWithStreamAsync(
-              this._readCbk.bind(this),
-              null,
-              null,
-              null,
-              null,
+            this._dec = await this._builder.buildWithFeedAsync(
               this._writeCbk.bind(this),
               this._metadataCbk.bind(this),
               this._errorCbk.bind(this),
@@ -136,46 +126,23 @@ class StreamDecoder extends stream.Transform {
           this._debug(`Failed initializing decoder: ${initStatus} ${initStatusString}`)
           throw error
         }
+
+        // the decoder reads from the feed in its thread while data is being received
+        this._debug('Starting decoding')
+        this._decoding = this._dec.processUntilEndOfStreamAsync()
+        // errors are handled when awaiting it in _transform or _flush
+        this._decoding.catch(() => {})
       }
 
       this._debug(`Received ${chunk.length} bytes to process`)
-      this._chunks.push(chunk)
-      while (!this._chunksIsAlmostEmpty() && this._dec !== null) {
-        // a processSingle needs data, and have received enough, so it is time to unblock
-        if (this._fillUpPause) {
-          this._debug('Another processSingle call is blocked and there is enough data -> unblocking')
-          this._fillUpPause()
-          callback()
-          return
-        }
-        // if the processSingle blocked did not finished yet, just don't do anything
-        if (this._readCallback) {
-          this._debug('Another processSingle call did not finished yet, doing nothing with this')
-          callback()
-          return
-        }
-
-        // flag to know if the next processSingle call has been blocked
-        this._hasBeenBlocked = false
-        this._lastBytesDemanded = 0
-        // store the current callback just in case it gets blocked
-        this._readCallback = callback
-        this._debug('Processing data')
-        if (!(await this._dec.processSingleAsync())) {
-          this._throwDecoderError()
-          return
-        }
-        this._readCallback = null
-
-        // if the call has been blocked, then it does not need to do anything else
-        if (this._hasBeenBlocked) {
-          this._debug('processSingle was blocked, stopping loop for this processing')
-          return
-        }
-
-        // avoid values of 0 bytes, by using a default value
-        this._lastBytesDemanded = this._lastBytesDemanded || this._dec.getBlocksize() || 1024 * 32
+      try {
+        await this._dec.feedAsync(chunk)
+      } catch {
+        // the decoder will not read anything else, something went wrong
+        await this._decoding
+        this._throwDecoderError()
       }
+
       callback()
     } catch (e) {
       callback(e)
@@ -190,13 +157,11 @@ class StreamDecoder extends stream.Transform {
         return
       }
 
-      this._timeToDie = true
-      if (this._chunks.length > 0) {
-        this._debug('Processing final chunks of data')
-        if (!(await this._dec.processUntilEndOfStreamAsync())) {
-          this._throwDecoderError()
-          return
-        }
+      this._debug('Processing final chunks of data')
+      this._dec.feedEnd()
+      if (!(await this._decoding)) {
+        this._throwDecoderError()
+        return
       }
 
       this._debug('Flushing decoder')
@@ -212,7 +177,13 @@ class StreamDecoder extends stream.Transform {
 
   _writeCbk(frame, buffers) {
     const outBps = this.getOutputBitsPerSample() / 8
-    const buff = flac.fns.zipAudio({ samples: frame.header.blocksize, outBps, buffers })
+    const buff = flac.fns.zipAudio({
+      samples: frame.header.blocksize,
+      outBps,
+      outFloat: this._outputAsFloat,
+      bitsPerSample: frame.header.bitsPerSample,
+      buffers,
+    })
 
     this._processedSamples += frame.header.blocksize
     this.push(buff)
@@ -221,47 +192,6 @@ class StreamDecoder extends stream.Transform {
     return flac.Decoder.WriteStatus.CONTINUE
   }
 
-  _readCbk(buffer) {
-    if (this._chunks.length > 0) {
-      const b = this._chunks[0]
-      const bytesRead = b.copy(buffer, 0)
-      if (bytesRead === b.length) {
-        this._chunks = this._chunks.slice(1)
-      } else {
-        this._chunks[0] = b.slice(bytesRead)
-      }
-      this._lastBytesDemanded += buffer.length
-      this._debug(`Read ${bytesRead} bytes from stored chunks to be decoded`)
-      return { bytes: bytesRead, returnValue: flac.Decoder.ReadStatus.CONTINUE }
-    }
-
-    if (this._timeToDie) {
-      this._debug('Wanted to read, but the stream is being finished -> returning EOF')
-      return { bytes: 0, returnValue: flac.Decoder.ReadStatus.END_OF_STREAM }
-    }
-
-    this._debug(`There is no chunks of data to be read (wanted ${buffer.length}) -> blocking processSingle`)
-    // there is not enough data: block the processSingle
-    //   1. store the required bytes
-    this._lastBytesDemanded = buffer.length
-    //   2. copy the callback
-    const cbk = this._readCallback
-    //   3. notify that processSingle has been blocked
-    this._hasBeenBlocked = true
-    //   4. block
-    return new Promise((resolve) => {
-      this._fillUpPause = () => {
-        resolve({ bytes: 0, returnValue: flac.Decoder.ReadStatus.CONTINUE })
-        this._fillUpPause = undefined
-      }
-
-      if (cbk) {
-        // call the readCallback here
-        cbk()
-      }
-    })
-  }
-
   _metadataCbk(metadata) {
     if (metadata.type === flac.format.MetadataType.STREAMINFO) {
       this.emit('format', {
@@ -269,6 +199,7 @@ class StreamDecoder extends stream.Transform {
         bitDepth: metadata.bitsPerSample,
         bitsPerSample: metadata.bitsPerSample,
         is32bit: this._outputAs32,
+        isFloat: this._outputAsFloat,
         sampleRate: metadata.sampleRate,
         totalSamples: metadata.totalSamples,
       })
@@ -294,13 +225,6 @@ class StreamDecoder extends stream.Transform {
     errorObj.code = error
     throw errorObj
   }
-
-  _chunksIsAlmostEmpty() {
-    if (this._lastBytesDemanded !== undefined) {
-      return this._chunks.reduce((r, v) => r + v.length, 0) < this._lastBytesDemanded * 2
-    }
-    return this._chunks.length < 2
-  }
 }
 
 export default StreamDecoder
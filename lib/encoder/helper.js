@@ -14,10 +14,16 @@ class BaseEncoder {
     this._processedSamples = 0
     /** @type {Buffer[]} */
     this._storedChunks = []
+    /**
+     * Reused for the converted samples, the encoder is done with them when the process resolves
+     * @type {Buffer | null}
+     */
+    this._convertBuffer = null
 
     // default values
     this._channels = 2
     this._bitsPerSample = 16
+    this._encoderBitsPerSample = 16
     this._builder = new EncoderBuilder()
       .setChannels(2)
       .setBitsPerSample(16)
@@ -44,11 +50,11 @@ class BaseEncoder {
    * @returns {Buffer} converted buffer
    */
   convertToInt32Buffer(inputChunk) {
-    if (this._inputAs32) {
+    if (this._inputAs32 && !this._inputAsFloat) {
       return inputChunk
     }
 
-    const inBps = this._bitsPerSample / 8
+    const inBps = this._inputAsFloat ? 4 : this._bitsPerSample / 8
     /** @type {Buffer} */
     let chunk = inputChunk
     if (this._storedChunks.length > 0) {
@@ -57,10 +63,19 @@ class BaseEncoder {
     }
 
     const samples = Math.trunc(chunk.length / inBps / this._channels)
+    const outputSize = samples * this._channels * 4
+    if (!this._convertBuffer || this._convertBuffer.length < outputSize) {
+      this._convertBuffer = Buffer.allocUnsafe(outputSize)
+    }
+
     const buffer = fns.convertSampleFormat({
       inBps,
       buffer: chunk,
       samples: samples * this._channels,
+      inFloat: this._inputAsFloat,
+      bitsPerSample: this._encoderBitsPerSample,
+      dither: this._dither,
+      output: this._convertBuffer,
     })
 
     if (samples !== chunk.length / inBps / this._channels) {
@@ -82,6 +97,8 @@ class BaseEncoder {
     this._debug('setOptionsToEncoder()')
 
     this._inputAs32 = options.inputAs32 || options.is32bit || false
+    this._inputAsFloat = options.inputAsFloat || false
+    this._dither = options.dither || false
 
     if (options.isOggStream != null) {
       this._oggStream = !!options.isOggStream
@@ -102,7 +119,8 @@ class BaseEncoder {
     const bps = options.bitsPerSample || options.bitDepth
     if (bps) {
       this._builder.setBitsPerSample(bps)
-      this._bitsPerSample = this._inputAs32 ? 32 : bps
+      this._encoderBitsPerSample = bps
+      this._bitsPerSample = this._inputAs32 || this._inputAsFloat ? 32 : bps
     }
 
     const sampleRate = options.sampleRate || options.samplerate
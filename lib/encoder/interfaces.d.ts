@@ -22,6 +22,17 @@ export interface EncoderOptions {
    * Alias of {@link EncoderOptions.inputAs32}.
    */
   is32bit?: boolean;
+  /**
+  * If set to `true`, the input will be treated as 32 bit floats in the
+  * range [-1, 1), which are scaled to `bitsPerSample` bit. Values outside
+  * the range are clamped. Takes precedence over `inputAs32`.
+  **/
+  inputAsFloat?: boolean;
+  /**
+  * If set to `true` and `inputAsFloat` is enabled, TPDF dither is added
+  * before rounding the samples. By default is set to false.
+  **/
+  dither?: boolean;
   /** Sample rate in Hz of the input to be encoded */
   samplerate?: number;
   /** Sample rate in Hz of the input to be encoded */
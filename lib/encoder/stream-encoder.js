@@ -1,6 +1,5 @@
 import debug from 'debug'
 import { Transform } from 'stream'
-import { Encoder } from '../api.js'
 import BaseEncoder from './helper.js'
 
 class StreamEncoder extends Transform {
@@ -14,10 +13,8 @@ class StreamEncoder extends Transform {
     this._debug = debug('flac:encoder:stream')
     this._baseEncoder = new BaseEncoder(
       options,
-      (builder) => builder.buildWithStreamAsync(this._writeFlac.bind(this), null, null, null),
-      (builder) => (
-        builder.buildWithOggStreamAsync(null, this._writeFlac.bind(this), null, null, null)
-      ),
+      (builder) => builder.buildWithDrainAsync().then(this._startDraining.bind(this)),
+      (builder) => builder.buildWithOggDrainAsync().then(this._startDraining.bind(this)),
       this._debug,
     )
 
@@ -44,14 +41,40 @@ class StreamEncoder extends Transform {
   }
 
   _flush(callback) {
-    return this._baseEncoder.finishEncoder(callback)
+    return this._baseEncoder.finishEncoder(async (error) => {
+      if (error) {
+        callback(error)
+        return
+      }
+
+      try {
+        // the encoded data is pushed asynchronously, wait until everything has been pushed
+        await this._draining
+        callback(null)
+      } catch (e) {
+        callback(e)
+      }
+    })
   }
 
-  _writeFlac(buffer) {
-    const buffer2 = Buffer.from(buffer)
-    this.push(buffer2)
-    this._debug(`Received ${buffer2.length} bytes of encoded flac data`)
-    return Encoder.WriteStatus.OK
+  _startDraining(enc) {
+    this._draining = this._drainFlac(enc)
+    // errors are reported in _flush, avoids unhandled rejection
+    this._draining.catch(() => {})
+    return enc
+  }
+
+  async _drainFlac(enc) {
+    for (;;) {
+      // eslint-disable-next-line no-await-in-loop
+      const buffer = await enc.drainAsync()
+      if (buffer === null) {
+        return
+      }
+
+      this.push(buffer)
+      this._debug(`Received ${buffer.length} bytes of encoded flac data`)
+    }
   }
 
   _format(format) {
@@ -1,6 +1,7 @@
 #include "../mappings/mappings.hpp"
 #include "../utils/defer.hpp"
 #include "../utils/encoder_decoder_utils.hpp"
+#include "../utils/stats.hpp"
 #include "decoder.hpp"
 
 namespace flac_bindings {
@@ -20,12 +21,125 @@ namespace flac_bindings {
       }));
 
       auto ok = func();
+      // frames still in the batch must reach JS before the operation ends
+      if (!ctx->writeBatch.isEmpty()) {
+        auto aborted = flushWriteBatch(ctx) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+        if (aborted && std::holds_alternative<int>(ok)) {
+          ok = 0;
+        }
+      }
+
       if (!c.isCompleted()) {
         c.resolve(ok);
       }
     };
   }
 
+  AsyncDecoderWork::FunctionCallback
+    AsyncDecoderWork::resumableProcessUntilEndOfStream(DecoderWorkContext* ctx) {
+    // same as FLAC__stream_decoder_process_until_end_of_stream, but one frame at a time: the
+    // thread is given back to the pool while waiting for the feed or for JS to handle a batch
+    return [ctx](AsyncDecoderWork::ExecutionProgress& c) {
+      ctx->asyncExecutionProgress = &c;
+      ctx->resumable = true;
+
+      auto finish = [ctx, &c](int ok) {
+        ctx->resumable = false;
+        ctx->pendingWriteBatch.reset();
+        ctx->resumableResult.reset();
+        ctx->runLocked([&]() {
+          ctx->workInProgress = false;
+          ctx->asyncExecutionProgress = nullptr;
+        });
+
+        if (!c.isCompleted()) {
+          c.resolve(ok);
+        }
+      };
+
+      if (ctx->pendingWriteBatch) {
+        auto status =
+          std::get<DecoderWorkRequest::WriteBatch>(ctx->pendingWriteBatch->data).returnValue;
+        ctx->pendingWriteBatch.reset();
+        ctx->writeBatch.clear();
+        if (status != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE) {
+          return finish(false);
+        }
+      }
+
+      if (ctx->resumableResult.has_value()) {
+        return finish(ctx->resumableResult.value());
+      }
+
+      int ok = true;
+      while (!c.isCompleted()) {
+        auto state = FLAC__stream_decoder_get_state(ctx->dec);
+        if (state == FLAC__STREAM_DECODER_END_OF_STREAM || state == FLAC__STREAM_DECODER_ABORTED) {
+          if (ctx->feed && state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+            ctx->feed->endOfStream = true;
+          }
+
+          break;
+        }
+
+        if (ctx->feed && !waitForFeed(ctx, c)) {
+          return;
+        }
+
+        {
+          stats::ProcessTimer timer(&stats::Stats::decoderProcess);
+          ok = FLAC__stream_decoder_process_single(ctx->dec);
+        }
+
+        if (!ok) {
+          break;
+        }
+
+        if (ctx->writeBatch.isAlmostFull() && sendWriteBatchAndSuspend(ctx, c)) {
+          return;
+        }
+      }
+
+      // frames still in the batch must reach JS before the operation ends
+      if (!ctx->writeBatch.isEmpty() && !c.isCompleted()) {
+        ctx->resumableResult = ok;
+        if (sendWriteBatchAndSuspend(ctx, c)) {
+          return;
+        }
+      }
+
+      finish(ok);
+    };
+  }
+
+  bool AsyncDecoderWork::waitForFeed(
+    DecoderWorkContext* ctx,
+    AsyncDecoderWork::ExecutionProgress& c) {
+    auto& feed = *ctx->feed;
+    if (feed.hasData()) {
+      return true;
+    }
+
+    c.suspend();
+    feed.waitingTask = c.getTask();
+    // JS may have fed the data before it could see the waiting task
+    if (feed.hasData() && feed.waitingTask.exchange(nullptr) != nullptr) {
+      c.cancelSuspend();
+      return true;
+    }
+
+    return false;
+  }
+
+  bool AsyncDecoderWork::sendWriteBatchAndSuspend(
+    DecoderWorkContext* ctx,
+    AsyncDecoderWork::ExecutionProgress& c) {
+    ctx->pendingWriteBatch =
+      std::make_shared<DecoderWorkRequest>(DecoderWorkRequest::WriteBatch());
+    c.sendProgressAndSuspend(ctx->pendingWriteBatch);
+    return !c.isCompleted();
+  }
+
   static Napi::Value
     variantIntToJsBoolean(const Napi::Env& env, AsyncDecoderWork::ValueType variant) {
     return booleanToJs(env, std::get<int>(variant));
@@ -36,10 +150,18 @@ namespace flac_bindings {
     std::function<ValueType()> function,
     const char* name,
     DecoderWorkContext* ctx,
+    std::function<Napi::Value(const Napi::Env&, ValueType)> convertFunction):
+      AsyncDecoderWork(list, decorate(ctx, function), name, ctx, convertFunction) {}
+
+  AsyncDecoderWork::AsyncDecoderWork(
+    const StoreList& list,
+    FunctionCallback function,
+    const char* name,
+    DecoderWorkContext* ctx,
     std::function<Napi::Value(const Napi::Env&, ValueType)> convertFunction):
       AsyncDecoderWorkBase(
         list.begin()->Env(),
-        decorate(ctx, function),
+        function,
         std::bind(&AsyncDecoderWork::onProgress, this, ctx, _1, _2, _3),
         name,
         convertFunction) {
@@ -49,18 +171,53 @@ namespace flac_bindings {
     }
   }
 
+  void AsyncDecoderWork::OnOK() {
+    if (endingFeed != nullptr && endingFeed->endOfStream) {
+      endingFeed->discardPending();
+    } else if (endingFeed != nullptr) {
+      endingFeed->rejectPending("The decoder stopped reading from the feed");
+    }
+
+    AsyncDecoderWorkBase::OnOK();
+  }
+
+  void AsyncDecoderWork::OnError(const Error& error) {
+    if (endingFeed != nullptr) {
+      endingFeed->rejectPending("The decoder stopped reading from the feed");
+    }
+
+    AsyncDecoderWorkBase::OnError(error);
+  }
+
   AsyncDecoderWork* AsyncDecoderWork::forFinish(const StoreList& list, StreamDecoder& decoder) {
     auto workFunction = [&decoder]() -> int {
-      return FLAC__stream_decoder_finish(decoder.ctx->dec);
+      auto ret = FLAC__stream_decoder_finish(decoder.ctx->dec);
+      if (decoder.ctx->frameIndex) {
+        decoder.ctx->frameIndex->save();
+      }
+      decoder.ctx->mappedInput.reset();
+      if (decoder.ctx->sharedOutput) {
+        decoder.ctx->sharedOutput->setFlag(DecoderSharedOutput::Ended);
+      }
+      if (decoder.ctx->wavOutput) {
+        decoder.ctx->wavOutput->finish();
+      }
+      return ret;
     };
 
-    auto convertFunction = [&decoder](auto env, auto value) {
+    auto convertFunction = [&decoder](auto env, auto value) -> Napi::Value {
       if (std::get<int>(value)) {
-        EscapableHandleScope scope(env);
         auto builder = StreamDecoderBuilder::Unwrap(decoder.builder.Value());
         builder->dec = decoder.dec;
         decoder.dec = nullptr;
-        return scope.Escape(decoder.builder.Value());
+      }
+
+      if (decoder.ctx->wavOutput && !decoder.ctx->wavOutput->error.empty()) {
+        throw Error::New(env, decoder.ctx->wavOutput->error);
+      }
+
+      if (std::get<int>(value)) {
+        return decoder.builder.Value();
       }
 
       return env.Null();
@@ -89,6 +246,7 @@ namespace flac_bindings {
   AsyncDecoderWork*
     AsyncDecoderWork::forProcessSingle(const StoreList& list, DecoderWorkContext* ctx) {
     auto workFunction = [ctx]() {
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
       return FLAC__stream_decoder_process_single(ctx->dec);
     };
     return new AsyncDecoderWork(
@@ -102,6 +260,7 @@ namespace flac_bindings {
   AsyncDecoderWork*
     AsyncDecoderWork::forProcessUntilEndOfMetadata(const StoreList& list, DecoderWorkContext* ctx) {
     auto workFunction = [ctx]() {
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
       return FLAC__stream_decoder_process_until_end_of_metadata(ctx->dec);
     };
     return new AsyncDecoderWork(
@@ -114,7 +273,19 @@ namespace flac_bindings {
 
   AsyncDecoderWork*
     AsyncDecoderWork::forProcessUntilEndOfStream(const StoreList& list, DecoderWorkContext* ctx) {
+    if (ctx->feed || ctx->writeBatch.isEnabled()) {
+      auto work = new AsyncDecoderWork(
+        list,
+        resumableProcessUntilEndOfStream(ctx),
+        "flac_bindings::StreamDecoder::processUntilEndOfStreamAsync",
+        ctx,
+        variantIntToJsBoolean);
+      work->endingFeed = ctx->feed.get();
+      return work;
+    }
+
     auto workFunction = [ctx]() {
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
       return FLAC__stream_decoder_process_until_end_of_stream(ctx->dec);
     };
     return new AsyncDecoderWork(
@@ -143,7 +314,9 @@ namespace flac_bindings {
     uint64_t value,
     DecoderWorkContext* ctx) {
     auto workFunction = [ctx, value]() {
-      return FLAC__stream_decoder_seek_absolute(ctx->dec, value);
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
+      auto ret = StreamDecoder::seekWithFrameIndex(ctx, value);
+      return ret.has_value() ? *ret : FLAC__stream_decoder_seek_absolute(ctx->dec, value);
     };
     return new AsyncDecoderWork(
       list,
@@ -158,14 +331,23 @@ namespace flac_bindings {
     std::shared_ptr<DecoderWorkContext> ctx,
     StreamDecoderBuilder& builder) {
     auto workFunction = [ctx]() {
+      FLAC__StreamDecoderReadCallback readCallback =
+        ctx->readCbk.IsEmpty() ? nullptr : AsyncDecoderWork::readCallback;
+      FLAC__StreamDecoderEofCallback eofCallback =
+        ctx->eofCbk.IsEmpty() ? nullptr : AsyncDecoderWork::eofCallback;
+      if (ctx->feed) {
+        readCallback = AsyncDecoderWork::feedReadCallback;
+        eofCallback = AsyncDecoderWork::feedEofCallback;
+      }
+
       return FLAC__stream_decoder_init_stream(
         ctx->dec,
-        ctx->readCbk.IsEmpty() ? nullptr : AsyncDecoderWork::readCallback,
+        readCallback,
         ctx->seekCbk.IsEmpty() ? nullptr : AsyncDecoderWork::seekCallback,
         ctx->tellCbk.IsEmpty() ? nullptr : AsyncDecoderWork::tellCallback,
         ctx->lengthCbk.IsEmpty() ? nullptr : AsyncDecoderWork::lengthCallback,
-        ctx->eofCbk.IsEmpty() ? nullptr : AsyncDecoderWork::eofCallback,
-        ctx->writeCbk.IsEmpty() ? nullptr : AsyncDecoderWork::writeCallback,
+        eofCallback,
+        ctx->hasWriteCallback() ? AsyncDecoderWork::writeCallback : nullptr,
         ctx->metadataCbk.IsEmpty() ? nullptr : AsyncDecoderWork::metadataCallback,
         ctx->errorCbk.IsEmpty() ? nullptr : AsyncDecoderWork::errorCallback,
         ctx.get());
@@ -187,14 +369,23 @@ namespace flac_bindings {
     std::shared_ptr<DecoderWorkContext> ctx,
     StreamDecoderBuilder& builder) {
     auto workFunction = [ctx]() {
+      FLAC__StreamDecoderReadCallback readCallback =
+        ctx->readCbk.IsEmpty() ? nullptr : AsyncDecoderWork::readCallback;
+      FLAC__StreamDecoderEofCallback eofCallback =
+        ctx->eofCbk.IsEmpty() ? nullptr : AsyncDecoderWork::eofCallback;
+      if (ctx->feed) {
+        readCallback = AsyncDecoderWork::feedReadCallback;
+        eofCallback = AsyncDecoderWork::feedEofCallback;
+      }
+
       return FLAC__stream_decoder_init_ogg_stream(
         ctx->dec,
-        ctx->readCbk.IsEmpty() ? nullptr : AsyncDecoderWork::readCallback,
+        readCallback,
         ctx->seekCbk.IsEmpty() ? nullptr : AsyncDecoderWork::seekCallback,
         ctx->tellCbk.IsEmpty() ? nullptr : AsyncDecoderWork::tellCallback,
         ctx->lengthCbk.IsEmpty() ? nullptr : AsyncDecoderWork::lengthCallback,
-        ctx->eofCbk.IsEmpty() ? nullptr : AsyncDecoderWork::eofCallback,
-        ctx->writeCbk.IsEmpty() ? nullptr : AsyncDecoderWork::writeCallback,
+        eofCallback,
+        ctx->hasWriteCallback() ? AsyncDecoderWork::writeCallback : nullptr,
         ctx->metadataCbk.IsEmpty() ? nullptr : AsyncDecoderWork::metadataCallback,
         ctx->errorCbk.IsEmpty() ? nullptr : AsyncDecoderWork::errorCallback,
         ctx.get());
@@ -214,13 +405,24 @@ namespace flac_bindings {
   AsyncDecoderWork* AsyncDecoderWork::forInitFile(
     const StoreList& list,
     const std::string& filePath,
+    bool mmap,
     std::shared_ptr<DecoderWorkContext> ctx,
     StreamDecoderBuilder& builder) {
-    auto workFunction = [ctx, filePath]() {
+    auto workFunction = [ctx, filePath, mmap]() {
+      if (mmap) {
+        return StreamDecoder::initWithMappedFile(
+          ctx.get(),
+          filePath,
+          false,
+          ctx->hasWriteCallback() ? AsyncDecoderWork::writeCallback : nullptr,
+          ctx->metadataCbk.IsEmpty() ? nullptr : AsyncDecoderWork::metadataCallback,
+          ctx->errorCbk.IsEmpty() ? nullptr : AsyncDecoderWork::errorCallback);
+      }
+
       return FLAC__stream_decoder_init_file(
         ctx->dec,
         filePath.c_str(),
-        ctx->writeCbk.IsEmpty() ? nullptr : AsyncDecoderWork::writeCallback,
+        ctx->hasWriteCallback() ? AsyncDecoderWork::writeCallback : nullptr,
         ctx->metadataCbk.IsEmpty() ? nullptr : AsyncDecoderWork::metadataCallback,
         ctx->errorCbk.IsEmpty() ? nullptr : AsyncDecoderWork::errorCallback,
         ctx.get());
@@ -240,13 +442,24 @@ namespace flac_bindings {
   AsyncDecoderWork* AsyncDecoderWork::forInitOggFile(
     const StoreList& list,
     const std::string& filePath,
+    bool mmap,
     std::shared_ptr<DecoderWorkContext> ctx,
     StreamDecoderBuilder& builder) {
-    auto workFunction = [ctx, filePath]() {
+    auto workFunction = [ctx, filePath, mmap]() {
+      if (mmap) {
+        return StreamDecoder::initWithMappedFile(
+          ctx.get(),
+          filePath,
+          true,
+          ctx->hasWriteCallback() ? AsyncDecoderWork::writeCallback : nullptr,
+          ctx->metadataCbk.IsEmpty() ? nullptr : AsyncDecoderWork::metadataCallback,
+          ctx->errorCbk.IsEmpty() ? nullptr : AsyncDecoderWork::errorCallback);
+      }
+
       return FLAC__stream_decoder_init_ogg_file(
         ctx->dec,
         filePath.c_str(),
-        ctx->writeCbk.IsEmpty() ? nullptr : AsyncDecoderWork::writeCallback,
+        ctx->hasWriteCallback() ? AsyncDecoderWork::writeCallback : nullptr,
         ctx->metadataCbk.IsEmpty() ? nullptr : AsyncDecoderWork::metadataCallback,
         ctx->errorCbk.IsEmpty() ? nullptr : AsyncDecoderWork::errorCallback,
         ctx.get());
@@ -351,9 +564,30 @@ namespace flac_bindings {
         buffers[ch] = writeSharedBufferRefs[ch].value();
       }
 
-      auto jsFrame = frameToJs(env, writeRequest.frame);
+      DEFER(ctx->frameDescriptors.release());
+      auto jsFrame = ctx->frameDescriptors.toJs(env, writeRequest.frame);
       result = ctx->writeCbk.MakeCallback(env.Global(), {jsFrame, buffers});
       processResult = generateParseNumberResult(writeRequest.returnValue, "Decoder:WriteCallback");
+    } else if (std::holds_alternative<DecoderWorkRequest::WriteBatch>(req->data)) {
+      auto& writeBatchRequest = std::get<DecoderWorkRequest::WriteBatch>(req->data);
+      const auto& batch = ctx->writeBatch;
+      auto frames = ctx->frameDescriptors.toJs(env, batch.headers, batch.footers);
+
+      Array buffers = Array::New(env);
+      for (uint32_t ch = 0; ch < batch.channels; ch += 1) {
+        writeSharedBufferRefs[ch].setFromWrap(
+          env,
+          const_cast<int32_t*>(batch.buffers[ch].data()),
+          batch.samples);
+        buffers[ch] = writeSharedBufferRefs[ch].value();
+      }
+
+      result = ctx->writeCbk.MakeCallback(env.Global(), {frames, buffers});
+      processResult =
+        generateParseNumberResult(writeBatchRequest.returnValue, "Decoder:WriteCallback");
+    } else if (std::holds_alternative<DecoderWorkRequest::FeedSpaceAvailable>(req->data)) {
+      ctx->feed->writePending();
+      ctx->feed->notifyDataAvailable();
     }
 
     if (result.IsPromise()) {
@@ -383,10 +617,40 @@ namespace flac_bindings {
     });
 
     ctx->asyncExecutionProgress->sendProgressAndWait(request);
+    stats::add(stats::global().bytesRead, *bytes);
 
     return std::get<DecoderWorkRequest::Read>(request->data).returnValue;
   }
 
+  FLAC__StreamDecoderReadStatus AsyncDecoderWork::feedReadCallback(
+    const FLAC__StreamDecoder*,
+    FLAC__byte buffer[],
+    size_t* bytes,
+    void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    auto& feed = *ctx->feed;
+
+    {
+      stats::WaitTimer timer;
+      *bytes = feed.ring.readWait(buffer, *bytes);
+    }
+
+    stats::add(stats::global().bytesRead, *bytes);
+    if (feed.spaceWanted.exchange(false)) {
+      auto request =
+        std::make_shared<DecoderWorkRequest>(DecoderWorkRequest::FeedSpaceAvailable());
+      ctx->asyncExecutionProgress->sendProgressAndWait(request);
+    }
+
+    return *bytes > 0 ? FLAC__STREAM_DECODER_READ_STATUS_CONTINUE
+                      : FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+  }
+
+  FLAC__bool AsyncDecoderWork::feedEofCallback(const FLAC__StreamDecoder*, void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    return ctx->feed->ring.isDrained();
+  }
+
   FLAC__StreamDecoderSeekStatus
     AsyncDecoderWork::seekCallback(const FLAC__StreamDecoder*, uint64_t offset, void* ptr) {
     auto ctx = (DecoderWorkContext*) ptr;
@@ -437,11 +701,41 @@ namespace flac_bindings {
   }
 
   FLAC__StreamDecoderWriteStatus AsyncDecoderWork::writeCallback(
-    const FLAC__StreamDecoder*,
+    const FLAC__StreamDecoder* dec,
     const FLAC__Frame* frame,
     const int32_t* const buffer[],
     void* ptr) {
     auto ctx = (DecoderWorkContext*) ptr;
+    if (ctx->frameIndex) {
+      frame = ctx->frameIndex->onFrame(dec, frame, buffer);
+      if (frame == nullptr) {
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+      }
+    }
+
+    stats::add(stats::global().decodedSamples, frame->header.blocksize);
+    if (ctx->sharedOutput) {
+      return ctx->sharedOutput->write(frame, buffer);
+    }
+
+    if (ctx->wavOutput) {
+      return ctx->wavOutput->write(dec, frame, buffer);
+    }
+
+    if (ctx->writeBatch.isEnabled()) {
+      auto& batch = ctx->writeBatch;
+      if (!batch.fits(frame)) {
+        auto status = flushWriteBatch(ctx);
+        if (status != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE) {
+          return status;
+        }
+      }
+
+      batch.push(frame, buffer);
+      // resumable operations send the batch themselves after the frame, without waiting
+      return batch.isFull() && !ctx->resumable ? flushWriteBatch(ctx)
+                                               : FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
 
     auto request = std::make_shared<DecoderWorkRequest>(DecoderWorkRequest::Write {
       frame,
@@ -453,6 +747,15 @@ namespace flac_bindings {
     return std::get<DecoderWorkRequest::Write>(request->data).returnValue;
   }
 
+  FLAC__StreamDecoderWriteStatus AsyncDecoderWork::flushWriteBatch(DecoderWorkContext* ctx) {
+    auto request = std::make_shared<DecoderWorkRequest>(DecoderWorkRequest::WriteBatch());
+
+    ctx->asyncExecutionProgress->sendProgressAndWait(request);
+    ctx->writeBatch.clear();
+
+    return std::get<DecoderWorkRequest::WriteBatch>(request->data).returnValue;
+  }
+
   void AsyncDecoderWork::metadataCallback(
     const FLAC__StreamDecoder*,
     const FLAC__StreamMetadata* metadata,
@@ -472,6 +775,11 @@ namespace flac_bindings {
     void* ptr) {
     auto ctx = (DecoderWorkContext*) ptr;
 
+    // keep the order in which things happened
+    if (!ctx->writeBatch.isEmpty()) {
+      flushWriteBatch(ctx);
+    }
+
     auto request = std::make_shared<DecoderWorkRequest>(DecoderWorkRequest::Error {
       error,
     });
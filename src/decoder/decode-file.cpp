@@ -0,0 +1,620 @@
+#include "../utils/async.hpp"
+#include "../utils/converters.hpp"
+#include "../utils/md5.hpp"
+#include "../utils/sample_kernels.hpp"
+#include "../utils/stats.hpp"
+#include <FLAC/stream_decoder.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace flac_bindings {
+
+  using namespace Napi;
+
+  /**
+   * State of a whole-file decode. Everything in here is only touched from the worker thread until
+   * the promise is resolved, so the FLAC callbacks never need to go back to JS.
+   */
+  struct DecodeFileContext {
+    std::string path;
+    bool ogg = false;
+    bool interleaved = true;
+    uint64_t outBps = 0;
+    unsigned threads = 1;
+    bool verifyMd5 = false;
+
+    uint32_t channels = 0;
+    uint32_t bitsPerSample = 0;
+    uint32_t sampleRate = 0;
+    uint64_t totalSamples = 0;
+    uint8_t md5sum[16] = {};
+    std::vector<uint64_t> seekPoints;
+    uint64_t samples = 0;
+    uint64_t capacity = 0;
+    std::vector<char*> buffers;
+    std::string error;
+
+    ~DecodeFileContext() {
+      for (auto buffer: buffers) {
+        free(buffer);
+      }
+    }
+
+    inline uint64_t frameBytes() const {
+      return interleaved ? channels * outBps : outBps;
+    }
+
+    bool reserve(uint64_t newCapacity) {
+      if (newCapacity <= capacity) {
+        return true;
+      }
+
+      buffers.resize(interleaved ? 1 : channels, nullptr);
+      for (auto& buffer: buffers) {
+        auto newBuffer = (char*) realloc(buffer, newCapacity * frameBytes());
+        if (newBuffer == nullptr) {
+          error = "Could not allocate memory";
+          return false;
+        }
+
+        buffer = newBuffer;
+      }
+
+      capacity = newCapacity;
+      return true;
+    }
+
+    bool configure(uint32_t frameChannels, uint32_t frameBitsPerSample) {
+      if (channels == 0) {
+        channels = frameChannels;
+        bitsPerSample = frameBitsPerSample;
+        if (outBps == 0) {
+          outBps = (bitsPerSample + 7) / 8;
+        }
+      } else if (channels != frameChannels || bitsPerSample != frameBitsPerSample) {
+        error = "Stream changes its format in the middle of the file, which is not supported";
+        return false;
+      }
+
+      return true;
+    }
+  };
+
+  static FLAC__StreamDecoderWriteStatus decodeFileWriteCallback(
+    const FLAC__StreamDecoder*,
+    const FLAC__Frame* frame,
+    const int32_t* const samples[],
+    void* ptr) {
+    auto ctx = (DecodeFileContext*) ptr;
+    const auto blocksize = frame->header.blocksize;
+    if (!ctx->configure(frame->header.channels, frame->header.bits_per_sample)) {
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    // STREAMINFO may not have the total samples (or may lie), so grow if needed
+    if (ctx->samples + blocksize > ctx->capacity) {
+      auto newCapacity = std::max(ctx->capacity * 2, ctx->samples + blocksize);
+      if (!ctx->reserve(newCapacity)) {
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+      }
+    }
+
+    const auto outBps = ctx->outBps;
+    if (ctx->interleaved) {
+      char* out = ctx->buffers[0] + ctx->samples * ctx->channels * outBps;
+      auto in = (const char* const*) samples;
+      interleaveSamples(in, 4, out, outBps, ctx->channels, blocksize);
+    } else {
+      for (uint32_t channel = 0; channel < ctx->channels; channel += 1) {
+        char* out = ctx->buffers[channel] + ctx->samples * outBps;
+        convertSamples((const char*) samples[channel], 4, out, outBps, blocksize);
+      }
+    }
+
+    ctx->samples += blocksize;
+    stats::add(stats::global().decodedSamples, blocksize);
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  }
+
+  static void decodeFileMetadataCallback(
+    const FLAC__StreamDecoder*,
+    const FLAC__StreamMetadata* metadata,
+    void* ptr) {
+    auto ctx = (DecodeFileContext*) ptr;
+    if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE) {
+      const auto& table = metadata->data.seek_table;
+      for (uint32_t i = 0; i < table.num_points; i += 1) {
+        if (table.points[i].sample_number != FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER) {
+          ctx->seekPoints.push_back(table.points[i].sample_number);
+        }
+      }
+      return;
+    }
+
+    if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) {
+      return;
+    }
+
+    const auto& info = metadata->data.stream_info;
+    ctx->sampleRate = info.sample_rate;
+    ctx->totalSamples = info.total_samples;
+    memcpy(ctx->md5sum, info.md5sum, sizeof(ctx->md5sum));
+    if (ctx->configure(info.channels, info.bits_per_sample) && info.total_samples > 0) {
+      ctx->reserve(info.total_samples);
+    }
+  }
+
+  static void decodeFileErrorCallback(
+    const FLAC__StreamDecoder*,
+    FLAC__StreamDecoderErrorStatus status,
+    void* ptr) {
+    auto ctx = (DecodeFileContext*) ptr;
+    if (ctx->error.empty()) {
+      ctx->error = "Decoder error: "s + FLAC__StreamDecoderErrorStatusString[status];
+    }
+  }
+
+  static void decodeFileImpl(const std::shared_ptr<DecodeFileContext>& ctx) {
+    auto dec = FLAC__stream_decoder_new();
+    if (dec == nullptr) {
+      ctx->error = "Could not allocate memory";
+      return;
+    }
+
+    auto initFunction =
+      ctx->ogg ? FLAC__stream_decoder_init_ogg_file : FLAC__stream_decoder_init_file;
+    auto initStatus = initFunction(
+      dec,
+      ctx->path.c_str(),
+      decodeFileWriteCallback,
+      decodeFileMetadataCallback,
+      decodeFileErrorCallback,
+      ctx.get());
+    if (initStatus != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      ctx->error =
+        "Decoder initialization failed: "s + FLAC__StreamDecoderInitStatusString[initStatus];
+    } else {
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
+      if (!FLAC__stream_decoder_process_until_end_of_stream(dec) && ctx->error.empty()) {
+        auto state = FLAC__stream_decoder_get_state(dec);
+        ctx->error = "Decoding failed: "s + FLAC__StreamDecoderStateString[state];
+      }
+    }
+
+    FLAC__stream_decoder_finish(dec);
+    FLAC__stream_decoder_delete(dec);
+  }
+
+  /**
+   * Compares the MD5 of the decoded audio with the one in STREAMINFO, if it has one.
+   */
+  static void verifyDecodedMd5(DecodeFileContext& ctx) {
+    static const uint8_t emptyMd5[16] = {};
+    if (memcmp(ctx.md5sum, emptyMd5, sizeof(emptyMd5)) == 0) {
+      return;
+    }
+
+    // the signature is computed with the samples packed in the minimum amount of bytes
+    const uint64_t bps = (ctx.bitsPerSample + 7) / 8;
+    if (ctx.outBps < bps) {
+      ctx.error = "Cannot verify the MD5 of the audio if outBps is smaller than "s
+                  + std::to_string(bps);
+      return;
+    }
+
+    Md5 md5;
+    constexpr uint64_t chunk = 4096;
+    std::vector<char> tmp(chunk * ctx.channels * bps);
+    for (uint64_t offset = 0; offset < ctx.samples; offset += chunk) {
+      const auto count = std::min(chunk, ctx.samples - offset);
+      if (ctx.interleaved) {
+        const auto in = ctx.buffers[0] + offset * ctx.channels * ctx.outBps;
+        convertSamples(in, ctx.outBps, tmp.data(), bps, count * ctx.channels);
+      } else {
+        const char* in[FLAC__MAX_CHANNELS];
+        for (uint32_t channel = 0; channel < ctx.channels; channel += 1) {
+          in[channel] = ctx.buffers[channel] + offset * ctx.outBps;
+        }
+
+        interleaveSamples(in, ctx.outBps, tmp.data(), bps, ctx.channels, count);
+      }
+
+      md5.update(tmp.data(), count * ctx.channels * bps);
+    }
+
+    uint8_t digest[16];
+    md5.finish(digest);
+    if (memcmp(digest, ctx.md5sum, sizeof(digest)) != 0) {
+      ctx.error = "MD5 signature of the decoded audio does not match the one in STREAMINFO";
+    }
+  }
+
+  /**
+   * Part of the stream decoded by one thread. All ranges write into the same output buffers, but
+   * each one into its own region, so they do not need any synchronization.
+   */
+  struct DecodeFileRange {
+    DecodeFileContext* ctx;
+    uint64_t start;
+    uint64_t end;
+    uint64_t position;
+    std::string error;
+    // samples of the last range after the output capacity, which cannot be grown while the other
+    // ranges are writing into it
+    std::vector<std::vector<char>> overflow = {};
+  };
+
+  static void writeRangeSamples(
+    const DecodeFileContext& ctx,
+    const int32_t* const samples[],
+    uint64_t skip,
+    uint64_t count,
+    char* const out[]) {
+    if (ctx.interleaved) {
+      const char* in[FLAC__MAX_CHANNELS];
+      for (uint32_t channel = 0; channel < ctx.channels; channel += 1) {
+        in[channel] = (const char*) (samples[channel] + skip);
+      }
+
+      interleaveSamples(in, 4, out[0], ctx.outBps, ctx.channels, count);
+    } else {
+      for (uint32_t channel = 0; channel < ctx.channels; channel += 1) {
+        convertSamples((const char*) (samples[channel] + skip), 4, out[channel], ctx.outBps, count);
+      }
+    }
+  }
+
+  static FLAC__StreamDecoderWriteStatus decodeFileRangeWriteCallback(
+    const FLAC__StreamDecoder*,
+    const FLAC__Frame* frame,
+    const int32_t* const samples[],
+    void* ptr) {
+    auto range = (DecodeFileRange*) ptr;
+    auto ctx = range->ctx;
+    const auto& header = frame->header;
+    if (header.channels != ctx->channels || header.bits_per_sample != ctx->bitsPerSample) {
+      range->error = "Stream changes its format in the middle of the file, which is not supported";
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    const uint64_t sample = header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER
+                              ? header.number.sample_number
+                              : uint64_t(header.number.frame_number) * header.blocksize;
+    // after a seek, the first frame may start before the range, and the last may go after it
+    const auto from = std::max(sample, range->position);
+    const auto to = std::min(sample + header.blocksize, range->end);
+    if (from >= to) {
+      range->position = std::max(range->position, to);
+      return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    const auto frameBytes = ctx->frameBytes();
+    const auto inPlaceEnd = std::min(to, ctx->capacity);
+    char* out[FLAC__MAX_CHANNELS];
+    if (from < inPlaceEnd) {
+      for (size_t i = 0; i < ctx->buffers.size(); i += 1) {
+        out[i] = ctx->buffers[i] + from * frameBytes;
+      }
+
+      writeRangeSamples(*ctx, samples, from - sample, inPlaceEnd - from, out);
+    }
+
+    // only the last range can go past the capacity, because it ends where the stream ends
+    if (to > ctx->capacity) {
+      const auto overflowFrom = std::max(from, ctx->capacity);
+      range->overflow.resize(ctx->buffers.size());
+      for (size_t i = 0; i < ctx->buffers.size(); i += 1) {
+        range->overflow[i].resize((to - ctx->capacity) * frameBytes);
+        out[i] = range->overflow[i].data() + (overflowFrom - ctx->capacity) * frameBytes;
+      }
+
+      writeRangeSamples(*ctx, samples, overflowFrom - sample, to - overflowFrom, out);
+    }
+
+    range->position = to;
+    stats::add(stats::global().decodedSamples, to - from);
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  }
+
+  static void decodeFileRangeErrorCallback(
+    const FLAC__StreamDecoder*,
+    FLAC__StreamDecoderErrorStatus status,
+    void* ptr) {
+    auto range = (DecodeFileRange*) ptr;
+    if (range->error.empty()) {
+      range->error = "Decoder error: "s + FLAC__StreamDecoderErrorStatusString[status];
+    }
+  }
+
+  static void decodeFileRange(DecodeFileRange& range) {
+    auto dec = FLAC__stream_decoder_new();
+    if (dec == nullptr) {
+      range.error = "Could not allocate memory";
+      return;
+    }
+
+    // the MD5 can only be checked for the whole stream
+    FLAC__stream_decoder_set_md5_checking(dec, false);
+    auto initStatus = FLAC__stream_decoder_init_file(
+      dec,
+      range.ctx->path.c_str(),
+      decodeFileRangeWriteCallback,
+      nullptr,
+      decodeFileRangeErrorCallback,
+      &range);
+    if (initStatus != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      range.error =
+        "Decoder initialization failed: "s + FLAC__StreamDecoderInitStatusString[initStatus];
+    } else if (range.start > 0 && !FLAC__stream_decoder_seek_absolute(dec, range.start)) {
+      if (range.error.empty()) {
+        range.error = "Could not seek to sample "s + std::to_string(range.start);
+      }
+    } else {
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
+      while (range.position < range.end && range.error.empty()) {
+        auto ok = FLAC__stream_decoder_process_single(dec);
+        auto state = FLAC__stream_decoder_get_state(dec);
+        if (!ok) {
+          if (range.error.empty()) {
+            range.error = "Decoding failed: "s + FLAC__StreamDecoderStateString[state];
+          }
+        } else if (state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+          break;
+        }
+      }
+    }
+
+    FLAC__stream_decoder_finish(dec);
+    FLAC__stream_decoder_delete(dec);
+  }
+
+  /**
+   * Reads the STREAMINFO and SEEKTABLE, without decoding any frame.
+   */
+  static bool decodeFileReadMetadata(const std::shared_ptr<DecodeFileContext>& ctx) {
+    auto dec = FLAC__stream_decoder_new();
+    if (dec == nullptr) {
+      ctx->error = "Could not allocate memory";
+      return false;
+    }
+
+    FLAC__stream_decoder_set_metadata_respond(dec, FLAC__METADATA_TYPE_SEEKTABLE);
+    auto initStatus = FLAC__stream_decoder_init_file(
+      dec,
+      ctx->path.c_str(),
+      decodeFileWriteCallback,
+      decodeFileMetadataCallback,
+      decodeFileErrorCallback,
+      ctx.get());
+    if (initStatus != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      ctx->error =
+        "Decoder initialization failed: "s + FLAC__StreamDecoderInitStatusString[initStatus];
+    } else if (!FLAC__stream_decoder_process_until_end_of_metadata(dec) && ctx->error.empty()) {
+      auto state = FLAC__stream_decoder_get_state(dec);
+      ctx->error = "Decoding failed: "s + FLAC__StreamDecoderStateString[state];
+    }
+
+    FLAC__stream_decoder_finish(dec);
+    FLAC__stream_decoder_delete(dec);
+    return ctx->error.empty();
+  }
+
+  /**
+   * Splits the stream into one range per thread. If there is a SEEKTABLE, the boundaries are
+   * moved to the closest seek point so each thread can find its first frame without searching.
+   * Otherwise libFLAC looks for it by doing a binary search of the frame sync codes.
+   */
+  static std::vector<uint64_t> decodeFileBoundaries(const DecodeFileContext& ctx) {
+    std::vector<uint64_t> boundaries {0};
+    for (unsigned i = 1; i < ctx.threads; i += 1) {
+      const uint64_t target = ctx.totalSamples * i / ctx.threads;
+      auto boundary = target;
+      uint64_t bestDistance = UINT64_MAX;
+      for (auto point: ctx.seekPoints) {
+        auto distance = point > target ? point - target : target - point;
+        if (point > 0 && point < ctx.totalSamples && distance < bestDistance) {
+          boundary = point;
+          bestDistance = distance;
+        }
+      }
+
+      if (boundary > boundaries.back()) {
+        boundaries.push_back(boundary);
+      }
+    }
+
+    // STREAMINFO may tell less samples than there are, so the last range ends with the stream
+    boundaries.push_back(UINT64_MAX);
+    return boundaries;
+  }
+
+  static void parallelDecodeFileImpl(const std::shared_ptr<DecodeFileContext>& ctx) {
+    if (!decodeFileReadMetadata(ctx)) {
+      return;
+    }
+
+    // without the total samples (or with only one thread) the stream cannot be split
+    if (ctx->totalSamples == 0 || ctx->threads <= 1) {
+      decodeFileImpl(ctx);
+    } else if (ctx->reserve(ctx->totalSamples)) {
+      auto boundaries = decodeFileBoundaries(*ctx);
+      std::vector<DecodeFileRange> ranges;
+      for (size_t i = 1; i < boundaries.size(); i += 1) {
+        ranges.push_back({ctx.get(), boundaries[i - 1], boundaries[i], boundaries[i - 1], ""});
+      }
+
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < ranges.size(); i += 1) {
+        threads.emplace_back(decodeFileRange, std::ref(ranges[i]));
+      }
+
+      decodeFileRange(ranges[0]);
+      for (auto& thread: threads) {
+        thread.join();
+      }
+
+      for (auto& range: ranges) {
+        bool isLast = &range == &ranges.back();
+        if (range.error.empty() && range.position < range.end && !isLast) {
+          range.error = "Stream ended before sample "s + std::to_string(range.end);
+        }
+
+        if (!range.error.empty()) {
+          ctx->error = range.error;
+          return;
+        }
+      }
+
+      // STREAMINFO may lie about the total samples, in both directions
+      const auto& last = ranges.back();
+      const auto base = ctx->capacity;
+      if (!ctx->reserve(last.position)) {
+        return;
+      }
+
+      ctx->samples = last.position;
+      if (!last.overflow.empty()) {
+        for (size_t i = 0; i < ctx->buffers.size(); i += 1) {
+          memcpy(
+            ctx->buffers[i] + base * ctx->frameBytes(),
+            last.overflow[i].data(),
+            last.overflow[i].size());
+        }
+      }
+    }
+
+    if (ctx->error.empty() && ctx->verifyMd5) {
+      verifyDecodedMd5(*ctx);
+    }
+  }
+
+  static Buffer<char> takeBuffer(const Napi::Env& env, char*& data, uint64_t size) {
+    if (size == 0) {
+      return Buffer<char>::New(env, 0);
+    }
+
+    // the buffer may be bigger than needed if STREAMINFO did not have the right size
+    auto shrinked = (char*) realloc(data, size);
+    if (shrinked != nullptr) {
+      data = shrinked;
+    }
+
+    auto buffer = Buffer<char>::New(env, data, size, [](auto, auto data) { free(data); });
+    data = nullptr;
+    return buffer;
+  }
+
+  static Object decodeFileResultToJs(const Napi::Env& env, DecodeFileContext& ctx) {
+    auto obj = Object::New(env);
+    ctx.buffers.resize(ctx.interleaved ? 1 : ctx.channels, nullptr);
+    if (ctx.interleaved) {
+      auto size = ctx.samples * ctx.channels * ctx.outBps;
+      obj["buffer"] = takeBuffer(env, ctx.buffers[0], size);
+    } else {
+      auto array = Array::New(env, ctx.channels);
+      for (uint32_t channel = 0; channel < ctx.channels; channel += 1) {
+        array[channel] = takeBuffer(env, ctx.buffers[channel], ctx.samples * ctx.outBps);
+      }
+      obj["buffers"] = array;
+    }
+
+    obj["samples"] = numberToJs(env, ctx.samples);
+    obj["channels"] = numberToJs(env, ctx.channels);
+    obj["bitsPerSample"] = numberToJs(env, ctx.bitsPerSample);
+    obj["sampleRate"] = numberToJs(env, ctx.sampleRate);
+    obj["outBps"] = numberToJs(env, ctx.outBps);
+    return obj;
+  }
+
+  /** Same limit as the threads of the pool in `configure`. */
+  static constexpr unsigned maxParallelDecodeThreads = 1024;
+
+  static std::shared_ptr<DecodeFileContext> decodeFileContextFromJs(const CallbackInfo& info) {
+    auto ctx = std::make_shared<DecodeFileContext>();
+    ctx->path = stringFromJs(info[0]);
+    if (info[1].IsObject()) {
+      auto obj = info[1].As<Object>();
+      ctx->outBps = maybeNumberFromJs<uint64_t>(obj.Get("outBps")).value_or(0);
+      ctx->interleaved = maybeBooleanFromJs<bool>(obj.Get("interleaved")).value_or(true);
+      ctx->ogg = maybeBooleanFromJs<bool>(obj.Get("isOggStream")).value_or(false);
+      ctx->verifyMd5 = maybeBooleanFromJs<bool>(obj.Get("verifyMd5")).value_or(false);
+      ctx->threads = maybeNumberFromJs<unsigned>(obj.Get("threads"))
+                       .value_or(std::max(std::thread::hardware_concurrency(), 1u));
+    } else if (!info[1].IsUndefined() && !info[1].IsNull()) {
+      throw TypeError::New(info.Env(), "Expected second argument to be object or undefined");
+    }
+
+    if (ctx->outBps > 4) {
+      throw RangeError::New(
+        info.Env(),
+        "Unsupported "s + std::to_string(ctx->outBps) + " bytes per sample"s);
+    }
+
+    return ctx;
+  }
+
+  Promise decodeFile(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+
+    auto ctx = decodeFileContextFromJs(info);
+    auto worker = new AsyncBackgroundTask<std::shared_ptr<DecodeFileContext>>(
+      info.Env(),
+      [ctx](auto& c) {
+        decodeFileImpl(ctx);
+        if (ctx->error.empty() && ctx->verifyMd5) {
+          verifyDecodedMd5(*ctx);
+        }
+
+        if (ctx->error.empty()) {
+          c.resolve(ctx);
+        } else {
+          c.reject(ctx->error);
+        }
+      },
+      nullptr,
+      "flac_bindings::decodeFile",
+      [](auto env, auto ctx) { return decodeFileResultToJs(env, *ctx); });
+
+    worker->Queue();
+    return scope.Escape(worker->getPromise()).As<Promise>();
+  }
+
+  Promise parallelDecodeFile(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+
+    auto ctx = decodeFileContextFromJs(info);
+    if (ctx->ogg) {
+      throw Error::New(info.Env(), "Ogg/FLAC files cannot be decoded in parallel");
+    }
+
+    if (ctx->threads == 0 || ctx->threads > maxParallelDecodeThreads) {
+      throw RangeError::New(
+        info.Env(),
+        "Number of threads must be between 1 and "s + std::to_string(maxParallelDecodeThreads));
+    }
+
+    // every range has its own thread and decoder, outside the pool, so more than one per CPU
+    // only adds threads that compete for the same CPUs
+    ctx->threads = std::min(ctx->threads, std::max(std::thread::hardware_concurrency(), 1u));
+
+    auto worker = new AsyncBackgroundTask<std::shared_ptr<DecodeFileContext>>(
+      info.Env(),
+      [ctx](auto& c) {
+        parallelDecodeFileImpl(ctx);
+        if (ctx->error.empty()) {
+          c.resolve(ctx);
+        } else {
+          c.reject(ctx->error);
+        }
+      },
+      nullptr,
+      "flac_bindings::parallelDecodeFile",
+      [](auto env, auto ctx) { return decodeFileResultToJs(env, *ctx); });
+
+    worker->Queue();
+    return scope.Escape(worker->getPromise()).As<Promise>();
+  }
+
+}
@@ -3,6 +3,8 @@
 
 namespace flac_bindings {
 
+  static constexpr size_t defaultFeedBufferSize = 256 * 1024;
+
   Function StreamDecoderBuilder::init(Napi::Env env, FlacAddon& addon) {
     EscapableHandleScope scope(env);
 
@@ -25,6 +27,10 @@ namespace flac_bindings {
         InstanceMethod(
           "setMetadataIgnoreApplication",
           &StreamDecoderBuilder::setMetadataIgnoreApplication),
+        InstanceMethod("setWriteBatch", &StreamDecoderBuilder::setWriteBatch),
+        InstanceMethod("setFrameDescriptor", &StreamDecoderBuilder::setFrameDescriptor),
+        InstanceMethod("setSharedOutput", &StreamDecoderBuilder::setSharedOutput),
+        InstanceMethod("setWavOutput", &StreamDecoderBuilder::setWavOutput),
 
         InstanceMethod("buildWithStream", &StreamDecoderBuilder::buildWithStream),
         InstanceMethod("buildWithOggStream", &StreamDecoderBuilder::buildWithOggStream),
@@ -35,6 +41,8 @@ namespace flac_bindings {
         InstanceMethod("buildWithOggStreamAsync", &StreamDecoderBuilder::buildWithOggStreamAsync),
         InstanceMethod("buildWithFileAsync", &StreamDecoderBuilder::buildWithFileAsync),
         InstanceMethod("buildWithOggFileAsync", &StreamDecoderBuilder::buildWithOggFileAsync),
+        InstanceMethod("buildWithFeedAsync", &StreamDecoderBuilder::buildWithFeedAsync),
+        InstanceMethod("buildWithOggFeedAsync", &StreamDecoderBuilder::buildWithOggFeedAsync),
       });
 
     constructor.Freeze();
@@ -151,13 +159,113 @@ namespace flac_bindings {
     return info.This();
   }
 
+  Napi::Value StreamDecoderBuilder::setWriteBatch(const CallbackInfo& info) {
+    checkIfBuilt(info.Env());
+
+    if (info[0].IsNull() || info[0].IsUndefined()) {
+      writeBatchFrames = 0;
+      writeBatchMaxSamples = 0;
+      return info.This();
+    }
+
+    if (!info[0].IsObject()) {
+      throw TypeError::New(info.Env(), "Expected first argument to be object or null");
+    }
+
+    auto obj = info[0].As<Object>();
+    auto frames = numberFromJs<uint32_t>(obj.Get("frames"));
+    auto maxSamples = maybeNumberFromJs<uint64_t>(obj.Get("maxSamples")).value_or(0);
+    if (frames == 0) {
+      throw RangeError::New(info.Env(), "frames must be greater than 0");
+    }
+
+    writeBatchFrames = frames;
+    writeBatchMaxSamples = maxSamples;
+    return info.This();
+  }
+
+  Napi::Value StreamDecoderBuilder::setFrameDescriptor(const CallbackInfo& info) {
+    checkIfBuilt(info.Env());
+
+    auto mode = stringFromJs(info[0]);
+    if (mode == "full") {
+      frameDescriptorMode = FrameDescriptors::Full;
+    } else if (mode == "shared") {
+      frameDescriptorMode = FrameDescriptors::Shared;
+    } else if (mode == "packed") {
+      frameDescriptorMode = FrameDescriptors::Packed;
+    } else {
+      throw RangeError::New(
+        info.Env(),
+        "Invalid frame descriptor \""s + mode + "\", expected full, shared or packed"s);
+    }
+
+    return info.This();
+  }
+
+  Napi::Value StreamDecoderBuilder::setSharedOutput(const CallbackInfo& info) {
+    checkIfBuilt(info.Env());
+
+    if (info[0].IsNull() || info[0].IsUndefined()) {
+      sharedOutput.reset();
+      return info.This();
+    }
+
+    if (!info[0].IsObject()) {
+      throw TypeError::New(info.Env(), "Expected first argument to be object or null");
+    }
+
+    if (!wavOutputPath.empty()) {
+      throw Error::New(info.Env(), "Cannot use a shared output and a WAV output at the same time");
+    }
+
+    auto obj = info[0].As<Object>();
+    auto channels = numberFromJs<uint32_t>(obj.Get("channels"));
+    if (channels == 0 || channels > FLAC__MAX_CHANNELS) {
+      throw RangeError::New(info.Env(), "channels must be between 1 and 8");
+    }
+
+    auto output = std::make_shared<DecoderSharedOutput>();
+    output->fromJs(obj, channels);
+    sharedOutput = output;
+    return info.This();
+  }
+
+  Napi::Value StreamDecoderBuilder::setWavOutput(const CallbackInfo& info) {
+    checkIfBuilt(info.Env());
+
+    if (info[0].IsNull() || info[0].IsUndefined()) {
+      wavOutputPath.clear();
+      return info.This();
+    }
+
+    if (!info[0].IsObject()) {
+      throw TypeError::New(info.Env(), "Expected first argument to be object or null");
+    }
+
+    if (sharedOutput) {
+      throw Error::New(info.Env(), "Cannot use a shared output and a WAV output at the same time");
+    }
+
+    auto obj = info[0].As<Object>();
+    auto path = stringFromJs(obj.Get("path"));
+    auto bitsPerSample = maybeNumberFromJs<uint32_t>(obj.Get("bitsPerSample")).value_or(0);
+    if (bitsPerSample > 32) {
+      throw RangeError::New(info.Env(), "bitsPerSample must be between 1 and 32");
+    }
+
+    wavOutputPath = path;
+    wavOutputBitsPerSample = bitsPerSample;
+    return info.This();
+  }
+
   // -- builder methods --
 
   Napi::Value StreamDecoderBuilder::buildWithStream(const CallbackInfo& info) {
     EscapableHandleScope scope(info.Env());
     checkIfBuilt(info.Env());
 
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Sync);
+    auto ctx = createSyncContext();
     maybeFunctionIntoRef(ctx->readCbk, info[0]);
     maybeFunctionIntoRef(ctx->seekCbk, info[1]);
     maybeFunctionIntoRef(ctx->tellCbk, info[2]);
@@ -174,7 +282,7 @@ namespace flac_bindings {
       !ctx->tellCbk.IsEmpty() ? StreamDecoder::tellCallback : nullptr,
       !ctx->lengthCbk.IsEmpty() ? StreamDecoder::lengthCallback : nullptr,
       !ctx->eofCbk.IsEmpty() ? StreamDecoder::eofCallback : nullptr,
-      !ctx->writeCbk.IsEmpty() ? StreamDecoder::writeCallback : nullptr,
+      ctx->hasWriteCallback() ? StreamDecoder::writeCallback : nullptr,
       !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
       !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr,
       ctx.get());
@@ -187,7 +295,7 @@ namespace flac_bindings {
     EscapableHandleScope scope(info.Env());
     checkIfBuilt(info.Env());
 
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Sync);
+    auto ctx = createSyncContext();
     maybeFunctionIntoRef(ctx->readCbk, info[0]);
     maybeFunctionIntoRef(ctx->seekCbk, info[1]);
     maybeFunctionIntoRef(ctx->tellCbk, info[2]);
@@ -204,7 +312,7 @@ namespace flac_bindings {
       !ctx->tellCbk.IsEmpty() ? StreamDecoder::tellCallback : nullptr,
       !ctx->lengthCbk.IsEmpty() ? StreamDecoder::lengthCallback : nullptr,
       !ctx->eofCbk.IsEmpty() ? StreamDecoder::eofCallback : nullptr,
-      !ctx->writeCbk.IsEmpty() ? StreamDecoder::writeCallback : nullptr,
+      ctx->hasWriteCallback() ? StreamDecoder::writeCallback : nullptr,
       !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
       !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr,
       ctx.get());
@@ -218,18 +326,32 @@ namespace flac_bindings {
     checkIfBuilt(info.Env());
 
     auto path = stringFromJs(info[0]);
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Sync);
+    auto mmap = maybeBooleanOptionFromJs<bool>(info[4], "mmap").value_or(false);
+    auto ctx = createSyncContext();
+    // the frame index reads the frames from the mapped file, so it implies mmap
+    ctx->frameIndex = frameIndexFromJs(info[4]);
     maybeFunctionIntoRef(ctx->writeCbk, info[1]);
     maybeFunctionIntoRef(ctx->metadataCbk, info[2]);
     maybeFunctionIntoRef(ctx->errorCbk, info[3]);
 
-    auto ret = FLAC__stream_decoder_init_file(
-      dec,
-      path.c_str(),
-      !ctx->writeCbk.IsEmpty() ? StreamDecoder::writeCallback : nullptr,
-      !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
-      !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr,
-      ctx.get());
+    FLAC__StreamDecoderInitStatus ret;
+    if (mmap || ctx->frameIndex) {
+      ret = StreamDecoder::initWithMappedFile(
+        ctx.get(),
+        path,
+        false,
+        ctx->hasWriteCallback() ? StreamDecoder::writeCallback : nullptr,
+        !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
+        !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr);
+    } else {
+      ret = FLAC__stream_decoder_init_file(
+        dec,
+        path.c_str(),
+        ctx->hasWriteCallback() ? StreamDecoder::writeCallback : nullptr,
+        !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
+        !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr,
+        ctx.get());
+    }
 
     checkInitStatus(info.Env(), ret);
     return scope.Escape(createDecoder(info.Env(), info.This(), ctx));
@@ -240,18 +362,34 @@ namespace flac_bindings {
     checkIfBuilt(info.Env());
 
     auto path = stringFromJs(info[0]);
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Sync);
+    auto mmap = maybeBooleanOptionFromJs<bool>(info[4], "mmap").value_or(false);
+    if (frameIndexFromJs(info[4])) {
+      throw Error::New(info.Env(), "The frame index is only supported for FLAC files");
+    }
+
+    auto ctx = createSyncContext();
     maybeFunctionIntoRef(ctx->writeCbk, info[1]);
     maybeFunctionIntoRef(ctx->metadataCbk, info[2]);
     maybeFunctionIntoRef(ctx->errorCbk, info[3]);
 
-    auto ret = FLAC__stream_decoder_init_ogg_file(
-      dec,
-      path.c_str(),
-      !ctx->writeCbk.IsEmpty() ? StreamDecoder::writeCallback : nullptr,
-      !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
-      !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr,
-      ctx.get());
+    FLAC__StreamDecoderInitStatus ret;
+    if (mmap) {
+      ret = StreamDecoder::initWithMappedFile(
+        ctx.get(),
+        path,
+        true,
+        ctx->hasWriteCallback() ? StreamDecoder::writeCallback : nullptr,
+        !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
+        !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr);
+    } else {
+      ret = FLAC__stream_decoder_init_ogg_file(
+        dec,
+        path.c_str(),
+        ctx->hasWriteCallback() ? StreamDecoder::writeCallback : nullptr,
+        !ctx->metadataCbk.IsEmpty() ? StreamDecoder::metadataCallback : nullptr,
+        !ctx->errorCbk.IsEmpty() ? StreamDecoder::errorCallback : nullptr,
+        ctx.get());
+    }
 
     checkInitStatus(info.Env(), ret);
     return scope.Escape(createDecoder(info.Env(), info.This(), ctx));
@@ -263,7 +401,7 @@ namespace flac_bindings {
     EscapableHandleScope scope(info.Env());
     checkIfBuilt(info.Env());
 
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Async);
+    auto ctx = createAsyncContext();
     maybeFunctionIntoRef(ctx->readCbk, info[0]);
     maybeFunctionIntoRef(ctx->seekCbk, info[1]);
     maybeFunctionIntoRef(ctx->tellCbk, info[2]);
@@ -285,7 +423,7 @@ namespace flac_bindings {
     EscapableHandleScope scope(info.Env());
     checkIfBuilt(info.Env());
 
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Async);
+    auto ctx = createAsyncContext();
     maybeFunctionIntoRef(ctx->readCbk, info[0]);
     maybeFunctionIntoRef(ctx->seekCbk, info[1]);
     maybeFunctionIntoRef(ctx->tellCbk, info[2]);
@@ -307,12 +445,20 @@ namespace flac_bindings {
     checkIfBuilt(info.Env());
 
     auto path = stringFromJs(info[0]);
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Async);
+    auto mmap = maybeBooleanOptionFromJs<bool>(info[4], "mmap").value_or(false);
+    auto ctx = createAsyncContext();
+    // the frame index reads the frames from the mapped file, so it implies mmap
+    ctx->frameIndex = frameIndexFromJs(info[4]);
     maybeFunctionIntoRef(ctx->writeCbk, info[1]);
     maybeFunctionIntoRef(ctx->metadataCbk, info[2]);
     maybeFunctionIntoRef(ctx->errorCbk, info[3]);
 
-    AsyncDecoderWork* work = AsyncDecoderWork::forInitFile({info.This()}, path, ctx, *this);
+    AsyncDecoderWork* work = AsyncDecoderWork::forInitFile(
+      {info.This()},
+      path,
+      mmap || ctx->frameIndex,
+      ctx,
+      *this);
     workInProgress = true;
     ctx->workInProgress = true;
     work->Queue();
@@ -324,12 +470,62 @@ namespace flac_bindings {
     checkIfBuilt(info.Env());
 
     auto path = stringFromJs(info[0]);
-    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Async);
+    auto mmap = maybeBooleanOptionFromJs<bool>(info[4], "mmap").value_or(false);
+    if (frameIndexFromJs(info[4])) {
+      throw Error::New(info.Env(), "The frame index is only supported for FLAC files");
+    }
+
+    auto ctx = createAsyncContext();
     maybeFunctionIntoRef(ctx->writeCbk, info[1]);
     maybeFunctionIntoRef(ctx->metadataCbk, info[2]);
     maybeFunctionIntoRef(ctx->errorCbk, info[3]);
 
-    AsyncDecoderWork* work = AsyncDecoderWork::forInitOggFile({info.This()}, path, ctx, *this);
+    AsyncDecoderWork* work =
+      AsyncDecoderWork::forInitOggFile({info.This()}, path, mmap, ctx, *this);
+    workInProgress = true;
+    ctx->workInProgress = true;
+    work->Queue();
+    return scope.Escape(work->getPromise());
+  }
+
+  Napi::Value StreamDecoderBuilder::buildWithFeedAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkIfBuilt(info.Env());
+
+    auto bufferSize = maybeNumberFromJs<size_t>(info[3]).value_or(defaultFeedBufferSize);
+    if (bufferSize == 0) {
+      throw RangeError::New(info.Env(), "Feed buffer size must be greater than 0");
+    }
+
+    auto ctx = createAsyncContext();
+    ctx->feed = std::make_shared<DecoderFeed>(bufferSize);
+    maybeFunctionIntoRef(ctx->writeCbk, info[0]);
+    maybeFunctionIntoRef(ctx->metadataCbk, info[1]);
+    maybeFunctionIntoRef(ctx->errorCbk, info[2]);
+
+    AsyncDecoderWork* work = AsyncDecoderWork::forInitStream({info.This()}, ctx, *this);
+    workInProgress = true;
+    ctx->workInProgress = true;
+    work->Queue();
+    return scope.Escape(work->getPromise());
+  }
+
+  Napi::Value StreamDecoderBuilder::buildWithOggFeedAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkIfBuilt(info.Env());
+
+    auto bufferSize = maybeNumberFromJs<size_t>(info[3]).value_or(defaultFeedBufferSize);
+    if (bufferSize == 0) {
+      throw RangeError::New(info.Env(), "Feed buffer size must be greater than 0");
+    }
+
+    auto ctx = createAsyncContext();
+    ctx->feed = std::make_shared<DecoderFeed>(bufferSize);
+    maybeFunctionIntoRef(ctx->writeCbk, info[0]);
+    maybeFunctionIntoRef(ctx->metadataCbk, info[1]);
+    maybeFunctionIntoRef(ctx->errorCbk, info[2]);
+
+    AsyncDecoderWork* work = AsyncDecoderWork::forInitOggStream({info.This()}, ctx, *this);
     workInProgress = true;
     ctx->workInProgress = true;
     work->Queue();
@@ -338,6 +534,75 @@ namespace flac_bindings {
 
   // -- helpers --
 
+  std::shared_ptr<DecoderWorkContext> StreamDecoderBuilder::createSyncContext() {
+    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Sync);
+    ctx->sharedOutput = sharedOutput;
+    ctx->wavOutput = createWavOutput();
+    return ctx;
+  }
+
+  std::shared_ptr<DecoderWorkContext> StreamDecoderBuilder::createAsyncContext() {
+    auto ctx = std::make_shared<DecoderWorkContext>(dec, DecoderWorkContext::ExecutionMode::Async);
+    ctx->sharedOutput = sharedOutput;
+    ctx->wavOutput = createWavOutput();
+    // batching only makes sense in async mode, where each write is a jump to the JS thread
+    ctx->writeBatch.maxFrames = writeBatchFrames;
+    ctx->writeBatch.maxSamples = writeBatchMaxSamples;
+    return ctx;
+  }
+
+  std::shared_ptr<DecoderFrameIndex>
+    StreamDecoderBuilder::frameIndexFromJs(const Napi::Value& options) {
+    if (!options.IsObject()) {
+      return nullptr;
+    }
+
+    auto env = options.Env();
+    auto obj = options.As<Object>();
+    auto value = obj.Get("frameIndex");
+    if (value.IsNull() || value.IsUndefined() || (value.IsBoolean() && !value.ToBoolean())) {
+      return nullptr;
+    }
+
+    auto frameIndex = std::make_shared<DecoderFrameIndex>();
+    if (value.IsString()) {
+      frameIndex->sidecarPath = stringFromJs(value);
+    } else if (value.IsBuffer()) {
+      auto buffer = value.As<Buffer<uint8_t>>();
+      std::string error;
+      if (!frameIndex->index.deserialize(buffer.Data(), buffer.Length(), error)) {
+        throw Error::New(env, error);
+      }
+
+      frameIndex->preloaded = true;
+    } else if (!value.IsBoolean()) {
+      throw TypeError::New(env, "Expected frameIndex to be boolean, string or Buffer");
+    }
+
+    auto mode = maybeStringFromJs(obj.Get("frameIndexMode")).value_or("scan");
+    if (mode == "incremental") {
+      frameIndex->incremental = true;
+    } else if (mode != "scan") {
+      throw RangeError::New(
+        env,
+        "Invalid frame index mode \""s + mode + "\", expected scan or incremental"s);
+    }
+
+    return frameIndex;
+  }
+
+  std::shared_ptr<DecoderWavOutput> StreamDecoderBuilder::createWavOutput() {
+    if (wavOutputPath.empty()) {
+      return nullptr;
+    }
+
+    // each decoder writes its own file, even if the builder is reused
+    auto output = std::make_shared<DecoderWavOutput>();
+    output->path = wavOutputPath;
+    output->bitsPerSample = wavOutputBitsPerSample;
+    return output;
+  }
+
   Napi::Value StreamDecoderBuilder::createDecoder(
     Napi::Env env,
     Napi::Value self,
@@ -350,6 +615,7 @@ namespace flac_bindings {
     auto decoder = ObjectWrap<StreamDecoder>::Unwrap(decoderJs);
     decoder->dec = dec;
     decoder->ctx = ctx;
+    ctx->frameDescriptors.mode = frameDescriptorMode;
 
     // decoder is build, cannot be used in builder
     dec = nullptr;
@@ -2,6 +2,8 @@
 #include "../mappings/mappings.hpp"
 #include "../utils/defer.hpp"
 #include "../utils/encoder_decoder_utils.hpp"
+#include "../utils/sample_kernels.hpp"
+#include "../utils/stats.hpp"
 #include <memory>
 
 namespace flac_bindings {
@@ -30,6 +32,7 @@ namespace flac_bindings {
         InstanceMethod("skipSingleFrame", &StreamDecoder::skipSingleFrame),
         InstanceMethod("seekAbsolute", &StreamDecoder::seekAbsolute),
         InstanceMethod("getDecodePosition", &StreamDecoder::getDecodePosition),
+        InstanceMethod("getFrameIndex", &StreamDecoder::getFrameIndex),
 
         InstanceMethod("getState", &StreamDecoder::getState),
         InstanceMethod("getResolvedStateString", &StreamDecoder::getResolvedStateString),
@@ -46,6 +49,10 @@ namespace flac_bindings {
         InstanceMethod("skipSingleFrameAsync", &StreamDecoder::skipSingleFrameAsync),
         InstanceMethod("seekAbsoluteAsync", &StreamDecoder::seekAbsoluteAsync),
         InstanceMethod("getDecodePositionAsync", &StreamDecoder::getDecodePositionAsync),
+
+        InstanceMethod("feed", &StreamDecoder::feed),
+        InstanceMethod("feedAsync", &StreamDecoder::feedAsync),
+        InstanceMethod("feedEnd", &StreamDecoder::feedEnd),
       });
     c_enum::declareInObject(constructor, "State", createStateEnum);
     c_enum::declareInObject(constructor, "InitStatus", createInitStatusEnum);
@@ -125,17 +132,35 @@ namespace flac_bindings {
   Napi::Value StreamDecoder::finish(const CallbackInfo& info) {
     checkPendingAsyncWork(info.Env(), DecoderWorkContext::ExecutionMode::Sync);
 
+    if (ctx->feed) {
+      ctx->feed->rejectPending("The decoder has been finished before reading the data");
+    }
+
     auto ret = FLAC__stream_decoder_finish(dec);
+    if (ctx->frameIndex) {
+      ctx->frameIndex->save();
+    }
+    ctx->mappedInput.reset();
+    if (ctx->sharedOutput) {
+      ctx->sharedOutput->setFlag(DecoderSharedOutput::Ended);
+    }
+    auto wavOutputOk = !ctx->wavOutput || ctx->wavOutput->finish();
     if (info.Env().IsExceptionPending()) {
       return Napi::Value();
     }
 
     if (ret) {
-      EscapableHandleScope scope(info.Env());
       auto builder = StreamDecoderBuilder::Unwrap(this->builder.Value());
       builder->dec = dec;
       dec = nullptr;
-      return scope.Escape(this->builder.Value());
+    }
+
+    if (!wavOutputOk) {
+      throw Error::New(info.Env(), ctx->wavOutput->error);
+    }
+
+    if (ret) {
+      return this->builder.Value();
     }
 
     return info.Env().Null();
@@ -158,6 +183,7 @@ namespace flac_bindings {
   Napi::Value StreamDecoder::processSingle(const CallbackInfo& info) {
     checkPendingAsyncWork(info.Env(), DecoderWorkContext::ExecutionMode::Sync);
 
+    stats::ProcessTimer timer(&stats::Stats::decoderProcess);
     auto ret = FLAC__stream_decoder_process_single(dec);
     return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), ret);
   }
@@ -165,6 +191,7 @@ namespace flac_bindings {
   Napi::Value StreamDecoder::processUntilEndOfMetadata(const CallbackInfo& info) {
     checkPendingAsyncWork(info.Env(), DecoderWorkContext::ExecutionMode::Sync);
 
+    stats::ProcessTimer timer(&stats::Stats::decoderProcess);
     auto ret = FLAC__stream_decoder_process_until_end_of_metadata(dec);
     return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), ret);
   }
@@ -172,6 +199,7 @@ namespace flac_bindings {
   Napi::Value StreamDecoder::processUntilEndOfStream(const CallbackInfo& info) {
     checkPendingAsyncWork(info.Env(), DecoderWorkContext::ExecutionMode::Sync);
 
+    stats::ProcessTimer timer(&stats::Stats::decoderProcess);
     auto ret = FLAC__stream_decoder_process_until_end_of_stream(dec);
     return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), ret);
   }
@@ -187,8 +215,12 @@ namespace flac_bindings {
     checkPendingAsyncWork(info.Env(), DecoderWorkContext::ExecutionMode::Sync);
 
     auto offset = numberFromJs<uint64_t>(info[0]);
-    auto ret = FLAC__stream_decoder_seek_absolute(dec, offset);
-    return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), ret);
+    stats::ProcessTimer timer(&stats::Stats::decoderProcess);
+    auto ret = seekWithFrameIndex(ctx.get(), offset);
+    if (!ret.has_value()) {
+      ret = FLAC__stream_decoder_seek_absolute(dec, offset);
+    }
+    return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), *ret);
   }
 
   Napi::Value StreamDecoder::getDecodePosition(const CallbackInfo& info) {
@@ -203,6 +235,17 @@ namespace flac_bindings {
     return info.Env().IsExceptionPending() ? Napi::Value() : info.Env().Null();
   }
 
+  Napi::Value StreamDecoder::getFrameIndex(const CallbackInfo& info) {
+    checkPendingAsyncWork(info.Env());
+
+    if (!ctx->frameIndex) {
+      return info.Env().Null();
+    }
+
+    auto data = ctx->frameIndex->index.serialize();
+    return Buffer<uint8_t>::Copy(info.Env(), data.data(), data.size());
+  }
+
   // -- state getters --
 
   Napi::Value StreamDecoder::getState(const CallbackInfo& info) {
@@ -220,6 +263,10 @@ namespace flac_bindings {
   Napi::Value StreamDecoder::finishAsync(const CallbackInfo& info) {
     checkPendingAsyncWork(info.Env(), DecoderWorkContext::ExecutionMode::Async);
 
+    if (ctx->feed) {
+      ctx->feed->rejectPending("The decoder has been finished before reading the data");
+    }
+
     AsyncDecoderWork* work = AsyncDecoderWork::forFinish({info.This()}, *this);
     return enqueueWork(work);
   }
@@ -275,6 +322,313 @@ namespace flac_bindings {
     return enqueueWork(work);
   }
 
+  // -- feed --
+
+  Napi::Value StreamDecoder::feed(const CallbackInfo& info) {
+    auto& feed = checkFeed(info.Env());
+
+    uint8_t* data;
+    size_t length;
+    std::tie(data, length) = pointer::fromBuffer<uint8_t>(info[0]);
+    if (feed.endOfStream) {
+      // nothing will read it, like the data after the end of a file
+      return numberToJs(info.Env(), length);
+    }
+
+    auto written = feed.ring.write(data, length);
+    feed.notifyDataAvailable();
+    return numberToJs(info.Env(), written);
+  }
+
+  Napi::Value StreamDecoder::feedAsync(const CallbackInfo& info) {
+    auto& feed = checkFeed(info.Env());
+
+    // checks that the value is a Buffer
+    pointer::fromBuffer<uint8_t>(info[0]);
+    auto deferred = Promise::Deferred::New(info.Env());
+    if (feed.endOfStream) {
+      deferred.Resolve(info.Env().Undefined());
+      return deferred.Promise();
+    }
+
+    feed.pendingBuffer = Napi::Persistent(info[0].As<Buffer<uint8_t>>());
+    feed.pendingOffset = 0;
+    feed.pendingDeferred = deferred;
+    feed.writePending();
+    feed.notifyDataAvailable();
+    return deferred.Promise();
+  }
+
+  Napi::Value StreamDecoder::feedEnd(const CallbackInfo& info) {
+    if (ctx == nullptr || !ctx->feed) {
+      throw Error::New(info.Env(), "Decoder has not been built using a feed");
+    }
+
+    if (ctx->feed->hasPendingData()) {
+      ctx->feed->endWhenFed = true;
+    } else {
+      ctx->feed->ring.close();
+      ctx->feed->notifyDataAvailable();
+    }
+
+    return info.Env().Undefined();
+  }
+
+  DecoderFeed& StreamDecoder::checkFeed(const Napi::Env& env) {
+    if (ctx == nullptr || !ctx->feed) {
+      throw Error::New(env, "Decoder has not been built using a feed");
+    }
+
+    if (ctx->feed->ring.isClosed() || ctx->feed->endWhenFed) {
+      throw Error::New(env, "Feed has been ended - cannot feed more data");
+    }
+
+    if (ctx->feed->hasPendingData()) {
+      throw Error::New(env, "There is a pending feedAsync call, wait until is resolved");
+    }
+
+    return *ctx->feed;
+  }
+
+  FLAC__StreamDecoderWriteStatus DecoderSharedOutput::write(
+    const FLAC__Frame* frame,
+    const int32_t* const buffer[]) {
+    const uint32_t blocksize = frame->header.blocksize;
+    if (frame->header.channels != channels || blocksize > capacity) {
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    const uint32_t writePosition = state[WritePosition].load(std::memory_order_relaxed);
+    auto hasSpace = [this, writePosition, blocksize]() {
+      const uint32_t readPosition = state[ReadPosition].load(std::memory_order_acquire);
+      return capacity - (writePosition - readPosition) >= blocksize;
+    };
+    if (!wait(hasSpace)) {
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    const SampleFormat inFormat = {4, false, frame->header.bits_per_sample};
+    const SampleFormat outFormat = {4, isFloat, frame->header.bits_per_sample};
+    const uint32_t offset = writePosition & (capacity - 1);
+    const uint32_t firstPart = std::min(blocksize, capacity - offset);
+    auto copy = [&](uint32_t start, uint32_t position, uint32_t count) {
+      if (planar) {
+        for (uint32_t ch = 0; ch < channels; ch += 1) {
+          auto in = (const char*) (buffer[ch] + start);
+          convertSamples(in, inFormat, sampleAt(ch, position), outFormat, count, false);
+        }
+      } else {
+        const char* in[FLAC__MAX_CHANNELS];
+        for (uint32_t ch = 0; ch < channels; ch += 1) {
+          in[ch] = (const char*) (buffer[ch] + start);
+        }
+
+        interleaveSamples(in, inFormat, sampleAt(0, position), outFormat, channels, count, false);
+      }
+    };
+
+    // when the frame does not fit until the end of the ring, the rest goes to the beginning
+    copy(0, offset, firstPart);
+    if (firstPart < blocksize) {
+      copy(firstPart, 0, blocksize - firstPart);
+    }
+
+    state[WritePosition].store(writePosition + blocksize, std::memory_order_release);
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  }
+
+  FLAC__StreamDecoderWriteStatus DecoderWavOutput::write(
+    const FLAC__StreamDecoder* dec,
+    const FLAC__Frame* frame,
+    const int32_t* const buffer[]) {
+    const auto& header = frame->header;
+    if (!opened) {
+      opened = true;
+      format.channels = header.channels;
+      format.bitsPerSample = bitsPerSample != 0 ? bitsPerSample : header.bits_per_sample;
+      format.sampleRate = header.sample_rate;
+      format.totalSamples =
+        FLAC__stream_decoder_get_total_samples(const_cast<FLAC__StreamDecoder*>(dec));
+      if (!writer.open(path, PcmContainer::Wav, format)) {
+        error = writer.error;
+      }
+    } else if (header.channels != format.channels || header.sample_rate != format.sampleRate) {
+      error = "The stream changed its format, it cannot be written into a WAV file";
+    }
+
+    if (!error.empty()) {
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    bool ok;
+    const int shift = int(format.bitsPerSample) - int(header.bits_per_sample);
+    if (shift == 0) {
+      ok = writer.write(buffer, header.blocksize);
+    } else {
+      // scale the samples to the bits per sample of the file
+      scratch.resize((size_t) header.blocksize * header.channels);
+      for (uint32_t i = 0; i < header.blocksize; i += 1) {
+        for (uint32_t ch = 0; ch < header.channels; ch += 1) {
+          const auto sample = buffer[ch][i];
+          scratch[i * header.channels + ch] =
+            shift > 0 ? int32_t(uint32_t(sample) << shift) : sample >> -shift;
+        }
+      }
+
+      ok = writer.writeInterleaved(scratch.data(), header.blocksize);
+    }
+
+    if (!ok) {
+      error = writer.error;
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  }
+
+  bool DecoderWavOutput::finish() {
+    if (opened && !writer.finish() && error.empty()) {
+      error = writer.error;
+    }
+
+    opened = false;
+    return error.empty();
+  }
+
+  void DecoderFrameIndex::prepare(const MappedFile& file) {
+    std::string error;
+    if (!preloaded && !sidecarPath.empty()) {
+      preloaded = index.load(sidecarPath, error);
+    }
+
+    // an index for another file (or an older version of it) is built again
+    if (preloaded && index.belongsTo(file) && (incremental || index.isComplete())) {
+      dirty = false;
+    } else if (incremental) {
+      index.reset(file, error);
+      dirty = false;
+    } else {
+      dirty = index.scan(file, error);
+      // saved now, because the decoder could never be finished
+      save();
+    }
+
+    // if the file is not FLAC, the index is empty and seeks use libFLAC as usual
+    nextOffset =
+      incremental && index.firstFrameOffset() != 0 ? index.firstFrameOffset() : UINT64_MAX;
+    nextSample = 0;
+  }
+
+  const FLAC__Frame* DecoderFrameIndex::onFrame(
+    const FLAC__StreamDecoder* dec,
+    const FLAC__Frame* frame,
+    const int32_t* const*& buffer) {
+    const auto& header = frame->header;
+    if (seekPending && header.number.sample_number != seekFrameSample) {
+      seekPending = false;
+      seekMismatch = true;
+      seekSkip = 0;
+      return nullptr;
+    }
+
+    if (nextOffset != UINT64_MAX && !index.isComplete()) {
+      // libFLAC always gives the sample number of the frame, even for fixed blocksize streams
+      const auto sample = header.number.sample_number;
+      if (sample == nextSample && index.append({nextOffset, sample, header.blocksize})) {
+        dirty = true;
+      }
+
+      // the decode position in the write callback is where the frame ends
+      uint64_t position;
+      auto ok =
+        FLAC__stream_decoder_get_decode_position(const_cast<FLAC__StreamDecoder*>(dec), &position);
+      nextOffset = ok ? position : UINT64_MAX;
+      nextSample = sample + header.blocksize;
+    }
+
+    seekPending = false;
+    if (seekSkip == 0 || seekSkip >= header.blocksize) {
+      seekSkip = 0;
+      return frame;
+    }
+
+    // like libFLAC does when seeking, the frame starts at the target sample
+    trimmedFrame = *frame;
+    trimmedFrame.header.blocksize -= seekSkip;
+    trimmedFrame.header.number.sample_number += seekSkip;
+    for (uint32_t ch = 0; ch < header.channels; ch += 1) {
+      trimmedBuffer[ch] = buffer[ch] + seekSkip;
+    }
+
+    buffer = trimmedBuffer;
+    seekSkip = 0;
+    return &trimmedFrame;
+  }
+
+  void DecoderFrameIndex::save() {
+    if (dirty && !sidecarPath.empty()) {
+      std::string error;
+      index.save(sidecarPath, error);
+      dirty = false;
+    }
+  }
+
+  void DecoderFeed::writePending() {
+    if (!hasPendingData()) {
+      return;
+    }
+
+    // ask for space before writing: if the decoder reads in between, it will notify anyway
+    spaceWanted = true;
+    auto buffer = pendingBuffer.Value();
+    pendingOffset += ring.write(buffer.Data() + pendingOffset, buffer.Length() - pendingOffset);
+    if (pendingOffset < buffer.Length()) {
+      return;
+    }
+
+    spaceWanted = false;
+    auto deferred = pendingDeferred.value();
+    pendingDeferred.reset();
+    pendingBuffer.Reset();
+    pendingOffset = 0;
+    if (endWhenFed) {
+      ring.close();
+    }
+
+    deferred.Resolve(deferred.Env().Undefined());
+  }
+
+  std::optional<Promise::Deferred> DecoderFeed::takePending() {
+    if (!hasPendingData()) {
+      return std::nullopt;
+    }
+
+    spaceWanted = false;
+    auto deferred = pendingDeferred;
+    pendingDeferred.reset();
+    pendingBuffer.Reset();
+    pendingOffset = 0;
+    if (endWhenFed) {
+      ring.close();
+    }
+
+    return deferred;
+  }
+
+  void DecoderFeed::rejectPending(const char* reason) {
+    auto deferred = takePending();
+    if (deferred) {
+      deferred->Reject(Error::New(deferred->Env(), reason).Value());
+    }
+  }
+
+  void DecoderFeed::discardPending() {
+    auto deferred = takePending();
+    if (deferred) {
+      deferred->Resolve(deferred->Env().Undefined());
+    }
+  }
+
   // -- enums --
 
   c_enum::DefineReturnType StreamDecoder::createStateEnum(const Napi::Env& env) {
@@ -433,6 +787,7 @@ namespace flac_bindings {
       auto ret = ctx->readCbk.MakeCallback(env.Global(), {jsBuffer});
       generateParseObjectResult(returnValue, "Decoder:ReadCallback", "bytes", *bytes)(ret);
       pointer::detach(jsBuffer);
+      stats::add(stats::global().bytesRead, *bytes);
     } catch (const Error& error) {
       pointer::detach(jsBuffer);
       error.ThrowAsJavaScriptException();
@@ -510,6 +865,22 @@ namespace flac_bindings {
     const int32_t* const samples[],
     void* ptr) {
     auto ctx = (DecoderWorkContext*) ptr;
+    if (ctx->frameIndex) {
+      frame = ctx->frameIndex->onFrame(dec, frame, samples);
+      if (frame == nullptr) {
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+      }
+    }
+
+    stats::add(stats::global().decodedSamples, frame->header.blocksize);
+    if (ctx->sharedOutput) {
+      return ctx->sharedOutput->write(frame, samples);
+    }
+
+    if (ctx->wavOutput) {
+      return ctx->wavOutput->write(dec, frame, samples);
+    }
+
     auto returnValue = FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
     auto env = ctx->writeCbk.Env();
     HandleScope scope(env);
@@ -522,7 +893,9 @@ namespace flac_bindings {
         buffers[ch] = buffer;
       }
 
-      auto ret = ctx->writeCbk.MakeCallback(env.Global(), {frameToJs(env, frame), buffers});
+      DEFER(ctx->frameDescriptors.release());
+      auto jsFrame = ctx->frameDescriptors.toJs(env, frame);
+      auto ret = ctx->writeCbk.MakeCallback(env.Global(), {jsFrame, buffers});
       generateParseNumberResult(returnValue, "Decoder:WriteCallback")(ret);
 
       for (uint32_t ch = 0; ch < channels; ch += 1) {
@@ -567,4 +940,148 @@ namespace flac_bindings {
     }
   }
 
+  // -- mmap callbacks --
+
+  FLAC__StreamDecoderInitStatus StreamDecoder::initWithMappedFile(
+    DecoderWorkContext* ctx,
+    const std::string& path,
+    bool ogg,
+    FLAC__StreamDecoderWriteCallback writeCallback,
+    FLAC__StreamDecoderMetadataCallback metadataCallback,
+    FLAC__StreamDecoderErrorCallback errorCallback) {
+    std::string error;
+    auto file = MappedFile::open(path, error);
+    if (!file) {
+      return FLAC__STREAM_DECODER_INIT_STATUS_ERROR_OPENING_FILE;
+    }
+
+    ctx->mappedInput.emplace(file);
+    if (ctx->frameIndex) {
+      ctx->frameIndex->prepare(*file);
+    }
+
+    auto init = ogg ? FLAC__stream_decoder_init_ogg_stream : FLAC__stream_decoder_init_stream;
+    auto status = init(
+      ctx->dec,
+      StreamDecoder::mappedReadCallback,
+      StreamDecoder::mappedSeekCallback,
+      StreamDecoder::mappedTellCallback,
+      StreamDecoder::mappedLengthCallback,
+      StreamDecoder::mappedEofCallback,
+      writeCallback,
+      metadataCallback,
+      errorCallback,
+      ctx);
+    if (status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      ctx->mappedInput.reset();
+    }
+
+    return status;
+  }
+
+  FLAC__StreamDecoderReadStatus StreamDecoder::mappedReadCallback(
+    const FLAC__StreamDecoder*,
+    FLAC__byte buffer[],
+    size_t* bytes,
+    void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    *bytes = ctx->mappedInput->read(buffer, *bytes);
+    stats::add(stats::global().bytesRead, *bytes);
+    return *bytes > 0 ? FLAC__STREAM_DECODER_READ_STATUS_CONTINUE
+                      : FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+  }
+
+  FLAC__StreamDecoderSeekStatus
+    StreamDecoder::mappedSeekCallback(const FLAC__StreamDecoder*, uint64_t offset, void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    if (offset > ctx->mappedInput->file->size()) {
+      return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+    }
+
+    ctx->mappedInput->position = offset;
+    return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+  }
+
+  FLAC__StreamDecoderTellStatus
+    StreamDecoder::mappedTellCallback(const FLAC__StreamDecoder*, uint64_t* offset, void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    *offset = ctx->mappedInput->position;
+    return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+  }
+
+  FLAC__StreamDecoderLengthStatus
+    StreamDecoder::mappedLengthCallback(const FLAC__StreamDecoder*, uint64_t* length, void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    *length = ctx->mappedInput->file->size();
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+  }
+
+  FLAC__bool StreamDecoder::mappedEofCallback(const FLAC__StreamDecoder*, void* ptr) {
+    auto ctx = (DecoderWorkContext*) ptr;
+    return ctx->mappedInput->eof();
+  }
+
+  // -- frame index --
+
+  std::optional<FLAC__bool> StreamDecoder::seekWithFrameIndex(
+    DecoderWorkContext* ctx,
+    uint64_t sample) {
+    auto frameIndex = ctx->frameIndex.get();
+    if (frameIndex == nullptr || !ctx->mappedInput) {
+      return std::nullopt;
+    }
+
+    auto entry = frameIndex->index.find(sample);
+    if (entry == nullptr) {
+      return std::nullopt;
+    }
+
+    switch (FLAC__stream_decoder_get_state(ctx->dec)) {
+      case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
+      case FLAC__STREAM_DECODER_READ_METADATA:
+        if (!FLAC__stream_decoder_process_until_end_of_metadata(ctx->dec)) {
+          return false;
+        }
+        break;
+      case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+      case FLAC__STREAM_DECODER_READ_FRAME:
+      case FLAC__STREAM_DECODER_END_OF_STREAM:
+        break;
+      default:
+        // libFLAC knows what to return in the other states
+        return std::nullopt;
+    }
+
+    // the frame is decoded from its offset and trimmed in the write callback, instead of
+    // searching it by bisection
+    if (!FLAC__stream_decoder_flush(ctx->dec)) {
+      return false;
+    }
+
+    ctx->mappedInput->position = entry->offset;
+    frameIndex->seekSkip = sample - entry->sample;
+    frameIndex->seekFrameSample = entry->sample;
+    frameIndex->seekPending = true;
+    frameIndex->seekMismatch = false;
+    if (frameIndex->incremental) {
+      frameIndex->nextOffset = entry->offset;
+      frameIndex->nextSample = entry->sample;
+    }
+
+    auto ret = FLAC__stream_decoder_process_single(ctx->dec);
+    frameIndex->seekSkip = 0;
+    if (frameIndex->seekMismatch) {
+      // the index does not describe this file (or the frame at the offset was damaged), so it is
+      // not used anymore and libFLAC searches the sample as usual
+      frameIndex->seekMismatch = false;
+      frameIndex->index = FrameIndex();
+      frameIndex->nextOffset = UINT64_MAX;
+      frameIndex->dirty = false;
+      return FLAC__stream_decoder_seek_absolute(ctx->dec, sample);
+    }
+
+    // if the frame could not be decoded, the seek failed
+    return ret && !frameIndex->seekPending;
+  }
+
 }
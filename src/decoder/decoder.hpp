@@ -1,12 +1,20 @@
 #pragma once
 
 #include "../flac_addon.hpp"
+#include "../mappings/mappings.hpp"
 #include "../utils/async.hpp"
 #include "../utils/converters.hpp"
 #include "../utils/enum.hpp"
+#include "../utils/file_io.hpp"
+#include "../utils/frame_index.hpp"
+#include "../utils/pcm_file.hpp"
 #include "../utils/pointer.hpp"
+#include "../utils/ring_buffer.hpp"
+#include "../utils/shared_ring.hpp"
 #include <FLAC/stream_decoder.h>
+#include <algorithm>
 #include <variant>
+#include <vector>
 
 namespace flac_bindings {
 
@@ -58,12 +66,221 @@ namespace flac_bindings {
       FLAC__StreamDecoderErrorStatus error = FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC;
     };
 
-    std::variant<Read, Seek, Tell, Length, Eof, Write, Metadata, Error> data;
+    struct WriteBatch {
+      FLAC__StreamDecoderWriteStatus returnValue = FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    };
+
+    struct FeedSpaceAvailable {};
+
+    typedef std::variant<
+      Read,
+      Seek,
+      Tell,
+      Length,
+      Eof,
+      Write,
+      Metadata,
+      Error,
+      WriteBatch,
+      FeedSpaceAvailable>
+      DataType;
+
+    DataType data;
 
     DecoderWorkRequest(const DecoderWorkRequest& req): data(req.data) {}
-    DecoderWorkRequest(
-      const std::variant<Read, Seek, Tell, Length, Eof, Write, Metadata, Error>& data):
-        data(data) {}
+    DecoderWorkRequest(const DataType& data): data(data) {}
+  };
+
+  /**
+   * Input of a decoder built with a feed: JS writes the data into the ring, and the decoder thread
+   * reads from it. The read callback only waits when the ring is empty.
+   */
+  struct DecoderFeed {
+    SpscRingBuffer ring;
+    // set from JS when there is data that did not fit into the ring, and then the decoder thread
+    // tells JS when it has read something
+    std::atomic_bool spaceWanted = false;
+    Reference<Buffer<uint8_t>> pendingBuffer;
+    size_t pendingOffset = 0;
+    std::optional<Promise::Deferred> pendingDeferred;
+    bool endWhenFed = false;
+    // set by the decoder thread once the stream has ended, data fed from then on is discarded
+    std::atomic_bool endOfStream = false;
+    // decoder suspended until there is enough data, resumed from JS after feeding it
+    std::atomic<AsyncBackgroundTaskBase<DecoderWorkRequest>*> waitingTask = nullptr;
+
+    DecoderFeed(size_t capacity): ring(capacity) {}
+
+    inline bool hasPendingData() const {
+      return pendingDeferred.has_value();
+    }
+
+    /**
+     * True if the read callback has something to read, or knows that the feed has ended. The
+     * rest of a frame is waited for in the read callback.
+     */
+    inline bool hasData() const {
+      return ring.isClosed() || ring.size() > 0;
+    }
+
+    inline void notifyDataAvailable() {
+      auto task = waitingTask.exchange(nullptr);
+      if (task != nullptr) {
+        task->resume();
+      }
+    }
+
+    void writePending();
+    /** Rejects the pending `feedAsync` call, if any, because nothing will read its data. */
+    void rejectPending(const char* reason);
+    /** Resolves the pending `feedAsync` call, if any, dropping the data that was not copied. */
+    void discardPending();
+
+  private:
+    std::optional<Promise::Deferred> takePending();
+  };
+
+  /**
+   * Ring in a SharedArrayBuffer where the decoder writes the samples directly, instead of calling
+   * the write callback.
+   */
+  struct DecoderSharedOutput: SharedSampleRing {
+    FLAC__StreamDecoderWriteStatus write(const FLAC__Frame*, const int32_t* const[]);
+  };
+
+  /**
+   * WAV file where the decoder writes the samples directly from the write callback, instead of
+   * calling the write callback. The file is created with the format of the first frame.
+   */
+  struct DecoderWavOutput {
+    std::string path;
+    // 0 to keep the bits per sample of the stream
+    uint32_t bitsPerSample = 0;
+    std::string error;
+
+    FLAC__StreamDecoderWriteStatus
+      write(const FLAC__StreamDecoder*, const FLAC__Frame*, const int32_t* const[]);
+    /** Updates the header and closes the file. Returns `false` if something failed. */
+    bool finish();
+
+  private:
+    PcmFileWriter writer;
+    PcmFormat format;
+    bool opened = false;
+    std::vector<int32_t> scratch;
+  };
+
+  /**
+   * Frame index of a decoder built with a file and the frameIndex option, which is used to seek
+   * with one read instead of the bisection search of libFLAC. It is loaded or scanned when the
+   * decoder is built, or filled with the frames as they are decoded.
+   */
+  struct DecoderFrameIndex {
+    FrameIndex index;
+    // the index is loaded from and saved into this file when not empty
+    std::string sidecarPath;
+    // true if the index was given from JS, used only if it belongs to the file
+    bool preloaded = false;
+    bool incremental = false;
+    bool dirty = false;
+    // where the next frame should start, to record it while decoding (UINT64_MAX if unknown)
+    uint64_t nextOffset = UINT64_MAX;
+    uint64_t nextSample = 0;
+    // samples to drop from the next frame, after a seek with the index, and the first sample that
+    // frame must have, else the index does not match the file and the frame is dropped
+    uint64_t seekSkip = 0;
+    uint64_t seekFrameSample = 0;
+    bool seekPending = false;
+    bool seekMismatch = false;
+
+    /** Loads, scans or prepares the index for the file, once the file has been mapped. */
+    void prepare(const MappedFile&);
+    /**
+     * Records the frame in the index if needed, and trims it if it is the target of a seek.
+     * Returns the frame to send, and changes `buffer` if the frame has been trimmed, or null if
+     * the frame is not the one the seek expected and must not be sent.
+     */
+    const FLAC__Frame*
+      onFrame(const FLAC__StreamDecoder*, const FLAC__Frame*, const int32_t* const*& buffer);
+    /** Saves the index into the sidecar file if it has changed. Errors are ignored. */
+    void save();
+
+  private:
+    FLAC__Frame trimmedFrame;
+    const int32_t* trimmedBuffer[FLAC__MAX_CHANNELS];
+  };
+
+  /**
+   * Holds decoded frames until they are sent to JS in one go. The storage is reused between
+   * batches and never grows while it contains frames, so the buffers given to JS stay valid
+   * during the write callback.
+   */
+  struct DecoderWriteBatch {
+    uint32_t maxFrames = 0;
+    uint64_t maxSamples = 0;
+    uint32_t channels = 0;
+    uint64_t samples = 0;
+    std::vector<FLAC__FrameHeader> headers;
+    std::vector<FLAC__FrameFooter> footers;
+    std::vector<int32_t> buffers[FLAC__MAX_CHANNELS];
+
+    inline bool isEnabled() const {
+      return maxFrames > 0;
+    }
+
+    inline bool isEmpty() const {
+      return headers.empty();
+    }
+
+    inline bool isFull() const {
+      return headers.size() >= maxFrames;
+    }
+
+    /** True if the batch is full, or if the next frame will not fit if it is like the last one. */
+    inline bool isAlmostFull() const {
+      if (isEmpty() || isFull()) {
+        return isFull();
+      }
+
+      const uint64_t nextSamples = samples + headers.back().blocksize;
+      return nextSamples > buffers[0].capacity() || (maxSamples != 0 && nextSamples > maxSamples);
+    }
+
+    inline bool fits(const FLAC__Frame* frame) const {
+      return isEmpty()
+             || (frame->header.channels == channels
+                 && samples + frame->header.blocksize <= buffers[0].capacity()
+                 && (maxSamples == 0 || samples + frame->header.blocksize <= maxSamples));
+    }
+
+    inline void push(const FLAC__Frame* frame, const int32_t* const buffer[]) {
+      const auto blocksize = frame->header.blocksize;
+      if (isEmpty()) {
+        channels = frame->header.channels;
+        uint64_t capacity = maxSamples != 0 ? maxSamples : (uint64_t) maxFrames * blocksize;
+        for (uint32_t ch = 0; ch < channels; ch += 1) {
+          buffers[ch].reserve(std::max<uint64_t>(capacity, blocksize));
+        }
+      }
+
+      for (uint32_t ch = 0; ch < channels; ch += 1) {
+        buffers[ch].insert(buffers[ch].end(), buffer[ch], buffer[ch] + blocksize);
+      }
+
+      headers.push_back(frame->header);
+      footers.push_back(frame->footer);
+      samples += blocksize;
+    }
+
+    inline void clear() {
+      for (uint32_t ch = 0; ch < channels; ch += 1) {
+        buffers[ch].clear();
+      }
+
+      headers.clear();
+      footers.clear();
+      samples = 0;
+    }
   };
 
   typedef AsyncBackgroundTask<
@@ -76,6 +293,21 @@ namespace flac_bindings {
     std::atomic_bool workInProgress = false;
     AsyncDecoderWorkBase::ExecutionProgress* asyncExecutionProgress = nullptr;
     FLAC__StreamDecoder* dec;
+    DecoderWriteBatch writeBatch;
+    // only used from the JS thread
+    FrameDescriptors frameDescriptors;
+    std::shared_ptr<DecoderFeed> feed;
+    std::shared_ptr<DecoderSharedOutput> sharedOutput;
+    std::shared_ptr<DecoderWavOutput> wavOutput;
+    // input of a decoder built with a file and the mmap option
+    std::optional<MappedFileReader> mappedInput;
+    // only for decoders built with a file and the frameIndex option
+    std::shared_ptr<DecoderFrameIndex> frameIndex;
+    // state of processUntilEndOfStreamAsync when it gives the thread back while JS works: full
+    // batches are sent from there instead of from the write callback
+    bool resumable = false;
+    std::shared_ptr<DecoderWorkRequest> pendingWriteBatch;
+    std::optional<int> resumableResult;
     enum ExecutionMode {
       Sync,
       Async,
@@ -102,6 +334,10 @@ namespace flac_bindings {
         errorCbk.Unref();
     }
 
+    inline bool hasWriteCallback() const {
+      return !writeCbk.IsEmpty() || sharedOutput || wavOutput;
+    }
+
     inline void runLocked(const std::function<void()>& funcBody) {
       std::lock_guard<std::mutex> lockGuard(this->mutex);
       funcBody();
@@ -132,6 +368,10 @@ namespace flac_bindings {
     Napi::Value setMetadataIgnore(const CallbackInfo&);
     Napi::Value setMetadataIgnoreAll(const CallbackInfo&);
     Napi::Value setMetadataIgnoreApplication(const CallbackInfo&);
+    Napi::Value setWriteBatch(const CallbackInfo&);
+    Napi::Value setFrameDescriptor(const CallbackInfo&);
+    Napi::Value setSharedOutput(const CallbackInfo&);
+    Napi::Value setWavOutput(const CallbackInfo&);
 
     Napi::Value buildWithStream(const CallbackInfo&);
     Napi::Value buildWithOggStream(const CallbackInfo&);
@@ -142,13 +382,26 @@ namespace flac_bindings {
     Napi::Value buildWithOggStreamAsync(const CallbackInfo&);
     Napi::Value buildWithFileAsync(const CallbackInfo&);
     Napi::Value buildWithOggFileAsync(const CallbackInfo&);
+    Napi::Value buildWithFeedAsync(const CallbackInfo&);
+    Napi::Value buildWithOggFeedAsync(const CallbackInfo&);
 
     Napi::Value createDecoder(Napi::Env, Napi::Value, std::shared_ptr<DecoderWorkContext>);
     void checkInitStatus(Napi::Env env, FLAC__StreamDecoderInitStatus status);
     void checkIfBuilt(Napi::Env env);
 
+    std::shared_ptr<DecoderWorkContext> createSyncContext();
+    std::shared_ptr<DecoderWorkContext> createAsyncContext();
+    std::shared_ptr<DecoderWavOutput> createWavOutput();
+    static std::shared_ptr<DecoderFrameIndex> frameIndexFromJs(const Napi::Value&);
+
     FLAC__StreamDecoder* dec = nullptr;
     std::atomic_bool workInProgress = false;
+    uint32_t writeBatchFrames = 0;
+    uint64_t writeBatchMaxSamples = 0;
+    FrameDescriptors::Mode frameDescriptorMode = FrameDescriptors::Full;
+    std::shared_ptr<DecoderSharedOutput> sharedOutput;
+    std::string wavOutputPath;
+    uint32_t wavOutputBitsPerSample = 0;
 
   public:
     static Function init(Napi::Env, FlacAddon&);
@@ -178,6 +431,7 @@ namespace flac_bindings {
     Napi::Value skipSingleFrame(const CallbackInfo&);
     Napi::Value seekAbsolute(const CallbackInfo&);
     Napi::Value getDecodePosition(const CallbackInfo&);
+    Napi::Value getFrameIndex(const CallbackInfo&);
 
     Napi::Value getState(const CallbackInfo&);
     Napi::Value getResolvedStateString(const CallbackInfo&);
@@ -191,6 +445,11 @@ namespace flac_bindings {
     Napi::Value seekAbsoluteAsync(const CallbackInfo&);
     Napi::Value getDecodePositionAsync(const CallbackInfo&);
 
+    Napi::Value feed(const CallbackInfo&);
+    Napi::Value feedAsync(const CallbackInfo&);
+    Napi::Value feedEnd(const CallbackInfo&);
+    DecoderFeed& checkFeed(const Napi::Env&);
+
     inline void checkPendingAsyncWork(
       const Napi::Env& env,
       std::optional<DecoderWorkContext::ExecutionMode> mode = std::nullopt) {
@@ -234,6 +493,24 @@ namespace flac_bindings {
     static void metadataCallback(const FLAC__StreamDecoder*, const FLAC__StreamMetadata*, void*);
     static void errorCallback(const FLAC__StreamDecoder*, FLAC__StreamDecoderErrorStatus, void*);
 
+    static FLAC__StreamDecoderInitStatus initWithMappedFile(
+      DecoderWorkContext*,
+      const std::string&,
+      bool,
+      FLAC__StreamDecoderWriteCallback,
+      FLAC__StreamDecoderMetadataCallback,
+      FLAC__StreamDecoderErrorCallback);
+    static FLAC__StreamDecoderReadStatus
+      mappedReadCallback(const FLAC__StreamDecoder*, FLAC__byte[], size_t*, void*);
+    static FLAC__StreamDecoderSeekStatus
+      mappedSeekCallback(const FLAC__StreamDecoder*, uint64_t, void*);
+    static FLAC__StreamDecoderTellStatus
+      mappedTellCallback(const FLAC__StreamDecoder*, uint64_t*, void*);
+    static FLAC__StreamDecoderLengthStatus
+      mappedLengthCallback(const FLAC__StreamDecoder*, uint64_t*, void*);
+    static FLAC__bool mappedEofCallback(const FLAC__StreamDecoder*, void*);
+    static std::optional<FLAC__bool> seekWithFrameIndex(DecoderWorkContext*, uint64_t);
+
     FLAC__StreamDecoder* dec = nullptr;
     std::shared_ptr<DecoderWorkContext> ctx;
     ObjectReference builder;
@@ -255,6 +532,12 @@ namespace flac_bindings {
       const char*,
       DecoderWorkContext*,
       std::function<Napi::Value(const Napi::Env&, ValueType)>);
+    AsyncDecoderWork(
+      const StoreList&,
+      FunctionCallback,
+      const char*,
+      DecoderWorkContext*,
+      std::function<Napi::Value(const Napi::Env&, ValueType)>);
 
     void onProgress(
       const DecoderWorkContext*,
@@ -263,6 +546,9 @@ namespace flac_bindings {
       const std::shared_ptr<DecoderWorkRequest>&);
 
     static FunctionCallback decorate(DecoderWorkContext*, const std::function<ValueType()>&);
+    static FunctionCallback resumableProcessUntilEndOfStream(DecoderWorkContext*);
+    static bool waitForFeed(DecoderWorkContext*, ExecutionProgress&);
+    static bool sendWriteBatchAndSuspend(DecoderWorkContext*, ExecutionProgress&);
 
     static FLAC__StreamDecoderReadStatus
       readCallback(const FLAC__StreamDecoder*, FLAC__byte[], size_t*, void*);
@@ -275,9 +561,20 @@ namespace flac_bindings {
       writeCallback(const FLAC__StreamDecoder*, const FLAC__Frame*, const int32_t* const[], void*);
     static void metadataCallback(const FLAC__StreamDecoder*, const FLAC__StreamMetadata*, void*);
     static void errorCallback(const FLAC__StreamDecoder*, FLAC__StreamDecoderErrorStatus, void*);
+    static FLAC__StreamDecoderWriteStatus flushWriteBatch(DecoderWorkContext*);
+    static FLAC__StreamDecoderReadStatus
+      feedReadCallback(const FLAC__StreamDecoder*, FLAC__byte[], size_t*, void*);
+    static FLAC__bool feedEofCallback(const FLAC__StreamDecoder*, void*);
 
     pointer::BufferReference<FLAC__byte> readSharedBufferRef;
     pointer::BufferReference<int32_t> writeSharedBufferRefs[FLAC__MAX_CHANNELS];
+    // when set, the decoder stops reading from this feed once the work ends, and the pending data
+    // is discarded if the stream has ended or rejected if the decoding failed
+    DecoderFeed* endingFeed = nullptr;
+
+  protected:
+    void OnOK() override;
+    void OnError(const Error&) override;
 
   public:
     static AsyncDecoderWork* forFinish(const StoreList&, StreamDecoder&);
@@ -296,11 +593,13 @@ namespace flac_bindings {
     static AsyncDecoderWork* forInitFile(
       const StoreList&,
       const std::string&,
+      bool,
       std::shared_ptr<DecoderWorkContext>,
       StreamDecoderBuilder&);
     static AsyncDecoderWork* forInitOggFile(
       const StoreList&,
       const std::string&,
+      bool,
       std::shared_ptr<DecoderWorkContext>,
       StreamDecoderBuilder&);
     static AsyncDecoderWork* forGetDecoderPosition(const StoreList&, DecoderWorkContext*);
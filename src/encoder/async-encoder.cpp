@@ -1,7 +1,12 @@
 #include "../mappings/mappings.hpp"
 #include "../utils/defer.hpp"
 #include "../utils/encoder_decoder_utils.hpp"
+#include "../utils/stats.hpp"
 #include "encoder.hpp"
+#include <FLAC/metadata.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 
 namespace flac_bindings {
 
@@ -45,7 +50,14 @@ namespace flac_bindings {
 
   AsyncEncoderWork* AsyncEncoderWork::forFinish(const StoreList& list, StreamEncoder& encoder) {
     auto workFunction = [&encoder]() {
-      return FLAC__stream_encoder_finish(encoder.ctx->enc);
+      auto ok = FLAC__stream_encoder_finish(encoder.ctx->enc);
+      if (encoder.ctx->output) {
+        // no more data will be written, wake up a pending drainAsync
+        encoder.ctx->output->ring.close();
+        AsyncEncoderWork::notifyOutputReader(encoder.ctx.get());
+      }
+
+      return ok;
     };
 
     auto convertFunction = [&encoder](auto env, auto value) {
@@ -75,6 +87,8 @@ namespace flac_bindings {
     uint64_t samples,
     EncoderWorkContext* ctx) {
     auto workFunction = [ctx, buffers, samples]() {
+      stats::add(stats::global().encodedSamples, samples);
+      stats::ProcessTimer timer(&stats::Stats::encoderProcess);
       return FLAC__stream_encoder_process(ctx->enc, buffers.data(), samples);
     };
 
@@ -91,6 +105,8 @@ namespace flac_bindings {
     uint64_t samples,
     EncoderWorkContext* ctx) {
     auto workFunction = [ctx, buffer, samples]() {
+      stats::add(stats::global().encodedSamples, samples);
+      stats::ProcessTimer timer(&stats::Stats::encoderProcess);
       return FLAC__stream_encoder_process_interleaved(ctx->enc, buffer, samples);
     };
 
@@ -101,18 +117,80 @@ namespace flac_bindings {
       ctx);
   }
 
+  AsyncEncoderWork* AsyncEncoderWork::forProcessSharedInput(
+    const StoreList& list,
+    std::shared_ptr<EncoderSharedInput> input,
+    EncoderWorkContext* ctx) {
+    auto workFunction = [ctx, input]() { return input->process(ctx->enc); };
+
+    return new AsyncEncoderWork(
+      list,
+      workFunction,
+      "flac_bindings::StreamEncoder::processSharedInputAsync",
+      ctx);
+  }
+
+  AsyncEncoderWork* AsyncEncoderWork::forProcessInput(
+    const StoreList& list,
+    EncoderWorkContext* ctx) {
+    auto workFunction = [ctx]() {
+      auto& input = *ctx->input;
+      const auto channels = input.format().channels;
+      // 1MiB of samples per read, so the file is read in few big requests
+      const uint64_t chunk = std::max<uint64_t>((1 << 18) / channels, 1);
+      std::vector<int32_t> buffer(chunk * channels);
+      while (true) {
+        const auto samples = input.read(buffer.data(), chunk);
+        if (samples == 0) {
+          break;
+        }
+
+        stats::add(stats::global().encodedSamples, samples);
+        stats::ProcessTimer timer(&stats::Stats::encoderProcess);
+        if (!FLAC__stream_encoder_process_interleaved(ctx->enc, buffer.data(), samples)) {
+          return false;
+        }
+      }
+
+      if (!input.error.empty()) {
+        ctx->asyncExecutionProgress->reject(input.error);
+        return false;
+      }
+
+      return true;
+    };
+
+    return new AsyncEncoderWork(
+      list,
+      workFunction,
+      "flac_bindings::StreamEncoder::processInputAsync",
+      ctx);
+  }
+
   AsyncEncoderWork* AsyncEncoderWork::forInitStream(
     const StoreList& list,
     std::shared_ptr<EncoderWorkContext> ctx,
     StreamEncoderBuilder& builder) {
     auto workFunction = [ctx]() {
-      return FLAC__stream_encoder_init_stream(
+      FLAC__StreamEncoderWriteCallback writeCallback = nullptr;
+      if (ctx->output) {
+        writeCallback = AsyncEncoderWork::outputWriteCallback;
+      } else if (!ctx->writeCbk.IsEmpty()) {
+        writeCallback = AsyncEncoderWork::writeCallback;
+      }
+
+      auto ret = FLAC__stream_encoder_init_stream(
         ctx->enc,
-        ctx->writeCbk.IsEmpty() ? nullptr : AsyncEncoderWork::writeCallback,
+        writeCallback,
         ctx->seekCbk.IsEmpty() ? nullptr : AsyncEncoderWork::seekCallback,
         ctx->tellCbk.IsEmpty() ? nullptr : AsyncEncoderWork::tellCallback,
         ctx->metadataCbk.IsEmpty() ? nullptr : AsyncEncoderWork::metadataCallback,
         ctx.get());
+      if (ctx->output) {
+        ctx->output->growable = false;
+      }
+
+      return ret;
     };
     auto convertFunction = [ctx, &builder](const Napi::Env& env, int value) {
       builder.checkInitStatus(env, (FLAC__StreamEncoderInitStatus) value);
@@ -132,14 +210,26 @@ namespace flac_bindings {
     std::shared_ptr<EncoderWorkContext> ctx,
     StreamEncoderBuilder& builder) {
     auto workFunction = [ctx]() {
-      return FLAC__stream_encoder_init_ogg_stream(
+      FLAC__StreamEncoderWriteCallback writeCallback = nullptr;
+      if (ctx->output) {
+        writeCallback = AsyncEncoderWork::outputWriteCallback;
+      } else if (!ctx->writeCbk.IsEmpty()) {
+        writeCallback = AsyncEncoderWork::writeCallback;
+      }
+
+      auto ret = FLAC__stream_encoder_init_ogg_stream(
         ctx->enc,
         ctx->readCbk.IsEmpty() ? nullptr : AsyncEncoderWork::readCallback,
-        ctx->writeCbk.IsEmpty() ? nullptr : AsyncEncoderWork::writeCallback,
+        writeCallback,
         ctx->seekCbk.IsEmpty() ? nullptr : AsyncEncoderWork::seekCallback,
         ctx->tellCbk.IsEmpty() ? nullptr : AsyncEncoderWork::tellCallback,
         ctx->metadataCbk.IsEmpty() ? nullptr : AsyncEncoderWork::metadataCallback,
         ctx.get());
+      if (ctx->output) {
+        ctx->output->growable = false;
+      }
+
+      return ret;
     };
     auto convertFunction = [ctx, &builder](const Napi::Env& env, int value) {
       builder.checkInitStatus(env, (FLAC__StreamEncoderInitStatus) value);
@@ -204,6 +294,115 @@ namespace flac_bindings {
       convertFunction);
   }
 
+  /** The speaker positions FLAC assumes for the number of channels, like the flac CLI does. */
+  static bool isDefaultChannelMask(const PcmFormat& format) {
+    switch (format.channels) {
+      case 1:
+        return format.channelMask == 0x0004;
+      case 2:
+        return format.channelMask == 0x0003;
+      case 3:
+        return format.channelMask == 0x0007;
+      case 4:
+        return format.channelMask == 0x0033;
+      case 5:
+        return format.channelMask == 0x0607 || format.channelMask == 0x0037;
+      case 6:
+        return format.channelMask == 0x060F || format.channelMask == 0x003F;
+      case 7:
+        return format.channelMask == 0x070F;
+      case 8:
+        return format.channelMask == 0x063F;
+      default:
+        return false;
+    }
+  }
+
+  /** Stores a non-default channel mask as a tag, so it is not lost when decoding back. */
+  static void setChannelMaskTag(EncoderWorkContext* ctx, const PcmFormat& format) {
+    if (format.channelMask == 0 || isDefaultChannelMask(format)) {
+      return;
+    }
+
+    std::shared_ptr<FLAC__StreamMetadata> block(
+      FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT),
+      FLAC__metadata_object_delete);
+    if (!block) {
+      return;
+    }
+
+    char value[11];
+    snprintf(value, sizeof(value), "0x%04X", format.channelMask);
+    FLAC__StreamMetadata_VorbisComment_Entry entry;
+    if (!FLAC__metadata_object_vorbiscomment_entry_from_name_value_pair(
+          &entry,
+          "WAVEFORMATEXTENSIBLE_CHANNEL_MASK",
+          value)) {
+      return;
+    }
+
+    if (!FLAC__metadata_object_vorbiscomment_append_comment(block.get(), entry, false)) {
+      free(entry.entry);
+      return;
+    }
+
+    auto blockPtr = block.get();
+    if (FLAC__stream_encoder_set_metadata(ctx->enc, &blockPtr, 1)) {
+      ctx->ownedMetadata = block;
+    }
+  }
+
+  AsyncEncoderWork* AsyncEncoderWork::forInitFromWavFile(
+    const StoreList& list,
+    const std::string& inputPath,
+    const std::string& outputPath,
+    bool keepChannelMask,
+    std::shared_ptr<EncoderWorkContext> ctx,
+    StreamEncoderBuilder& builder) {
+    auto workFunction = [ctx, inputPath, outputPath, keepChannelMask]() {
+      auto input = std::make_shared<PcmFileReader>();
+      if (!input->open(inputPath, PcmContainer::Wav, {})) {
+        ctx->inputError = input->error;
+        return (int) FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+      }
+
+      const auto& format = input->format();
+      FLAC__stream_encoder_set_channels(ctx->enc, format.channels);
+      FLAC__stream_encoder_set_bits_per_sample(ctx->enc, format.bitsPerSample);
+      FLAC__stream_encoder_set_sample_rate(ctx->enc, format.sampleRate);
+      if (format.totalSamples > 0) {
+        FLAC__stream_encoder_set_total_samples_estimate(ctx->enc, format.totalSamples);
+      }
+
+      if (keepChannelMask) {
+        setChannelMaskTag(ctx.get(), format);
+      }
+
+      ctx->input = input;
+      return (int) FLAC__stream_encoder_init_file(
+        ctx->enc,
+        outputPath.c_str(),
+        ctx->progressCbk.IsEmpty() ? nullptr : AsyncEncoderWork::progressCallback,
+        ctx.get());
+    };
+    auto convertFunction = [ctx, &builder](const Napi::Env& env, int value) {
+      if (!ctx->inputError.empty()) {
+        builder.workInProgress = false;
+        throw Error::New(env, ctx->inputError);
+      }
+
+      builder.checkInitStatus(env, (FLAC__StreamEncoderInitStatus) value);
+      return builder.createEncoder(env, builder.Value(), ctx);
+    };
+
+    return new AsyncEncoderWork(
+      list,
+      workFunction,
+      "flac_bindings::StreamEncoderBuilder::buildFromWavFileAsync",
+      ctx.get(),
+      convertFunction);
+  }
+
   void AsyncEncoderWork::onProgress(
     const EncoderWorkContext* ctx,
     Napi::Env& env,
@@ -260,6 +459,9 @@ namespace flac_bindings {
           numberToJs(env, progressRequest.framesWritten),
           numberToJs(env, progressRequest.totalFramesEstimate),
         });
+    } else if (std::holds_alternative<EncoderWorkRequest::OutputAvailable>(req->data)) {
+      ctx->output->resolvePending();
+      return;
     }
 
     if (result.IsPromise()) {
@@ -306,6 +508,7 @@ namespace flac_bindings {
       EncoderWorkRequest::Write {buffer, bytes, samples, frame});
 
     ctx->asyncExecutionProgress->sendProgressAndWait(request);
+    stats::add(stats::global().bytesWritten, bytes);
 
     return std::get<EncoderWorkRequest::Write>(request->data).returnValue;
   }
@@ -361,4 +564,40 @@ namespace flac_bindings {
 
     ctx->asyncExecutionProgress->sendProgressAndWait(request);
   }
+
+  FLAC__StreamEncoderWriteStatus AsyncEncoderWork::outputWriteCallback(
+    const FLAC__StreamEncoder*,
+    const FLAC__byte buffer[],
+    size_t bytes,
+    unsigned,
+    unsigned,
+    void* ptr) {
+    auto ctx = (EncoderWorkContext*) ptr;
+    auto& output = *ctx->output;
+
+    if (output.growable && output.ring.space() < bytes) {
+      output.ring.grow(std::max(output.ring.size() * 2, output.ring.size() + bytes));
+    }
+
+    // only blocks when JS is not draining fast enough
+    {
+      stats::WaitTimer timer;
+      if (!output.ring.writeWait(buffer, bytes)) {
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+      }
+    }
+
+    stats::add(stats::global().bytesWritten, bytes);
+
+    notifyOutputReader(ctx);
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+  }
+
+  void AsyncEncoderWork::notifyOutputReader(EncoderWorkContext* ctx) {
+    if (ctx->output->dataWanted.exchange(false)) {
+      auto request =
+        std::make_shared<EncoderWorkRequest>(EncoderWorkRequest::OutputAvailable());
+      ctx->asyncExecutionProgress->sendProgressAndWait(request);
+    }
+  }
 }
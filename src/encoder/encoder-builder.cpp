@@ -3,6 +3,8 @@
 
 namespace flac_bindings {
 
+  static constexpr size_t defaultDrainBufferSize = 256 * 1024;
+
   Function StreamEncoderBuilder::init(Napi::Env env, FlacAddon& addon) {
     EscapableHandleScope scope(env);
 
@@ -78,6 +80,9 @@ namespace flac_bindings {
         InstanceMethod("buildWithOggStreamAsync", &StreamEncoderBuilder::buildWithOggStreamAsync),
         InstanceMethod("buildWithFileAsync", &StreamEncoderBuilder::buildWithFileAsync),
         InstanceMethod("buildWithOggFileAsync", &StreamEncoderBuilder::buildWithOggFileAsync),
+        InstanceMethod("buildWithDrainAsync", &StreamEncoderBuilder::buildWithDrainAsync),
+        InstanceMethod("buildWithOggDrainAsync", &StreamEncoderBuilder::buildWithOggDrainAsync),
+        InstanceMethod("buildFromWavFileAsync", &StreamEncoderBuilder::buildFromWavFileAsync),
       });
 
     constructor.Freeze();
@@ -561,6 +566,70 @@ namespace flac_bindings {
     return scope.Escape(work->getPromise());
   }
 
+  Napi::Value StreamEncoderBuilder::buildWithDrainAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkIfBuilt(info.Env());
+
+    auto bufferSize = maybeNumberFromJs<size_t>(info[1]).value_or(defaultDrainBufferSize);
+    if (bufferSize == 0) {
+      throw RangeError::New(info.Env(), "Output buffer size must be greater than 0");
+    }
+
+    auto ctx = std::make_shared<EncoderWorkContext>(enc, EncoderWorkContext::ExecutionMode::Async);
+    ctx->output = std::make_shared<EncoderOutput>(bufferSize);
+    maybeFunctionIntoRef(ctx->metadataCbk, info[0]);
+
+    AsyncEncoderWork* work = AsyncEncoderWork::forInitStream({info.This()}, ctx, *this);
+    workInProgress = true;
+    ctx->workInProgress = true;
+    work->Queue();
+    return scope.Escape(work->getPromise());
+  }
+
+  Napi::Value StreamEncoderBuilder::buildWithOggDrainAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkIfBuilt(info.Env());
+
+    auto bufferSize = maybeNumberFromJs<size_t>(info[1]).value_or(defaultDrainBufferSize);
+    if (bufferSize == 0) {
+      throw RangeError::New(info.Env(), "Output buffer size must be greater than 0");
+    }
+
+    auto ctx = std::make_shared<EncoderWorkContext>(enc, EncoderWorkContext::ExecutionMode::Async);
+    ctx->output = std::make_shared<EncoderOutput>(bufferSize);
+    maybeFunctionIntoRef(ctx->metadataCbk, info[0]);
+
+    AsyncEncoderWork* work = AsyncEncoderWork::forInitOggStream({info.This()}, ctx, *this);
+    workInProgress = true;
+    ctx->workInProgress = true;
+    work->Queue();
+    return scope.Escape(work->getPromise());
+  }
+
+  Napi::Value StreamEncoderBuilder::buildFromWavFileAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkIfBuilt(info.Env());
+
+    auto inputPath = stringFromJs(info[0]);
+    auto outputPath = stringFromJs(info[1]);
+    auto ctx = std::make_shared<EncoderWorkContext>(enc, EncoderWorkContext::ExecutionMode::Async);
+    maybeFunctionIntoRef(ctx->progressCbk, info[2]);
+
+    // the channel mask tag would replace the metadata blocks set by the user
+    auto keepChannelMask = info.This().As<Object>().Get("__metadataArrayRef").IsNull();
+    AsyncEncoderWork* work = AsyncEncoderWork::forInitFromWavFile(
+      {info.This()},
+      inputPath,
+      outputPath,
+      keepChannelMask,
+      ctx,
+      *this);
+    workInProgress = true;
+    ctx->workInProgress = true;
+    work->Queue();
+    return scope.Escape(work->getPromise());
+  }
+
   // -- helpers --
 
   Napi::Value StreamEncoderBuilder::createEncoder(
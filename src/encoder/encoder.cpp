@@ -3,6 +3,8 @@
 #include "../mappings/mappings.hpp"
 #include "../utils/defer.hpp"
 #include "../utils/encoder_decoder_utils.hpp"
+#include "../utils/sample_kernels.hpp"
+#include "../utils/stats.hpp"
 
 #define DEFER_SYNCHRONIZED(f) DEFER(runLocked([&]() { f; }));
 
@@ -77,6 +79,11 @@ namespace flac_bindings {
         InstanceMethod("finishAsync", &StreamEncoder::finishAsync),
         InstanceMethod("processAsync", &StreamEncoder::processAsync),
         InstanceMethod("processInterleavedAsync", &StreamEncoder::processInterleavedAsync),
+        InstanceMethod("processSharedInputAsync", &StreamEncoder::processSharedInputAsync),
+        InstanceMethod("processInputAsync", &StreamEncoder::processInputAsync),
+
+        InstanceMethod("drain", &StreamEncoder::drain),
+        InstanceMethod("drainAsync", &StreamEncoder::drainAsync),
       });
     c_enum::declareInObject(constructor, "State", createStateEnum);
     c_enum::declareInObject(constructor, "InitStatus", createInitStatusEnum);
@@ -296,6 +303,8 @@ namespace flac_bindings {
     auto channels = FLAC__stream_encoder_get_channels(enc);
     auto buffers = getBuffersFromArray(info[0], samples, channels);
 
+    stats::add(stats::global().encodedSamples, samples);
+    stats::ProcessTimer timer(&stats::Stats::encoderProcess);
     auto ret = FLAC__stream_encoder_process(enc, buffers.data(), samples);
     return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), ret);
   }
@@ -307,6 +316,8 @@ namespace flac_bindings {
     unsigned samples;
     int32_t* buffer = getInterleavedBufferFromArgs(info, channels, samples);
 
+    stats::add(stats::global().encodedSamples, samples);
+    stats::ProcessTimer timer(&stats::Stats::encoderProcess);
     auto ret = FLAC__stream_encoder_process_interleaved(enc, buffer, samples);
     return info.Env().IsExceptionPending() ? Napi::Value() : booleanToJs(info.Env(), ret);
   }
@@ -342,6 +353,147 @@ namespace flac_bindings {
     return enqueueWork(work);
   }
 
+  Napi::Value StreamEncoder::processSharedInputAsync(const CallbackInfo& info) {
+    checkPendingAsyncWork(info.Env(), EncoderWorkContext::ExecutionMode::Async);
+    if (!info[0].IsObject()) {
+      throw TypeError::New(info.Env(), "Expected options to be object");
+    }
+
+    auto input = std::make_shared<EncoderSharedInput>();
+    input->fromJs(info[0].As<Object>(), FLAC__stream_encoder_get_channels(enc));
+
+    AsyncEncoderWork* work =
+      AsyncEncoderWork::forProcessSharedInput({info.This(), info[0]}, input, ctx.get());
+    return enqueueWork(work);
+  }
+
+  Napi::Value StreamEncoder::processInputAsync(const CallbackInfo& info) {
+    checkPendingAsyncWork(info.Env(), EncoderWorkContext::ExecutionMode::Async);
+    if (!ctx->input) {
+      throw Error::New(info.Env(), "Encoder has not been built from a WAV or AIFF file");
+    }
+
+    AsyncEncoderWork* work = AsyncEncoderWork::forProcessInput({info.This()}, ctx.get());
+    return enqueueWork(work);
+  }
+
+  bool EncoderSharedInput::process(FLAC__StreamEncoder* enc) {
+    // big enough to not wake up too often, small enough to not wait for the ring to be full
+    constexpr uint32_t maxChunk = 4096;
+    const auto bps = FLAC__stream_encoder_get_bits_per_sample(enc);
+    if (isFloat) {
+      scratch.resize((size_t) maxChunk * channels);
+    }
+
+    uint32_t readPosition = state[ReadPosition].load(std::memory_order_relaxed);
+    while (true) {
+      uint32_t available = 0;
+      bool ended = false;
+      auto hasSamples = [&]() {
+        // flags first: if it has ended, the write position read after is the last one
+        ended = flags() & Ended;
+        available = state[WritePosition].load(std::memory_order_acquire) - readPosition;
+        return available > 0 || ended;
+      };
+      if (!wait(hasSamples)) {
+        return false;
+      }
+
+      if (available == 0) {
+        return true;
+      }
+
+      // the chunk never goes through the end of the ring, the rest is taken in the next pass
+      const uint32_t offset = readPosition & (capacity - 1);
+      const uint32_t count = std::min({available, capacity - offset, maxChunk});
+      stats::add(stats::global().encodedSamples, count);
+      stats::ProcessTimer timer(&stats::Stats::encoderProcess);
+      FLAC__bool ok;
+      if (isFloat && planar) {
+        const int32_t* buffers[FLAC__MAX_CHANNELS];
+        for (uint32_t ch = 0; ch < channels; ch += 1) {
+          auto out = scratch.data() + (size_t) ch * count;
+          samplesFromFloat(sampleAt(ch, offset), (char*) out, 4, bps, false, count);
+          buffers[ch] = out;
+        }
+        ok = FLAC__stream_encoder_process(enc, buffers, count);
+      } else if (isFloat) {
+        auto out = (char*) scratch.data();
+        samplesFromFloat(sampleAt(0, offset), out, 4, bps, false, (uint64_t) count * channels);
+        ok = FLAC__stream_encoder_process_interleaved(enc, scratch.data(), count);
+      } else if (planar) {
+        const int32_t* buffers[FLAC__MAX_CHANNELS];
+        for (uint32_t ch = 0; ch < channels; ch += 1) {
+          buffers[ch] = (const int32_t*) sampleAt(ch, offset);
+        }
+        ok = FLAC__stream_encoder_process(enc, buffers, count);
+      } else {
+        // the samples are already in the format libFLAC wants, no need to copy them
+        auto buffer = (const int32_t*) sampleAt(0, offset);
+        ok = FLAC__stream_encoder_process_interleaved(enc, buffer, count);
+      }
+
+      if (!ok) {
+        return false;
+      }
+
+      readPosition += count;
+      state[ReadPosition].store(readPosition, std::memory_order_release);
+    }
+  }
+
+  // -- drain --
+
+  Napi::Value StreamEncoder::drain(const CallbackInfo& info) {
+    return checkOutput(info.Env()).drain(info.Env());
+  }
+
+  Napi::Value StreamEncoder::drainAsync(const CallbackInfo& info) {
+    auto& output = checkOutput(info.Env());
+    if (output.hasPendingDrain()) {
+      throw Error::New(info.Env(), "There is a pending drainAsync call, wait until is resolved");
+    }
+
+    auto deferred = Promise::Deferred::New(info.Env());
+    output.pendingDeferred = deferred;
+    // ask for data before checking: if the encoder writes in between, it will notify anyway
+    output.dataWanted = true;
+    output.resolvePending();
+    return deferred.Promise();
+  }
+
+  EncoderOutput& StreamEncoder::checkOutput(const Napi::Env& env) {
+    if (ctx == nullptr || !ctx->output) {
+      throw Error::New(env, "Encoder has not been built using drain");
+    }
+
+    return *ctx->output;
+  }
+
+  Napi::Value EncoderOutput::drain(const Napi::Env& env) {
+    // if closed, nothing else will be written, so the size read after is the final one
+    auto closed = ring.isClosed();
+    auto size = ring.size();
+    if (size == 0) {
+      return closed ? env.Null() : Buffer<uint8_t>::New(env, 0);
+    }
+
+    auto buffer = Buffer<uint8_t>::New(env, size);
+    ring.read(buffer.Data(), size);
+    return buffer;
+  }
+
+  void EncoderOutput::resolvePending() {
+    if (!hasPendingDrain() || (ring.size() == 0 && !ring.isClosed())) {
+      return;
+    }
+
+    dataWanted = false;
+    auto deferred = pendingDeferred.value();
+    pendingDeferred.reset();
+    deferred.Resolve(drain(deferred.Env()));
+  }
+
   // -- enums --
 
   c_enum::DefineReturnType StreamEncoder::createStateEnum(const Napi::Env& env) {
@@ -528,6 +680,7 @@ namespace flac_bindings {
         {jsBuffer, numberToJs(env, samples), numberToJs(env, frame)});
       generateParseNumberResult(returnValue, "Encoder:WriteCallback")(ret);
       pointer::detach(jsBuffer);
+      stats::add(stats::global().bytesWritten, bytes);
     } catch (const Error& error) {
       pointer::detach(jsBuffer);
       error.ThrowAsJavaScriptException();
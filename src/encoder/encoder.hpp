@@ -4,8 +4,12 @@
 #include "../utils/async.hpp"
 #include "../utils/converters.hpp"
 #include "../utils/enum.hpp"
+#include "../utils/pcm_file.hpp"
 #include "../utils/pointer.hpp"
+#include "../utils/ring_buffer.hpp"
+#include "../utils/shared_ring.hpp"
 #include <FLAC/stream_encoder.h>
+#include <optional>
 #include <variant>
 
 namespace flac_bindings {
@@ -68,11 +72,50 @@ namespace flac_bindings {
           totalFramesEstimate(totalFramesEstimate) {}
     };
 
-    std::variant<Read, Write, Seek, Tell, Metadata, Progress> data;
+    struct OutputAvailable {};
+
+    typedef std::variant<Read, Write, Seek, Tell, Metadata, Progress, OutputAvailable> DataType;
+
+    DataType data;
 
     EncoderWorkRequest(const EncoderWorkRequest& other): data(other.data) {}
-    EncoderWorkRequest(const std::variant<Read, Write, Seek, Tell, Metadata, Progress>& data):
-        data(data) {}
+    EncoderWorkRequest(const DataType& data): data(data) {}
+  };
+
+  /**
+   * Output of an encoder built with drain: the encoder thread writes the encoded bytes into the
+   * ring, and JS takes them out in bulk. The write callback only waits when the ring is full.
+   */
+  struct EncoderOutput {
+    SpscRingBuffer ring;
+    // set from JS when it is waiting for data, and then the encoder thread tells JS when it has
+    // written something (or when the ring has been closed)
+    std::atomic_bool dataWanted = false;
+    std::optional<Promise::Deferred> pendingDeferred;
+    // while initializing, JS has no way to drain the ring yet, so it grows instead of blocking
+    // (only touched from the encoder thread)
+    bool growable = true;
+
+    EncoderOutput(size_t capacity): ring(capacity) {}
+
+    inline bool hasPendingDrain() const {
+      return pendingDeferred.has_value();
+    }
+
+    Napi::Value drain(const Napi::Env& env);
+    void resolvePending();
+  };
+
+  /**
+   * Input of an encoder in a SharedArrayBuffer ring: the encoder thread takes the samples that a
+   * JS thread has written, until the producer sets the Ended flag and the ring is empty.
+   */
+  struct EncoderSharedInput: SharedSampleRing {
+    // float samples are converted here before giving them to the encoder
+    std::vector<int32_t> scratch;
+
+    /** Encodes everything until the end, returns false if cancelled or the encoder failed. */
+    bool process(FLAC__StreamEncoder* enc);
   };
 
   typedef AsyncBackgroundTask<int, EncoderWorkRequest> AsyncEncoderWorkBase;
@@ -81,6 +124,12 @@ namespace flac_bindings {
     FunctionReference readCbk, writeCbk, seekCbk, tellCbk, metadataCbk, progressCbk;
     std::atomic_bool workInProgress = false;
     AsyncEncoderWorkBase::ExecutionProgress* asyncExecutionProgress = nullptr;
+    std::shared_ptr<EncoderOutput> output;
+    // samples source when built from a WAV or AIFF file, and why it could not be opened
+    std::shared_ptr<PcmFileReader> input;
+    std::string inputError;
+    // metadata created natively, must live as long as the encoder
+    std::shared_ptr<FLAC__StreamMetadata> ownedMetadata;
     FLAC__StreamEncoder* enc;
     enum ExecutionMode {
       Sync,
@@ -175,6 +224,9 @@ namespace flac_bindings {
     Napi::Value buildWithOggStreamAsync(const CallbackInfo&);
     Napi::Value buildWithFileAsync(const CallbackInfo&);
     Napi::Value buildWithOggFileAsync(const CallbackInfo&);
+    Napi::Value buildWithDrainAsync(const CallbackInfo&);
+    Napi::Value buildWithOggDrainAsync(const CallbackInfo&);
+    Napi::Value buildFromWavFileAsync(const CallbackInfo&);
 
     Napi::Value createEncoder(Napi::Env, Napi::Value, std::shared_ptr<EncoderWorkContext>);
     void checkInitStatus(Napi::Env env, FLAC__StreamEncoderInitStatus status);
@@ -224,6 +276,12 @@ namespace flac_bindings {
     Napi::Value finishAsync(const CallbackInfo&);
     Napi::Value processAsync(const CallbackInfo&);
     Napi::Value processInterleavedAsync(const CallbackInfo&);
+    Napi::Value processSharedInputAsync(const CallbackInfo&);
+    Napi::Value processInputAsync(const CallbackInfo&);
+
+    Napi::Value drain(const CallbackInfo&);
+    Napi::Value drainAsync(const CallbackInfo&);
+    EncoderOutput& checkOutput(const Napi::Env&);
 
     inline void checkPendingAsyncWork(
       const Napi::Env& env,
@@ -280,6 +338,32 @@ namespace flac_bindings {
     ~StreamEncoder();
   };
 
+  struct ParallelEncoderContext;
+
+  /**
+   * Encoder that splits the audio into segments of whole frames and encodes each one in its own
+   * thread, with its own libFLAC encoder. The frames are renumbered and written in order into a
+   * file, and the STREAMINFO (with the MD5 of the whole audio) and SEEKTABLE are written at the
+   * end.
+   */
+  class ParallelEncoder: public ObjectWrap<ParallelEncoder> {
+    Napi::Value getThreads(const CallbackInfo&);
+    Napi::Value getBlocksize(const CallbackInfo&);
+
+    Napi::Value processInterleavedAsync(const CallbackInfo&);
+    Napi::Value finishAsync(const CallbackInfo&);
+
+    void checkPendingAsyncWork(const Napi::Env&);
+
+    std::shared_ptr<ParallelEncoderContext> ctx;
+
+  public:
+    static Function init(Napi::Env env, FlacAddon& addon);
+
+    ParallelEncoder(const CallbackInfo&);
+    ~ParallelEncoder();
+  };
+
   class AsyncEncoderWork: public AsyncEncoderWorkBase {
 
     typedef std::initializer_list<Napi::Value> StoreList;
@@ -313,6 +397,14 @@ namespace flac_bindings {
     static void metadataCallback(const FLAC__StreamEncoder*, const FLAC__StreamMetadata*, void*);
     static void
       progressCallback(const FLAC__StreamEncoder*, uint64_t, uint64_t, unsigned, unsigned, void*);
+    static FLAC__StreamEncoderWriteStatus outputWriteCallback(
+      const FLAC__StreamEncoder*,
+      const FLAC__byte[],
+      size_t,
+      unsigned,
+      unsigned,
+      void*);
+    static void notifyOutputReader(EncoderWorkContext*);
 
     pointer::BufferReference<FLAC__byte> sharedBufferRef;
 
@@ -328,6 +420,11 @@ namespace flac_bindings {
       int32_t* buffer,
       uint64_t samples,
       EncoderWorkContext* ctx);
+    static AsyncEncoderWork* forProcessSharedInput(
+      const StoreList&,
+      std::shared_ptr<EncoderSharedInput> input,
+      EncoderWorkContext* ctx);
+    static AsyncEncoderWork* forProcessInput(const StoreList&, EncoderWorkContext* ctx);
     static AsyncEncoderWork* forInitStream(
       const StoreList&,
       std::shared_ptr<EncoderWorkContext> ctx,
@@ -346,6 +443,13 @@ namespace flac_bindings {
       const std::string& path,
       std::shared_ptr<EncoderWorkContext> ctx,
       StreamEncoderBuilder&);
+    static AsyncEncoderWork* forInitFromWavFile(
+      const StoreList&,
+      const std::string& inputPath,
+      const std::string& outputPath,
+      bool keepChannelMask,
+      std::shared_ptr<EncoderWorkContext> ctx,
+      StreamEncoderBuilder&);
   };
 
 }
@@ -0,0 +1,647 @@
+#include "../flac_addon.hpp"
+#include "../utils/defer.hpp"
+#include "../utils/frame_utils.hpp"
+#include "../utils/md5.hpp"
+#include "../utils/sample_kernels.hpp"
+#include "../utils/stats.hpp"
+#include "encoder.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace flac_bindings {
+
+  using namespace Napi;
+
+  struct ParallelEncoderConfig {
+    unsigned channels;
+    unsigned bitsPerSample;
+    unsigned sampleRate;
+    unsigned compressionLevel;
+    unsigned blocksize;
+    unsigned threads;
+    // always a multiple of the blocksize, so every segment (but the last) has only full frames
+    uint64_t segmentSamples;
+    uint64_t seekPointSpacing;
+    // space reserved in the SEEKTABLE, the unused points are written as placeholders
+    uint64_t seekPoints;
+
+    inline uint64_t headerSize() const {
+      return 4 + 4 + FLAC__STREAM_METADATA_STREAMINFO_LENGTH
+             + (seekPoints > 0 ? 4 + seekPoints * FLAC__STREAM_METADATA_SEEKPOINT_LENGTH : 0);
+    }
+  };
+
+  struct ParallelEncoderSegment {
+    uint64_t index;
+    uint64_t firstFrame;
+    uint64_t samples = 0;
+    std::unique_ptr<int32_t[]> pcm;
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> frameSizes;
+    std::string error;
+  };
+
+  static void configureEncoder(FLAC__StreamEncoder* enc, const ParallelEncoderConfig& config) {
+    FLAC__stream_encoder_set_channels(enc, config.channels);
+    FLAC__stream_encoder_set_bits_per_sample(enc, config.bitsPerSample);
+    FLAC__stream_encoder_set_sample_rate(enc, config.sampleRate);
+    FLAC__stream_encoder_set_compression_level(enc, config.compressionLevel);
+    if (config.blocksize > 0) {
+      FLAC__stream_encoder_set_blocksize(enc, config.blocksize);
+    }
+    // the MD5 of each segment is useless, it is computed for the whole stream while writing
+    FLAC__stream_encoder_set_do_md5(enc, false);
+  }
+
+  static FLAC__StreamEncoderWriteStatus segmentWriteCallback(
+    const FLAC__StreamEncoder*,
+    const FLAC__byte buffer[],
+    size_t bytes,
+    unsigned samples,
+    unsigned currentFrame,
+    void* ptr) {
+    // the stream marker and STREAMINFO, which are written for the whole stream at the end
+    if (samples == 0) {
+      return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    }
+
+    auto segment = (ParallelEncoderSegment*) ptr;
+    const auto before = segment->data.size();
+    if (segment->firstFrame == 0) {
+      segment->data.insert(segment->data.end(), buffer, buffer + bytes);
+    } else if (!appendRenumberedFrame(
+                 segment->data,
+                 buffer,
+                 bytes,
+                 segment->firstFrame + currentFrame)) {
+      segment->error = "Encoder generated an invalid frame";
+      return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    }
+
+    segment->frameSizes.push_back(segment->data.size() - before);
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+  }
+
+  static FLAC__StreamEncoderWriteStatus discardWriteCallback(
+    const FLAC__StreamEncoder*,
+    const FLAC__byte[],
+    size_t,
+    unsigned,
+    unsigned,
+    void*) {
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+  }
+
+  static void encodeSegment(const ParallelEncoderConfig& config, ParallelEncoderSegment& segment) {
+    auto enc = FLAC__stream_encoder_new();
+    if (enc == nullptr) {
+      segment.error = "Could not allocate memory";
+      return;
+    }
+
+    DEFER(FLAC__stream_encoder_delete(enc));
+    configureEncoder(enc, config);
+    FLAC__stream_encoder_set_total_samples_estimate(enc, segment.samples);
+    auto status = FLAC__stream_encoder_init_stream(
+      enc,
+      segmentWriteCallback,
+      nullptr,
+      nullptr,
+      nullptr,
+      &segment);
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+      segment.error =
+        "Encoder initialization failed: "s + FLAC__StreamEncoderInitStatusString[status];
+      return;
+    }
+
+    stats::add(stats::global().encodedSamples, segment.samples);
+    FLAC__bool ok;
+    {
+      stats::ProcessTimer timer(&stats::Stats::encoderProcess);
+      ok = FLAC__stream_encoder_process_interleaved(enc, segment.pcm.get(), segment.samples);
+    }
+
+    ok = FLAC__stream_encoder_finish(enc) && ok;
+    if (!ok && segment.error.empty()) {
+      segment.error = "Encoding failed: "s + FLAC__stream_encoder_get_resolved_state_string(enc);
+    }
+  }
+
+  struct ParallelEncoderContext {
+    ParallelEncoderConfig config;
+    std::string path;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<ParallelEncoderSegment>> queue;
+    // encoded segments waiting for the previous ones to be written
+    std::map<uint64_t, std::shared_ptr<ParallelEncoderSegment>> encoded;
+    uint64_t nextSegmentToWrite = 0;
+    uint64_t segmentsInFlight = 0;
+    bool writing = false;
+    bool stopping = false;
+    std::string error;
+    std::vector<std::thread> workers;
+
+    // only touched by the thread that is writing, or once all workers have stopped
+    FILE* file = nullptr;
+    Md5 md5;
+    uint64_t totalSamples = 0;
+    uint64_t framesBytes = 0;
+    uint32_t minFrameSize = UINT32_MAX;
+    uint32_t maxFrameSize = 0;
+    std::vector<uint64_t> frameOffsets;
+
+    // only touched from the async tasks, which run one at a time
+    std::shared_ptr<ParallelEncoderSegment> current;
+    uint64_t nextSegmentIndex = 0;
+    std::atomic_bool workInProgress = false;
+    bool finished = false;
+
+    ~ParallelEncoderContext() {
+      stop();
+      if (file != nullptr) {
+        fclose(file);
+      }
+    }
+
+    std::string getError() {
+      std::lock_guard<std::mutex> lg(mutex);
+      return error;
+    }
+
+    void setError(const std::string& message) {
+      std::lock_guard<std::mutex> lg(mutex);
+      if (error.empty()) {
+        error = message;
+      }
+      cond.notify_all();
+    }
+
+    bool openFile() {
+      if (file != nullptr) {
+        return true;
+      }
+
+      file = fopen(path.c_str(), "wb");
+      if (file == nullptr) {
+        setError("Could not open file "s + path + ": "s + strerror(errno));
+        return false;
+      }
+
+      // the header is written at the end, when everything is known
+      std::vector<uint8_t> placeholder(config.headerSize(), 0);
+      return writeFile(placeholder.data(), placeholder.size());
+    }
+
+    bool writeFile(const void* data, size_t size) {
+      if (fwrite(data, 1, size, file) != size) {
+        setError("Could not write to file "s + path + ": "s + strerror(errno));
+        return false;
+      }
+
+      return true;
+    }
+
+    void startWorkers() {
+      for (unsigned i = 0; i < config.threads; i += 1) {
+        workers.emplace_back([this]() { workerLoop(); });
+      }
+    }
+
+    void stop() {
+      {
+        std::lock_guard<std::mutex> lg(mutex);
+        stopping = true;
+      }
+
+      cond.notify_all();
+      for (auto& worker: workers) {
+        worker.join();
+      }
+      workers.clear();
+    }
+
+    void workerLoop() {
+      while (true) {
+        std::shared_ptr<ParallelEncoderSegment> segment;
+        {
+          std::unique_lock<std::mutex> ul(mutex);
+          cond.wait(ul, [this]() { return stopping || !queue.empty(); });
+          if (stopping) {
+            return;
+          }
+
+          segment = queue.front();
+          queue.pop_front();
+        }
+
+        encodeSegment(config, *segment);
+        segmentEncoded(segment);
+      }
+    }
+
+    /**
+     * Stores the encoded segment, and writes all the segments that are in order if nobody else
+     * is doing it. The MD5 is computed while writing, so it also sees the samples in order.
+     */
+    void segmentEncoded(const std::shared_ptr<ParallelEncoderSegment>& segment) {
+      std::unique_lock<std::mutex> ul(mutex);
+      if (!segment->error.empty() && error.empty()) {
+        error = segment->error;
+      }
+
+      encoded[segment->index] = segment;
+      if (writing) {
+        return;
+      }
+
+      writing = true;
+      while (error.empty()) {
+        auto it = encoded.find(nextSegmentToWrite);
+        if (it == encoded.end()) {
+          break;
+        }
+
+        auto next = it->second;
+        encoded.erase(it);
+        ul.unlock();
+        writeSegment(*next);
+        ul.lock();
+        nextSegmentToWrite += 1;
+        segmentsInFlight -= 1;
+        cond.notify_all();
+      }
+
+      writing = false;
+      cond.notify_all();
+    }
+
+    void writeSegment(ParallelEncoderSegment& segment) {
+      if (!writeFile(segment.data.data(), segment.data.size())) {
+        return;
+      }
+
+      for (auto size: segment.frameSizes) {
+        frameOffsets.push_back(framesBytes);
+        framesBytes += size;
+        minFrameSize = std::min(minFrameSize, size);
+        maxFrameSize = std::max(maxFrameSize, size);
+      }
+
+      // libFLAC signs the samples using the least amount of bytes that hold them
+      const auto pcm = (const char*) segment.pcm.get();
+      const auto count = segment.samples * config.channels;
+      const uint64_t bps = (config.bitsPerSample + 7) / 8;
+      if (bps == 4) {
+        md5.update(pcm, count * 4);
+      } else {
+        char tmp[4096 * 4];
+        for (uint64_t offset = 0; offset < count; offset += 4096) {
+          auto n = std::min<uint64_t>(4096, count - offset);
+          convertSamples(pcm + offset * 4, 4, tmp, bps, n);
+          md5.update(tmp, n * bps);
+        }
+      }
+
+      totalSamples += segment.samples;
+      segment.pcm.reset();
+      segment.data = std::vector<uint8_t>();
+    }
+
+    bool submit(const std::shared_ptr<ParallelEncoderSegment>& segment) {
+      if (workers.empty()) {
+        startWorkers();
+      }
+
+      std::unique_lock<std::mutex> ul(mutex);
+      // limits the memory used when the input is faster than the encoders
+      cond.wait(ul, [this]() {
+        return segmentsInFlight < config.threads * 2 || !error.empty();
+      });
+      if (!error.empty()) {
+        return false;
+      }
+
+      segmentsInFlight += 1;
+      queue.push_back(segment);
+      cond.notify_all();
+      return true;
+    }
+
+    bool append(const int32_t* buffer, uint64_t samples) {
+      if (!openFile()) {
+        return false;
+      }
+
+      const auto channels = config.channels;
+      while (samples > 0) {
+        if (!current) {
+          current = std::make_shared<ParallelEncoderSegment>();
+          current->index = nextSegmentIndex;
+          current->firstFrame = nextSegmentIndex * config.segmentSamples / config.blocksize;
+          current->pcm.reset(new int32_t[config.segmentSamples * channels]);
+          nextSegmentIndex += 1;
+        }
+
+        auto count = std::min(samples, config.segmentSamples - current->samples);
+        memcpy(
+          current->pcm.get() + current->samples * channels,
+          buffer,
+          count * channels * sizeof(int32_t));
+        current->samples += count;
+        buffer += count * channels;
+        samples -= count;
+
+        if (current->samples == config.segmentSamples) {
+          auto segment = std::move(current);
+          if (!submit(segment)) {
+            return false;
+          }
+        }
+      }
+
+      return getError().empty();
+    }
+
+    bool finish() {
+      if (!openFile()) {
+        return false;
+      }
+
+      if (current) {
+        auto segment = std::move(current);
+        if (!submit(segment)) {
+          stop();
+          return false;
+        }
+      }
+
+      {
+        std::unique_lock<std::mutex> ul(mutex);
+        cond.wait(ul, [this]() { return segmentsInFlight == 0 || !error.empty(); });
+      }
+
+      stop();
+      if (!getError().empty() || !writeHeader()) {
+        return false;
+      }
+
+      auto closed = fclose(file) == 0;
+      file = nullptr;
+      if (!closed) {
+        setError("Could not write to file "s + path + ": "s + strerror(errno));
+      }
+
+      return closed;
+    }
+
+    bool writeHeader() {
+      std::vector<uint8_t> header;
+      auto put = [&header](uint64_t value, unsigned bytes) {
+        for (unsigned i = bytes; i > 0; i -= 1) {
+          header.push_back(uint8_t(value >> ((i - 1) * 8)));
+        }
+      };
+
+      header.insert(header.end(), {'f', 'L', 'a', 'C'});
+      put(config.seekPoints > 0 ? 0 : 0x80, 1);
+      put(FLAC__STREAM_METADATA_STREAMINFO_LENGTH, 3);
+      put(config.blocksize, 2);
+      put(config.blocksize, 2);
+      put(frameOffsets.empty() ? 0 : minFrameSize, 3);
+      put(maxFrameSize, 3);
+      // like libFLAC, a length that does not fit in 36 bits is written as unknown
+      const uint64_t storedTotalSamples =
+        totalSamples < (uint64_t(1) << FLAC__STREAM_METADATA_STREAMINFO_TOTAL_SAMPLES_LEN)
+        ? totalSamples
+        : 0;
+      put(
+        (uint64_t(config.sampleRate) << 44) | (uint64_t(config.channels - 1) << 41)
+          | (uint64_t(config.bitsPerSample - 1) << 36) | storedTotalSamples,
+        8);
+      uint8_t digest[16];
+      md5.finish(digest);
+      header.insert(header.end(), digest, digest + 16);
+
+      if (config.seekPoints > 0) {
+        put(0x80 | FLAC__METADATA_TYPE_SEEKTABLE, 1);
+        put(config.seekPoints * FLAC__STREAM_METADATA_SEEKPOINT_LENGTH, 3);
+
+        std::vector<uint64_t> frames;
+        for (uint64_t sample = 0; sample < totalSamples; sample += config.seekPointSpacing) {
+          auto frame = sample / config.blocksize;
+          if (frames.empty() || frames.back() != frame) {
+            frames.push_back(frame);
+          }
+        }
+
+        // if there is no space for all of them, keep them evenly distributed
+        const auto step = (frames.size() + config.seekPoints - 1) / config.seekPoints;
+        uint64_t points = 0;
+        for (uint64_t i = 0; i < frames.size(); i += std::max<uint64_t>(step, 1)) {
+          auto sample = frames[i] * config.blocksize;
+          put(sample, 8);
+          put(frameOffsets[frames[i]], 8);
+          put(std::min<uint64_t>(config.blocksize, totalSamples - sample), 2);
+          points += 1;
+        }
+
+        for (; points < config.seekPoints; points += 1) {
+          put(FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER, 8);
+          put(0, 8);
+          put(0, 2);
+        }
+      }
+
+      if (fseek(file, 0, SEEK_SET) != 0) {
+        setError("Could not seek in file "s + path + ": "s + strerror(errno));
+        return false;
+      }
+
+      return writeFile(header.data(), header.size());
+    }
+  };
+
+  // -- JS --
+
+  Function ParallelEncoder::init(Napi::Env env, FlacAddon& addon) {
+    EscapableHandleScope scope(env);
+
+    auto attrs = napi_property_attributes::napi_enumerable;
+    auto constructor = DefineClass(
+      env,
+      "ParallelEncoder",
+      {
+        InstanceAccessor("threads", &ParallelEncoder::getThreads, nullptr, attrs),
+        InstanceAccessor("blocksize", &ParallelEncoder::getBlocksize, nullptr, attrs),
+        InstanceMethod("processInterleavedAsync", &ParallelEncoder::processInterleavedAsync),
+        InstanceMethod("finishAsync", &ParallelEncoder::finishAsync),
+      });
+
+    constructor.Freeze();
+    addon.parallelEncoderConstructor = Persistent(constructor);
+
+    return scope.Escape(constructor).As<Function>();
+  }
+
+  ParallelEncoder::ParallelEncoder(const CallbackInfo& info): ObjectWrap<ParallelEncoder>(info) {
+    ctx = std::make_shared<ParallelEncoderContext>();
+    ctx->path = stringFromJs(info[0]);
+    if (!info[1].IsObject()) {
+      throw TypeError::New(info.Env(), "Expected second argument to be object");
+    }
+
+    auto obj = info[1].As<Object>();
+    auto& config = ctx->config;
+    config.channels = maybeNumberFromJs<unsigned>(obj.Get("channels")).value_or(2);
+    config.bitsPerSample = maybeNumberFromJs<unsigned>(obj.Get("bitsPerSample")).value_or(16);
+    config.sampleRate = maybeNumberFromJs<unsigned>(obj.Get("sampleRate")).value_or(44100);
+    config.compressionLevel =
+      maybeNumberFromJs<unsigned>(obj.Get("compressionLevel")).value_or(5);
+    config.blocksize = maybeNumberFromJs<unsigned>(obj.Get("blocksize")).value_or(0);
+    config.threads = maybeNumberFromJs<unsigned>(obj.Get("threads"))
+                       .value_or(std::max(std::thread::hardware_concurrency(), 1u));
+    if (config.threads == 0) {
+      throw RangeError::New(info.Env(), "Number of threads must be greater than 0");
+    }
+
+    // checks the configuration now instead of failing in the first segment
+    auto enc = FLAC__stream_encoder_new();
+    if (enc == nullptr) {
+      throw Error::New(info.Env(), "Could not allocate memory");
+    }
+
+    DEFER(FLAC__stream_encoder_delete(enc));
+    configureEncoder(enc, config);
+    auto status = FLAC__stream_encoder_init_stream(
+      enc,
+      discardWriteCallback,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr);
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+      throw Error::New(
+        info.Env(),
+        "Encoder initialization failed: "s + FLAC__StreamEncoderInitStatusString[status]);
+    }
+
+    // the compression level chooses one if not set
+    config.blocksize = FLAC__stream_encoder_get_blocksize(enc);
+
+    auto segmentSamples =
+      maybeNumberFromJs<uint64_t>(obj.Get("segmentSamples")).value_or(config.blocksize * 64);
+    config.segmentSamples =
+      std::max<uint64_t>(1, (segmentSamples + config.blocksize - 1) / config.blocksize)
+      * config.blocksize;
+
+    config.seekPointSpacing = maybeNumberFromJs<uint64_t>(obj.Get("seekPointSpacing"))
+                                .value_or(uint64_t(config.sampleRate) * 10);
+    if (config.seekPointSpacing > 0) {
+      // without an estimate, reserves space for an hour of audio
+      auto totalSamplesEstimate = maybeNumberFromJs<uint64_t>(obj.Get("totalSamplesEstimate"))
+                                    .value_or(uint64_t(config.sampleRate) * 3600);
+      auto seekPoints =
+        (totalSamplesEstimate + config.seekPointSpacing - 1) / config.seekPointSpacing;
+      // the length of a metadata block must fit in 24 bits
+      config.seekPoints = std::clamp<uint64_t>(seekPoints, 1, 65536);
+    } else {
+      config.seekPoints = 0;
+    }
+  }
+
+  ParallelEncoder::~ParallelEncoder() {}
+
+  Napi::Value ParallelEncoder::getThreads(const CallbackInfo& info) {
+    return numberToJs(info.Env(), ctx->config.threads);
+  }
+
+  Napi::Value ParallelEncoder::getBlocksize(const CallbackInfo& info) {
+    return numberToJs(info.Env(), ctx->config.blocksize);
+  }
+
+  void ParallelEncoder::checkPendingAsyncWork(const Napi::Env& env) {
+    if (ctx->workInProgress) {
+      throw Error::New(env, "There is still an operation running on this object");
+    }
+
+    if (ctx->finished) {
+      throw Error::New(env, "Encoder has already been finished");
+    }
+  }
+
+  Napi::Value ParallelEncoder::processInterleavedAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkPendingAsyncWork(info.Env());
+
+    const auto channels = ctx->config.channels;
+    int32_t* buffer;
+    size_t size;
+    std::tie(buffer, size) = pointer::fromBuffer<int32_t>(info[0]);
+    uint64_t samples = maybeNumberFromJs<uint64_t>(info[1]).value_or(size / channels);
+    if (size < samples * channels) {
+      throw RangeError::New(
+        info.Env(),
+        "Buffer has not enough bytes: expected "s
+          + std::to_string(samples * channels * sizeof(int32_t)) + " bytes but got "s
+          + std::to_string(size * sizeof(int32_t)) + " bytes"s);
+    }
+
+    auto ctx = this->ctx;
+    ctx->workInProgress = true;
+    auto worker = new AsyncBackgroundTask<bool>(
+      info.Env(),
+      [ctx, buffer, samples](auto& c) {
+        DEFER(ctx->workInProgress = false);
+        if (ctx->append(buffer, samples)) {
+          c.resolve(true);
+        } else {
+          c.reject(ctx->getError());
+        }
+      },
+      nullptr,
+      "flac_bindings::ParallelEncoder::processInterleavedAsync",
+      [](auto env, auto value) { return booleanToJs(env, value); });
+    // keeps the buffer alive while it is being copied
+    worker->Receiver().Set("this", info.This());
+    worker->Receiver().Set("buffer", info[0]);
+    worker->Queue();
+    return scope.Escape(worker->getPromise());
+  }
+
+  Napi::Value ParallelEncoder::finishAsync(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    checkPendingAsyncWork(info.Env());
+
+    auto ctx = this->ctx;
+    ctx->workInProgress = true;
+    ctx->finished = true;
+    auto worker = new AsyncBackgroundTask<bool>(
+      info.Env(),
+      [ctx](auto& c) {
+        DEFER(ctx->workInProgress = false);
+        if (ctx->finish()) {
+          c.resolve(true);
+        } else {
+          c.reject(ctx->getError());
+        }
+      },
+      nullptr,
+      "flac_bindings::ParallelEncoder::finishAsync",
+      [](auto env, auto value) { return booleanToJs(env, value); });
+    worker->Receiver().Set("this", info.This());
+    worker->Queue();
+    return scope.Escape(worker->getPromise());
+  }
+
+}
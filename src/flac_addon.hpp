@@ -1,6 +1,8 @@
 #pragma once
 
 #include <napi.h>
+#include <typeindex>
+#include <unordered_map>
 
 namespace flac_bindings {
 
@@ -13,6 +15,7 @@ namespace flac_bindings {
     Napi::FunctionReference decoderConstructor;
     Napi::FunctionReference encoderBuilderConstructor;
     Napi::FunctionReference encoderConstructor;
+    Napi::FunctionReference parallelEncoderConstructor;
     Napi::FunctionReference streamInfoMetadataConstructor;
     Napi::FunctionReference paddingMetadataConstructor;
     Napi::FunctionReference applicationMetadataConstructor;
@@ -28,6 +31,8 @@ namespace flac_bindings {
     Napi::FunctionReference chainConstructor;
     Napi::FunctionReference iteratorConstructor;
     Napi::FunctionReference nativeIteratorConstructor;
+    // one per type of NativeAsyncIterator, created the first time one is used
+    std::unordered_map<std::type_index, Napi::FunctionReference> nativeAsyncIteratorConstructors;
   };
 
 }
@@ -10,12 +10,18 @@ namespace flac_bindings {
   using namespace Napi;
 
   extern Promise testAsync(const CallbackInfo& info);
+  extern Promise decodeFile(const CallbackInfo& info);
+  extern Promise parallelDecodeFile(const CallbackInfo& info);
+  extern Promise transcode(const CallbackInfo& info);
+  extern Promise buildSeekTable(const CallbackInfo& info);
+  extern Value configure(const CallbackInfo& info);
   extern Object initFormat(const Env& env);
   extern Object initMetadata0(const Env& env);
   extern Function initMetadata1(Env env, FlacAddon&);
   extern Value initMetadata2Chain(Env env, FlacAddon&);
   extern Value initMetadata2Iterator(Env env, FlacAddon&);
   extern Object initFns(Env env);
+  extern Object initStats(Env env);
 
   FlacAddon::FlacAddon(Env env, Object exports) {
     NativeIterator::init(env, *this);
@@ -27,6 +33,7 @@ namespace flac_bindings {
         InstanceValue("napiVersion", Number::New(env, NAPI_VERSION), napi_enumerable),
         InstanceValue("EncoderBuilder", StreamEncoderBuilder::init(env, *this), napi_enumerable),
         InstanceValue("Encoder", StreamEncoder::init(env, *this), napi_enumerable),
+        InstanceValue("ParallelEncoder", ParallelEncoder::init(env, *this), napi_enumerable),
         InstanceValue("DecoderBuilder", StreamDecoderBuilder::init(env, *this), napi_enumerable),
         InstanceValue("Decoder", StreamDecoder::init(env, *this), napi_enumerable),
         InstanceValue("format", initFormat(env), napi_enumerable),
@@ -68,6 +75,21 @@ namespace flac_bindings {
         InstanceValue("Chain", initMetadata2Chain(env, *this), napi_enumerable),
         InstanceValue("Iterator", initMetadata2Iterator(env, *this), napi_enumerable),
         InstanceValue("fns", initFns(env), napi_enumerable),
+        InstanceValue("stats", initStats(env), napi_enumerable),
+        InstanceValue(
+          "decodeFile",
+          Function::New(env, decodeFile, "decodeFile"),
+          napi_enumerable),
+        InstanceValue(
+          "parallelDecodeFile",
+          Function::New(env, parallelDecodeFile, "parallelDecodeFile"),
+          napi_enumerable),
+        InstanceValue("transcode", Function::New(env, transcode, "transcode"), napi_enumerable),
+        InstanceValue(
+          "buildSeekTable",
+          Function::New(env, buildSeekTable, "buildSeekTable"),
+          napi_enumerable),
+        InstanceValue("configure", Function::New(env, configure, "configure"), napi_enumerable),
       });
 
     exports.Freeze();
@@ -1,4 +1,5 @@
 #include "../utils/converters.hpp"
+#include "mappings.hpp"
 #include <FLAC/format.h>
 #include <numeric>
 
@@ -171,4 +172,185 @@ namespace flac_bindings {
     return scope.Escape(obj).As<Object>();
   }
 
+  Object
+    frameToJs(const Env& env, const FLAC__FrameHeader& header, const FLAC__FrameFooter& footer) {
+    EscapableHandleScope scope(env);
+    auto obj = Object::New(env);
+    auto attrs = napi_property_attributes::napi_enumerable;
+    obj.DefineProperties({
+      PropertyDescriptor::Value("header", frameHeaderToJs(env, header), attrs),
+      PropertyDescriptor::Value("footer", frameFooterToJs(env, footer), attrs),
+    });
+
+    obj.Freeze();
+    return scope.Escape(obj).As<Object>();
+  }
+
+  // -- FrameDescriptors --
+
+  static void updateHeader(const Env& env, Object obj, const FLAC__FrameHeader& header) {
+    const bool isFrameNumber =
+      header.number_type == FLAC__FrameNumberType::FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER;
+    obj.Set("blocksize", numberToJs(env, header.blocksize));
+    obj.Set("sampleRate", numberToJs(env, header.sample_rate));
+    obj.Set("channels", numberToJs(env, header.channels));
+    obj.Set("channelAssignment", numberToJs(env, header.channel_assignment));
+    obj.Set("bitsPerSample", numberToJs(env, header.bits_per_sample));
+    obj.Set("crc", numberToJs(env, header.crc));
+    obj.Set(
+      "frameNumber",
+      isFrameNumber ? numberToJs(env, header.number.frame_number) : env.Undefined());
+    obj.Set(
+      "sampleNumber",
+      isFrameNumber ? env.Undefined() : numberToJs(env, header.number.sample_number));
+  }
+
+  static void updateSharedFrame(
+    const Env& env,
+    Object frame,
+    const FLAC__FrameHeader& header,
+    const FLAC__FrameFooter& footer) {
+    updateHeader(env, frame.Get("header").As<Object>(), header);
+    frame.Get("footer").As<Object>().Set("crc", numberToJs(env, footer.crc));
+  }
+
+  static void
+    writePacked(double* out, const FLAC__FrameHeader& header, const FLAC__FrameFooter& footer) {
+    const bool isFrameNumber =
+      header.number_type == FLAC__FrameNumberType::FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER;
+    out[0] = header.blocksize;
+    out[1] = header.sample_rate;
+    out[2] = header.channels;
+    out[3] = header.channel_assignment;
+    out[4] = header.bits_per_sample;
+    out[5] = isFrameNumber ? header.number.frame_number : (double) header.number.sample_number;
+    out[6] = isFrameNumber ? 0 : 1;
+    out[7] = header.crc;
+    out[8] = footer.crc;
+  }
+
+  Object FrameDescriptors::createSharedFrame(const Env& env, bool withSubframes) {
+    EscapableHandleScope scope(env);
+    auto attrs = napi_property_attributes::napi_enumerable;
+    auto writable = static_cast<napi_property_attributes>(napi_enumerable | napi_writable);
+    auto header = Object::New(env);
+    header.DefineProperties({
+      PropertyDescriptor::Value("blocksize", env.Undefined(), writable),
+      PropertyDescriptor::Value("sampleRate", env.Undefined(), writable),
+      PropertyDescriptor::Value("channels", env.Undefined(), writable),
+      PropertyDescriptor::Value("channelAssignment", env.Undefined(), writable),
+      PropertyDescriptor::Value("bitsPerSample", env.Undefined(), writable),
+      PropertyDescriptor::Value("crc", env.Undefined(), writable),
+      PropertyDescriptor::Value("frameNumber", env.Undefined(), writable),
+      PropertyDescriptor::Value("sampleNumber", env.Undefined(), writable),
+    });
+    header.Seal();
+
+    auto footer = Object::New(env);
+    footer.DefineProperty(PropertyDescriptor::Value("crc", env.Undefined(), writable));
+    footer.Seal();
+
+    auto frame = Object::New(env);
+    frame.DefineProperties({
+      PropertyDescriptor::Value("header", header, attrs),
+      PropertyDescriptor::Value("footer", footer, attrs),
+    });
+
+    if (withSubframes) {
+      // the frame is only valid during the write callback, so the getter looks at the slot
+      frame.DefineProperty(PropertyDescriptor::Accessor(
+        env,
+        frame,
+        "subframes",
+        [slot = this->slot](const CallbackInfo& info) -> Napi::Value {
+          if (slot->frame == nullptr) {
+            throw Error::New(info.Env(), "Subframes can only be read inside the write callback");
+          }
+
+          return subframesToJs(info.Env(), slot->frame);
+        },
+        attrs));
+    }
+
+    frame.Freeze();
+    return scope.Escape(frame).As<Object>();
+  }
+
+  Napi::Value FrameDescriptors::toJs(const Env& env, const FLAC__Frame* frame) {
+    EscapableHandleScope scope(env);
+    switch (mode) {
+      case Shared: {
+        if (sharedFrame.IsEmpty()) {
+          sharedFrame = Persistent(createSharedFrame(env, true));
+        }
+
+        auto obj = sharedFrame.Value();
+        updateSharedFrame(env, obj, frame->header, frame->footer);
+        slot->frame = frame;
+        return scope.Escape(obj);
+      }
+
+      case Packed: {
+        if (packed.IsEmpty()) {
+          packed = Persistent(Float64Array::New(env, packedFields));
+        }
+
+        auto array = packed.Value();
+        writePacked(array.Data(), frame->header, frame->footer);
+        return scope.Escape(array);
+      }
+
+      default:
+        return scope.Escape(frameToJs(env, frame));
+    }
+  }
+
+  Napi::Value FrameDescriptors::toJs(
+    const Env& env,
+    const std::vector<FLAC__FrameHeader>& headers,
+    const std::vector<FLAC__FrameFooter>& footers) {
+    EscapableHandleScope scope(env);
+    const auto count = headers.size();
+    if (mode == Packed) {
+      // reuses the storage while it is big enough, and the view while the batch size is the same
+      auto array = packedBatch.IsEmpty() ? Float64Array() : packedBatch.Value();
+      if (array.IsEmpty() || array.ElementLength() != count * packedFields) {
+        auto storage = array.IsEmpty() ? ArrayBuffer() : array.ArrayBuffer();
+        if (storage.IsEmpty() || storage.ByteLength() < count * packedFields * sizeof(double)) {
+          storage = ArrayBuffer::New(env, count * packedFields * sizeof(double));
+        }
+
+        array = Float64Array::New(env, count * packedFields, storage, 0);
+        packedBatch = Persistent(array);
+      }
+
+      for (size_t i = 0; i < count; i += 1) {
+        writePacked(array.Data() + i * packedFields, headers[i], footers[i]);
+      }
+
+      return scope.Escape(array);
+    }
+
+    auto frames = Array::New(env, count);
+    for (size_t i = 0; i < count; i += 1) {
+      if (mode == Shared) {
+        if (sharedBatchFrames.size() <= i) {
+          sharedBatchFrames.push_back(Persistent(createSharedFrame(env, false)));
+        }
+
+        auto obj = sharedBatchFrames[i].Value();
+        updateSharedFrame(env, obj, headers[i], footers[i]);
+        frames[i] = obj;
+      } else {
+        frames[i] = frameToJs(env, headers[i], footers[i]);
+      }
+    }
+
+    return scope.Escape(frames);
+  }
+
+  void FrameDescriptors::release() {
+    slot->frame = nullptr;
+  }
+
 }
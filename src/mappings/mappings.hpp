@@ -10,6 +10,47 @@ namespace flac_bindings {
   using namespace Napi;
 
   Object frameToJs(const Env&, const FLAC__Frame*);
+  Object frameToJs(const Env&, const FLAC__FrameHeader&, const FLAC__FrameFooter&);
+
+  /**
+   * Builds the frames given to the write callback of a decoder. In `Full` mode every frame is a
+   * new frozen object. In `Shared` mode the same objects are updated in place, and the subframes
+   * are built only when read. In `Packed` mode the fields are written into a reused
+   * `Float64Array`, `packedFields` numbers per frame.
+   */
+  class FrameDescriptors {
+  public:
+    enum Mode {
+      Full,
+      Shared,
+      Packed,
+    };
+
+    static constexpr size_t packedFields = 9;
+
+    Mode mode = Full;
+
+    Napi::Value toJs(const Env&, const FLAC__Frame*);
+    Napi::Value toJs(
+      const Env&,
+      const std::vector<FLAC__FrameHeader>&,
+      const std::vector<FLAC__FrameFooter>&);
+    /** Must be called after the write callback, the frame is no longer valid after it. */
+    void release();
+
+  private:
+    struct Slot {
+      const FLAC__Frame* frame = nullptr;
+    };
+
+    std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+    ObjectReference sharedFrame;
+    std::vector<ObjectReference> sharedBatchFrames;
+    Reference<Float64Array> packed;
+    Reference<Float64Array> packedBatch;
+
+    Object createSharedFrame(const Env&, bool withSubframes);
+  };
 
   class FlacAddon;
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "../flac_addon.hpp"
 #include "../utils/async.hpp"
 #include "../utils/converters.hpp"
+#include <algorithm>
 #include <optional>
+#include <vector>
 
 namespace flac_bindings {
 
@@ -12,29 +15,32 @@ namespace flac_bindings {
   class NativeAsyncIterator: public ObjectWrap<NativeAsyncIterator<T>> {
   public:
     typedef std::optional<T> IterationReturnValue;
-    typedef AsyncBackgroundTask<IterationReturnValue> AsyncTask;
+    typedef AsyncBackgroundTask<std::vector<T>> AsyncTask;
     typedef std::function<IterationReturnValue(typename AsyncTask::ExecutionProgress&, uint64_t)>
       IteratorFunction;
     typedef std::function<Napi::Value(const Napi::Env&, T)> ToJsFunction;
+    typedef std::function<void(T)> DisposeFunction;
 
+    /**
+     * Creates an async iterator that gets up to `prefetch` items in each jump to the thread pool.
+     * `dispose` is called for the items that were got before the iteration failed, because they
+     * will never reach `map`.
+     */
     static Napi::Value newIterator(
       const Napi::Env& env,
       const char* name,
       const IteratorFunction& impl,
-      const ToJsFunction& map) {
+      const ToJsFunction& map,
+      uint32_t prefetch = 1,
+      const DisposeFunction& dispose = nullptr) {
       EscapableHandleScope scope(env);
 
-      Function constructor = NativeAsyncIterator::DefineClass(
-        env,
-        "NativeAsyncIterator",
-        {
-          NativeAsyncIterator::InstanceMethod("next", &NativeAsyncIterator::next),
-        });
-
-      auto obj = constructor.New({
+      auto obj = getConstructor(env).New({
         String::New(env, name),
         External<IteratorFunction>::New(env, new IteratorFunction(impl)),
         External<ToJsFunction>::New(env, new ToJsFunction(map)),
+        numberToJs(env, std::max<uint32_t>(prefetch, 1)),
+        External<DisposeFunction>::New(env, new DisposeFunction(dispose)),
       });
       return scope.Escape(obj);
     }
@@ -43,33 +49,67 @@ namespace flac_bindings {
       name = info[0].As<String>().Utf8Value();
       impl = info[1].As<External<IteratorFunction>>().Data();
       map = info[2].As<External<ToJsFunction>>().Data();
+      prefetch = numberFromJs<uint32_t>(info[3]);
+      dispose = info[4].As<External<DisposeFunction>>().Data();
     }
 
     virtual ~NativeAsyncIterator() {
       delete impl;
       delete map;
+      delete dispose;
     }
 
     Napi::Value next(const CallbackInfo& info) {
-      auto worker = new AsyncBackgroundTask<IterationReturnValue>(
+      // the items got in the previous jump are returned without going to the thread pool
+      if (hasPrefetched() || done) {
+        auto deferred = Promise::Deferred::New(info.Env());
+        deferred.Resolve(nextResult(info.Env()));
+        return deferred.Promise();
+      }
+
+      auto worker = new AsyncTask(
         info.Env(),
-        [this](auto c) { c.resolve((*impl)(c, pos)); },
+        [this](auto& c) {
+          std::vector<T> items;
+          while (items.size() < prefetch) {
+            auto value = (*impl)(c, pos + items.size());
+            if (c.isCompleted()) {
+              // rejected, so the items will not be converted to JS
+              if (value.has_value()) {
+                items.push_back(value.value());
+              }
+              if (*dispose) {
+                for (auto& item: items) {
+                  (*dispose)(item);
+                }
+              }
+              return;
+            }
+
+            if (!value.has_value()) {
+              break;
+            }
+
+            items.push_back(value.value());
+          }
+
+          c.resolve(items);
+        },
         nullptr,
         name.c_str(),
-        [this](auto env, auto value) {
-          auto returnObject = Object::New(env);
-
-          if (value.has_value()) {
-            returnObject["done"] = booleanToJs(env, false);
-            returnObject["value"] = (*map)(env, value.value());
-            pos += 1;
-          } else {
-            returnObject["done"] = booleanToJs(env, true);
+        [this](auto env, auto items) {
+          done = items.size() < prefetch;
+          auto array = Array::New(env, items.size());
+          for (size_t i = 0; i < items.size(); i += 1) {
+            array[i] = (*map)(env, items[i]);
           }
 
-          return returnObject;
+          prefetched = Persistent(array.template As<Object>());
+          prefetchedPosition = 0;
+          return nextResult(env);
         });
 
+      worker->Receiver().Set("this", info.This());
       worker->Queue();
       return worker->getPromise();
     }
@@ -78,7 +118,54 @@ namespace flac_bindings {
     std::string name;
     IteratorFunction* impl;
     ToJsFunction* map;
+    DisposeFunction* dispose;
+    uint32_t prefetch = 1;
     uint64_t pos = 0;
+    bool done = false;
+    ObjectReference prefetched;
+    uint32_t prefetchedPosition = 0;
+
+    static Function getConstructor(const Napi::Env& env) {
+      auto& constructor = env.GetInstanceData<FlacAddon>()
+                            ->nativeAsyncIteratorConstructors[std::type_index(typeid(T))];
+      if (constructor.IsEmpty()) {
+        constructor = Persistent(NativeAsyncIterator::DefineClass(
+          env,
+          "NativeAsyncIterator",
+          {
+            NativeAsyncIterator::InstanceMethod("next", &NativeAsyncIterator::next),
+            // so it can also be used directly in a for await
+            NativeAsyncIterator::InstanceMethod(
+              Napi::Symbol::WellKnown(env, "asyncIterator"),
+              &NativeAsyncIterator::self),
+          }));
+      }
+
+      return constructor.Value();
+    }
+
+    Napi::Value self(const CallbackInfo& info) {
+      return info.This();
+    }
+
+    inline bool hasPrefetched() const {
+      return !prefetched.IsEmpty() && prefetchedPosition < prefetched.Value().As<Array>().Length();
+    }
+
+    Object nextResult(const Napi::Env& env) {
+      auto returnObject = Object::New(env);
+      if (hasPrefetched()) {
+        returnObject["done"] = booleanToJs(env, false);
+        returnObject["value"] = prefetched.Value().Get(prefetchedPosition);
+        prefetchedPosition += 1;
+        pos += 1;
+      } else {
+        returnObject["done"] = booleanToJs(env, true);
+        prefetched.Reset();
+      }
+
+      return returnObject;
+    }
   };
 
 }
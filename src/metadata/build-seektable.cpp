@@ -0,0 +1,218 @@
+#include "../utils/async.hpp"
+#include "../utils/converters.hpp"
+#include "../utils/defer.hpp"
+#include "../utils/frame_index.hpp"
+#include <FLAC/metadata.h>
+#include <algorithm>
+#include <napi.h>
+
+namespace flac_bindings {
+
+  using namespace Napi;
+
+  /** Seek tables use 10 seconds between points by default, like `flac -S 10s`. */
+  static constexpr uint64_t defaultSpacingSeconds = 10;
+
+  /** Everything in here is only touched from the worker thread until the promise is resolved. */
+  struct BuildSeekTableContext {
+    std::string path;
+    uint64_t spacingSamples = 0;
+    bool preserveFileStats = false;
+
+    uint64_t frames = 0;
+    uint64_t points = 0;
+    bool rewritten = false;
+    std::string error;
+  };
+
+  static std::string chainError(FLAC__Metadata_Chain* chain) {
+    // remove prefix FLAC__METADATA_CHAIN_STATUS_
+    auto statusString = FLAC__Metadata_ChainStatusString[FLAC__metadata_chain_status(chain)] + 28;
+    return "Chain operation failed: "s + statusString;
+  }
+
+  /**
+   * Fills the seek table with a point every `spacing` samples. Each point is the frame that
+   * contains the target sample, with its offset relative to the first frame, as libFLAC would
+   * write them while encoding.
+   */
+  static bool fillSeekTable(
+    FLAC__StreamMetadata* seekTable,
+    const FrameIndex& index,
+    uint64_t totalSamples,
+    uint64_t spacing,
+    std::string& error) {
+    const uint64_t maxPoints =
+      ((1u << FLAC__STREAM_METADATA_LENGTH_LEN) - 1) / FLAC__STREAM_METADATA_SEEKPOINT_LENGTH;
+    std::vector<FLAC__StreamMetadata_SeekPoint> points;
+    points.reserve(std::min(totalSamples / spacing + 1, maxPoints));
+    for (uint64_t sample = 0; sample < totalSamples; sample += spacing) {
+      auto frame = index.find(sample);
+      if (frame == nullptr) {
+        break;
+      }
+
+      // with a spacing smaller than the blocksize, the same frame would appear several times
+      if (!points.empty() && points.back().sample_number == frame->sample) {
+        continue;
+      }
+
+      if (points.size() == maxPoints) {
+        error = "Too many seek points, use a bigger spacing";
+        return false;
+      }
+
+      points.push_back({frame->sample, frame->offset - index.firstFrameOffset(), frame->blocksize});
+    }
+
+    if (!FLAC__metadata_object_seektable_resize_points(seekTable, points.size())) {
+      error = "Could not allocate memory for the seek points";
+      return false;
+    }
+
+    std::copy(points.begin(), points.end(), seekTable->data.seek_table.points);
+    return true;
+  }
+
+  /** Replaces the SEEKTABLE of the chain, or adds it after the STREAMINFO if there is none. */
+  static bool putSeekTable(FLAC__Metadata_Chain* chain, FLAC__StreamMetadata* seekTable) {
+    auto iterator = FLAC__metadata_iterator_new();
+    if (iterator == nullptr) {
+      return false;
+    }
+
+    DEFER(FLAC__metadata_iterator_delete(iterator));
+    FLAC__metadata_iterator_init(iterator, chain);
+    do {
+      if (FLAC__metadata_iterator_get_block_type(iterator) == FLAC__METADATA_TYPE_SEEKTABLE) {
+        return FLAC__metadata_iterator_set_block(iterator, seekTable);
+      }
+    } while (FLAC__metadata_iterator_next(iterator));
+
+    FLAC__metadata_iterator_init(iterator, chain);
+    return FLAC__metadata_iterator_insert_block_after(iterator, seekTable);
+  }
+
+  static void buildSeekTableImpl(BuildSeekTableContext& ctx) {
+    auto chain = FLAC__metadata_chain_new();
+    if (chain == nullptr) {
+      ctx.error = "Could not allocate memory for the chain";
+      return;
+    }
+
+    DEFER(FLAC__metadata_chain_delete(chain));
+    if (!FLAC__metadata_chain_read(chain, ctx.path.c_str())) {
+      ctx.error = chainError(chain);
+      return;
+    }
+
+    // the file is unmapped before writing, because the chain could replace it
+    FrameIndex index;
+    {
+      auto file = MappedFile::open(ctx.path, ctx.error);
+      if (!file || !index.scan(*file, ctx.error)) {
+        return;
+      }
+    }
+
+    // the first block of a chain is always the STREAMINFO
+    auto iterator = FLAC__metadata_iterator_new();
+    if (iterator == nullptr) {
+      ctx.error = "Could not allocate memory for the iterator";
+      return;
+    }
+
+    FLAC__metadata_iterator_init(iterator, chain);
+    const auto streamInfo = FLAC__metadata_iterator_get_block(iterator)->data.stream_info;
+    FLAC__metadata_iterator_delete(iterator);
+
+    auto totalSamples = streamInfo.total_samples;
+    if (totalSamples == 0) {
+      totalSamples = index.endSample();
+    } else if (!index.isComplete()) {
+      ctx.error = "Could not read the frames until the end of the file";
+      return;
+    }
+
+    auto spacing = ctx.spacingSamples;
+    if (spacing == 0) {
+      spacing = defaultSpacingSeconds * streamInfo.sample_rate;
+      if (spacing == 0) {
+        ctx.error = "The sample rate of the file is not valid";
+        return;
+      }
+    }
+
+    auto seekTable = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE);
+    if (seekTable == nullptr) {
+      ctx.error = "Could not allocate memory for the seek table";
+      return;
+    }
+
+    if (!fillSeekTable(seekTable, index, totalSamples, spacing, ctx.error)) {
+      FLAC__metadata_object_delete(seekTable);
+      return;
+    }
+
+    ctx.frames = index.size();
+    ctx.points = seekTable->data.seek_table.num_points;
+    if (!putSeekTable(chain, seekTable)) {
+      FLAC__metadata_object_delete(seekTable);
+      ctx.error = "Could not add the seek table to the chain";
+      return;
+    }
+
+    // all the padding at the end, so it can absorb the change in size of the seek table
+    FLAC__metadata_chain_sort_padding(chain);
+    ctx.rewritten = FLAC__metadata_chain_check_if_tempfile_needed(chain, true);
+    if (!FLAC__metadata_chain_write(chain, true, ctx.preserveFileStats)) {
+      ctx.error = chainError(chain);
+    }
+  }
+
+  static Napi::Value buildSeekTableResultToJs(const Napi::Env& env, BuildSeekTableContext& ctx) {
+    auto obj = Object::New(env);
+    obj["frames"] = numberToJs(env, ctx.frames);
+    obj["points"] = numberToJs(env, ctx.points);
+    obj["rewritten"] = booleanToJs(env, ctx.rewritten);
+    return obj;
+  }
+
+  Promise buildSeekTable(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+
+    auto ctx = std::make_shared<BuildSeekTableContext>();
+    ctx->path = stringFromJs(info[0]);
+    if (info[1].IsObject()) {
+      auto obj = info[1].As<Object>();
+      auto spacingSamples = maybeNumberFromJs<uint64_t>(obj.Get("spacingSamples"));
+      if (spacingSamples && *spacingSamples == 0) {
+        throw RangeError::New(info.Env(), "spacingSamples must be greater than 0");
+      }
+
+      ctx->spacingSamples = spacingSamples.value_or(0);
+      ctx->preserveFileStats =
+        maybeBooleanFromJs<bool>(obj.Get("preserveFileStats")).value_or(false);
+    } else if (!info[1].IsUndefined() && !info[1].IsNull()) {
+      throw TypeError::New(info.Env(), "Expected second argument to be object or undefined");
+    }
+
+    auto worker = new AsyncBackgroundTask<std::shared_ptr<BuildSeekTableContext>>(
+      info.Env(),
+      [ctx](auto& c) {
+        buildSeekTableImpl(*ctx);
+        if (ctx->error.empty()) {
+          c.resolve(ctx);
+        } else {
+          c.reject(ctx->error);
+        }
+      },
+      nullptr,
+      "flac_bindings::buildSeekTable",
+      [](auto env, auto ctx) { return buildSeekTableResultToJs(env, *ctx); });
+
+    worker->Queue();
+    return scope.Escape(worker->getPromise()).As<Promise>();
+  }
+
+}
@@ -6,6 +6,8 @@ namespace flac_bindings {
 
   using namespace Napi;
 
+  extern Napi::Value scanMetadata(const CallbackInfo& info);
+
   static Value
     asyncImpl(const Env& env, const char* name, std::function<FLAC__StreamMetadata*()> impl) {
     EscapableHandleScope scope(env);
@@ -150,6 +152,7 @@ namespace flac_bindings {
       PropertyDescriptor::Function(env, metadata0, "getCuesheetAsync", &getCuesheetAsync, attrs),
       PropertyDescriptor::Function(env, metadata0, "getPicture", &getPicture, attrs),
       PropertyDescriptor::Function(env, metadata0, "getPictureAsync", &getPictureAsync, attrs),
+      PropertyDescriptor::Function(env, metadata0, "scanMetadata", &scanMetadata, attrs),
     });
 
     metadata0.Freeze();
@@ -10,6 +10,9 @@ namespace flac_bindings {
 
   using namespace Napi;
 
+  // blocks got from the file in each jump to the thread pool when iterating asynchronously
+  static constexpr uint32_t defaultAsyncIteratorPrefetch = 8;
+
   class SimpleIterator: public ObjectWrap<SimpleIterator> {
     FLAC__Metadata_SimpleIterator* it;
 
@@ -151,7 +154,7 @@ namespace flac_bindings {
       return NAI::newIterator(
         info.Env(),
         "flac_bindings::SimpleIterator::asyncIterator",
-        [this, hasRollbacked, pastEnd](auto c, auto) -> NAI::IterationReturnValue {
+        [this, hasRollbacked, pastEnd](auto& c, auto) -> NAI::IterationReturnValue {
           if (!*hasRollbacked) {
             while (FLAC__metadata_simple_iterator_prev(it))
               ;
@@ -167,11 +170,17 @@ namespace flac_bindings {
           }
 
           auto metadata = FLAC__metadata_simple_iterator_get_block(it);
-          rejectIfStatusIsNotOk<std::optional<FLAC__StreamMetadata*>>(c);
+          rejectIfStatusIsNotOk<std::vector<FLAC__StreamMetadata*>>(c);
           FLAC__metadata_simple_iterator_next(it);
           return metadata;
         },
-        [](auto env, auto* metadata) { return Metadata::toJs(env, metadata, true); });
+        [](auto env, auto* metadata) { return Metadata::toJs(env, metadata, true); },
+        maybeNumberFromJs<uint32_t>(info[0]).value_or(defaultAsyncIteratorPrefetch),
+        [](auto* metadata) {
+          if (metadata != nullptr) {
+            FLAC__metadata_object_delete(metadata);
+          }
+        });
     }
 
     Napi::Value status(const CallbackInfo& info) {
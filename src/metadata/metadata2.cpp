@@ -4,7 +4,9 @@
 #include "../mappings/native_iterator.hpp"
 #include "../utils/converters.hpp"
 #include "../utils/enum.hpp"
+#include "../utils/file_io.hpp"
 #include "../utils/pointer.hpp"
+#include <filesystem>
 
 namespace flac_bindings {
 
@@ -12,6 +14,11 @@ namespace flac_bindings {
 
   class Chain: public ObjectWrap<Chain> {
     FLAC__Metadata_Chain* chain;
+    // path of the file when it was read using mmap, libFLAC only knows about the callbacks
+    std::string mappedPath;
+    // errors from opening, mapping or renaming files outside libFLAC
+    FLAC__Metadata_ChainStatus fileStatus = FLAC__METADATA_CHAIN_STATUS_OK;
+    std::string fileError;
 
     Napi::Value simpleAsyncImpl(
       const Napi::Value& self,
@@ -32,18 +39,124 @@ namespace flac_bindings {
       return scope.Escape(worker->getPromise());
     }
 
+    FLAC__Metadata_ChainStatus takeStatus() {
+      fileError.clear();
+      if (fileStatus != FLAC__METADATA_CHAIN_STATUS_OK) {
+        auto status = fileStatus;
+        fileStatus = FLAC__METADATA_CHAIN_STATUS_OK;
+        return status;
+      }
+
+      return FLAC__metadata_chain_status(chain);
+    }
+
     void checkStatus(const Napi::Env& env, bool succeeded) {
       if (!succeeded) {
-        auto status = FLAC__metadata_chain_status(chain);
+        auto details = fileError.empty() ? ""s : " ("s + fileError + ")"s;
+        auto status = takeStatus();
         // remove prefix FLAC__METADATA_CHAIN_STATUS_
         auto statusString = FLAC__Metadata_ChainStatusString[status] + 28;
-        auto error = Error::New(env, "Chain operation failed: "s + statusString);
+        auto error = Error::New(env, "Chain operation failed: "s + statusString + details);
         error.Set("status", numberToJs(env, status));
         error.Set("statusString", String::New(env, statusString));
         throw error;
       }
     }
 
+    bool readImpl(const std::string& path, bool ogg, bool mmap) {
+      mappedPath.clear();
+      if (!mmap) {
+        return ogg ? FLAC__metadata_chain_read_ogg(chain, path.c_str())
+                   : FLAC__metadata_chain_read(chain, path.c_str());
+      }
+
+      auto file = MappedFile::open(path, fileError);
+      if (!file) {
+        fileStatus = FLAC__METADATA_CHAIN_STATUS_ERROR_OPENING_FILE;
+        return false;
+      }
+
+      // the blocks are copied into the chain, so the file is only mapped while reading
+      MappedFileReader reader(file);
+      auto ret = ogg ? FLAC__metadata_chain_read_ogg_with_callbacks(
+                         chain,
+                         &reader,
+                         MappedFileReader::ioCallbacks)
+                     : FLAC__metadata_chain_read_with_callbacks(
+                         chain,
+                         &reader,
+                         MappedFileReader::ioCallbacks);
+      if (ret) {
+        mappedPath = path;
+      }
+
+      return ret;
+    }
+
+    bool writeImpl(bool padding, bool preserve) {
+      if (mappedPath.empty()) {
+        return FLAC__metadata_chain_write(chain, padding, preserve);
+      }
+
+      // the chain was read with callbacks, so it must be written the same way
+      if (!FLAC__metadata_chain_check_if_tempfile_needed(chain, padding)) {
+        StdioFile file(mappedPath, "r+b");
+        if (!file) {
+          fileStatus = FLAC__METADATA_CHAIN_STATUS_ERROR_OPENING_FILE;
+          return false;
+        }
+
+        return FLAC__metadata_chain_write_with_callbacks(
+          chain,
+          padding,
+          file.file,
+          StdioFile::ioCallbacks);
+      }
+
+      namespace fs = std::filesystem;
+      auto tempPath = mappedPath + ".metadata_edit.tmp";
+      auto path = fs::u8path(mappedPath);
+      std::error_code ec;
+      bool ret;
+      {
+        StdioFile file(mappedPath, "rb");
+        StdioFile tempFile(tempPath, "w+b");
+        if (!file || !tempFile) {
+          fileStatus = FLAC__METADATA_CHAIN_STATUS_ERROR_OPENING_FILE;
+          ret = false;
+        } else {
+          ret = FLAC__metadata_chain_write_with_callbacks_and_tempfile(
+            chain,
+            padding,
+            file.file,
+            StdioFile::ioCallbacks,
+            tempFile.file,
+            StdioFile::ioCallbacks);
+        }
+      }
+
+      if (ret) {
+        // the original file is still untouched at this point
+        auto permissions = fs::status(path, ec).permissions();
+        auto lastWriteTime = fs::last_write_time(path, ec);
+        fs::rename(fs::u8path(tempPath), path, ec);
+        if (ec) {
+          fileStatus = FLAC__METADATA_CHAIN_STATUS_RENAME_ERROR;
+          fileError = ec.message();
+          ret = false;
+        } else if (preserve) {
+          fs::permissions(path, permissions, ec);
+          fs::last_write_time(path, lastWriteTime, ec);
+        }
+      }
+
+      if (!ret) {
+        fs::remove(fs::u8path(tempPath), ec);
+      }
+
+      return ret;
+    }
+
     friend class Iterator;
 
   public:
@@ -90,34 +203,39 @@ namespace flac_bindings {
     }
 
     Napi::Value status(const CallbackInfo& info) {
-      auto status = FLAC__metadata_chain_status(chain);
+      auto status = takeStatus();
       return numberToJs(info.Env(), status);
     }
 
     void read(const CallbackInfo& info) {
       auto path = stringFromJs(info[0]);
-      auto ret = FLAC__metadata_chain_read(chain, path.c_str());
+      auto mmap = maybeBooleanOptionFromJs<bool>(info[1], "mmap").value_or(false);
+      auto ret = readImpl(path, false, mmap);
       checkStatus(info.Env(), ret);
     }
 
     Napi::Value readAsync(const CallbackInfo& info) {
       auto path = stringFromJs(info[0]);
-      return simpleAsyncImpl(info.This(), "flac_bindings::Chain::readAsync", [this, path]() {
-        return FLAC__metadata_chain_read(chain, path.c_str());
+      auto mmap = maybeBooleanOptionFromJs<bool>(info[1], "mmap").value_or(false);
+      return simpleAsyncImpl(info.This(), "flac_bindings::Chain::readAsync", [this, path, mmap]() {
+        return readImpl(path, false, mmap);
       });
     }
 
     void readOgg(const CallbackInfo& info) {
       auto path = stringFromJs(info[0]);
-      auto ret = FLAC__metadata_chain_read_ogg(chain, path.c_str());
+      auto mmap = maybeBooleanOptionFromJs<bool>(info[1], "mmap").value_or(false);
+      auto ret = readImpl(path, true, mmap);
       checkStatus(info.Env(), ret);
     }
 
     Napi::Value readOggAsync(const CallbackInfo& info) {
       auto path = stringFromJs(info[0]);
-      return simpleAsyncImpl(info.This(), "flac_bindings::Chain::readOggAsync", [this, path]() {
-        return FLAC__metadata_chain_read_ogg(chain, path.c_str());
-      });
+      auto mmap = maybeBooleanOptionFromJs<bool>(info[1], "mmap").value_or(false);
+      return simpleAsyncImpl(
+        info.This(),
+        "flac_bindings::Chain::readOggAsync",
+        [this, path, mmap]() { return readImpl(path, true, mmap); });
     }
 
     Napi::Value readWithCallbacks(const CallbackInfo& info) {
@@ -128,6 +246,7 @@ namespace flac_bindings {
           "Expected "s + obj.ToString().Utf8Value() + " to be object"s);
       }
 
+      mappedPath.clear();
       auto work = new AsyncFlacIOWork(
         [this](FLAC__IOHandle io, FLAC__IOCallbacks c) {
           return FLAC__metadata_chain_read_with_callbacks(chain, io, c);
@@ -148,6 +267,7 @@ namespace flac_bindings {
           "Expected "s + obj.ToString().Utf8Value() + " to be object"s);
       }
 
+      mappedPath.clear();
       auto work = new AsyncFlacIOWork(
         [this](FLAC__IOHandle io, FLAC__IOCallbacks c) {
           return FLAC__metadata_chain_read_ogg_with_callbacks(chain, io, c);
@@ -164,7 +284,7 @@ namespace flac_bindings {
       auto padding = maybeBooleanFromJs<FLAC__bool>(info[0]).value_or(true);
       auto preserve = maybeBooleanFromJs<FLAC__bool>(info[1]).value_or(false);
 
-      auto ret = FLAC__metadata_chain_write(chain, padding, preserve);
+      auto ret = writeImpl(padding, preserve);
       checkStatus(info.Env(), ret);
     }
 
@@ -174,9 +294,7 @@ namespace flac_bindings {
       return simpleAsyncImpl(
         info.This(),
         "flac_bindings::Chain::writeAsync",
-        [this, padding, preserve]() {
-          return FLAC__metadata_chain_write(chain, padding, preserve);
-        });
+        [this, padding, preserve]() { return writeImpl(padding, preserve); });
     }
 
     Napi::Value writeWithCallbacks(const CallbackInfo& info) {
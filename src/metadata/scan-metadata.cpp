@@ -0,0 +1,240 @@
+#include "../mappings/mappings.hpp"
+#include "../mappings/native_async_iterator.hpp"
+#include "../utils/async.hpp"
+#include <FLAC/metadata.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace flac_bindings {
+
+  using namespace Napi;
+
+  struct ScanMetadataResult {
+    uint32_t index;
+    std::vector<FLAC__StreamMetadata*> blocks;
+    std::string error;
+  };
+
+  typedef std::shared_ptr<std::vector<ScanMetadataResult>> ScanMetadataBatch;
+
+  /**
+   * Pool of threads reading the metadata of a list of files. Each thread takes the next file
+   * that nobody has taken yet, so slow files do not hold back the rest. The results are queued
+   * until the iterator takes them in batches.
+   */
+  struct ScanMetadataContext {
+    std::vector<std::string> paths;
+    // the block type has 7 bits in the header
+    bool types[128] = {};
+    bool allTypes = true;
+    uint32_t batchSize;
+    size_t maxQueued;
+
+    std::atomic<uint32_t> nextPath = 0;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<ScanMetadataResult> results;
+    uint32_t runningThreads = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    ~ScanMetadataContext() {
+      {
+        std::lock_guard<std::mutex> lg(mutex);
+        stopping = true;
+      }
+
+      cond.notify_all();
+      for (auto& thread: threads) {
+        thread.join();
+      }
+
+      for (auto& result: results) {
+        freeBlocks(result);
+      }
+    }
+
+    static void freeBlocks(ScanMetadataResult& result) {
+      for (auto block: result.blocks) {
+        FLAC__metadata_object_delete(block);
+      }
+      result.blocks.clear();
+    }
+
+    void start(unsigned concurrency) {
+      runningThreads = concurrency;
+      for (unsigned i = 0; i < concurrency; i += 1) {
+        threads.emplace_back([this]() { threadLoop(); });
+      }
+    }
+
+    inline bool isWanted(FLAC__MetadataType type) const {
+      return allTypes || (unsigned(type) < 128 && types[type]);
+    }
+
+    void scan(ScanMetadataResult& result) {
+      auto it = FLAC__metadata_simple_iterator_new();
+      if (it == nullptr) {
+        result.error = "Could not allocate memory";
+        return;
+      }
+
+      // only the wanted blocks are read, the rest are skipped using their length
+      const auto& path = paths[result.index];
+      if (FLAC__metadata_simple_iterator_init(it, path.c_str(), true, false)) {
+        do {
+          auto type = FLAC__metadata_simple_iterator_get_block_type(it);
+          if (!isWanted(type)) {
+            continue;
+          }
+
+          auto block = FLAC__metadata_simple_iterator_get_block(it);
+          if (block == nullptr) {
+            break;
+          }
+
+          result.blocks.push_back(block);
+        } while (FLAC__metadata_simple_iterator_next(it));
+      }
+
+      auto status = FLAC__metadata_simple_iterator_status(it);
+      if (status != FLAC__METADATA_SIMPLE_ITERATOR_STATUS_OK) {
+        result.error =
+          "Operation failed: "s + &FLAC__Metadata_SimpleIteratorStatusString[status][38];
+        freeBlocks(result);
+      }
+
+      FLAC__metadata_simple_iterator_delete(it);
+    }
+
+    void threadLoop() {
+      while (true) {
+        const auto index = nextPath.fetch_add(1);
+        if (index >= paths.size()) {
+          break;
+        }
+
+        ScanMetadataResult result;
+        result.index = index;
+        scan(result);
+
+        std::unique_lock<std::mutex> ul(mutex);
+        // keeps the memory bounded if the results are not consumed fast enough
+        cond.wait(ul, [this]() { return stopping || results.size() < maxQueued; });
+        if (stopping) {
+          freeBlocks(result);
+          return;
+        }
+
+        results.push_back(std::move(result));
+        cond.notify_all();
+      }
+
+      std::lock_guard<std::mutex> lg(mutex);
+      runningThreads -= 1;
+      cond.notify_all();
+    }
+
+    std::optional<ScanMetadataBatch> nextBatch() {
+      std::unique_lock<std::mutex> ul(mutex);
+      cond.wait(ul, [this]() { return results.size() >= batchSize || runningThreads == 0; });
+      if (results.empty()) {
+        return std::nullopt;
+      }
+
+      auto batch = std::make_shared<std::vector<ScanMetadataResult>>();
+      while (!results.empty() && batch->size() < batchSize) {
+        batch->push_back(std::move(results.front()));
+        results.pop_front();
+      }
+
+      cond.notify_all();
+      return batch;
+    }
+  };
+
+  static Napi::Value scanMetadataBatchToJs(
+    const Napi::Env& env,
+    const std::vector<std::string>& paths,
+    const ScanMetadataBatch& batch) {
+    EscapableHandleScope scope(env);
+    auto array = Array::New(env, batch->size());
+    for (size_t i = 0; i < batch->size(); i += 1) {
+      auto& result = (*batch)[i];
+      auto obj = Object::New(env);
+      obj["index"] = numberToJs(env, result.index);
+      obj["path"] = String::New(env, paths[result.index]);
+      if (result.error.empty()) {
+        auto blocks = Array::New(env, result.blocks.size());
+        for (size_t j = 0; j < result.blocks.size(); j += 1) {
+          blocks[j] = Metadata::toJs(env, result.blocks[j], true);
+        }
+        // owned by the JS objects now
+        result.blocks.clear();
+        obj["blocks"] = blocks;
+      } else {
+        obj["blocks"] = Array::New(env);
+        obj["error"] = String::New(env, result.error);
+      }
+
+      array[i] = obj;
+    }
+
+    return scope.Escape(array);
+  }
+
+  Napi::Value scanMetadata(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+    using NAI = NativeAsyncIterator<ScanMetadataBatch>;
+
+    auto ctx = std::make_shared<ScanMetadataContext>();
+    ctx->paths = arrayFromJs<std::string>(info[0], stringFromJs);
+    const unsigned maxConcurrency = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned concurrency = maxConcurrency;
+    ctx->batchSize = 64;
+    if (info[1].IsObject()) {
+      auto obj = info[1].As<Object>();
+      concurrency = maybeNumberFromJs<unsigned>(obj.Get("concurrency")).value_or(concurrency);
+      ctx->batchSize = maybeNumberFromJs<uint32_t>(obj.Get("batchSize")).value_or(ctx->batchSize);
+      auto types = obj.Get("types");
+      if (!types.IsUndefined() && !types.IsNull()) {
+        ctx->allTypes = false;
+        for (auto type: arrayFromJs<uint32_t>(types, numberFromJs<uint32_t>)) {
+          if (type >= 127) {
+            throw RangeError::New(info.Env(), "Invalid metadata type "s + std::to_string(type));
+          }
+          ctx->types[type] = true;
+        }
+      }
+    } else if (!info[1].IsUndefined() && !info[1].IsNull()) {
+      throw TypeError::New(info.Env(), "Expected second argument to be object or undefined");
+    }
+
+    if (concurrency == 0 || ctx->batchSize == 0) {
+      throw RangeError::New(info.Env(), "concurrency and batchSize must be greater than 0");
+    }
+
+    // the threads are not from the pool, so they are capped to avoid creating one per file
+    concurrency = std::min<size_t>(
+      std::min(concurrency, maxConcurrency),
+      std::max<size_t>(ctx->paths.size(), 1));
+    ctx->maxQueued = std::max<size_t>(ctx->batchSize * 4, concurrency);
+    ctx->start(concurrency);
+
+    return scope.Escape(NAI::newIterator(
+      info.Env(),
+      "flac_bindings::scanMetadata",
+      [ctx](auto&, auto) { return ctx->nextBatch(); },
+      [ctx](auto env, auto batch) { return scanMetadataBatchToJs(env, ctx->paths, batch); },
+      1,
+      [](auto batch) {
+        for (auto& result: *batch) {
+          ScanMetadataContext::freeBlocks(result);
+        }
+      }));
+  }
+
+}
@@ -0,0 +1,582 @@
+#include "utils/async.hpp"
+#include "utils/converters.hpp"
+#include "utils/defer.hpp"
+#include "utils/pcm_file.hpp"
+#include "utils/stats.hpp"
+#include <FLAC/stream_decoder.h>
+#include <FLAC/stream_encoder.h>
+#include <cctype>
+#include <napi.h>
+
+namespace flac_bindings {
+
+  using namespace Napi;
+
+  enum class TranscodeFormat {
+    Flac,
+    Ogg,
+    Wav,
+    Aiff,
+    Raw,
+  };
+
+  /** Encoder settings, applied over the compression level like the JS encoders do. */
+  struct TranscodeEncoderOptions {
+    std::optional<unsigned> compressionLevel;
+    std::optional<unsigned> blocksize;
+    std::optional<bool> verify;
+    std::optional<bool> doMidSideStereo;
+    std::optional<bool> looseMidSideStereo;
+    std::optional<std::string> apodization;
+    std::optional<unsigned> maxLpcOrder;
+    std::optional<unsigned> qlpCoeffPrecision;
+    std::optional<bool> doQlpCoeffPrecSearch;
+    std::optional<bool> doExhaustiveModelSearch;
+    std::optional<unsigned> minResidualPartitionOrder;
+    std::optional<unsigned> maxResidualPartitionOrder;
+    std::optional<long> oggSerialNumber;
+
+    void apply(FLAC__StreamEncoder* enc) const {
+      if (compressionLevel) {
+        FLAC__stream_encoder_set_compression_level(enc, *compressionLevel);
+      }
+      if (blocksize) {
+        FLAC__stream_encoder_set_blocksize(enc, *blocksize);
+      }
+      if (verify) {
+        FLAC__stream_encoder_set_verify(enc, *verify);
+      }
+      if (doMidSideStereo) {
+        FLAC__stream_encoder_set_do_mid_side_stereo(enc, *doMidSideStereo);
+      }
+      if (looseMidSideStereo) {
+        FLAC__stream_encoder_set_loose_mid_side_stereo(enc, *looseMidSideStereo);
+      }
+      if (apodization) {
+        FLAC__stream_encoder_set_apodization(enc, apodization->c_str());
+      }
+      if (maxLpcOrder) {
+        FLAC__stream_encoder_set_max_lpc_order(enc, *maxLpcOrder);
+      }
+      if (qlpCoeffPrecision) {
+        FLAC__stream_encoder_set_qlp_coeff_precision(enc, *qlpCoeffPrecision);
+      }
+      if (doQlpCoeffPrecSearch) {
+        FLAC__stream_encoder_set_do_qlp_coeff_prec_search(enc, *doQlpCoeffPrecSearch);
+      }
+      if (doExhaustiveModelSearch) {
+        FLAC__stream_encoder_set_do_exhaustive_model_search(enc, *doExhaustiveModelSearch);
+      }
+      if (minResidualPartitionOrder) {
+        FLAC__stream_encoder_set_min_residual_partition_order(enc, *minResidualPartitionOrder);
+      }
+      if (maxResidualPartitionOrder) {
+        FLAC__stream_encoder_set_max_residual_partition_order(enc, *maxResidualPartitionOrder);
+      }
+      if (oggSerialNumber) {
+        FLAC__stream_encoder_set_ogg_serial_number(enc, *oggSerialNumber);
+      }
+    }
+  };
+
+  struct TranscodeProgress {
+    uint64_t samples;
+    uint64_t totalSamples;
+  };
+
+  /**
+   * State of a transcode. Everything in here is only touched from the worker thread until the
+   * promise is resolved, except when the progress is sent, which waits for JS to handle it.
+   */
+  struct TranscodeContext {
+    std::string input;
+    std::string output;
+    TranscodeFormat inputFormat = TranscodeFormat::Flac;
+    TranscodeFormat outputFormat = TranscodeFormat::Flac;
+    PcmFormat rawFormat;
+    TranscodeEncoderOptions encoderOptions;
+    uint64_t progressInterval = 0;
+
+    PcmFormat format;
+    uint64_t samples = 0;
+    std::string error;
+
+    FLAC__StreamEncoder* enc = nullptr;
+    PcmFileWriter writer;
+    bool opened = false;
+
+    // sends the progress to JS, returns false if the transcode must stop
+    std::function<bool(const TranscodeProgress&)> sendProgress;
+    uint64_t lastProgress = 0;
+
+    ~TranscodeContext() {
+      if (enc != nullptr) {
+        FLAC__stream_encoder_delete(enc);
+      }
+    }
+
+    inline bool isFlacOutput() const {
+      return outputFormat == TranscodeFormat::Flac || outputFormat == TranscodeFormat::Ogg;
+    }
+
+    bool openOutput() {
+      opened = true;
+      if (!isFlacOutput()) {
+        auto container =
+          outputFormat == TranscodeFormat::Wav ? PcmContainer::Wav : PcmContainer::Raw;
+        if (!writer.open(output, container, format)) {
+          error = writer.error;
+          return false;
+        }
+
+        return true;
+      }
+
+      enc = FLAC__stream_encoder_new();
+      if (enc == nullptr) {
+        error = "Could not allocate memory";
+        return false;
+      }
+
+      FLAC__stream_encoder_set_channels(enc, format.channels);
+      FLAC__stream_encoder_set_bits_per_sample(enc, format.bitsPerSample);
+      FLAC__stream_encoder_set_sample_rate(enc, format.sampleRate);
+      FLAC__stream_encoder_set_total_samples_estimate(enc, format.totalSamples);
+      encoderOptions.apply(enc);
+      auto initFunction = outputFormat == TranscodeFormat::Ogg
+                            ? FLAC__stream_encoder_init_ogg_file
+                            : FLAC__stream_encoder_init_file;
+      auto status = initFunction(enc, output.c_str(), nullptr, nullptr);
+      if (status == FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR) {
+        error = "Encoder initialization failed: "s
+                + FLAC__stream_encoder_get_resolved_state_string(enc);
+        return false;
+      } else if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        error = "Encoder initialization failed: "s + FLAC__StreamEncoderInitStatusString[status];
+        return false;
+      }
+
+      return true;
+    }
+
+    bool write(const int32_t* const planar[], uint64_t count) {
+      if (enc != nullptr) {
+        stats::ProcessTimer timer(&stats::Stats::encoderProcess);
+        if (!FLAC__stream_encoder_process(enc, planar, count)) {
+          error = "Encoding failed: "s + FLAC__stream_encoder_get_resolved_state_string(enc);
+          return false;
+        }
+      } else if (!writer.write(planar, count)) {
+        error = writer.error;
+        return false;
+      }
+
+      return advance(count);
+    }
+
+    bool writeInterleaved(const int32_t* interleaved, uint64_t count) {
+      if (enc != nullptr) {
+        stats::ProcessTimer timer(&stats::Stats::encoderProcess);
+        if (!FLAC__stream_encoder_process_interleaved(enc, interleaved, count)) {
+          error = "Encoding failed: "s + FLAC__stream_encoder_get_resolved_state_string(enc);
+          return false;
+        }
+      } else if (!writer.writeInterleaved(interleaved, count)) {
+        error = writer.error;
+        return false;
+      }
+
+      return advance(count);
+    }
+
+    bool advance(uint64_t count) {
+      samples += count;
+      if (isFlacOutput()) {
+        stats::add(stats::global().encodedSamples, count);
+      }
+
+      if (!sendProgress) {
+        return true;
+      }
+
+      // at most one progress every interval, so JS is not in the way of the conversion
+      const auto now = stats::now();
+      if (now - lastProgress < progressInterval) {
+        return true;
+      }
+
+      lastProgress = now;
+      return sendProgress({samples, format.totalSamples});
+    }
+
+    bool closeOutput() {
+      if (enc != nullptr) {
+        stats::ProcessTimer timer(&stats::Stats::encoderProcess);
+        auto ok = FLAC__stream_encoder_finish(enc);
+        if (!ok && error.empty()) {
+          error = "Encoding failed: "s + FLAC__stream_encoder_get_resolved_state_string(enc);
+        }
+
+        FLAC__stream_encoder_delete(enc);
+        enc = nullptr;
+        return ok;
+      }
+
+      if (!writer.finish()) {
+        if (error.empty()) {
+          error = writer.error;
+        }
+        return false;
+      }
+
+      return true;
+    }
+  };
+
+  // -- FLAC input --
+
+  static FLAC__StreamDecoderWriteStatus transcodeWriteCallback(
+    const FLAC__StreamDecoder*,
+    const FLAC__Frame* frame,
+    const int32_t* const samples[],
+    void* ptr) {
+    auto ctx = (TranscodeContext*) ptr;
+    const auto& header = frame->header;
+    stats::add(stats::global().decodedSamples, header.blocksize);
+    if (!ctx->opened) {
+      // the frame has the format even if STREAMINFO was not found
+      ctx->format.channels = header.channels;
+      ctx->format.bitsPerSample = header.bits_per_sample;
+      ctx->format.sampleRate = header.sample_rate;
+      if (!ctx->openOutput()) {
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+      }
+    } else if (
+      header.channels != ctx->format.channels
+      || header.bits_per_sample != ctx->format.bitsPerSample) {
+      ctx->error = "Stream changes its format in the middle of the file, which is not supported";
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    if (!ctx->write(samples, header.blocksize)) {
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  }
+
+  static void transcodeMetadataCallback(
+    const FLAC__StreamDecoder*,
+    const FLAC__StreamMetadata* metadata,
+    void* ptr) {
+    auto ctx = (TranscodeContext*) ptr;
+    if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+      const auto& info = metadata->data.stream_info;
+      ctx->format.channels = info.channels;
+      ctx->format.bitsPerSample = info.bits_per_sample;
+      ctx->format.sampleRate = info.sample_rate;
+      ctx->format.totalSamples = info.total_samples;
+    }
+  }
+
+  static void transcodeErrorCallback(
+    const FLAC__StreamDecoder*,
+    FLAC__StreamDecoderErrorStatus status,
+    void* ptr) {
+    auto ctx = (TranscodeContext*) ptr;
+    if (ctx->error.empty()) {
+      ctx->error = "Decoder error: "s + FLAC__StreamDecoderErrorStatusString[status];
+    }
+  }
+
+  static bool transcodeFromFlac(TranscodeContext& ctx) {
+    auto dec = FLAC__stream_decoder_new();
+    if (dec == nullptr) {
+      ctx.error = "Could not allocate memory";
+      return false;
+    }
+
+    DEFER(FLAC__stream_decoder_delete(dec));
+    auto initFunction = ctx.inputFormat == TranscodeFormat::Ogg
+                          ? FLAC__stream_decoder_init_ogg_file
+                          : FLAC__stream_decoder_init_file;
+    auto initStatus = initFunction(
+      dec,
+      ctx.input.c_str(),
+      transcodeWriteCallback,
+      transcodeMetadataCallback,
+      transcodeErrorCallback,
+      &ctx);
+    if (initStatus != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      ctx.error =
+        "Decoder initialization failed: "s + FLAC__StreamDecoderInitStatusString[initStatus];
+      return false;
+    }
+
+    bool ok;
+    {
+      // the encoder runs in the write callback, and its own timer takes it out of this one
+      stats::ProcessTimer timer(&stats::Stats::decoderProcess);
+      ok = FLAC__stream_decoder_process_until_end_of_stream(dec);
+    }
+
+    if (!ok && ctx.error.empty()) {
+      auto state = FLAC__stream_decoder_get_state(dec);
+      ctx.error = "Decoding failed: "s + FLAC__StreamDecoderStateString[state];
+    }
+
+    FLAC__stream_decoder_finish(dec);
+    return ok && ctx.error.empty();
+  }
+
+  // -- PCM input --
+
+  static bool transcodeFromPcm(TranscodeContext& ctx) {
+    PcmFileReader reader;
+    // the reader finds the kind of WAV or AIFF from the header
+    auto container =
+      ctx.inputFormat == TranscodeFormat::Raw ? PcmContainer::Raw : PcmContainer::Wav;
+    if (!reader.open(ctx.input, container, ctx.rawFormat)) {
+      ctx.error = reader.error;
+      return false;
+    }
+
+    ctx.format = reader.format();
+    if (!ctx.openOutput()) {
+      return false;
+    }
+
+    // one buffer for the whole file, big enough to make few reads and encoder calls
+    constexpr uint64_t chunkSamples = 16384;
+    std::vector<int32_t> buffer(chunkSamples * ctx.format.channels);
+    while (true) {
+      auto count = reader.read(buffer.data(), chunkSamples);
+      if (count == 0) {
+        break;
+      }
+
+      stats::add(stats::global().bytesRead, count * ctx.format.channels * ctx.format.bps());
+      if (!ctx.writeInterleaved(buffer.data(), count)) {
+        return false;
+      }
+    }
+
+    if (!reader.error.empty()) {
+      ctx.error = reader.error;
+      return false;
+    }
+
+    return true;
+  }
+
+  static void transcodeImpl(TranscodeContext& ctx) {
+    auto isFlacInput =
+      ctx.inputFormat == TranscodeFormat::Flac || ctx.inputFormat == TranscodeFormat::Ogg;
+    auto ok = isFlacInput ? transcodeFromFlac(ctx) : transcodeFromPcm(ctx);
+    if (ok && !ctx.opened) {
+      // a stream without frames still generates an (empty) output
+      if (ctx.format.channels == 0) {
+        ctx.error = "Could not find the format of the input";
+        return;
+      }
+
+      ok = ctx.openOutput();
+    }
+
+    if (ctx.opened) {
+      ok = ctx.closeOutput() && ok;
+    }
+
+    if (ok && ctx.sendProgress) {
+      // the last one is always sent, so JS sees the end
+      ctx.sendProgress({ctx.samples, ctx.format.totalSamples});
+    }
+  }
+
+  // -- JS --
+
+  static std::optional<TranscodeFormat> formatFromExtension(const std::string& path) {
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos) {
+      return std::nullopt;
+    }
+
+    auto extension = path.substr(dot + 1);
+    for (auto& ch: extension) {
+      ch = (char) tolower(ch);
+    }
+
+    if (extension == "flac" || extension == "fla") {
+      return TranscodeFormat::Flac;
+    } else if (extension == "oga" || extension == "ogg") {
+      return TranscodeFormat::Ogg;
+    } else if (extension == "wav" || extension == "wave" || extension == "w64"
+               || extension == "rf64") {
+      return TranscodeFormat::Wav;
+    } else if (extension == "aif" || extension == "aiff" || extension == "aifc") {
+      return TranscodeFormat::Aiff;
+    } else if (extension == "raw" || extension == "pcm") {
+      return TranscodeFormat::Raw;
+    }
+
+    return std::nullopt;
+  }
+
+  static TranscodeFormat
+    formatFromJs(const Napi::Value& value, const std::string& path, const char* name) {
+    auto env = value.Env();
+    if (value.IsUndefined() || value.IsNull()) {
+      auto format = formatFromExtension(path);
+      if (!format) {
+        throw Error::New(
+          env,
+          "Cannot guess the format of "s + path + " from its extension, set "s + name);
+      }
+
+      return format.value();
+    }
+
+    auto format = stringFromJs(value);
+    if (format == "flac") {
+      return TranscodeFormat::Flac;
+    } else if (format == "ogg") {
+      return TranscodeFormat::Ogg;
+    } else if (format == "wav") {
+      return TranscodeFormat::Wav;
+    } else if (format == "aiff") {
+      return TranscodeFormat::Aiff;
+    } else if (format == "raw") {
+      return TranscodeFormat::Raw;
+    }
+
+    throw RangeError::New(
+      env,
+      "Invalid "s + name + " \""s + format + "\", expected flac, ogg, wav, aiff or raw"s);
+  }
+
+  static TranscodeEncoderOptions encoderOptionsFromJs(const Napi::Value& value) {
+    TranscodeEncoderOptions options;
+    if (value.IsUndefined() || value.IsNull()) {
+      return options;
+    }
+
+    if (!value.IsObject()) {
+      throw TypeError::New(value.Env(), "Expected encoderOptions to be object");
+    }
+
+    auto obj = value.As<Object>();
+    options.compressionLevel = maybeNumberFromJs<unsigned>(obj.Get("compressionLevel"));
+    options.blocksize = maybeNumberFromJs<unsigned>(obj.Get("blocksize"));
+    options.verify = maybeBooleanFromJs<bool>(obj.Get("verify"));
+    options.doMidSideStereo = maybeBooleanFromJs<bool>(obj.Get("doMidSideStereo"));
+    options.looseMidSideStereo = maybeBooleanFromJs<bool>(obj.Get("looseMidSideStereo"));
+    options.apodization = maybeStringFromJs(obj.Get("apodization"));
+    options.maxLpcOrder = maybeNumberFromJs<unsigned>(obj.Get("maxLpcOrder"));
+    options.qlpCoeffPrecision = maybeNumberFromJs<unsigned>(obj.Get("qlpCoeffPrecision"));
+    options.doQlpCoeffPrecSearch = maybeBooleanFromJs<bool>(obj.Get("doQlpCoeffPrecSearch"));
+    options.doExhaustiveModelSearch =
+      maybeBooleanFromJs<bool>(obj.Get("doExhaustiveModelSearch"));
+    options.minResidualPartitionOrder =
+      maybeNumberFromJs<unsigned>(obj.Get("minResidualPartitionOrder"));
+    options.maxResidualPartitionOrder =
+      maybeNumberFromJs<unsigned>(obj.Get("maxResidualPartitionOrder"));
+    options.oggSerialNumber = maybeNumberFromJs<long>(obj.Get("oggSerialNumber"));
+    return options;
+  }
+
+  static Object transcodeResultToJs(const Napi::Env& env, const TranscodeContext& ctx) {
+    auto obj = Object::New(env);
+    obj["samples"] = numberToJs(env, ctx.samples);
+    obj["channels"] = numberToJs(env, ctx.format.channels);
+    obj["bitsPerSample"] = numberToJs(env, ctx.format.bitsPerSample);
+    obj["sampleRate"] = numberToJs(env, ctx.format.sampleRate);
+    return obj;
+  }
+
+  Promise transcode(const CallbackInfo& info) {
+    EscapableHandleScope scope(info.Env());
+
+    if (!info[0].IsObject()) {
+      throw TypeError::New(info.Env(), "Expected first argument to be object");
+    }
+
+    auto obj = info[0].As<Object>();
+    auto ctx = std::make_shared<TranscodeContext>();
+    ctx->input = stringFromJs(obj.Get("input"));
+    ctx->output = stringFromJs(obj.Get("output"));
+    ctx->inputFormat = formatFromJs(obj.Get("inputFormat"), ctx->input, "inputFormat");
+    ctx->outputFormat = formatFromJs(obj.Get("outputFormat"), ctx->output, "outputFormat");
+    if (ctx->outputFormat == TranscodeFormat::Aiff) {
+      throw RangeError::New(info.Env(), "AIFF files can only be read");
+    }
+
+    ctx->encoderOptions = encoderOptionsFromJs(obj.Get("encoderOptions"));
+    if (ctx->inputFormat == TranscodeFormat::Raw) {
+      auto rawFormat = obj.Get("rawFormat");
+      if (!rawFormat.IsObject()) {
+        throw TypeError::New(info.Env(), "Expected rawFormat to be object for raw input");
+      }
+
+      auto format = rawFormat.As<Object>();
+      ctx->rawFormat.channels = numberFromJs<uint32_t>(format.Get("channels"));
+      ctx->rawFormat.bitsPerSample = numberFromJs<uint32_t>(format.Get("bitsPerSample"));
+      ctx->rawFormat.sampleRate = numberFromJs<uint32_t>(format.Get("sampleRate"));
+    }
+
+    auto progress = obj.Get("progress");
+    if (!progress.IsFunction() && !progress.IsUndefined() && !progress.IsNull()) {
+      throw TypeError::New(info.Env(), "Expected progress to be function");
+    }
+
+    // in milliseconds
+    ctx->progressInterval =
+      maybeNumberFromJs<uint64_t>(obj.Get("progressInterval")).value_or(500) * 1000000;
+
+    typedef AsyncBackgroundTask<std::shared_ptr<TranscodeContext>, TranscodeProgress> Task;
+    Task::ProgressCallback progressCallback = nullptr;
+    if (progress.IsFunction()) {
+      progressCallback = [](auto& env, auto& c, auto progress) {
+        HandleScope scope(env);
+        auto func = c.getTask()->Receiver().Get("progress").template As<Function>();
+        auto obj = Object::New(env);
+        obj["samples"] = numberToJs(env, progress->samples);
+        obj["totalSamples"] = numberToJs(env, progress->totalSamples);
+        auto result = func.MakeCallback(env.Global(), {obj});
+        if (result.IsPromise()) {
+          c.defer(result.template As<Promise>());
+        }
+      };
+    }
+
+    auto worker = new Task(
+      info.Env(),
+      [ctx, hasProgress = progress.IsFunction()](auto& c) {
+        if (hasProgress) {
+          ctx->sendProgress = [&c](const TranscodeProgress& progress) {
+            c.sendProgressAndWait(std::make_shared<TranscodeProgress>(progress));
+            return !c.isCompleted();
+          };
+        }
+
+        transcodeImpl(*ctx);
+        ctx->sendProgress = nullptr;
+        if (c.isCompleted()) {
+          return;
+        }
+
+        if (ctx->error.empty()) {
+          c.resolve(ctx);
+        } else {
+          c.reject(ctx->error);
+        }
+      },
+      progressCallback,
+      "flac_bindings::transcode",
+      [](auto env, auto ctx) { return transcodeResultToJs(env, *ctx); });
+
+    worker->Receiver().Set("progress", progress);
+    worker->Queue();
+    return scope.Escape(worker->getPromise()).As<Promise>();
+  }
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "stats.hpp"
+#include "thread_pool.hpp"
 #include <atomic>
 #include <cassert>
 #include <condition_variable>
@@ -19,10 +21,18 @@ namespace flac_bindings {
     std::mutex mutex;
     std::condition_variable cond;
     volatile bool deferred = false;
+    // called instead of waking up the thread, when nobody waits for the request
+    std::function<void()> onCompleted;
 
     inline ProgressRequest(const std::shared_ptr<DataType>& data): data(data) {}
 
     inline void notifyCompleted() {
+      if (onCompleted) {
+        completed = true;
+        onCompleted();
+        return;
+      }
+
       std::lock_guard<std::mutex> lg(mutex);
       completed = true;
       cond.notify_one();
@@ -34,8 +44,198 @@ namespace flac_bindings {
     }
   };
 
+  /**
+   * Runs some work in the codec thread pool (see `thread_pool.hpp`) instead of the libuv
+   * threadpool, with the same interface as `AsyncProgressQueueWorker`. Progress and completion
+   * are sent to the JS thread through a thread-safe function. The object deletes itself once
+   * everything has been delivered.
+   */
   template<typename P>
-  using AsyncBackgroundTaskBase = AsyncProgressQueueWorker<std::shared_ptr<ProgressRequest<P>>>;
+  class AsyncBackgroundTaskBase {
+  public:
+    typedef std::shared_ptr<ProgressRequest<P>> ProgressData;
+
+    class ExecutionProgress {
+      AsyncBackgroundTaskBase<P>* task;
+
+      friend class AsyncBackgroundTaskBase<P>;
+
+      explicit ExecutionProgress(AsyncBackgroundTaskBase<P>* task): task(task) {}
+
+    public:
+      /** Returns false if it cannot be sent because the environment is being torn down. */
+      bool Send(const ProgressData* data, size_t count) const {
+        (void) count; // In RELEASE this variable is not used :)
+        assert(count == 1);
+        return task->send(new Message {Message::Progress, *data});
+      }
+    };
+
+  private:
+    struct Message {
+      enum Type {
+        Progress,
+        Completed,
+      } type;
+      ProgressData data;
+    };
+
+    static void callJs(Napi::Env env, Function, AsyncBackgroundTaskBase<P>* self, Message* msg) {
+      // when the environment is torn down, the task may already be deleted: only the message is
+      // touched, and the thread waiting for the progress is released
+      if (env == nullptr) {
+        if (msg->type == Message::Progress) {
+          msg->data->notifyCompleted();
+        }
+
+        delete msg;
+        return;
+      }
+
+      HandleScope scope(env);
+      CallbackScope callbackScope(env, self->asyncContext);
+      try {
+        if (msg->type == Message::Progress) {
+          self->OnProgress(&msg->data, 1);
+        } else if (self->error.empty()) {
+          self->OnOK();
+        } else {
+          self->OnError(Error::New(env, self->error));
+        }
+      } catch (const Error& error) {
+        error.ThrowAsJavaScriptException();
+      }
+
+      delete msg;
+    }
+
+    static void finalize(Napi::Env, AsyncBackgroundTaskBase<P>* self) {
+      // if the work is still running, the environment is being torn down: the task is leaked
+      // because it cannot be safely deleted from the pool thread
+      if (self->executed) {
+        delete self;
+      }
+    }
+
+    typedef TypedThreadSafeFunction<AsyncBackgroundTaskBase<P>, Message, callJs> Channel;
+
+    enum SuspendState {
+      NotSuspended,
+      // the work has asked to be suspended, but the thread is still running it
+      Suspending,
+      // the thread has been given back to the pool
+      Suspended,
+    };
+
+    Napi::Env env;
+    std::string name;
+    AsyncContext asyncContext;
+    ObjectReference receiver;
+    Channel channel;
+    std::string error;
+    std::atomic_bool executed = false;
+    std::atomic_bool closing = false;
+    std::atomic_int suspendState = NotSuspended;
+    // only used from the thread running the work
+    bool suspendRequested = false;
+
+    bool send(Message* msg) {
+      if (!closing && channel.BlockingCall(msg) == napi_ok) {
+        return true;
+      }
+
+      closing = true;
+      delete msg;
+      return false;
+    }
+
+    void run() {
+      ExecutionProgress progress(this);
+      while (true) {
+        suspendRequested = false;
+        Execute(progress);
+        if (!suspendRequested) {
+          break;
+        }
+
+        int expected = Suspending;
+        if (suspendState.compare_exchange_strong(expected, Suspended)) {
+          // resume() will queue it again
+          return;
+        }
+
+        // it was resumed before the thread could be released, so it continues here
+      }
+
+      // from now on, `this` can be deleted in the JS thread at any time
+      auto channel = this->channel;
+      bool canSend = !closing;
+      executed = true;
+      auto msg = new Message {Message::Completed, nullptr};
+      if (canSend && channel.BlockingCall(msg) == napi_ok) {
+        channel.Release();
+      } else {
+        delete msg;
+      }
+    }
+
+  protected:
+    AsyncBackgroundTaskBase(const Napi::Env& env, const char* name):
+        env(env), name(name), asyncContext(env, name),
+        receiver(Persistent(Object::New(env))) {}
+
+    void SetError(const std::string& message) {
+      error = message;
+    }
+
+    /**
+     * Makes the thread go back to the pool when `Execute` returns, instead of completing the
+     * task. `Execute` will be called again (maybe in another thread) after `resume()`.
+     */
+    void suspend() {
+      suspendRequested = true;
+      suspendState = Suspending;
+    }
+
+    /** Undoes `suspend()` when `Execute` has not returned yet and nobody has resumed it. */
+    void cancelSuspend() {
+      suspendRequested = false;
+      suspendState = NotSuspended;
+    }
+
+    inline bool isSuspending() const {
+      return suspendRequested;
+    }
+
+    virtual void Execute(const ExecutionProgress& progress) = 0;
+    virtual void OnOK() = 0;
+    virtual void OnError(const Error& error) = 0;
+    virtual void OnProgress(const ProgressData* data, size_t count) = 0;
+
+  public:
+    virtual ~AsyncBackgroundTaskBase() {}
+
+    inline Napi::Env Env() const {
+      return env;
+    }
+
+    inline ObjectReference& Receiver() {
+      return receiver;
+    }
+
+    /** Continues a suspended task. Can be called from any thread. */
+    void resume() {
+      if (suspendState.exchange(NotSuspended) == Suspended) {
+        thread_pool::submit([this]() { run(); });
+      }
+    }
+
+    /** Queues the task in the codec thread pool. Must be called once, from the JS thread. */
+    void Queue() {
+      channel = Channel::New(env, name, 0, 1, this, finalize);
+      thread_pool::submit([this]() { run(); });
+    }
+  };
 
   template<typename T, typename P = char>
   class AsyncBackgroundTask: public AsyncBackgroundTaskBase<P> {
@@ -44,7 +244,7 @@ namespace flac_bindings {
 
     class ExecutionProgress {
       AsyncBackgroundTask<T, P>* self;
-      const NapiExecutionProgress& progress;
+      NapiExecutionProgress progress;
       volatile bool completed = false;
       std::shared_ptr<ProgressRequest<P>> currentProgressRequest;
 
@@ -130,12 +330,50 @@ namespace flac_bindings {
 
       void sendProgressAndWait(const std::shared_ptr<P>& data) {
         if (!completed) {
+          stats::WaitTimer timer(&stats::Stats::callbackRoundTrip);
+          stats::add(stats::global().callbacks, 1);
           auto req = std::make_shared<ProgressRequest<P>>(data);
-          progress.Send(&req, 1);
+          if (!progress.Send(&req, 1)) {
+            reject("The environment is being torn down");
+            return;
+          }
+
           req->wait();
         }
       }
 
+      /**
+       * Sends the data to JS without waiting for the answer. The work function must return after
+       * calling it, and it is called again once JS has processed the data (including the promise
+       * returned, if any), so the thread is not held in between.
+       */
+      void sendProgressAndSuspend(const std::shared_ptr<P>& data) {
+        if (!completed) {
+          stats::add(stats::global().callbacks, 1);
+          auto req = std::make_shared<ProgressRequest<P>>(data);
+          auto task = self;
+          req->onCompleted = [task]() { task->resume(); };
+          self->suspend();
+          if (!progress.Send(&req, 1)) {
+            self->cancelSuspend();
+            reject("The environment is being torn down");
+          }
+        }
+      }
+
+      /**
+       * The work function must return after calling it, and it is called again once
+       * `getTask()->resume()` is called from somewhere else.
+       */
+      void suspend() {
+        self->suspend();
+      }
+
+      /** Undoes `suspend()` if nobody has called `resume()` yet. */
+      void cancelSuspend() {
+        self->cancelSuspend();
+      }
+
       void defer(
         Promise promise,
         FullPromiseCallback resolve = nullptr,
@@ -168,7 +406,7 @@ namespace flac_bindings {
         return self;
       }
 
-      inline bool isCompleted() {
+      inline bool isCompleted() const {
         return completed;
       }
     };
@@ -187,10 +425,8 @@ namespace flac_bindings {
     ValueMapFunction converter;
     std::optional<T> returnValue = std::nullopt;
     Reference<Object> exceptionValue;
-
-    static Value _doNothing(const CallbackInfo& i) {
-      return i.Env().Undefined();
-    }
+    // only set when the stats are enabled
+    uint64_t createdAt = 0;
 
   public:
     AsyncBackgroundTask(
@@ -199,14 +435,18 @@ namespace flac_bindings {
       ProgressCallback progress,
       const char* name,
       ValueMapFunction converter):
-        AsyncBackgroundTaskBase<P>(Function::New(env, _doNothing, "_doNothing"), name),
+        AsyncBackgroundTaskBase<P>(env, name),
         resolver(Promise::Deferred::New(env)), function(function), progress(progress),
-        converter(converter) {}
+        converter(converter), createdAt(stats::isEnabled() ? stats::now() : 0) {
+      stats::global().activeTasks += 1;
+    }
 
     ~AsyncBackgroundTask() {
       if (!exceptionValue.IsEmpty()) {
         exceptionValue.Unref();
       }
+
+      stats::global().activeTasks -= 1;
     }
 
     inline Promise getPromise() const {
@@ -215,13 +455,29 @@ namespace flac_bindings {
     }
 
     virtual void Execute(const NapiExecutionProgress& progress) override {
+      auto& globalStats = stats::global();
+      globalStats.runningTasks += 1;
+      if (createdAt != 0 && stats::isEnabled()) {
+        globalStats.queueWait.record(stats::now() - createdAt);
+      }
+      createdAt = 0;
+
       if (function) {
-        context = new ExecutionProgress(this, progress);
+        // a suspended task keeps the context for the next time it runs
+        if (context == nullptr) {
+          context = new ExecutionProgress(this, progress);
+        }
+
         function(*context);
-        delete context;
+        if (!this->isSuspending()) {
+          delete context;
+          context = nullptr;
+        }
       } else {
         this->SetError("No lambda function received in AsyncBackgroundTask");
       }
+
+      globalStats.runningTasks -= 1;
     }
 
     virtual void OnOK() override {
@@ -249,8 +505,9 @@ namespace flac_bindings {
       }
     }
 
-    virtual void
-      OnProgress(const std::shared_ptr<ProgressRequest<P>>* requestPtr, size_t size) override {
+    virtual void OnProgress(
+      const typename AsyncBackgroundTaskBase<P>::ProgressData* requestPtr,
+      size_t size) override {
       (void) size; // In RELEASE this variable is not used :)
       assert(size == 1);
       if (progress) {
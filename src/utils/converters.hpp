@@ -123,6 +123,24 @@ namespace flac_bindings {
     return booleanFromJs<T>(value);
   }
 
+  /** Reads a boolean property from an optional options object. */
+  template<typename T>
+  static inline std::optional<T> maybeBooleanOptionFromJs(
+    const Napi::Value& options,
+    const char* name) {
+    if (options.IsNull() || options.IsUndefined()) {
+      return std::nullopt;
+    }
+
+    if (!options.IsObject()) {
+      throw Napi::TypeError::New(
+        options.Env(),
+        "Expected "s + options.ToString().Utf8Value() + " to be object"s);
+    }
+
+    return maybeBooleanFromJs<T>(options.As<Napi::Object>().Get(name));
+  }
+
   template<typename T, typename std::enable_if_t<std::is_integral<T>::value, bool> = 0>
   static inline Napi::Value booleanToJs(const Napi::Env& env, T boolean) {
     return Napi::Boolean::New(env, boolean);
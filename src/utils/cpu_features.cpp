@@ -0,0 +1,97 @@
+#include "cpu_features.hpp"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#define FLAC_BINDINGS_CPUID
+#endif
+
+namespace flac_bindings {
+
+#ifdef FLAC_BINDINGS_CPUID
+  struct CpuidResult {
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+  };
+
+  static CpuidResult cpuid(uint32_t leaf, uint32_t subleaf = 0) {
+    CpuidResult result;
+#ifdef _MSC_VER
+    int maxInfo[4];
+    __cpuid(maxInfo, leaf & 0x80000000);
+    if ((uint32_t) maxInfo[0] < leaf) {
+      return result;
+    }
+
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    result = {(uint32_t) info[0], (uint32_t) info[1], (uint32_t) info[2], (uint32_t) info[3]};
+#else
+    // returns false if the leaf is not supported, and then everything stays as 0
+    __get_cpuid_count(leaf, subleaf, &result.eax, &result.ebx, &result.ecx, &result.edx);
+#endif
+    return result;
+  }
+
+  static uint64_t xgetbv() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t) edx << 32) | eax;
+#endif
+  }
+
+  static inline bool hasBits(uint32_t value, uint32_t bits) {
+    return (value & bits) == bits;
+  }
+
+  static unsigned detectX86Level() {
+    const auto xcr0 = [] { return (uint32_t) xgetbv(); };
+    auto leaf1 = cpuid(1);
+    auto leaf7 = cpuid(7);
+    auto extLeaf1 = cpuid(0x80000001);
+
+    // SSE3, SSSE3, CMPXCHG16B, SSE4.1, SSE4.2, POPCNT
+    const uint32_t v2Ecx = (1 << 0) | (1 << 9) | (1 << 13) | (1 << 19) | (1 << 20) | (1 << 23);
+    if (!hasBits(leaf1.ecx, v2Ecx)) {
+      return 1;
+    }
+
+    // AVX registers must be enabled by the OS (OSXSAVE and XCR0)
+    if (!hasBits(leaf1.ecx, 1 << 27) || !hasBits(xcr0(), 0x6)) {
+      return 2;
+    }
+
+    // FMA, MOVBE, AVX, F16C + BMI1, AVX2, BMI2 + LZCNT
+    const uint32_t v3Ecx = (1 << 12) | (1 << 22) | (1 << 28) | (1 << 29);
+    const uint32_t v3Ebx7 = (1 << 3) | (1 << 5) | (1 << 8);
+    auto v3 = hasBits(leaf1.ecx, v3Ecx) && hasBits(leaf7.ebx, v3Ebx7);
+    if (!v3 || !hasBits(extLeaf1.ecx, 1 << 5)) {
+      return 2;
+    }
+
+    // AVX-512 F, DQ, CD, BW, VL, and the OS must save the opmask and ZMM registers
+    const uint32_t v4Ebx7 = (1 << 16) | (1 << 17) | (1 << 28) | (1u << 30) | (1u << 31);
+    if (!hasBits(leaf7.ebx, v4Ebx7) || !hasBits(xcr0(), 0xE0)) {
+      return 3;
+    }
+
+    return 4;
+  }
+#endif
+
+  unsigned cpuX86Level() {
+#ifdef FLAC_BINDINGS_CPUID
+    static const unsigned level = detectX86Level();
+    return level;
+#else
+    return 0;
+#endif
+  }
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace flac_bindings {
+
+  /**
+   * The x86-64 micro-architecture level supported by the CPU (and the OS): 1 for the baseline,
+   * 2 for x86-64-v2, 3 for x86-64-v3 (AVX2) and 4 for x86-64-v4 (AVX-512). On other architectures
+   * it returns 0. It is detected once using cpuid.
+   */
+  unsigned cpuX86Level();
+
+}
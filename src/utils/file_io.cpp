@@ -0,0 +1,226 @@
+#include "file_io.hpp"
+#include <cstring>
+#include <system_error>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace flac_bindings {
+
+#ifdef _WIN32
+  static std::wstring toWide(const std::string& str) {
+    auto length = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, nullptr, 0);
+    std::wstring wide(length > 0 ? length - 1 : 0, L'\0');
+    if (length > 1) {
+      MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, wide.data(), length);
+    }
+    return wide;
+  }
+
+  MappedFile::~MappedFile() {
+    if (data != nullptr) {
+      UnmapViewOfFile(data);
+    }
+
+    if (mapping != nullptr) {
+      CloseHandle(mapping);
+    }
+  }
+
+  std::shared_ptr<MappedFile> MappedFile::open(const std::string& path, std::string& error) {
+    auto handle = CreateFileW(
+      toWide(path).c_str(),
+      GENERIC_READ,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      error = std::system_category().message(GetLastError());
+      return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+      error = std::system_category().message(GetLastError());
+      CloseHandle(handle);
+      return nullptr;
+    }
+
+    // empty files cannot be mapped
+    file->length = size.QuadPart;
+    if (file->length > 0) {
+      file->mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (file->mapping != nullptr) {
+        file->data = (const uint8_t*) MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+      }
+
+      if (file->data == nullptr) {
+        error = std::system_category().message(GetLastError());
+        CloseHandle(handle);
+        return nullptr;
+      }
+    }
+
+    // the mapping keeps the file open
+    CloseHandle(handle);
+    return file;
+  }
+#else
+  MappedFile::~MappedFile() {
+    if (data != nullptr) {
+      munmap((void*) data, length);
+    }
+  }
+
+  std::shared_ptr<MappedFile> MappedFile::open(const std::string& path, std::string& error) {
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      error = std::generic_category().message(errno);
+      return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      error = std::generic_category().message(errno);
+      close(fd);
+      return nullptr;
+    }
+
+    // empty files cannot be mapped
+    file->length = st.st_size;
+    if (file->length > SIZE_MAX) {
+      error = "File is too large to be mapped";
+      close(fd);
+      return nullptr;
+    } else if (file->length > 0) {
+      auto ptr = mmap(nullptr, file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED) {
+        error = std::generic_category().message(errno);
+        close(fd);
+        return nullptr;
+      }
+
+      file->data = (const uint8_t*) ptr;
+    }
+
+    // the mapping keeps the file open
+    close(fd);
+    return file;
+  }
+#endif
+
+  size_t MappedFileReader::read(void* buffer, size_t bytes) {
+    if (eof()) {
+      return 0;
+    }
+
+    auto available = file->size() - position;
+    if (bytes > available) {
+      bytes = available;
+    }
+
+    std::memcpy(buffer, file->bytes() + position, bytes);
+    position += bytes;
+    return bytes;
+  }
+
+  bool MappedFileReader::seek(int64_t offset, int whence) {
+    int64_t base;
+    switch (whence) {
+      case SEEK_SET:
+        base = 0;
+        break;
+      case SEEK_CUR:
+        base = position;
+        break;
+      case SEEK_END:
+        base = file->size();
+        break;
+      default:
+        return false;
+    }
+
+    // like fseek, the position can go past the end of the file, but not before the start
+    if (base + offset < 0) {
+      return false;
+    }
+
+    position = base + offset;
+    return true;
+  }
+
+  const FLAC__IOCallbacks MappedFileReader::ioCallbacks = {
+    [](void* ptr, size_t size, size_t nmemb, FLAC__IOHandle handle) -> size_t {
+      if (size == 0) {
+        return 0;
+      }
+
+      return ((MappedFileReader*) handle)->read(ptr, size * nmemb) / size;
+    },
+    nullptr,
+    [](FLAC__IOHandle handle, FLAC__int64 offset, int whence) -> int {
+      return ((MappedFileReader*) handle)->seek(offset, whence) ? 0 : -1;
+    },
+    [](FLAC__IOHandle handle) -> FLAC__int64 {
+      return ((MappedFileReader*) handle)->position;
+    },
+    [](FLAC__IOHandle handle) -> int {
+      return ((MappedFileReader*) handle)->eof() ? 1 : 0;
+    },
+    nullptr,
+  };
+
+  StdioFile::StdioFile(const std::string& path, const char* mode) {
+#ifdef _WIN32
+    file = _wfopen(toWide(path).c_str(), toWide(mode).c_str());
+#else
+    file = fopen(path.c_str(), mode);
+#endif
+  }
+
+  StdioFile::~StdioFile() {
+    if (file != nullptr) {
+      fclose(file);
+    }
+  }
+
+  const FLAC__IOCallbacks StdioFile::ioCallbacks = {
+    [](void* ptr, size_t size, size_t nmemb, FLAC__IOHandle handle) -> size_t {
+      return fread(ptr, size, nmemb, (FILE*) handle);
+    },
+    [](const void* ptr, size_t size, size_t nmemb, FLAC__IOHandle handle) -> size_t {
+      return fwrite(ptr, size, nmemb, (FILE*) handle);
+    },
+    [](FLAC__IOHandle handle, FLAC__int64 offset, int whence) -> int {
+#ifdef _WIN32
+      return _fseeki64((FILE*) handle, offset, whence);
+#else
+      return fseeko((FILE*) handle, offset, whence);
+#endif
+    },
+    [](FLAC__IOHandle handle) -> FLAC__int64 {
+#ifdef _WIN32
+      return _ftelli64((FILE*) handle);
+#else
+      return ftello((FILE*) handle);
+#endif
+    },
+    [](FLAC__IOHandle handle) -> int {
+      return feof((FILE*) handle);
+    },
+    nullptr,
+  };
+
+}
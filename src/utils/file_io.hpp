@@ -0,0 +1,76 @@
+#pragma once
+
+#include <FLAC/callback.h>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace flac_bindings {
+
+  /**
+   * Read-only view of a whole file mapped into memory. The file must not be truncated while it is
+   * mapped, or reading the lost pages will crash the process.
+   */
+  class MappedFile {
+    const uint8_t* data = nullptr;
+    uint64_t length = 0;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+
+    MappedFile() = default;
+
+  public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /** Maps the file, or returns null and fills the error message. */
+    static std::shared_ptr<MappedFile> open(const std::string& path, std::string& error);
+
+    inline const uint8_t* bytes() const {
+      return data;
+    }
+
+    inline uint64_t size() const {
+      return length;
+    }
+  };
+
+  /**
+   * Cursor over a mapped file, which can be used as a FLAC__IOHandle with the callbacks in
+   * ioCallbacks.
+   */
+  struct MappedFileReader {
+    std::shared_ptr<MappedFile> file;
+    uint64_t position = 0;
+
+    MappedFileReader(std::shared_ptr<MappedFile> file): file(file) {}
+
+    size_t read(void* buffer, size_t bytes);
+    bool seek(int64_t offset, int whence);
+
+    inline bool eof() const {
+      return position >= file->size();
+    }
+
+    static const FLAC__IOCallbacks ioCallbacks;
+  };
+
+  /** stdio FILE opened from an UTF-8 path, usable as a FLAC__IOHandle with ioCallbacks. */
+  struct StdioFile {
+    FILE* file = nullptr;
+
+    StdioFile(const std::string& path, const char* mode);
+    StdioFile(const StdioFile&) = delete;
+    ~StdioFile();
+
+    inline operator bool() const {
+      return file != nullptr;
+    }
+
+    static const FLAC__IOCallbacks ioCallbacks;
+  };
+
+}
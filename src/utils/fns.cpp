@@ -1,75 +1,96 @@
 #include "converters.hpp"
 #include "pointer.hpp"
+#include "sample_kernels.hpp"
+#include <optional>
 
 namespace flac_bindings {
 
-  static int64_t readI32(const void* buff) {
-    return *((const int32_t*) buff);
-  }
-
-  static void writeI32(void* buff, int64_t value) {
-    *((int32_t*) buff) = value;
+  static inline void checkBps(uint64_t bps, Napi::Env env) {
+    if (bps < 1 || bps > 4) {
+      throw Napi::Error::New(env, "Unsupported "s + std::to_string(bps) + " bits per sample"s);
+    }
   }
 
-  static int64_t readI24(const void* buff) {
-    const auto tmp = (const uint8_t*) buff;
-    const uint64_t val = tmp[0] | (tmp[1] << 8) | (tmp[2] << 16);
-    return val | (val & 0x800000) * 0x1FE;
+  /**
+   * Formats of the input and output samples of the functions.
+   */
+  struct ConversionOptions {
+    SampleFormat in;
+    SampleFormat out;
+    bool dither;
+  };
+
+  static ConversionOptions conversionFromJs(const Napi::Object& obj) {
+    ConversionOptions options;
+    options.in.isFloat = maybeBooleanFromJs<bool>(obj.Get("inFloat")).value_or(false);
+    options.out.isFloat = maybeBooleanFromJs<bool>(obj.Get("outFloat")).value_or(false);
+    options.in.bps =
+      options.in.isFloat ? 4 : maybeNumberFromJs<uint64_t>(obj.Get("inBps")).value_or(4);
+    options.out.bps =
+      options.out.isFloat ? 4 : maybeNumberFromJs<uint64_t>(obj.Get("outBps")).value_or(4);
+
+    // only used for the integer side when converting from or to float
+    auto bitsPerSample = maybeNumberFromJs<uint64_t>(obj.Get("bitsPerSample"));
+    options.in.bitsPerSample = bitsPerSample.value_or(options.in.bps * 8);
+    options.out.bitsPerSample = bitsPerSample.value_or(options.out.bps * 8);
+    options.dither = maybeBooleanFromJs<bool>(obj.Get("dither")).value_or(false);
+    return options;
   }
 
-  static void writeI24(void* buff, int64_t value) {
-    auto tmp = (uint8_t*) buff;
-    tmp[0] = value & 0xFF;
-    tmp[1] = (value >> 8) & 0xFF;
-    tmp[2] = (value >> 16) & 0xFF;
-  }
+  static inline void checkConversion(const ConversionOptions& options, Napi::Env env) {
+    if (options.in.isFloat == options.out.isFloat) {
+      return;
+    }
 
-  static int64_t readI16(const void* buff) {
-    return *((const int16_t*) buff);
+    const auto& format = options.in.isFloat ? options.out : options.in;
+    if (format.bitsPerSample < 1 || format.bitsPerSample > format.bps * 8) {
+      throw Napi::RangeError::New(
+        env,
+        "Unsupported bitsPerSample "s + std::to_string(format.bitsPerSample) + " for "s
+          + std::to_string(format.bps) + " bytes per sample"s);
+    }
   }
 
-  static void writeI16(void* buff, int64_t value) {
-    *((int16_t*) buff) = value;
+  static inline bool overlaps(const char* a, uint64_t aSize, const char* b, uint64_t bSize) {
+    return a < b + bSize && b < a + aSize;
   }
 
-  static int64_t readI8(const void* buff) {
-    return *((const int8_t*) buff);
-  }
+  /**
+   * Checks the optional output buffer of the functions.
+   * @returns The buffer, or nothing if the output has to be allocated.
+   */
+  static std::optional<Napi::Buffer<char>>
+    maybeOutputFromJs(const Napi::Value& value, uint64_t size) {
+    using namespace Napi;
+    if (value.IsUndefined() || value.IsNull()) {
+      return std::nullopt;
+    }
 
-  static void writeI8(void* buff, int64_t value) {
-    *((int8_t*) buff) = value;
-  }
+    if (!value.IsBuffer()) {
+      throw TypeError::New(value.Env(), "Expected output to be a Buffer");
+    }
 
-  typedef int64_t (*BufferReader)(const void* buff);
-  static inline BufferReader getReader(uint64_t inBps, Napi::Env env) {
-    switch (inBps) {
-      case 1:
-        return readI8;
-      case 2:
-        return readI16;
-      case 3:
-        return readI24;
-      case 4:
-        return readI32;
-      default:
-        throw Napi::Error::New(env, "Unsupported "s + std::to_string(inBps) + " bits per sample"s);
+    auto buffer = value.As<Buffer<char>>();
+    if (buffer.ByteLength() < size) {
+      throw RangeError::New(
+        value.Env(),
+        "Output buffer has size "s + std::to_string(buffer.ByteLength())
+          + " but expected to be at least "s + std::to_string(size));
     }
+
+    return buffer;
   }
 
-  typedef void (*BufferWriter)(void* buff, int64_t);
-  static inline BufferWriter getWriter(uint64_t outBps, Napi::Env env) {
-    switch (outBps) {
-      case 1:
-        return writeI8;
-      case 2:
-        return writeI16;
-      case 3:
-        return writeI24;
-      case 4:
-        return writeI32;
-      default:
-        throw Napi::Error::New(env, "Unsupported "s + std::to_string(outBps) + " bits per sample"s);
+  /**
+   * Returns the output buffer, or a view of the written part if it is bigger.
+   */
+  static Napi::Value outputToJs(Napi::Buffer<char> buffer, uint64_t size) {
+    if (buffer.ByteLength() == size) {
+      return buffer;
     }
+
+    auto subarray = buffer.Get("subarray").As<Napi::Function>();
+    return subarray.Call(buffer, {numberToJs(buffer.Env(), 0), numberToJs(buffer.Env(), size)});
   }
 
   static Napi::Value zipAudio(const Napi::CallbackInfo& info) {
@@ -82,8 +103,9 @@ namespace flac_bindings {
 
     auto obj = info[0].As<Object>();
     auto samples = numberFromJs<uint64_t>(obj.Get("samples"));
-    auto inBps = maybeNumberFromJs<uint64_t>(obj.Get("inBps")).value_or(4);
-    auto outBps = maybeNumberFromJs<uint64_t>(obj.Get("outBps")).value_or(4);
+    auto options = conversionFromJs(obj);
+    auto inBps = options.in.bps;
+    auto outBps = options.out.bps;
     auto buffers = arrayFromJs<char*>(obj.Get("buffers"), [&samples, &inBps](auto val) {
       if (!val.IsBuffer()) {
         throw TypeError::New(val.Env(), "Expected value in buffers to be a Buffer");
@@ -105,23 +127,40 @@ namespace flac_bindings {
       throw Error::New(info.Env(), "Invalid value for one of the given properties");
     }
 
-    // NOTE: if outBps > inBps means that after one sample copy, there is some bytes that need
-    //       to be cleared up. To be faster, all memory is cleared when allocated.
-    //       the reader and writer functions are here to properly read and write ints.
-    auto reader = getReader(inBps, info.Env());
-    auto writer = getWriter(outBps, info.Env());
+    // NOTE: the kernels write every byte of every sample, so there is no need to clear the memory
+    checkBps(inBps, info.Env());
+    checkBps(outBps, info.Env());
+    checkConversion(options, info.Env());
     uint64_t outputBufferSize = samples * outBps * channels;
-    char* outputBuffer =
-      (char*) (outBps <= inBps ? malloc(outputBufferSize) : calloc(outputBufferSize, 1));
-    for (uint64_t sample = 0; sample < samples; sample++) {
-      for (uint64_t channel = 0; channel < channels; channel++) {
-        char* out = outputBuffer + (sample * channels + channel) * outBps;
-        char* in = buffers[channel] + sample * inBps;
-        auto value = reader(in);
-        writer(out, value);
+    auto output = maybeOutputFromJs(obj.Get("output"), outputBufferSize);
+    if (output) {
+      for (auto buffer: buffers) {
+        if (overlaps(buffer, samples * inBps, output->Data(), outputBufferSize)) {
+          throw Error::New(info.Env(), "Output buffer cannot overlap the input buffers");
+        }
       }
+
+      interleaveSamples(
+        buffers.data(),
+        options.in,
+        output->Data(),
+        options.out,
+        channels,
+        samples,
+        options.dither);
+      return scope.Escape(outputToJs(*output, outputBufferSize));
     }
 
+    char* outputBuffer = (char*) malloc(outputBufferSize);
+    interleaveSamples(
+      buffers.data(),
+      options.in,
+      outputBuffer,
+      options.out,
+      channels,
+      samples,
+      options.dither);
+
     return scope.Escape(
       Buffer<char>::New(info.Env(), outputBuffer, outputBufferSize, [](auto, auto data) {
         free(data);
@@ -137,8 +176,9 @@ namespace flac_bindings {
     }
 
     auto obj = info[0].As<Object>();
-    auto inBps = maybeNumberFromJs<uint64_t>(obj.Get("inBps")).value_or(4);
-    auto outBps = maybeNumberFromJs<uint64_t>(obj.Get("outBps")).value_or(4);
+    auto options = conversionFromJs(obj);
+    auto inBps = options.in.bps;
+    auto outBps = options.out.bps;
     auto channels = maybeNumberFromJs<uint64_t>(obj.Get("channels")).value_or(2);
 
     auto bufferPair = pointer::fromBuffer<char>(obj.Get("buffer"));
@@ -158,23 +198,63 @@ namespace flac_bindings {
     }
 
     // NOTE: see above function note about the outputBuffer
-    auto reader = getReader(inBps, info.Env());
-    auto writer = getWriter(outBps, info.Env());
+    checkBps(inBps, info.Env());
+    checkBps(outBps, info.Env());
+    checkConversion(options, info.Env());
     uint64_t outputBufferSize = samples * outBps;
-    std::vector<char*> outputBuffers(channels);
-    for (uint64_t channel = 0; channel < channels; channel += 1) {
-      outputBuffers[channel] =
-        (char*) (outBps <= inBps ? malloc(outputBufferSize) : calloc(outputBufferSize, 1));
-    }
-    for (uint64_t sample = 0; sample < samples; sample++) {
+    auto outputValue = obj.Get("output");
+    if (!outputValue.IsUndefined() && !outputValue.IsNull()) {
+      auto outputs = arrayFromJs<Buffer<char>>(outputValue, [&](const Napi::Value& value) {
+        auto output = maybeOutputFromJs(value, outputBufferSize);
+        if (!output) {
+          throw TypeError::New(info.Env(), "Expected output to be a Buffer");
+        }
+
+        return *output;
+      });
+      if (outputs.size() != channels) {
+        throw RangeError::New(
+          info.Env(),
+          "Expected "s + std::to_string(channels) + " output buffers but got "s
+            + std::to_string(outputs.size()));
+      }
+
+      std::vector<char*> outputBuffers(channels);
+      auto array = Napi::Array::New(info.Env(), channels);
       for (uint64_t channel = 0; channel < channels; channel += 1) {
-        char* out = outputBuffers[channel] + sample * outBps;
-        char* in = buffer + (sample * channels + channel) * inBps;
-        auto value = reader(in);
-        writer(out, value);
+        outputBuffers[channel] = outputs[channel].Data();
+        auto output = outputBuffers[channel];
+        if (overlaps(buffer, samples * inBps * channels, output, outputBufferSize)) {
+          throw Error::New(info.Env(), "Output buffers cannot overlap the input buffer");
+        }
+
+        array[channel] = outputToJs(outputs[channel], outputBufferSize);
       }
+
+      deinterleaveSamples(
+        buffer,
+        options.in,
+        outputBuffers.data(),
+        options.out,
+        channels,
+        samples,
+        options.dither);
+      return scope.Escape(array);
     }
 
+    std::vector<char*> outputBuffers(channels);
+    for (uint64_t channel = 0; channel < channels; channel += 1) {
+      outputBuffers[channel] = (char*) malloc(outputBufferSize);
+    }
+    deinterleaveSamples(
+      buffer,
+      options.in,
+      outputBuffers.data(),
+      options.out,
+      channels,
+      samples,
+      options.dither);
+
     auto array = Napi::Array::New(info.Env(), channels);
     for (uint64_t channel = 0; channel < channels; channel += 1) {
       array[channel] = Buffer<char>::New(
@@ -195,10 +275,14 @@ namespace flac_bindings {
     }
 
     auto obj = info[0].As<Object>();
-    auto inBps = maybeNumberFromJs<uint64_t>(obj.Get("inBps")).value_or(4);
-    auto outBps = maybeNumberFromJs<uint64_t>(obj.Get("outBps")).value_or(4);
-
-    if (inBps == outBps) {
+    auto options = conversionFromJs(obj);
+    auto inBps = options.in.bps;
+    auto outBps = options.out.bps;
+
+    auto outputValue = obj.Get("output");
+    auto hasOutput = !outputValue.IsUndefined() && !outputValue.IsNull();
+    auto sameFormat = inBps == outBps && options.in.isFloat == options.out.isFloat;
+    if (sameFormat && !hasOutput) {
       return scope.Escape(obj.Get("buffer"));
     }
 
@@ -219,18 +303,29 @@ namespace flac_bindings {
     }
 
     // NOTE: see above function note about the outputBuffer
-    auto reader = getReader(inBps, info.Env());
-    auto writer = getWriter(outBps, info.Env());
+    checkBps(inBps, info.Env());
+    checkBps(outBps, info.Env());
+    checkConversion(options, info.Env());
     uint64_t outputBufferSize = samples * outBps;
-    char* outputBuffer =
-      (char*) (outBps <= inBps ? malloc(outputBufferSize) : calloc(outputBufferSize, 1));
-    for (uint64_t sample = 0; sample < samples; sample++) {
-      char* out = outputBuffer + sample * outBps;
-      char* in = buffer + sample * inBps;
-      auto value = reader(in);
-      writer(out, value);
+    auto output = maybeOutputFromJs(outputValue, outputBufferSize);
+    if (output) {
+      // converting to the same or smaller sample size can be done in place, as every sample is
+      // written after it has been read
+      auto inPlace = output->Data() == buffer && outBps <= inBps;
+      if (!inPlace && overlaps(buffer, samples * inBps, output->Data(), outputBufferSize)) {
+        throw Error::New(
+          info.Env(),
+          "Output buffer can only overlap the input buffer if both start at the same position"
+          " and outBps <= inBps");
+      }
+
+      convertSamples(buffer, options.in, output->Data(), options.out, samples, options.dither);
+      return scope.Escape(outputToJs(*output, outputBufferSize));
     }
 
+    char* outputBuffer = (char*) malloc(outputBufferSize);
+    convertSamples(buffer, options.in, outputBuffer, options.out, samples, options.dither);
+
     return scope.Escape(
       Buffer<char>::New(info.Env(), outputBuffer, outputBufferSize, [](auto, auto data) {
         free(data);
@@ -251,6 +346,7 @@ namespace flac_bindings {
         "convertSampleFormat",
         convertSampleFormat,
         napi_enumerable),
+      PropertyDescriptor::Value("kernels", String::New(env, sampleKernelsName()), napi_enumerable),
     });
 
     obj.Freeze();
@@ -0,0 +1,304 @@
+#include "frame_index.hpp"
+#include "frame_utils.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace flac_bindings {
+
+  static constexpr uint8_t indexMagic[4] = {'F', 'L', 'I', 'X'};
+  static constexpr uint32_t indexVersion = 2;
+  static constexpr size_t indexHeaderBytes = 4 + 4 + 8 * 4 + 4 * 2 + 16;
+  static constexpr size_t indexEntryBytes = 8 + 8 + 4;
+
+  static inline uint64_t readLE(const uint8_t* data, unsigned bytes) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < bytes; i += 1) {
+      value |= uint64_t(data[i]) << (8 * i);
+    }
+    return value;
+  }
+
+  static inline void appendLE(std::vector<uint8_t>& out, uint64_t value, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; i += 1) {
+      out.push_back(uint8_t(value >> (8 * i)));
+    }
+  }
+
+  /** What is needed from the metadata blocks to walk through the frames. */
+  struct FlacLayout {
+    uint64_t audioOffset = 0;
+    uint64_t totalSamples = 0;
+    uint32_t fixedBlocksize = 0;
+    uint32_t minFrameSize = 0;
+    uint32_t maxFrameSize = 0;
+    uint8_t md5sum[16] = {};
+  };
+
+  static bool readLayout(const MappedFile& file, FlacLayout& layout, std::string& error) {
+    const auto data = file.bytes();
+    const auto size = file.size();
+    uint64_t pos = 0;
+
+    // libFLAC skips ID3v2 tags at the start of the file, so do the same
+    if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+      pos = 10 + ((data[6] & 0x7F) << 21 | (data[7] & 0x7F) << 14 | (data[8] & 0x7F) << 7)
+        + (data[9] & 0x7F) + (data[5] & 0x10 ? 10 : 0);
+    }
+
+    if (pos + 4 > size || memcmp(data + pos, "fLaC", 4) != 0) {
+      error = "File is not a FLAC file";
+      return false;
+    }
+
+    pos += 4;
+    bool last = false;
+    bool hasStreamInfo = false;
+    while (!last) {
+      if (pos + 4 > size) {
+        error = "The metadata blocks are truncated";
+        return false;
+      }
+
+      last = data[pos] & 0x80;
+      const unsigned type = data[pos] & 0x7F;
+      const uint64_t length = uint64_t(data[pos + 1]) << 16 | data[pos + 2] << 8 | data[pos + 3];
+      pos += 4;
+      if (pos + length > size) {
+        error = "The metadata blocks are truncated";
+        return false;
+      }
+
+      if (type == 0 && length >= 34) {
+        const auto streamInfo = data + pos;
+        const uint32_t minBlocksize = streamInfo[0] << 8 | streamInfo[1];
+        const uint32_t maxBlocksize = streamInfo[2] << 8 | streamInfo[3];
+        layout.fixedBlocksize = minBlocksize == maxBlocksize ? minBlocksize : 0;
+        layout.minFrameSize = streamInfo[4] << 16 | streamInfo[5] << 8 | streamInfo[6];
+        layout.maxFrameSize = streamInfo[7] << 16 | streamInfo[8] << 8 | streamInfo[9];
+        memcpy(layout.md5sum, streamInfo + 18, sizeof(layout.md5sum));
+        layout.totalSamples = uint64_t(streamInfo[13] & 0x0F) << 32
+          | uint64_t(streamInfo[14]) << 24 | streamInfo[15] << 16 | streamInfo[16] << 8
+          | streamInfo[17];
+        hasStreamInfo = true;
+      }
+
+      pos += length;
+    }
+
+    if (!hasStreamInfo) {
+      error = "The STREAMINFO block is missing";
+      return false;
+    }
+
+    layout.audioOffset = pos;
+    return true;
+  }
+
+  void FrameIndex::assign(const MappedFile& file, const FlacLayout& layout) {
+    entries.clear();
+    fileSize = file.size();
+    audioOffset = layout.audioOffset;
+    totalSamples = layout.totalSamples;
+    minFrameSize = layout.minFrameSize;
+    maxFrameSize = layout.maxFrameSize;
+    memcpy(md5sum, layout.md5sum, sizeof(md5sum));
+  }
+
+  bool FrameIndex::reset(const MappedFile& file, std::string& error) {
+    FlacLayout layout;
+    if (!readLayout(file, layout, error)) {
+      return false;
+    }
+
+    assign(file, layout);
+    return true;
+  }
+
+  bool FrameIndex::scan(const MappedFile& file, std::string& error) {
+    FlacLayout layout;
+    if (!readLayout(file, layout, error)) {
+      return false;
+    }
+
+    assign(file, layout);
+    if (totalSamples != 0) {
+      // 4096 is the blocksize the reference encoder uses by default
+      entries.reserve(totalSamples / (layout.fixedBlocksize ? layout.fixedBlocksize : 4096) + 1);
+    }
+
+    const auto data = file.bytes();
+    const auto size = file.size();
+    uint32_t fixedBlocksize = layout.fixedBlocksize;
+    uint64_t expectedSample = 0;
+    uint64_t pos = audioOffset;
+    while (pos < size && (totalSamples == 0 || expectedSample < totalSamples)) {
+      // look for the next frame sync code, 0xFFF8 or 0xFFF9, without touching the subframes
+      auto found = (const uint8_t*) memchr(data + pos, 0xFF, size - pos);
+      if (found == nullptr) {
+        break;
+      }
+
+      pos = found - data;
+      FrameHeaderInfo info;
+      if (
+        pos + 1 >= size || (data[pos + 1] & 0xFE) != 0xF8
+        || !parseFrameHeader(data + pos, size - pos, fixedBlocksize, info)
+        || info.sample != expectedSample) {
+        // a sync code inside a frame, or a frame that does not follow the previous one
+        pos += 1;
+        continue;
+      }
+
+      // for fixed blocksize streams, the frame number is multiplied by the blocksize of the
+      // first frame if the STREAMINFO does not tell it
+      if (fixedBlocksize == 0 && !(data[pos + 1] & 1)) {
+        fixedBlocksize = info.blocksize;
+      }
+
+      entries.push_back({pos, info.sample, info.blocksize});
+      expectedSample = info.sample + info.blocksize;
+      // a frame has at least one byte of subframe and the CRC-16 after the header
+      pos += std::max<uint64_t>(layout.minFrameSize, info.size + 3);
+    }
+
+    if (entries.empty()) {
+      error = "No frames found in the file";
+      return false;
+    }
+
+    return true;
+  }
+
+  const FrameIndexEntry* FrameIndex::find(uint64_t sample) const {
+    auto it = std::upper_bound(
+      entries.begin(),
+      entries.end(),
+      sample,
+      [](uint64_t sample, const FrameIndexEntry& entry) { return sample < entry.sample; });
+    if (it == entries.begin()) {
+      return nullptr;
+    }
+
+    --it;
+    return sample < it->sample + it->blocksize ? &*it : nullptr;
+  }
+
+  bool FrameIndex::append(const FrameIndexEntry& entry) {
+    if (entries.empty()) {
+      if (entry.sample != 0 || entry.offset != audioOffset) {
+        return false;
+      }
+    } else {
+      const auto& last = entries.back();
+      if (entry.sample != last.sample + last.blocksize || entry.offset <= last.offset) {
+        return false;
+      }
+    }
+
+    entries.push_back(entry);
+    return true;
+  }
+
+  bool FrameIndex::belongsTo(const MappedFile& file) const {
+    FlacLayout layout;
+    std::string error;
+    return fileSize == file.size() && readLayout(file, layout, error)
+      && layout.audioOffset == audioOffset && layout.totalSamples == totalSamples
+      && layout.minFrameSize == minFrameSize && layout.maxFrameSize == maxFrameSize
+      && memcmp(layout.md5sum, md5sum, sizeof(md5sum)) == 0;
+  }
+
+  bool FrameIndex::isComplete() const {
+    if (entries.empty() || totalSamples == 0) {
+      return false;
+    }
+
+    const auto& last = entries.back();
+    return last.sample + last.blocksize >= totalSamples;
+  }
+
+  std::vector<uint8_t> FrameIndex::serialize() const {
+    std::vector<uint8_t> out;
+    out.reserve(indexHeaderBytes + entries.size() * indexEntryBytes);
+    out.insert(out.end(), indexMagic, indexMagic + 4);
+    appendLE(out, indexVersion, 4);
+    appendLE(out, fileSize, 8);
+    appendLE(out, audioOffset, 8);
+    appendLE(out, totalSamples, 8);
+    appendLE(out, entries.size(), 8);
+    appendLE(out, minFrameSize, 4);
+    appendLE(out, maxFrameSize, 4);
+    out.insert(out.end(), md5sum, md5sum + sizeof(md5sum));
+    for (const auto& entry: entries) {
+      appendLE(out, entry.offset, 8);
+      appendLE(out, entry.sample, 8);
+      appendLE(out, entry.blocksize, 4);
+    }
+    return out;
+  }
+
+  bool FrameIndex::deserialize(const uint8_t* data, size_t size, std::string& error) {
+    if (size < indexHeaderBytes || memcmp(data, indexMagic, 4) != 0) {
+      error = "The frame index is not valid";
+      return false;
+    }
+
+    if (readLE(data + 4, 4) != indexVersion) {
+      error = "The frame index version is not supported";
+      return false;
+    }
+
+    const auto count = readLE(data + 32, 8);
+    if ((size - indexHeaderBytes) / indexEntryBytes != count
+        || (size - indexHeaderBytes) % indexEntryBytes != 0) {
+      error = "The frame index is truncated";
+      return false;
+    }
+
+    FrameIndex index;
+    index.fileSize = readLE(data + 8, 8);
+    index.audioOffset = readLE(data + 16, 8);
+    index.totalSamples = readLE(data + 24, 8);
+    index.minFrameSize = uint32_t(readLE(data + 40, 4));
+    index.maxFrameSize = uint32_t(readLE(data + 44, 4));
+    memcpy(index.md5sum, data + 48, sizeof(index.md5sum));
+    index.entries.reserve(count);
+    for (uint64_t i = 0; i < count; i += 1) {
+      const auto entry = data + indexHeaderBytes + i * indexEntryBytes;
+      const auto blocksize = uint32_t(readLE(entry + 16, 4));
+      if (blocksize == 0 || !index.append({readLE(entry, 8), readLE(entry + 8, 8), blocksize})) {
+        error = "The frame index is not valid";
+        return false;
+      }
+    }
+
+    *this = std::move(index);
+    return true;
+  }
+
+  bool FrameIndex::load(const std::string& path, std::string& error) {
+    auto file = MappedFile::open(path, error);
+    if (!file) {
+      return false;
+    }
+
+    return deserialize(file->bytes(), file->size(), error);
+  }
+
+  bool FrameIndex::save(const std::string& path, std::string& error) const {
+    StdioFile file(path, "wb");
+    if (!file) {
+      error = "Cannot open " + path + " for writing";
+      return false;
+    }
+
+    const auto data = serialize();
+    if (fwrite(data.data(), 1, data.size(), file.file) != data.size()) {
+      error = "Could not write the frame index";
+      return false;
+    }
+
+    return true;
+  }
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "file_io.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace flac_bindings {
+
+  /** Where a frame is in a FLAC file. */
+  struct FrameIndexEntry {
+    uint64_t offset;
+    uint64_t sample;
+    uint32_t blocksize;
+  };
+
+  struct FlacLayout;
+
+  /**
+   * Offset, first sample and blocksize of every frame of a native FLAC file, sorted and without
+   * gaps from the first frame, so any sample can be found without reading the file. It can be
+   * complete, built by scanning the frame headers, or partial, built while decoding.
+   */
+  class FrameIndex {
+    std::vector<FrameIndexEntry> entries;
+    // size of the file and offset of its first frame, to detect if the index belongs to another
+    // file or to a file whose metadata has been changed
+    uint64_t fileSize = 0;
+    uint64_t audioOffset = 0;
+    // from the STREAMINFO, 0 if unknown, also to detect if the audio is not the same
+    uint64_t totalSamples = 0;
+    uint32_t minFrameSize = 0;
+    uint32_t maxFrameSize = 0;
+    uint8_t md5sum[16] = {};
+
+    void assign(const MappedFile& file, const FlacLayout& layout);
+
+  public:
+    /** Empties the index, and prepares it to be filled from the frames of the file. */
+    bool reset(const MappedFile& file, std::string& error);
+
+    /**
+     * Builds the index by reading only the frame headers of a mapped FLAC file. A header is
+     * accepted if its CRC-8 is valid and its first sample follows the previous frame.
+     */
+    bool scan(const MappedFile& file, std::string& error);
+
+    /** The frame that contains `sample`, or null if it is not indexed. */
+    const FrameIndexEntry* find(uint64_t sample) const;
+
+    /** Adds the frame after the last one, other frames are ignored. */
+    bool append(const FrameIndexEntry& entry);
+
+    /**
+     * `true` if the index has been built for the file, and the first frame is in its place. The
+     * STREAMINFO is compared too, so an index of a re-encoded file with the same size is rejected.
+     */
+    bool belongsTo(const MappedFile& file) const;
+
+    /** `true` if every frame of the file is in the index. */
+    bool isComplete() const;
+
+    inline uint64_t firstFrameOffset() const {
+      return audioOffset;
+    }
+
+    inline size_t size() const {
+      return entries.size();
+    }
+
+    /** The sample after the last indexed frame. */
+    inline uint64_t endSample() const {
+      return entries.empty() ? 0 : entries.back().sample + entries.back().blocksize;
+    }
+
+    std::vector<uint8_t> serialize() const;
+    bool deserialize(const uint8_t* data, size_t size, std::string& error);
+
+    bool load(const std::string& path, std::string& error);
+    bool save(const std::string& path, std::string& error) const;
+  };
+
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace flac_bindings {
+
+  // -- CRC --
+
+  template<typename T, unsigned Bits, unsigned Polynomial>
+  static constexpr std::array<T, 256> crcTable() {
+    std::array<T, 256> table {};
+    for (unsigned i = 0; i < 256; i += 1) {
+      unsigned crc = i << (Bits - 8);
+      for (unsigned bit = 0; bit < 8; bit += 1) {
+        crc = (crc & (1u << (Bits - 1))) ? (crc << 1) ^ Polynomial : crc << 1;
+      }
+      table[i] = T(crc);
+    }
+    return table;
+  }
+
+  /**
+   * CRC-8 of the FLAC frame header (polynomial x^8 + x^2 + x^1 + x^0, initialized with 0).
+   */
+  static inline uint8_t crc8(const uint8_t* data, size_t size) {
+    static constexpr auto table = crcTable<uint8_t, 8, 0x07>();
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i += 1) {
+      crc = table[crc ^ data[i]];
+    }
+    return crc;
+  }
+
+  /**
+   * CRC-16 of the whole FLAC frame (polynomial x^16 + x^15 + x^2 + x^0, initialized with 0).
+   */
+  static inline uint16_t crc16(const uint8_t* data, size_t size) {
+    static constexpr auto table = crcTable<uint16_t, 16, 0x8005>();
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i += 1) {
+      crc = uint16_t((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+  }
+
+  // -- frame header --
+
+  /**
+   * Length of the UTF-8 like coded number in the frame header, given its first byte, or 0 if
+   * the byte is not valid.
+   */
+  static inline unsigned codedNumberLength(uint8_t first) {
+    unsigned length = 0;
+    while (length < 8 && (first & (0x80 >> length))) {
+      length += 1;
+    }
+
+    if (length == 0) {
+      return 1;
+    }
+
+    return length == 1 || length == 8 ? 0 : length;
+  }
+
+  /**
+   * Reads the UTF-8 like coded number of `length` bytes (see codedNumberLength).
+   * @returns `false` if the continuation bytes are not valid.
+   */
+  static inline bool readCodedNumber(const uint8_t* data, unsigned length, uint64_t& value) {
+    value = length == 1 ? data[0] : data[0] & (0x7F >> length);
+    for (unsigned i = 1; i < length; i += 1) {
+      if ((data[i] & 0xC0) != 0x80) {
+        return false;
+      }
+
+      value = (value << 6) | (data[i] & 0x3F);
+    }
+
+    return true;
+  }
+
+  static inline void appendCodedNumber(std::vector<uint8_t>& out, uint64_t value) {
+    if (value < 0x80) {
+      out.push_back(uint8_t(value));
+      return;
+    }
+
+    // 1 byte per 6 bits, and the first byte holds the rest of the bits after the length mark
+    unsigned length = 2;
+    while (length < 7 && value >= (uint64_t(1) << (5 * length + 1))) {
+      length += 1;
+    }
+
+    out.push_back(uint8_t((0xFF00 >> length) | (value >> (6 * (length - 1)))));
+    for (unsigned i = length - 1; i > 0; i -= 1) {
+      out.push_back(uint8_t(0x80 | ((value >> (6 * (i - 1))) & 0x3F)));
+    }
+  }
+
+  /**
+   * Size of the frame header without the CRC-8, or 0 if it is not a valid header.
+   */
+  static inline size_t frameHeaderSize(const uint8_t* frame, size_t size) {
+    if (size < 5 || frame[0] != 0xFF || (frame[1] & 0xFE) != 0xF8) {
+      return 0;
+    }
+
+    auto numberLength = codedNumberLength(frame[4]);
+    if (numberLength == 0) {
+      return 0;
+    }
+
+    const unsigned blocksizeCode = frame[2] >> 4;
+    const unsigned sampleRateCode = frame[2] & 0x0F;
+    size_t headerSize = 4 + numberLength;
+    headerSize += blocksizeCode == 6 ? 1 : blocksizeCode == 7 ? 2 : 0;
+    headerSize += sampleRateCode == 12 ? 1 : (sampleRateCode == 13 || sampleRateCode == 14) ? 2 : 0;
+    return headerSize < size ? headerSize : 0;
+  }
+
+  /** The fields of a frame header needed to know where the frame is in the stream. */
+  struct FrameHeaderInfo {
+    // bytes of the header including the CRC-8
+    size_t size;
+    uint32_t blocksize;
+    // first sample of the frame, already multiplied for fixed blocksize streams
+    uint64_t sample;
+  };
+
+  /**
+   * Parses the frame header at `frame` and checks its CRC-8, without reading the subframes. The
+   * frame number of fixed blocksize streams is converted into a sample number using
+   * `fixedBlocksize`, or the blocksize of the frame itself if it is 0.
+   * @returns `false` if it is not a valid frame header.
+   */
+  static inline bool parseFrameHeader(
+    const uint8_t* frame,
+    size_t size,
+    uint32_t fixedBlocksize,
+    FrameHeaderInfo& info) {
+    const auto headerSize = frameHeaderSize(frame, size);
+    // reserved blocksize and sample rate codes, and the reserved bit after the sample size
+    if (headerSize == 0 || (frame[2] >> 4) == 0 || (frame[2] & 0x0F) == 15 || (frame[3] & 1)) {
+      return false;
+    }
+
+    if (crc8(frame, headerSize) != frame[headerSize]) {
+      return false;
+    }
+
+    const auto numberLength = codedNumberLength(frame[4]);
+    uint64_t number;
+    if (!readCodedNumber(frame + 4, numberLength, number)) {
+      return false;
+    }
+
+    const unsigned blocksizeCode = frame[2] >> 4;
+    const uint8_t* extra = frame + 4 + numberLength;
+    if (blocksizeCode == 1) {
+      info.blocksize = 192;
+    } else if (blocksizeCode <= 5) {
+      info.blocksize = 576u << (blocksizeCode - 2);
+    } else if (blocksizeCode == 6) {
+      info.blocksize = extra[0] + 1u;
+    } else if (blocksizeCode == 7) {
+      info.blocksize = ((uint32_t(extra[0]) << 8) | extra[1]) + 1u;
+    } else {
+      info.blocksize = 256u << (blocksizeCode - 8);
+    }
+
+    const bool variableBlocksize = frame[1] & 1;
+    info.size = headerSize + 1;
+    const uint32_t frameBlocksize = fixedBlocksize != 0 ? fixedBlocksize : info.blocksize;
+    info.sample = variableBlocksize ? number : number * frameBlocksize;
+    return true;
+  }
+
+  /**
+   * Appends a fixed blocksize frame to `out`, changing its frame number and updating both CRCs.
+   * @returns `false` if the frame header is not valid.
+   */
+  static inline bool appendRenumberedFrame(
+    std::vector<uint8_t>& out,
+    const uint8_t* frame,
+    size_t size,
+    uint64_t n) {
+    auto headerSize = frameHeaderSize(frame, size);
+    // header + CRC-8 + at least the CRC-16
+    if (headerSize == 0 || headerSize + 3 > size) {
+      return false;
+    }
+
+    const auto start = out.size();
+    out.reserve(start + size + 8);
+    out.insert(out.end(), frame, frame + 4);
+    appendCodedNumber(out, n);
+    const auto numberEnd = 4 + codedNumberLength(frame[4]);
+    out.insert(out.end(), frame + numberEnd, frame + headerSize);
+    out.push_back(crc8(out.data() + start, out.size() - start));
+    out.insert(out.end(), frame + headerSize + 1, frame + size - 2);
+    auto crc = crc16(out.data() + start, out.size() - start);
+    out.push_back(uint8_t(crc >> 8));
+    out.push_back(uint8_t(crc & 0xFF));
+    return true;
+  }
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flac_bindings {
+
+  /**
+   * MD5 (RFC 1321), used to compute the STREAMINFO signature when the audio is not encoded or
+   * decoded by a single libFLAC instance.
+   */
+  class Md5 {
+    uint32_t state[4];
+    uint64_t length = 0;
+    uint8_t buffer[64];
+
+    void transform(const uint8_t* block);
+
+  public:
+    Md5();
+
+    void update(const void* data, size_t size);
+    void finish(uint8_t digest[16]);
+  };
+
+}
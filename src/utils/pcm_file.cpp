@@ -0,0 +1,670 @@
+#include "pcm_file.hpp"
+#include "sample_kernels.hpp"
+#include <FLAC/format.h>
+#include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+
+namespace flac_bindings {
+
+  using namespace std::string_literals;
+
+  // samples converted at a time when writing, so the buffer does not depend on the input
+  static constexpr uint64_t chunkSamples = 4096;
+  // RIFF sizes are 32 bit, and the header (but the first 8 bytes) counts inside the RIFF size
+  static constexpr uint64_t wavHeaderBytes = 44;
+  // with a JUNK chunk that becomes the ds64 chunk if the file ends up being RF64
+  static constexpr uint64_t rf64HeaderBytes = 80;
+  // a WAVE_FORMAT_EXTENSIBLE fmt chunk is 24 bytes bigger than a PCM one
+  static constexpr uint64_t extensibleFmtExtraBytes = 24;
+
+  /** Bytes of samples that fit in a RIFF file with that header, including the padding. */
+  static inline uint64_t riffDataLimit(uint64_t headerBytes) {
+    return UINT32_MAX - (headerBytes - 8) - 1;
+  }
+
+  static inline uint32_t readLE(const uint8_t* data, unsigned bytes) {
+    uint32_t value = 0;
+    for (unsigned i = 0; i < bytes; i += 1) {
+      value |= uint32_t(data[i]) << (i * 8);
+    }
+    return value;
+  }
+
+  static inline uint64_t readLE64(const uint8_t* data) {
+    return readLE(data, 4) | (uint64_t(readLE(data + 4, 4)) << 32);
+  }
+
+  static inline uint32_t readBE(const uint8_t* data, unsigned bytes) {
+    uint32_t value = 0;
+    for (unsigned i = 0; i < bytes; i += 1) {
+      value = (value << 8) | data[i];
+    }
+    return value;
+  }
+
+  /** Reads the 80 bit extended float that AIFF uses for the sample rate. */
+  static double readExtended(const uint8_t* data) {
+    const int exponent = int(readBE(data, 2) & 0x7FFF);
+    const uint64_t mantissa = (uint64_t(readBE(data + 2, 4)) << 32) | readBE(data + 6, 4);
+    const double value = std::ldexp(double(mantissa), exponent - 16383 - 63);
+    return (data[0] & 0x80) ? -value : value;
+  }
+
+  static inline void putLE(uint8_t* data, uint64_t value, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; i += 1) {
+      data[i] = uint8_t(value >> (i * 8));
+    }
+  }
+
+  static inline bool seekFile(StdioFile& file, int64_t offset, int whence) {
+    return StdioFile::ioCallbacks.seek(file.file, offset, whence) == 0;
+  }
+
+  // Wave64 uses GUIDs instead of FourCCs, the first four bytes are still the FourCC
+  static constexpr uint8_t w64RiffGuid[16] = {
+    'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00,
+  };
+  static constexpr uint8_t w64WaveGuid[16] = {
+    'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A,
+  };
+  static constexpr uint8_t w64FmtGuid[16] = {
+    'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A,
+  };
+  static constexpr uint8_t w64DataGuid[16] = {
+    'd', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A,
+  };
+  // KSDATAFORMAT_SUBTYPE_PCM without the format tag in the first two bytes
+  static constexpr uint8_t pcmSubformatSuffix[14] = {
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71,
+  };
+
+  static bool checkFormat(const PcmFormat& format, std::string& error) {
+    if (format.channels == 0) {
+      error = "Number of channels must be greater than 0";
+      return false;
+    }
+
+    if (format.bitsPerSample == 0 || format.bitsPerSample > 32) {
+      error = "Unsupported "s + std::to_string(format.bitsPerSample) + " bits per sample"s;
+      return false;
+    }
+
+    return true;
+  }
+
+  // -- reader --
+
+  bool PcmFileReader::open(
+    const std::string& path,
+    PcmContainer container,
+    const PcmFormat& rawFormat) {
+    this->container = container;
+    file = std::make_unique<StdioFile>(path, "rb");
+    if (!*file) {
+      error = "Could not open file "s + path + ": "s + strerror(errno);
+      return false;
+    }
+
+    // samples are read in big blocks, the stdio buffer would only add another copy
+    setvbuf(file->file, nullptr, _IONBF, 0);
+    if (container != PcmContainer::Raw) {
+      uint8_t header[12];
+      if (fread(header, 1, 12, file->file) == 12) {
+        if (memcmp(header, "RIFF", 4) == 0 || memcmp(header, "RF64", 4) == 0) {
+          return readRiffHeader(header);
+        }
+        if (memcmp(header, "riff", 4) == 0) {
+          return readWave64Header(header);
+        }
+        if (memcmp(header, "FORM", 4) == 0) {
+          return readAiffHeader(header);
+        }
+      }
+
+      error = "File is not a WAV or AIFF file";
+      return false;
+    }
+
+    pcmFormat = rawFormat;
+    if (!checkFormat(pcmFormat, error)) {
+      return false;
+    }
+
+    if (!seekFile(*file, 0, SEEK_END)) {
+      error = "Could not seek in file "s + path + ": "s + strerror(errno);
+      return false;
+    }
+
+    const auto size = StdioFile::ioCallbacks.tell(file->file);
+    seekFile(*file, 0, SEEK_SET);
+    sampleBytes = pcmFormat.bps();
+    remaining = size > 0 ? uint64_t(size) / (pcmFormat.channels * sampleBytes) : 0;
+    pcmFormat.totalSamples = remaining;
+    return true;
+  }
+
+  bool PcmFileReader::readRiffHeader(const uint8_t* header) {
+    if (memcmp(header + 8, "WAVE", 4) != 0) {
+      error = "File is not a WAV file";
+      return false;
+    }
+
+    const bool rf64 = memcmp(header, "RF64", 4) == 0;
+    uint64_t rf64DataSize = UINT64_MAX;
+    bool hasFormat = false;
+    while (true) {
+      uint8_t chunk[8];
+      if (fread(chunk, 1, 8, file->file) != 8) {
+        error = "WAV file has no data chunk";
+        return false;
+      }
+
+      uint64_t size = readLE(chunk + 4, 4);
+      // chunks are aligned to 2 bytes
+      uint64_t skip = size + (size & 1);
+      if (rf64 && memcmp(chunk, "ds64", 4) == 0) {
+        uint8_t ds64[24];
+        if (size < 24 || fread(ds64, 1, 24, file->file) != 24) {
+          error = "RF64 file has an invalid ds64 chunk";
+          return false;
+        }
+
+        rf64DataSize = readLE64(ds64 + 8);
+        skip -= 24;
+      } else if (memcmp(chunk, "fmt ", 4) == 0) {
+        uint8_t fmt[40];
+        const auto fmtSize = std::min<uint64_t>(size, sizeof(fmt));
+        if (fread(fmt, 1, fmtSize, file->file) != fmtSize || !readWaveFormat(fmt, fmtSize)) {
+          error = error.empty() ? "WAV file has an invalid fmt chunk" : error;
+          return false;
+        }
+
+        hasFormat = true;
+        skip -= fmtSize;
+      } else if (memcmp(chunk, "data", 4) == 0) {
+        if (!hasFormat) {
+          error = "WAV file has the data chunk before the fmt chunk";
+          return false;
+        }
+
+        // the size is in the ds64 chunk for RF64, and streamed WAV files do not know it
+        return startData(size == UINT32_MAX ? rf64DataSize : size);
+      }
+
+      if (skip > 0 && !seekFile(*file, skip, SEEK_CUR)) {
+        error = "Could not seek in WAV file: "s + strerror(errno);
+        return false;
+      }
+    }
+  }
+
+  bool PcmFileReader::readWave64Header(const uint8_t* header) {
+    uint8_t riff[40];
+    memcpy(riff, header, 12);
+    if (fread(riff + 12, 1, 28, file->file) != 28 || memcmp(riff, w64RiffGuid, 16) != 0
+        || memcmp(riff + 24, w64WaveGuid, 16) != 0) {
+      error = "File is not a Wave64 file";
+      return false;
+    }
+
+    bool hasFormat = false;
+    while (true) {
+      uint8_t chunk[24];
+      if (fread(chunk, 1, 24, file->file) != 24) {
+        error = "Wave64 file has no data chunk";
+        return false;
+      }
+
+      // sizes include the chunk header, and chunks are aligned to 8 bytes
+      const uint64_t size = readLE64(chunk + 16);
+      if (size < 24) {
+        error = "Wave64 file has an invalid chunk";
+        return false;
+      }
+
+      uint64_t skip = ((size + 7) & ~uint64_t(7)) - 24;
+      if (memcmp(chunk, w64FmtGuid, 16) == 0) {
+        uint8_t fmt[40];
+        const auto fmtSize = std::min<uint64_t>(size - 24, sizeof(fmt));
+        if (fread(fmt, 1, fmtSize, file->file) != fmtSize || !readWaveFormat(fmt, fmtSize)) {
+          error = error.empty() ? "Wave64 file has an invalid fmt chunk" : error;
+          return false;
+        }
+
+        hasFormat = true;
+        skip -= fmtSize;
+      } else if (memcmp(chunk, w64DataGuid, 16) == 0) {
+        if (!hasFormat) {
+          error = "Wave64 file has the data chunk before the fmt chunk";
+          return false;
+        }
+
+        return startData(size - 24);
+      }
+
+      if (skip > 0 && !seekFile(*file, skip, SEEK_CUR)) {
+        error = "Could not seek in Wave64 file: "s + strerror(errno);
+        return false;
+      }
+    }
+  }
+
+  bool PcmFileReader::readWaveFormat(const uint8_t* fmt, uint64_t size) {
+    if (size < 16) {
+      return false;
+    }
+
+    auto tag = readLE(fmt, 2);
+    const auto blockAlign = readLE(fmt + 12, 2);
+    const auto containerBits = readLE(fmt + 14, 2);
+    pcmFormat.channels = readLE(fmt + 2, 2);
+    pcmFormat.sampleRate = readLE(fmt + 4, 4);
+    pcmFormat.bitsPerSample = containerBits;
+    if (tag == 0xFFFE) {
+      // WAVE_FORMAT_EXTENSIBLE: the real format is in the subformat GUID
+      if (size < 40) {
+        return false;
+      }
+
+      const auto validBits = readLE(fmt + 18, 2);
+      pcmFormat.channelMask = readLE(fmt + 20, 4);
+      tag = memcmp(fmt + 26, pcmSubformatSuffix, 14) == 0 ? readLE(fmt + 24, 2) : 0;
+      if (validBits > containerBits) {
+        return false;
+      }
+
+      pcmFormat.bitsPerSample = validBits > 0 ? validBits : containerBits;
+    }
+
+    if (tag != 1) {
+      error = "Unsupported WAV format "s + std::to_string(tag) + ", only integer PCM is"s
+              + " supported"s;
+      return false;
+    }
+
+    if (!checkFormat(pcmFormat, error)) {
+      return false;
+    }
+
+    sampleBytes = (containerBits + 7) / 8;
+    if (blockAlign != pcmFormat.channels * sampleBytes) {
+      error = "WAV file has an invalid block align";
+      return false;
+    }
+
+    bigEndian = false;
+    // 8 bit WAV samples are unsigned
+    unsignedSamples = sampleBytes == 1;
+    return true;
+  }
+
+  bool PcmFileReader::readAiffHeader(const uint8_t* header) {
+    const bool aifc = memcmp(header + 8, "AIFC", 4) == 0;
+    if (!aifc && memcmp(header + 8, "AIFF", 4) != 0) {
+      error = "File is not an AIFF file";
+      return false;
+    }
+
+    bool hasFormat = false;
+    while (true) {
+      uint8_t chunk[8];
+      if (fread(chunk, 1, 8, file->file) != 8) {
+        error = "AIFF file has no SSND chunk";
+        return false;
+      }
+
+      const uint64_t size = readBE(chunk + 4, 4);
+      uint64_t skip = size + (size & 1);
+      if (memcmp(chunk, "COMM", 4) == 0) {
+        uint8_t comm[22];
+        const uint64_t commSize = aifc ? 22 : 18;
+        if (size < commSize || fread(comm, 1, commSize, file->file) != commSize) {
+          error = "AIFF file has an invalid COMM chunk";
+          return false;
+        }
+
+        pcmFormat.channels = readBE(comm, 2);
+        pcmFormat.bitsPerSample = readBE(comm + 6, 2);
+        pcmFormat.sampleRate = uint32_t(std::lround(readExtended(comm + 8)));
+        if (!checkFormat(pcmFormat, error)) {
+          return false;
+        }
+
+        bigEndian = true;
+        if (aifc && memcmp(comm + 18, "sowt", 4) == 0) {
+          bigEndian = false;
+        } else if (aifc && memcmp(comm + 18, "NONE", 4) != 0 && memcmp(comm + 18, "twos", 4) != 0) {
+          error = "Unsupported AIFF-C compression "s + std::string((const char*) comm + 18, 4)
+                  + ", only uncompressed PCM is supported"s;
+          return false;
+        }
+
+        sampleBytes = pcmFormat.bps();
+        unsignedSamples = false;
+        hasFormat = true;
+        skip -= commSize;
+      } else if (memcmp(chunk, "SSND", 4) == 0) {
+        if (!hasFormat) {
+          error = "AIFF file has the SSND chunk before the COMM chunk";
+          return false;
+        }
+
+        uint8_t ssnd[8];
+        if (size < 8 || fread(ssnd, 1, 8, file->file) != 8) {
+          error = "AIFF file has an invalid SSND chunk";
+          return false;
+        }
+
+        const uint64_t offset = readBE(ssnd, 4);
+        if (offset > size - 8 || (offset > 0 && !seekFile(*file, offset, SEEK_CUR))) {
+          error = "AIFF file has an invalid SSND chunk";
+          return false;
+        }
+
+        return startData(size - 8 - offset);
+      }
+
+      if (skip > 0 && !seekFile(*file, skip, SEEK_CUR)) {
+        error = "Could not seek in AIFF file: "s + strerror(errno);
+        return false;
+      }
+    }
+  }
+
+  /** Sets up the reading of a data chunk of `size` bytes, or until the end if unknown. */
+  bool PcmFileReader::startData(uint64_t size) {
+    remaining = size == UINT64_MAX ? UINT64_MAX : size / (pcmFormat.channels * sampleBytes);
+    pcmFormat.totalSamples = remaining == UINT64_MAX ? 0 : remaining;
+    return true;
+  }
+
+  uint64_t PcmFileReader::read(int32_t* out, uint64_t samples) {
+    const uint64_t frameBytes = pcmFormat.channels * sampleBytes;
+    samples = std::min(samples, remaining);
+    if (samples == 0) {
+      return 0;
+    }
+
+    // 32 bit samples are read in place, without the intermediate buffer
+    char* in = (char*) out;
+    if (sampleBytes != 4) {
+      buffer.resize(std::max<size_t>(buffer.size(), samples * frameBytes));
+      in = buffer.data();
+    }
+
+    const auto requested = samples * frameBytes;
+    const auto bytes = fread(in, 1, requested, file->file);
+    if (bytes < requested && ferror(file->file)) {
+      error = "Could not read from file: "s + strerror(errno);
+      return 0;
+    }
+
+    // a truncated file ends at the last complete sample
+    samples = bytes / frameBytes;
+    if (bytes < requested) {
+      remaining = 0;
+    } else if (remaining != UINT64_MAX) {
+      remaining -= samples;
+    }
+
+    const auto count = samples * pcmFormat.channels;
+    if (bigEndian && sampleBytes > 1) {
+      for (uint64_t i = 0; i < count; i += 1) {
+        std::reverse(in + i * sampleBytes, in + (i + 1) * sampleBytes);
+      }
+    }
+
+    if (unsignedSamples) {
+      for (uint64_t i = 0; i < count; i += 1) {
+        in[i] ^= 0x80;
+      }
+    }
+
+    convertSamples(in, sampleBytes, (char*) out, 4, count);
+    // WAV and AIFF samples are stored in the most significant bits
+    const auto shift = sampleBytes * 8 - pcmFormat.bitsPerSample;
+    if (container != PcmContainer::Raw && shift > 0) {
+      for (uint64_t i = 0; i < count; i += 1) {
+        out[i] >>= shift;
+      }
+    }
+
+    return samples;
+  }
+
+  // -- writer --
+
+  bool PcmFileWriter::open(
+    const std::string& path,
+    PcmContainer container,
+    const PcmFormat& format) {
+    this->container = container;
+    pcmFormat = format;
+    if (container == PcmContainer::Aiff) {
+      error = "AIFF files can only be read";
+      return false;
+    }
+
+    if (!checkFormat(pcmFormat, error)) {
+      return false;
+    }
+
+    file = std::make_unique<StdioFile>(path, "wb");
+    if (!*file) {
+      error = "Could not open file "s + path + ": "s + strerror(errno);
+      return false;
+    }
+
+    buffer.resize(chunkSamples * pcmFormat.channels * pcmFormat.bps());
+    return container != PcmContainer::Wav || writeWavHeader();
+  }
+
+  bool PcmFileWriter::writeBytes(const void* data, size_t size) {
+    if (fwrite(data, 1, size, file->file) != size) {
+      error = "Could not write to file: "s + strerror(errno);
+      return false;
+    }
+
+    return true;
+  }
+
+  /** The speaker positions FLAC assumes for the number of channels, like the flac CLI does. */
+  static uint32_t defaultChannelMask(uint32_t channels) {
+    static constexpr uint32_t masks[] = {
+      0x0004, 0x0003, 0x0007, 0x0033, 0x0607, 0x060F, 0x070F, 0x063F,
+    };
+    return channels >= 1 && channels <= 8 ? masks[channels - 1] : 0;
+  }
+
+  bool PcmFileWriter::writeWavHeader() {
+    const uint32_t blockAlign = pcmFormat.channels * pcmFormat.bps();
+    const auto estimatedBytes = pcmFormat.totalSamples * blockAlign;
+    // PCM format tag is only meant for up to 2 channels of 8 or 16 bits
+    const bool extensible = pcmFormat.channels > 2 || pcmFormat.bitsPerSample > 16
+                            || pcmFormat.bitsPerSample % 8 != 0;
+    const uint64_t fmtExtraBytes = extensible ? extensibleFmtExtraBytes : 0;
+    // if the size is not known or too big for RIFF, there is space for the RF64 sizes
+    headerBytes = wavHeaderBytes + fmtExtraBytes;
+    rf64Header = pcmFormat.totalSamples == 0 || estimatedBytes > riffDataLimit(headerBytes);
+    if (rf64Header) {
+      headerBytes = rf64HeaderBytes + fmtExtraBytes;
+    }
+
+    // the sizes are updated at the end, but the estimate helps if it is read while writing
+    const auto dataSize = std::min(estimatedBytes, riffDataLimit(headerBytes));
+    uint8_t header[rf64HeaderBytes + extensibleFmtExtraBytes] = {};
+    uint8_t* fmt = header + 12;
+    memcpy(header, "RIFF", 4);
+    putLE(header + 4, headerBytes - 8 + dataSize, 4);
+    memcpy(header + 8, "WAVE", 4);
+    if (rf64Header) {
+      memcpy(header + 12, "JUNK", 4);
+      putLE(header + 16, 28, 4);
+      fmt += 36;
+    }
+
+    memcpy(fmt, "fmt ", 4);
+    putLE(fmt + 4, 16 + fmtExtraBytes, 4);
+    putLE(fmt + 8, extensible ? 0xFFFE : 1, 2);
+    putLE(fmt + 10, pcmFormat.channels, 2);
+    putLE(fmt + 12, pcmFormat.sampleRate, 4);
+    putLE(fmt + 16, pcmFormat.sampleRate * blockAlign, 4);
+    putLE(fmt + 20, blockAlign, 2);
+    if (extensible) {
+      const auto channelMask = pcmFormat.channelMask != 0
+                                 ? pcmFormat.channelMask
+                                 : defaultChannelMask(pcmFormat.channels);
+      putLE(fmt + 22, pcmFormat.bps() * 8, 2);
+      putLE(fmt + 24, 22, 2);
+      putLE(fmt + 26, pcmFormat.bitsPerSample, 2);
+      putLE(fmt + 28, channelMask, 4);
+      // KSDATAFORMAT_SUBTYPE_PCM
+      putLE(fmt + 32, 1, 2);
+      memcpy(fmt + 34, pcmSubformatSuffix, sizeof(pcmSubformatSuffix));
+      fmt += extensibleFmtExtraBytes;
+    } else {
+      putLE(fmt + 22, pcmFormat.bitsPerSample, 2);
+    }
+
+    memcpy(fmt + 24, "data", 4);
+    putLE(fmt + 28, dataSize, 4);
+    return writeBytes(header, headerBytes);
+  }
+
+  /** Writes the first `samples` samples of the buffer, once packed. */
+  bool PcmFileWriter::writeBuffer(uint64_t samples) {
+    const uint64_t bytes = samples * pcmFormat.channels * pcmFormat.bps();
+    if (container == PcmContainer::Wav) {
+      if (!rf64Header && dataBytes + bytes > riffDataLimit(headerBytes)) {
+        error = "WAV files cannot hold more than 4GiB of samples";
+        return false;
+      }
+
+      if (pcmFormat.bps() == 1) {
+        for (uint64_t i = 0; i < bytes; i += 1) {
+          buffer[i] ^= 0x80;
+        }
+      }
+    }
+
+    dataBytes += bytes;
+    return writeBytes(buffer.data(), bytes);
+  }
+
+  bool PcmFileWriter::write(const int32_t* const planar[], uint64_t samples) {
+    const auto bps = pcmFormat.bps();
+    const auto shift = bps * 8 - pcmFormat.bitsPerSample;
+    if (container == PcmContainer::Wav && shift > 0) {
+      // rare enough (12 or 20 bits) to go through the interleaved path
+      std::vector<int32_t> interleaved(std::min(samples, chunkSamples) * pcmFormat.channels);
+      for (uint64_t offset = 0; offset < samples; offset += chunkSamples) {
+        const auto count = std::min(chunkSamples, samples - offset);
+        const char* in[FLAC__MAX_CHANNELS];
+        for (uint32_t channel = 0; channel < pcmFormat.channels; channel += 1) {
+          in[channel] = (const char*) (planar[channel] + offset);
+        }
+
+        interleaveSamples(in, 4, (char*) interleaved.data(), 4, pcmFormat.channels, count);
+        if (!writeInterleaved(interleaved.data(), count)) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    for (uint64_t offset = 0; offset < samples; offset += chunkSamples) {
+      const auto count = std::min(chunkSamples, samples - offset);
+      const char* in[FLAC__MAX_CHANNELS];
+      for (uint32_t channel = 0; channel < pcmFormat.channels; channel += 1) {
+        in[channel] = (const char*) (planar[channel] + offset);
+      }
+
+      interleaveSamples(in, 4, buffer.data(), bps, pcmFormat.channels, count);
+      if (!writeBuffer(count)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool PcmFileWriter::writeInterleaved(const int32_t* interleaved, uint64_t samples) {
+    const auto bps = pcmFormat.bps();
+    const auto shift = container == PcmContainer::Wav ? bps * 8 - pcmFormat.bitsPerSample : 0;
+    for (uint64_t offset = 0; offset < samples; offset += chunkSamples) {
+      const auto count = std::min(chunkSamples, samples - offset);
+      const auto in = interleaved + offset * pcmFormat.channels;
+      if (shift > 0) {
+        // WAV samples are stored in the most significant bits
+        for (uint64_t i = 0; i < count * pcmFormat.channels; i += 1) {
+          const auto sample = uint32_t(in[i]) << shift;
+          for (unsigned byte = 0; byte < bps; byte += 1) {
+            buffer[i * bps + byte] = char(sample >> (byte * 8));
+          }
+        }
+      } else {
+        convertSamples((const char*) in, 4, buffer.data(), bps, count * pcmFormat.channels);
+      }
+
+      if (!writeBuffer(count)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool PcmFileWriter::finish() {
+    if (!file) {
+      return true;
+    }
+
+    bool ok = true;
+    if (container == PcmContainer::Wav) {
+      const uint8_t padding = 0;
+      const uint64_t riffSize = headerBytes - 8 + dataBytes + (dataBytes & 1);
+      ok = ((dataBytes & 1) == 0 || writeBytes(&padding, 1));
+      if (dataBytes > riffDataLimit(headerBytes)) {
+        // too big for RIFF: the JUNK chunk becomes the ds64 chunk with the real sizes
+        uint8_t header[36];
+        memcpy(header, "RF64", 4);
+        putLE(header + 4, UINT32_MAX, 4);
+        memcpy(header + 8, "WAVEds64", 8);
+        putLE(header + 16, 28, 4);
+        putLE(header + 20, riffSize, 8);
+        putLE(header + 28, dataBytes, 8);
+        uint8_t ds64Rest[12];
+        putLE(ds64Rest, dataBytes / (pcmFormat.channels * pcmFormat.bps()), 8);
+        putLE(ds64Rest + 8, 0, 4);
+        uint8_t size[4];
+        putLE(size, UINT32_MAX, 4);
+        ok = ok && seekFile(*file, 0, SEEK_SET) && writeBytes(header, sizeof(header))
+             && writeBytes(ds64Rest, sizeof(ds64Rest));
+        ok = ok && seekFile(*file, headerBytes - 4, SEEK_SET) && writeBytes(size, 4);
+      } else {
+        uint8_t size[4];
+        putLE(size, riffSize, 4);
+        ok = ok && seekFile(*file, 4, SEEK_SET) && writeBytes(size, 4);
+        putLE(size, dataBytes, 4);
+        ok = ok && seekFile(*file, headerBytes - 4, SEEK_SET) && writeBytes(size, 4);
+      }
+
+      if (!ok && error.empty()) {
+        error = "Could not update the WAV header: "s + strerror(errno);
+      }
+    }
+
+    auto closed = fclose(file->file) == 0;
+    file->file = nullptr;
+    file.reset();
+    if (!closed && ok) {
+      error = "Could not write to file: "s + strerror(errno);
+    }
+
+    return ok && closed;
+  }
+
+}
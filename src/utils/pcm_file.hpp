@@ -0,0 +1,112 @@
+#pragma once
+
+#include "file_io.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace flac_bindings {
+
+  /** Format of the samples of a PCM file. */
+  struct PcmFormat {
+    uint32_t channels = 0;
+    uint32_t bitsPerSample = 0;
+    uint32_t sampleRate = 0;
+    // 0 if unknown
+    uint64_t totalSamples = 0;
+    // speaker positions from WAVE_FORMAT_EXTENSIBLE, 0 if unknown
+    uint32_t channelMask = 0;
+
+    /** Bytes of each sample in the file. */
+    inline uint32_t bps() const {
+      return (bitsPerSample + 7) / 8;
+    }
+  };
+
+  /** How the samples are stored in a PCM file. */
+  enum class PcmContainer {
+    // only the samples, little endian and signed, without any header
+    Raw,
+    // RIFF/WAVE with integer samples, when reading also RF64 and Wave64
+    Wav,
+    // AIFF or uncompressed AIFF-C, only for reading
+    Aiff,
+  };
+
+  /**
+   * Reads the samples of a PCM file as interleaved 32 bit integers, using one buffer for the whole
+   * file. Must be opened before using it. On failure, `error` has the reason.
+   */
+  class PcmFileReader {
+    std::unique_ptr<StdioFile> file;
+    PcmContainer container = PcmContainer::Raw;
+    PcmFormat pcmFormat;
+    // bytes of each sample in the file, can be bigger than the bits per sample need
+    uint32_t sampleBytes = 0;
+    bool bigEndian = false;
+    bool unsignedSamples = false;
+    // samples left in the data chunk, or UINT64_MAX if the header does not know
+    uint64_t remaining = 0;
+    std::vector<char> buffer;
+
+    bool readRiffHeader(const uint8_t* header);
+    bool readWave64Header(const uint8_t* header);
+    bool readAiffHeader(const uint8_t* header);
+    bool readWaveFormat(const uint8_t* fmt, uint64_t size);
+    bool startData(uint64_t size);
+
+  public:
+    std::string error;
+
+    /**
+     * Opens the file and reads its header. For raw files the format must be given, and the
+     * total samples are computed from the size of the file. For any other container, the kind
+     * of file (RIFF, RF64, Wave64, AIFF or AIFF-C) is found from the header.
+     */
+    bool open(const std::string& path, PcmContainer container, const PcmFormat& rawFormat);
+
+    /** Reads up to `samples` samples into `out`. Returns 0 at the end of the file or on error. */
+    uint64_t read(int32_t* out, uint64_t samples);
+
+    inline const PcmFormat& format() const {
+      return pcmFormat;
+    }
+  };
+
+  /**
+   * Writes samples into a PCM file, converting them to the bits per sample of the format, using
+   * one buffer for the whole file. The header is written when opened, and the sizes in it are
+   * updated in `finish()`. If the total samples of the format are unknown or do not fit in RIFF,
+   * the WAV file becomes RF64 when it grows beyond 4GiB. On failure, `error` has the reason.
+   */
+  class PcmFileWriter {
+    std::unique_ptr<StdioFile> file;
+    PcmContainer container = PcmContainer::Raw;
+    PcmFormat pcmFormat;
+    uint64_t dataBytes = 0;
+    uint64_t headerBytes = 0;
+    // the header has the JUNK chunk to become RF64
+    bool rf64Header = false;
+    std::vector<char> buffer;
+
+    bool writeBytes(const void* data, size_t size);
+    bool writeWavHeader();
+    bool writeBuffer(uint64_t samples);
+
+  public:
+    std::string error;
+
+    bool open(const std::string& path, PcmContainer container, const PcmFormat& format);
+
+    /** Writes `samples` samples from one buffer per channel, like libFLAC gives them. */
+    bool write(const int32_t* const planar[], uint64_t samples);
+
+    /** Writes `samples` interleaved samples. */
+    bool writeInterleaved(const int32_t* interleaved, uint64_t samples);
+
+    /** Updates the header and closes the file. */
+    bool finish();
+  };
+
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace flac_bindings {
+
+  /**
+   * Byte ring buffer for one producer thread and one consumer thread. Reads and writes never take
+   * a lock, the mutex is only used when one side is sleeping, waiting for the other one.
+   */
+  class SpscRingBuffer {
+    std::unique_ptr<uint8_t[]> data;
+    size_t capacity;
+    // monotonic counters, the difference is the used space
+    std::atomic<uint64_t> head = 0;
+    std::atomic<uint64_t> tail = 0;
+    std::atomic_bool closed = false;
+    std::atomic_int waiters = 0;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    inline void notify() {
+      if (waiters.load() > 0) {
+        { std::lock_guard<std::mutex> lg(mutex); }
+        cond.notify_all();
+      }
+    }
+
+    template<typename Predicate>
+    inline void wait(Predicate predicate) {
+      std::unique_lock<std::mutex> ul(mutex);
+      waiters += 1;
+      cond.wait(ul, predicate);
+      waiters -= 1;
+    }
+
+  public:
+    explicit SpscRingBuffer(size_t capacity): data(new uint8_t[capacity]), capacity(capacity) {}
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    inline size_t size() const {
+      return head.load() - tail.load();
+    }
+
+    inline size_t space() const {
+      return capacity - size();
+    }
+
+    inline bool isClosed() const {
+      return closed.load();
+    }
+
+    inline bool isDrained() const {
+      return closed.load() && size() == 0;
+    }
+
+    /**
+     * Writes as many bytes as possible without blocking.
+     * @returns The number of bytes written.
+     */
+    size_t write(const void* src, size_t bytes) {
+      const uint64_t h = head.load(std::memory_order_relaxed);
+      const uint64_t t = tail.load(std::memory_order_acquire);
+      bytes = std::min<size_t>(bytes, capacity - (h - t));
+      if (bytes == 0) {
+        return 0;
+      }
+
+      const size_t offset = h % capacity;
+      const size_t first = std::min(bytes, capacity - offset);
+      memcpy(data.get() + offset, src, first);
+      memcpy(data.get(), (const uint8_t*) src + first, bytes - first);
+      head.store(h + bytes);
+      notify();
+      return bytes;
+    }
+
+    /**
+     * Reads as many bytes as possible without blocking.
+     * @returns The number of bytes read.
+     */
+    size_t read(void* dst, size_t bytes) {
+      const uint64_t t = tail.load(std::memory_order_relaxed);
+      const uint64_t h = head.load(std::memory_order_acquire);
+      bytes = std::min<size_t>(bytes, h - t);
+      if (bytes == 0) {
+        return 0;
+      }
+
+      const size_t offset = t % capacity;
+      const size_t first = std::min(bytes, capacity - offset);
+      memcpy(dst, data.get() + offset, first);
+      memcpy((uint8_t*) dst + first, data.get(), bytes - first);
+      tail.store(t + bytes);
+      notify();
+      return bytes;
+    }
+
+    /**
+     * Reads some bytes, waiting if the buffer is empty.
+     * @returns The number of bytes read, or 0 if the buffer has been closed and it is empty.
+     */
+    size_t readWait(void* dst, size_t bytes) {
+      if (bytes == 0) {
+        return 0;
+      }
+
+      while (true) {
+        auto read = this->read(dst, bytes);
+        if (read > 0 || isDrained()) {
+          return read;
+        }
+
+        wait([this]() { return size() > 0 || closed.load(); });
+      }
+    }
+
+    /**
+     * Writes all bytes, waiting if the buffer is full.
+     * @returns `false` if the buffer was closed before all bytes could be written.
+     */
+    bool writeWait(const void* src, size_t bytes) {
+      auto ptr = (const uint8_t*) src;
+      while (bytes > 0) {
+        if (closed.load()) {
+          return false;
+        }
+
+        auto written = write(ptr, bytes);
+        ptr += written;
+        bytes -= written;
+        if (written == 0) {
+          wait([this]() { return space() > 0 || closed.load(); });
+        }
+      }
+
+      return true;
+    }
+
+    /**
+     * Makes the buffer bigger, keeping its contents. It is not thread-safe: only call it when the
+     * other side is not using the buffer yet.
+     */
+    void grow(size_t newCapacity) {
+      if (newCapacity <= capacity) {
+        return;
+      }
+
+      const size_t used = size();
+      std::unique_ptr<uint8_t[]> newData(new uint8_t[newCapacity]);
+      read(newData.get(), used);
+      data = std::move(newData);
+      capacity = newCapacity;
+      tail = 0;
+      head = used;
+    }
+
+    /**
+     * Marks the end of the data. Waiting readers will get the remaining bytes and then 0.
+     */
+    void close() {
+      closed = true;
+      notify();
+    }
+  };
+
+}
@@ -0,0 +1,496 @@
+#include "sample_kernels.hpp"
+#include "cpu_features.hpp"
+#include "sample_kernels_internal.hpp"
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#ifdef FLAC_BINDINGS_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace flac_bindings {
+
+  static const SampleKernels scalarKernels = {
+    "scalar",
+    convertScalar<2, 4>,
+    convertScalar<3, 4>,
+    convertScalar<4, 2>,
+    convertScalar<4, 3>,
+    interleave2x32Scalar,
+    deinterleave2x32Scalar,
+    int32ToFloatScalar,
+    floatToInt32Scalar,
+  };
+
+#ifdef FLAC_BINDINGS_KERNELS_NEON
+  // -- NEON --
+
+  static void convert16to32Neon(const char* in, char* out, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto value = vld1q_s16((const int16_t*) (in + i * 2));
+      vst1q_s32((int32_t*) (out + i * 4), vmovl_s16(vget_low_s16(value)));
+      vst1q_s32((int32_t*) (out + i * 4 + 16), vmovl_high_s16(value));
+    }
+
+    convertScalar<2, 4>(in + i * 2, out + i * 4, count - i);
+  }
+
+  static void convert24to32Neon(const char* in, char* out, uint64_t count) {
+    // out of range indices produce zeroes
+    static const uint8_t indices[16] = {255, 0, 1, 2, 255, 3, 4, 5, 255, 6, 7, 8, 255, 9, 10, 11};
+    const auto table = vld1q_u8(indices);
+    uint64_t i = 0;
+    // reads 16 bytes but only uses 12, so stop before reading past the end
+    for (; i + 6 <= count; i += 4) {
+      auto value = vqtbl1q_u8(vld1q_u8((const uint8_t*) (in + i * 3)), table);
+      vst1q_s32((int32_t*) (out + i * 4), vshrq_n_s32(vreinterpretq_s32_u8(value), 8));
+    }
+
+    convertScalar<3, 4>(in + i * 3, out + i * 4, count - i);
+  }
+
+  static void convert32to16Neon(const char* in, char* out, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto low = vmovn_s32(vld1q_s32((const int32_t*) (in + i * 4)));
+      auto high = vmovn_s32(vld1q_s32((const int32_t*) (in + i * 4 + 16)));
+      vst1q_s16((int16_t*) (out + i * 2), vcombine_s16(low, high));
+    }
+
+    convertScalar<4, 2>(in + i * 4, out + i * 2, count - i);
+  }
+
+  static void convert32to24Neon(const char* in, char* out, uint64_t count) {
+    static const uint8_t indices[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 255, 255, 255, 255};
+    const auto table = vld1q_u8(indices);
+    uint64_t i = 0;
+    // writes 16 bytes but only 12 are valid, the next iteration overwrites the rest
+    for (; i + 6 <= count; i += 4) {
+      auto value = vqtbl1q_u8(vld1q_u8((const uint8_t*) (in + i * 4)), table);
+      vst1q_u8((uint8_t*) (out + i * 3), value);
+    }
+
+    convertScalar<4, 3>(in + i * 4, out + i * 3, count - i);
+  }
+
+  static void interleave2x32Neon(const char* left, const char* right, char* out, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      int32x4x2_t value;
+      value.val[0] = vld1q_s32((const int32_t*) (left + i * 4));
+      value.val[1] = vld1q_s32((const int32_t*) (right + i * 4));
+      vst2q_s32((int32_t*) (out + i * 8), value);
+    }
+
+    interleave2x32Scalar(left + i * 4, right + i * 4, out + i * 8, n - i);
+  }
+
+  static void deinterleave2x32Neon(const char* in, char* left, char* right, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      auto value = vld2q_s32((const int32_t*) (in + i * 8));
+      vst1q_s32((int32_t*) (left + i * 4), value.val[0]);
+      vst1q_s32((int32_t*) (right + i * 4), value.val[1]);
+    }
+
+    deinterleave2x32Scalar(in + i * 8, left + i * 4, right + i * 4, n - i);
+  }
+
+  static void int32ToFloatNeon(const char* in, char* out, float scale, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      auto value = vcvtq_f32_s32(vld1q_s32((const int32_t*) (in + i * 4)));
+      vst1q_f32((float*) (out + i * 4), vmulq_n_f32(value, scale));
+    }
+
+    int32ToFloatScalar(in + i * 4, out + i * 4, scale, count - i);
+  }
+
+  static void floatToInt32Neon(
+    const char* in,
+    char* out,
+    float scale,
+    float min,
+    float max,
+    uint64_t count) {
+    const auto low = vdupq_n_f32(min);
+    const auto high = vdupq_n_f32(max);
+    uint64_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      auto value = vmulq_n_f32(vld1q_f32((const float*) (in + i * 4)), scale);
+      // the nm variants return the number if the other one is NaN
+      value = vminnmq_f32(vmaxnmq_f32(value, low), high);
+      vst1q_s32((int32_t*) (out + i * 4), vcvtnq_s32_f32(value));
+    }
+
+    floatToInt32Scalar(in + i * 4, out + i * 4, scale, min, max, count - i);
+  }
+
+  static const SampleKernels neonKernels = {
+    "neon",
+    convert16to32Neon,
+    convert24to32Neon,
+    convert32to16Neon,
+    convert32to24Neon,
+    interleave2x32Neon,
+    deinterleave2x32Neon,
+    int32ToFloatNeon,
+    floatToInt32Neon,
+  };
+#endif
+
+  static const SampleKernels& selectKernels() {
+#if defined(FLAC_BINDINGS_KERNELS_X86)
+    const auto level = cpuX86Level();
+#ifdef FLAC_BINDINGS_X86_64_V4
+    if (level >= 4) {
+      return x86_64_v4Kernels;
+    }
+#endif
+#ifdef FLAC_BINDINGS_X86_64_V3
+    if (level >= 3) {
+      return x86_64_v3Kernels;
+    }
+#endif
+#ifdef FLAC_BINDINGS_X86_64_V2
+    if (level >= 2) {
+      return x86_64_v2Kernels;
+    }
+#endif
+#elif defined(FLAC_BINDINGS_KERNELS_NEON)
+    return neonKernels;
+#endif
+
+    return scalarKernels;
+  }
+
+  static inline const SampleKernels& kernels() {
+    static const SampleKernels& selected = selectKernels();
+    return selected;
+  }
+
+  // -- dispatch --
+
+  // samples per channel converted at a time when going through an intermediate buffer
+  static constexpr uint64_t blockSamples = 512;
+
+  template<typename Function>
+  static inline void withBps(uint64_t bps, Function function) {
+    switch (bps) {
+      case 1:
+        function(std::integral_constant<unsigned, 1>());
+        break;
+      case 2:
+        function(std::integral_constant<unsigned, 2>());
+        break;
+      case 3:
+        function(std::integral_constant<unsigned, 3>());
+        break;
+      default:
+        function(std::integral_constant<unsigned, 4>());
+        break;
+    }
+  }
+
+  void convertSamples(const char* in, uint64_t inBps, char* out, uint64_t outBps, uint64_t count) {
+    const auto& k = kernels();
+    if (inBps == outBps) {
+      memmove(out, in, count * inBps);
+    } else if (inBps == 2 && outBps == 4) {
+      k.convert16to32(in, out, count);
+    } else if (inBps == 3 && outBps == 4) {
+      k.convert24to32(in, out, count);
+    } else if (inBps == 4 && outBps == 2) {
+      k.convert32to16(in, out, count);
+    } else if (inBps == 4 && outBps == 3) {
+      k.convert32to24(in, out, count);
+    } else {
+      withBps(inBps, [&](auto inBpsT) {
+        withBps(outBps, [&](auto outBpsT) {
+          convertScalar<decltype(inBpsT)::value, decltype(outBpsT)::value>(in, out, count);
+        });
+      });
+    }
+  }
+
+  void interleaveSamples(
+    const char* const* in,
+    uint64_t inBps,
+    char* out,
+    uint64_t outBps,
+    uint64_t channels,
+    uint64_t samples) {
+    const auto& k = kernels();
+    if (channels == 2 && inBps == 4 && outBps == 4) {
+      k.interleave2x32(in[0], in[1], out, samples);
+      return;
+    }
+
+    if (channels == 2 && inBps == 4) {
+      // this is what the decoder does: interleave, and then convert to the output format
+      int32_t tmp[blockSamples * 2];
+      for (uint64_t offset = 0; offset < samples; offset += blockSamples) {
+        auto count = std::min(blockSamples, samples - offset);
+        k.interleave2x32(in[0] + offset * 4, in[1] + offset * 4, (char*) tmp, count);
+        convertSamples((const char*) tmp, 4, out + offset * 2 * outBps, outBps, count * 2);
+      }
+      return;
+    }
+
+    withBps(inBps, [&](auto inBpsT) {
+      withBps(outBps, [&](auto outBpsT) {
+        constexpr auto InBps = decltype(inBpsT)::value;
+        constexpr auto OutBps = decltype(outBpsT)::value;
+        if (channels == 2) {
+          interleaveScalar<InBps, OutBps, 2>(in, out, channels, samples);
+        } else if (channels == 6) {
+          interleaveScalar<InBps, OutBps, 6>(in, out, channels, samples);
+        } else {
+          interleaveScalar<InBps, OutBps, 0>(in, out, channels, samples);
+        }
+      });
+    });
+  }
+
+  void deinterleaveSamples(
+    const char* in,
+    uint64_t inBps,
+    char* const* out,
+    uint64_t outBps,
+    uint64_t channels,
+    uint64_t samples) {
+    const auto& k = kernels();
+    if (channels == 2 && inBps == 4 && outBps == 4) {
+      k.deinterleave2x32(in, out[0], out[1], samples);
+      return;
+    }
+
+    if (channels == 2 && outBps == 4) {
+      // this is what the encoder does: convert to 32 bit, and then deinterleave
+      int32_t tmp[blockSamples * 2];
+      for (uint64_t offset = 0; offset < samples; offset += blockSamples) {
+        auto count = std::min(blockSamples, samples - offset);
+        convertSamples(in + offset * 2 * inBps, inBps, (char*) tmp, 4, count * 2);
+        k.deinterleave2x32((const char*) tmp, out[0] + offset * 4, out[1] + offset * 4, count);
+      }
+      return;
+    }
+
+    withBps(inBps, [&](auto inBpsT) {
+      withBps(outBps, [&](auto outBpsT) {
+        constexpr auto InBps = decltype(inBpsT)::value;
+        constexpr auto OutBps = decltype(outBpsT)::value;
+        if (channels == 2) {
+          deinterleaveScalar<InBps, OutBps, 2>(in, out, channels, samples);
+        } else if (channels == 6) {
+          deinterleaveScalar<InBps, OutBps, 6>(in, out, channels, samples);
+        } else {
+          deinterleaveScalar<InBps, OutBps, 0>(in, out, channels, samples);
+        }
+      });
+    });
+  }
+
+  // -- float --
+
+  // float has 24 bits of precision, the kernels cannot be used for bigger samples
+  static constexpr uint64_t maxFloatKernelBits = 24;
+
+  static inline double floatScale(uint64_t bitsPerSample) {
+    return double(uint64_t(1) << (bitsPerSample - 1));
+  }
+
+  // TPDF dither: the difference of two uniform values in [0, 1) has a triangular distribution in
+  // (-1, 1), in LSB units
+  static inline double nextDither() {
+    static thread_local uint32_t state = 0x9E3779B9;
+    auto next = []() {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      return double(state);
+    };
+
+    auto a = next();
+    auto b = next();
+    return (a - b) * (1.0 / 4294967296.0);
+  }
+
+  static void floatToInt32Precise(
+    const char* in,
+    char* out,
+    uint64_t bitsPerSample,
+    bool dither,
+    uint64_t count) {
+    const double scale = floatScale(bitsPerSample);
+    const double min = -scale;
+    const double max = scale - 1;
+    for (uint64_t i = 0; i < count; i += 1) {
+      float sample;
+      memcpy(&sample, in + i * 4, 4);
+      double value = double(sample) * scale + (dither ? nextDither() : 0.0);
+      value = value >= min ? value : min;
+      value = value > max ? max : value;
+      storeSample<4>(out + i * 4, (int32_t) std::nearbyint(value));
+    }
+  }
+
+  void samplesToFloat(
+    const char* in,
+    uint64_t inBps,
+    uint64_t bitsPerSample,
+    char* out,
+    uint64_t count) {
+    const auto& k = kernels();
+    // a power of two, so the scale is exact even if it is a float
+    const float scale = float(1.0 / floatScale(bitsPerSample));
+    if (inBps == 4) {
+      k.int32ToFloat(in, out, scale, count);
+      return;
+    }
+
+    int32_t tmp[blockSamples * 2];
+    for (uint64_t offset = 0; offset < count; offset += blockSamples * 2) {
+      auto n = std::min(blockSamples * 2, count - offset);
+      convertSamples(in + offset * inBps, inBps, (char*) tmp, 4, n);
+      k.int32ToFloat((const char*) tmp, out + offset * 4, scale, n);
+    }
+  }
+
+  void samplesFromFloat(
+    const char* in,
+    char* out,
+    uint64_t outBps,
+    uint64_t bitsPerSample,
+    bool dither,
+    uint64_t count) {
+    const auto& k = kernels();
+    const auto precise = dither || bitsPerSample > maxFloatKernelBits;
+    const float scale = float(floatScale(bitsPerSample));
+    if (outBps == 4 && precise) {
+      floatToInt32Precise(in, out, bitsPerSample, dither, count);
+      return;
+    } else if (outBps == 4) {
+      k.floatToInt32(in, out, scale, -scale, scale - 1, count);
+      return;
+    }
+
+    // every block is read before it is written, and is written at the same or lower position
+    int32_t tmp[blockSamples * 2];
+    for (uint64_t offset = 0; offset < count; offset += blockSamples * 2) {
+      auto n = std::min(blockSamples * 2, count - offset);
+      if (precise) {
+        floatToInt32Precise(in + offset * 4, (char*) tmp, bitsPerSample, dither, n);
+      } else {
+        k.floatToInt32(in + offset * 4, (char*) tmp, scale, -scale, scale - 1, n);
+      }
+      convertSamples((const char*) tmp, 4, out + offset * outBps, outBps, n);
+    }
+  }
+
+  void convertSamples(
+    const char* in,
+    const SampleFormat& inFormat,
+    char* out,
+    const SampleFormat& outFormat,
+    uint64_t count,
+    bool dither) {
+    if (inFormat.isFloat == outFormat.isFloat) {
+      convertSamples(in, inFormat.bps, out, outFormat.bps, count);
+    } else if (outFormat.isFloat) {
+      samplesToFloat(in, inFormat.bps, inFormat.bitsPerSample, out, count);
+    } else {
+      samplesFromFloat(in, out, outFormat.bps, outFormat.bitsPerSample, dither, count);
+    }
+  }
+
+  void interleaveSamples(
+    const char* const* in,
+    const SampleFormat& inFormat,
+    char* out,
+    const SampleFormat& outFormat,
+    uint64_t channels,
+    uint64_t samples,
+    bool dither) {
+    if (inFormat.isFloat == outFormat.isFloat) {
+      interleaveSamples(in, inFormat.bps, out, outFormat.bps, channels, samples);
+      return;
+    }
+
+    // goes block by block so the second pass runs over data that is still in the cache
+    const auto inBps = inFormat.bps;
+    const auto outBps = outFormat.bps;
+    std::vector<const char*> blockIn(channels);
+    std::vector<int32_t> tmp(outFormat.isFloat ? 0 : blockSamples * channels);
+    for (uint64_t offset = 0; offset < samples; offset += blockSamples) {
+      auto n = std::min(blockSamples, samples - offset);
+      for (uint64_t channel = 0; channel < channels; channel += 1) {
+        blockIn[channel] = in[channel] + offset * inBps;
+      }
+
+      if (outFormat.isFloat) {
+        char* blockOut = out + offset * channels * 4;
+        interleaveSamples(blockIn.data(), inBps, blockOut, 4, channels, n);
+        samplesToFloat(blockOut, 4, inFormat.bitsPerSample, blockOut, n * channels);
+      } else {
+        interleaveSamples(blockIn.data(), 4, (char*) tmp.data(), 4, channels, n);
+        samplesFromFloat(
+          (const char*) tmp.data(),
+          out + offset * channels * outBps,
+          outBps,
+          outFormat.bitsPerSample,
+          dither,
+          n * channels);
+      }
+    }
+  }
+
+  void deinterleaveSamples(
+    const char* in,
+    const SampleFormat& inFormat,
+    char* const* out,
+    const SampleFormat& outFormat,
+    uint64_t channels,
+    uint64_t samples,
+    bool dither) {
+    if (inFormat.isFloat == outFormat.isFloat) {
+      deinterleaveSamples(in, inFormat.bps, out, outFormat.bps, channels, samples);
+      return;
+    }
+
+    const auto inBps = inFormat.bps;
+    const auto outBps = outFormat.bps;
+    std::vector<char*> blockOut(channels);
+    std::vector<int32_t> tmp(outFormat.isFloat ? 0 : blockSamples * channels);
+    for (uint64_t offset = 0; offset < samples; offset += blockSamples) {
+      auto n = std::min(blockSamples, samples - offset);
+      for (uint64_t channel = 0; channel < channels; channel += 1) {
+        blockOut[channel] = out[channel] + offset * outBps;
+      }
+
+      const char* blockIn = in + offset * channels * inBps;
+      if (outFormat.isFloat) {
+        deinterleaveSamples(blockIn, inBps, blockOut.data(), 4, channels, n);
+        for (uint64_t channel = 0; channel < channels; channel += 1) {
+          samplesToFloat(blockOut[channel], 4, inFormat.bitsPerSample, blockOut[channel], n);
+        }
+      } else {
+        samplesFromFloat(
+          blockIn,
+          (char*) tmp.data(),
+          4,
+          outFormat.bitsPerSample,
+          dither,
+          n * channels);
+        deinterleaveSamples((const char*) tmp.data(), 4, blockOut.data(), outBps, channels, n);
+      }
+    }
+  }
+
+  const char* sampleKernelsName() {
+    return kernels().name;
+  }
+
+}
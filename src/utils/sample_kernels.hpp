@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+namespace flac_bindings {
+
+  /**
+   * Converts `count` signed little endian samples of `inBps` bytes into samples of `outBps` bytes.
+   * `in` and `out` can be the same pointer if `outBps <= inBps`.
+   */
+  void convertSamples(const char* in, uint64_t inBps, char* out, uint64_t outBps, uint64_t count);
+
+  /**
+   * Interleaves `channels` buffers (one per channel) of `samples` samples into `out`, converting
+   * from `inBps` to `outBps` bytes per sample at the same time.
+   */
+  void interleaveSamples(
+    const char* const* in,
+    uint64_t inBps,
+    char* out,
+    uint64_t outBps,
+    uint64_t channels,
+    uint64_t samples);
+
+  /**
+   * Deinterleaves `in` into `channels` buffers (one per channel) of `samples` samples, converting
+   * from `inBps` to `outBps` bytes per sample at the same time.
+   */
+  void deinterleaveSamples(
+    const char* in,
+    uint64_t inBps,
+    char* const* out,
+    uint64_t outBps,
+    uint64_t channels,
+    uint64_t samples);
+
+  /**
+   * How the samples are stored in a buffer.
+   */
+  struct SampleFormat {
+    /** Bytes per sample, always 4 for float */
+    uint64_t bps;
+    /** The samples are float in the [-1, 1) range instead of signed integers */
+    bool isFloat;
+    /** Bits of the integer samples, used to scale them from or to float */
+    uint64_t bitsPerSample;
+  };
+
+  /**
+   * Converts `count` signed integer samples of `inBps` bytes holding `bitsPerSample` bits into
+   * float. `in` and `out` can be the same pointer if `inBps` is 4.
+   */
+  void samplesToFloat(
+    const char* in,
+    uint64_t inBps,
+    uint64_t bitsPerSample,
+    char* out,
+    uint64_t count);
+
+  /**
+   * Converts `count` float samples into signed integer samples of `outBps` bytes holding
+   * `bitsPerSample` bits, rounding to the nearest value and clamping. If `dither` is set, TPDF
+   * dither is added before rounding. `in` and `out` can be the same pointer.
+   */
+  void samplesFromFloat(
+    const char* in,
+    char* out,
+    uint64_t outBps,
+    uint64_t bitsPerSample,
+    bool dither,
+    uint64_t count);
+
+  /**
+   * Like the integer only functions, but any of the formats can be float. `dither` is only used
+   * when converting from float to integer.
+   */
+  void convertSamples(
+    const char* in,
+    const SampleFormat& inFormat,
+    char* out,
+    const SampleFormat& outFormat,
+    uint64_t count,
+    bool dither);
+
+  void interleaveSamples(
+    const char* const* in,
+    const SampleFormat& inFormat,
+    char* out,
+    const SampleFormat& outFormat,
+    uint64_t channels,
+    uint64_t samples,
+    bool dither);
+
+  void deinterleaveSamples(
+    const char* in,
+    const SampleFormat& inFormat,
+    char* const* out,
+    const SampleFormat& outFormat,
+    uint64_t channels,
+    uint64_t samples,
+    bool dither);
+
+  /**
+   * Name of the set of vectorized kernels selected for this CPU (`"x86-64-v4"`, `"x86-64-v3"`,
+   * `"x86-64-v2"`, `"neon"` or `"scalar"`).
+   */
+  const char* sampleKernelsName();
+
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FLAC_BINDINGS_KERNELS_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define FLAC_BINDINGS_KERNELS_NEON
+#endif
+
+// NOTE: this header is included from translation units built for different micro-architectures,
+//       so everything in here must have internal linkage. An inline function with external
+//       linkage could end up being the AVX-512 copy for the whole addon.
+
+namespace flac_bindings {
+
+  // -- scalar --
+
+  template<unsigned Bps>
+  static inline int32_t loadSample(const char* in) {
+    if constexpr (Bps == 4) {
+      int32_t value;
+      memcpy(&value, in, 4);
+      return value;
+    } else if constexpr (Bps == 3) {
+      auto tmp = (const uint8_t*) in;
+      // places the sample in the upper bits and shifts back to extend the sign
+      return int32_t((uint32_t(tmp[0]) << 8) | (uint32_t(tmp[1]) << 16) | (uint32_t(tmp[2]) << 24))
+             >> 8;
+    } else if constexpr (Bps == 2) {
+      int16_t value;
+      memcpy(&value, in, 2);
+      return value;
+    } else {
+      return (int8_t) in[0];
+    }
+  }
+
+  template<unsigned Bps>
+  static inline void storeSample(char* out, int32_t value) {
+    if constexpr (Bps == 4) {
+      memcpy(out, &value, 4);
+    } else if constexpr (Bps == 3) {
+      out[0] = value & 0xFF;
+      out[1] = (value >> 8) & 0xFF;
+      out[2] = (value >> 16) & 0xFF;
+    } else if constexpr (Bps == 2) {
+      int16_t tmp = value;
+      memcpy(out, &tmp, 2);
+    } else {
+      out[0] = (int8_t) value;
+    }
+  }
+
+  template<unsigned InBps, unsigned OutBps>
+  static inline void convertScalar(const char* in, char* out, uint64_t count) {
+    for (uint64_t i = 0; i < count; i += 1) {
+      storeSample<OutBps>(out + i * OutBps, loadSample<InBps>(in + i * InBps));
+    }
+  }
+
+  // Channels = 0 means that the number of channels is only known at runtime
+  template<unsigned InBps, unsigned OutBps, unsigned Channels>
+  static inline void interleaveScalar(
+    const char* const* in,
+    char* out,
+    uint64_t runtimeChannels,
+    uint64_t samples) {
+    const uint64_t channels = Channels == 0 ? runtimeChannels : Channels;
+    for (uint64_t i = 0; i < samples; i += 1) {
+      for (uint64_t channel = 0; channel < channels; channel += 1) {
+        auto value = loadSample<InBps>(in[channel] + i * InBps);
+        storeSample<OutBps>(out + (i * channels + channel) * OutBps, value);
+      }
+    }
+  }
+
+  template<unsigned InBps, unsigned OutBps, unsigned Channels>
+  static inline void deinterleaveScalar(
+    const char* in,
+    char* const* out,
+    uint64_t runtimeChannels,
+    uint64_t samples) {
+    const uint64_t channels = Channels == 0 ? runtimeChannels : Channels;
+    for (uint64_t i = 0; i < samples; i += 1) {
+      for (uint64_t channel = 0; channel < channels; channel += 1) {
+        auto value = loadSample<InBps>(in + (i * channels + channel) * InBps);
+        storeSample<OutBps>(out[channel] + i * OutBps, value);
+      }
+    }
+  }
+
+  static inline void
+    interleave2x32Scalar(const char* left, const char* right, char* out, uint64_t n) {
+    const char* const in[2] = {left, right};
+    interleaveScalar<4, 4, 2>(in, out, 2, n);
+  }
+
+  static inline void
+    deinterleave2x32Scalar(const char* in, char* left, char* right, uint64_t n) {
+    char* const out[2] = {left, right};
+    deinterleaveScalar<4, 4, 2>(in, out, 2, n);
+  }
+
+  static inline void int32ToFloatScalar(const char* in, char* out, float scale, uint64_t count) {
+    for (uint64_t i = 0; i < count; i += 1) {
+      float value = float(loadSample<4>(in + i * 4)) * scale;
+      memcpy(out + i * 4, &value, 4);
+    }
+  }
+
+  // NaN ends up as min, like the vectorized versions do
+  static inline void floatToInt32Scalar(
+    const char* in,
+    char* out,
+    float scale,
+    float min,
+    float max,
+    uint64_t count) {
+    for (uint64_t i = 0; i < count; i += 1) {
+      float value;
+      memcpy(&value, in + i * 4, 4);
+      value *= scale;
+      value = value >= min ? value : min;
+      value = value > max ? max : value;
+      storeSample<4>(out + i * 4, (int32_t) std::nearbyint(value));
+    }
+  }
+
+  // -- kernel table --
+
+  typedef void (*ConvertKernel)(const char* in, char* out, uint64_t count);
+  typedef void (*Interleave2Kernel)(const char* left, const char* right, char* out, uint64_t n);
+  typedef void (*Deinterleave2Kernel)(const char* in, char* left, char* right, uint64_t n);
+  typedef void (*ToFloatKernel)(const char* in, char* out, float scale, uint64_t count);
+  typedef void (*FromFloatKernel)(
+    const char* in,
+    char* out,
+    float scale,
+    float min,
+    float max,
+    uint64_t count);
+
+  /**
+   * The conversions that run on every decoded frame and every encoded chunk. Everything else
+   * uses the scalar templates, or goes through these using a small intermediate buffer.
+   */
+  struct SampleKernels {
+    const char* name;
+    ConvertKernel convert16to32;
+    ConvertKernel convert24to32;
+    ConvertKernel convert32to16;
+    ConvertKernel convert32to24;
+    Interleave2Kernel interleave2x32;
+    Deinterleave2Kernel deinterleave2x32;
+    // scale, round to nearest and clamp: only valid up to 24 bits, where every integer fits in a
+    // float (in and out can be the same buffer)
+    ToFloatKernel int32ToFloat;
+    FromFloatKernel floatToInt32;
+  };
+
+#ifdef FLAC_BINDINGS_KERNELS_X86
+  // each one is only available if the compiler supports the flags for that level (see CMake)
+  extern const SampleKernels x86_64_v2Kernels;
+  extern const SampleKernels x86_64_v3Kernels;
+  extern const SampleKernels x86_64_v4Kernels;
+#endif
+
+}
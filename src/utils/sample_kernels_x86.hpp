@@ -0,0 +1,367 @@
+#pragma once
+
+// Vectorized kernels for x86-64. This file is included once per micro-architecture level, from
+// translation units that CMake builds with the flags of that level (see CMakeLists.txt), and
+// SAMPLE_KERNELS_X86_LEVEL tells which one is being built.
+
+#include "sample_kernels_internal.hpp"
+#include <immintrin.h>
+
+#ifndef SAMPLE_KERNELS_X86_LEVEL
+#error "SAMPLE_KERNELS_X86_LEVEL must be defined before including this file"
+#endif
+
+namespace flac_bindings {
+
+#if SAMPLE_KERNELS_X86_LEVEL >= 4
+  // -- AVX-512 (x86-64-v4) --
+
+  static void convert16to32(const char* in, char* out, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      auto value = _mm256_loadu_si256((const __m256i*) (in + i * 2));
+      _mm512_storeu_si512(out + i * 4, _mm512_cvtepi16_epi32(value));
+    }
+
+    convertScalar<2, 4>(in + i * 2, out + i * 4, count - i);
+  }
+
+  static void convert24to32(const char* in, char* out, uint64_t count) {
+    // moves the 12 bytes of every 4 samples to the start of a 128 bit lane
+    const auto spread = _mm512_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0);
+    const auto shuffle = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11));
+    uint64_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      // the mask makes the load read exactly 48 bytes
+      auto value = _mm512_maskz_loadu_epi32(0x0FFF, in + i * 3);
+      value = _mm512_permutexvar_epi32(spread, value);
+      value = _mm512_srai_epi32(_mm512_shuffle_epi8(value, shuffle), 8);
+      _mm512_storeu_si512(out + i * 4, value);
+    }
+
+    convertScalar<3, 4>(in + i * 3, out + i * 4, count - i);
+  }
+
+  static void convert32to16(const char* in, char* out, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      // vpmovdw truncates, like the scalar version does
+      auto value = _mm512_cvtepi32_epi16(_mm512_loadu_si512(in + i * 4));
+      _mm256_storeu_si256((__m256i*) (out + i * 2), value);
+    }
+
+    convertScalar<4, 2>(in + i * 4, out + i * 2, count - i);
+  }
+
+  static void convert32to24(const char* in, char* out, uint64_t count) {
+    const auto shuffle = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    const auto pack = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 3, 7, 11, 15);
+    uint64_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      auto value = _mm512_shuffle_epi8(_mm512_loadu_si512(in + i * 4), shuffle);
+      // the mask makes the store write exactly 48 bytes
+      _mm512_mask_storeu_epi32(out + i * 3, 0x0FFF, _mm512_permutexvar_epi32(pack, value));
+    }
+
+    convertScalar<4, 3>(in + i * 4, out + i * 3, count - i);
+  }
+
+  static void interleave2x32(const char* left, const char* right, char* out, uint64_t n) {
+    const auto low = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    const auto high =
+      _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      auto l = _mm512_loadu_si512(left + i * 4);
+      auto r = _mm512_loadu_si512(right + i * 4);
+      _mm512_storeu_si512(out + i * 8, _mm512_permutex2var_epi32(l, low, r));
+      _mm512_storeu_si512(out + i * 8 + 64, _mm512_permutex2var_epi32(l, high, r));
+    }
+
+    interleave2x32Scalar(left + i * 4, right + i * 4, out + i * 8, n - i);
+  }
+
+  static void deinterleave2x32(const char* in, char* left, char* right, uint64_t n) {
+    const auto even =
+      _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const auto odd =
+      _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      auto a = _mm512_loadu_si512(in + i * 8);
+      auto b = _mm512_loadu_si512(in + i * 8 + 64);
+      _mm512_storeu_si512(left + i * 4, _mm512_permutex2var_epi32(a, even, b));
+      _mm512_storeu_si512(right + i * 4, _mm512_permutex2var_epi32(a, odd, b));
+    }
+
+    deinterleave2x32Scalar(in + i * 8, left + i * 4, right + i * 4, n - i);
+  }
+  static void int32ToFloat(const char* in, char* out, float scale, uint64_t count) {
+    const auto factor = _mm512_set1_ps(scale);
+    uint64_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      auto value = _mm512_cvtepi32_ps(_mm512_loadu_si512(in + i * 4));
+      _mm512_storeu_ps(out + i * 4, _mm512_mul_ps(value, factor));
+    }
+
+    int32ToFloatScalar(in + i * 4, out + i * 4, scale, count - i);
+  }
+
+  static void
+    floatToInt32(const char* in, char* out, float scale, float min, float max, uint64_t count) {
+    const auto factor = _mm512_set1_ps(scale);
+    const auto low = _mm512_set1_ps(min);
+    const auto high = _mm512_set1_ps(max);
+    uint64_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+      auto value = _mm512_mul_ps(_mm512_loadu_ps(in + i * 4), factor);
+      // max returns the second operand if one is NaN
+      value = _mm512_min_ps(_mm512_max_ps(value, low), high);
+      _mm512_storeu_si512(out + i * 4, _mm512_cvtps_epi32(value));
+    }
+
+    floatToInt32Scalar(in + i * 4, out + i * 4, scale, min, max, count - i);
+  }
+#elif SAMPLE_KERNELS_X86_LEVEL == 3
+  // -- AVX2 (x86-64-v3) --
+
+  static void convert16to32(const char* in, char* out, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto value = _mm_loadu_si128((const __m128i*) (in + i * 2));
+      _mm256_storeu_si256((__m256i*) (out + i * 4), _mm256_cvtepi16_epi32(value));
+    }
+
+    convertScalar<2, 4>(in + i * 2, out + i * 4, count - i);
+  }
+
+  static void convert24to32(const char* in, char* out, uint64_t count) {
+    const auto shuffle = _mm256_setr_epi8(
+      -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+      -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    uint64_t i = 0;
+    // the second load reads 16 bytes but only uses 12, so stop before reading past the end
+    for (; i + 10 <= count; i += 8) {
+      auto low = _mm_loadu_si128((const __m128i*) (in + i * 3));
+      auto high = _mm_loadu_si128((const __m128i*) (in + i * 3 + 12));
+      auto value = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+      value = _mm256_srai_epi32(_mm256_shuffle_epi8(value, shuffle), 8);
+      _mm256_storeu_si256((__m256i*) (out + i * 4), value);
+    }
+
+    convertScalar<3, 4>(in + i * 3, out + i * 4, count - i);
+  }
+
+  static void convert32to16(const char* in, char* out, uint64_t count) {
+    const auto shuffle = _mm256_setr_epi8(
+      0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+      0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto value = _mm256_loadu_si256((const __m256i*) (in + i * 4));
+      // each 128 bit lane has 4 samples in its lower half, move them together
+      value = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(value, shuffle), 0xD8);
+      _mm_storeu_si128((__m128i*) (out + i * 2), _mm256_castsi256_si128(value));
+    }
+
+    convertScalar<4, 2>(in + i * 4, out + i * 2, count - i);
+  }
+
+  static void convert32to24(const char* in, char* out, uint64_t count) {
+    const auto shuffle = _mm256_setr_epi8(
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const auto permutation = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    uint64_t i = 0;
+    // writes 32 bytes but only 24 are valid, the next iteration overwrites the rest
+    for (; i + 11 <= count; i += 8) {
+      auto value = _mm256_loadu_si256((const __m256i*) (in + i * 4));
+      value = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(value, shuffle), permutation);
+      _mm256_storeu_si256((__m256i*) (out + i * 3), value);
+    }
+
+    convertScalar<4, 3>(in + i * 4, out + i * 3, count - i);
+  }
+
+  static void interleave2x32(const char* left, const char* right, char* out, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      auto l = _mm256_loadu_si256((const __m256i*) (left + i * 4));
+      auto r = _mm256_loadu_si256((const __m256i*) (right + i * 4));
+      auto low = _mm256_unpacklo_epi32(l, r);
+      auto high = _mm256_unpackhi_epi32(l, r);
+      _mm256_storeu_si256((__m256i*) (out + i * 8), _mm256_permute2x128_si256(low, high, 0x20));
+      _mm256_storeu_si256(
+        (__m256i*) (out + i * 8 + 32),
+        _mm256_permute2x128_si256(low, high, 0x31));
+    }
+
+    interleave2x32Scalar(left + i * 4, right + i * 4, out + i * 8, n - i);
+  }
+
+  static void deinterleave2x32(const char* in, char* left, char* right, uint64_t n) {
+    const auto permutation = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      auto a = _mm256_loadu_si256((const __m256i*) (in + i * 8));
+      auto b = _mm256_loadu_si256((const __m256i*) (in + i * 8 + 32));
+      a = _mm256_permutevar8x32_epi32(a, permutation);
+      b = _mm256_permutevar8x32_epi32(b, permutation);
+      _mm256_storeu_si256((__m256i*) (left + i * 4), _mm256_permute2x128_si256(a, b, 0x20));
+      _mm256_storeu_si256((__m256i*) (right + i * 4), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+
+    deinterleave2x32Scalar(in + i * 8, left + i * 4, right + i * 4, n - i);
+  }
+  static void int32ToFloat(const char* in, char* out, float scale, uint64_t count) {
+    const auto factor = _mm256_set1_ps(scale);
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto value = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*) (in + i * 4)));
+      _mm256_storeu_ps((float*) (out + i * 4), _mm256_mul_ps(value, factor));
+    }
+
+    int32ToFloatScalar(in + i * 4, out + i * 4, scale, count - i);
+  }
+
+  static void
+    floatToInt32(const char* in, char* out, float scale, float min, float max, uint64_t count) {
+    const auto factor = _mm256_set1_ps(scale);
+    const auto low = _mm256_set1_ps(min);
+    const auto high = _mm256_set1_ps(max);
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto value = _mm256_mul_ps(_mm256_loadu_ps((const float*) (in + i * 4)), factor);
+      // max returns the second operand if one is NaN
+      value = _mm256_min_ps(_mm256_max_ps(value, low), high);
+      _mm256_storeu_si256((__m256i*) (out + i * 4), _mm256_cvtps_epi32(value));
+    }
+
+    floatToInt32Scalar(in + i * 4, out + i * 4, scale, min, max, count - i);
+  }
+#else
+  // -- SSE4.1 (x86-64-v2) --
+
+  static void convert16to32(const char* in, char* out, uint64_t count) {
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto value = _mm_loadu_si128((const __m128i*) (in + i * 2));
+      _mm_storeu_si128((__m128i*) (out + i * 4), _mm_cvtepi16_epi32(value));
+      _mm_storeu_si128((__m128i*) (out + i * 4 + 16), _mm_cvtepi16_epi32(_mm_srli_si128(value, 8)));
+    }
+
+    convertScalar<2, 4>(in + i * 2, out + i * 4, count - i);
+  }
+
+  static void convert24to32(const char* in, char* out, uint64_t count) {
+    const auto shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    uint64_t i = 0;
+    // reads 16 bytes but only uses 12, so stop before reading past the end
+    for (; i + 6 <= count; i += 4) {
+      auto value = _mm_loadu_si128((const __m128i*) (in + i * 3));
+      value = _mm_srai_epi32(_mm_shuffle_epi8(value, shuffle), 8);
+      _mm_storeu_si128((__m128i*) (out + i * 4), value);
+    }
+
+    convertScalar<3, 4>(in + i * 3, out + i * 4, count - i);
+  }
+
+  static void convert32to16(const char* in, char* out, uint64_t count) {
+    // truncates like the scalar version does, instead of saturating
+    const auto shuffle = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    uint64_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      auto low = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (in + i * 4)), shuffle);
+      auto high = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (in + i * 4 + 16)), shuffle);
+      _mm_storeu_si128((__m128i*) (out + i * 2), _mm_unpacklo_epi64(low, high));
+    }
+
+    convertScalar<4, 2>(in + i * 4, out + i * 2, count - i);
+  }
+
+  static void convert32to24(const char* in, char* out, uint64_t count) {
+    const auto shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    uint64_t i = 0;
+    // writes 16 bytes but only 12 are valid, the next iteration overwrites the rest
+    for (; i + 6 <= count; i += 4) {
+      auto value = _mm_loadu_si128((const __m128i*) (in + i * 4));
+      _mm_storeu_si128((__m128i*) (out + i * 3), _mm_shuffle_epi8(value, shuffle));
+    }
+
+    convertScalar<4, 3>(in + i * 4, out + i * 3, count - i);
+  }
+
+  static void interleave2x32(const char* left, const char* right, char* out, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      auto l = _mm_loadu_si128((const __m128i*) (left + i * 4));
+      auto r = _mm_loadu_si128((const __m128i*) (right + i * 4));
+      _mm_storeu_si128((__m128i*) (out + i * 8), _mm_unpacklo_epi32(l, r));
+      _mm_storeu_si128((__m128i*) (out + i * 8 + 16), _mm_unpackhi_epi32(l, r));
+    }
+
+    interleave2x32Scalar(left + i * 4, right + i * 4, out + i * 8, n - i);
+  }
+
+  static void deinterleave2x32(const char* in, char* left, char* right, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      auto a = _mm_loadu_ps((const float*) (in + i * 8));
+      auto b = _mm_loadu_ps((const float*) (in + i * 8 + 16));
+      _mm_storeu_ps((float*) (left + i * 4), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps((float*) (right + i * 4), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    deinterleave2x32Scalar(in + i * 8, left + i * 4, right + i * 4, n - i);
+  }
+  static void int32ToFloat(const char* in, char* out, float scale, uint64_t count) {
+    const auto factor = _mm_set1_ps(scale);
+    uint64_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      auto value = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*) (in + i * 4)));
+      _mm_storeu_ps((float*) (out + i * 4), _mm_mul_ps(value, factor));
+    }
+
+    int32ToFloatScalar(in + i * 4, out + i * 4, scale, count - i);
+  }
+
+  static void
+    floatToInt32(const char* in, char* out, float scale, float min, float max, uint64_t count) {
+    const auto factor = _mm_set1_ps(scale);
+    const auto low = _mm_set1_ps(min);
+    const auto high = _mm_set1_ps(max);
+    uint64_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      auto value = _mm_mul_ps(_mm_loadu_ps((const float*) (in + i * 4)), factor);
+      // max returns the second operand if one is NaN
+      value = _mm_min_ps(_mm_max_ps(value, low), high);
+      _mm_storeu_si128((__m128i*) (out + i * 4), _mm_cvtps_epi32(value));
+    }
+
+    floatToInt32Scalar(in + i * 4, out + i * 4, scale, min, max, count - i);
+  }
+#endif
+
+#if SAMPLE_KERNELS_X86_LEVEL >= 4
+  const SampleKernels x86_64_v4Kernels = {
+    "x86-64-v4",
+#elif SAMPLE_KERNELS_X86_LEVEL == 3
+  const SampleKernels x86_64_v3Kernels = {
+    "x86-64-v3",
+#else
+  const SampleKernels x86_64_v2Kernels = {
+    "x86-64-v2",
+#endif
+    convert16to32,
+    convert24to32,
+    convert32to16,
+    convert32to24,
+    interleave2x32,
+    deinterleave2x32,
+    int32ToFloat,
+    floatToInt32,
+  };
+
+}
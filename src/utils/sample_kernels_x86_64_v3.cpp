@@ -0,0 +1,5 @@
+// only built when the compiler supports the flags for this level (see CMakeLists.txt)
+#ifdef FLAC_BINDINGS_X86_64_V3
+#define SAMPLE_KERNELS_X86_LEVEL 3
+#include "sample_kernels_x86.hpp"
+#endif
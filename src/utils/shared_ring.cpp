@@ -0,0 +1,65 @@
+#include "shared_ring.hpp"
+#include "converters.hpp"
+
+namespace flac_bindings {
+
+  using namespace Napi;
+
+  static bool isSharedTypedArray(const Napi::Value& value, napi_typedarray_type type) {
+    if (!value.IsTypedArray() || value.As<TypedArray>().TypedArrayType() != type) {
+      return false;
+    }
+
+    // a normal ArrayBuffer could be detached or transferred while the native side uses it
+    auto sharedArrayBuffer = value.Env().Global().Get("SharedArrayBuffer").As<Function>();
+    return value.As<TypedArray>().Get("buffer").As<Object>().InstanceOf(sharedArrayBuffer);
+  }
+
+  void SharedSampleRing::fromJs(const Object& options, uint32_t channels) {
+    auto env = options.Env();
+    auto data = options.Get("data");
+    auto state = options.Get("state");
+    this->channels = channels;
+    planar = maybeBooleanFromJs<bool>(options.Get("planar")).value_or(false);
+
+    if (isSharedTypedArray(data, napi_float32_array)) {
+      isFloat = true;
+    } else if (isSharedTypedArray(data, napi_int32_array)) {
+      isFloat = false;
+    } else {
+      throw TypeError::New(
+        env,
+        "Expected data to be an Int32Array or Float32Array of a SharedArrayBuffer");
+    }
+
+    if (!isSharedTypedArray(state, napi_int32_array)) {
+      throw TypeError::New(env, "Expected state to be an Int32Array of a SharedArrayBuffer");
+    }
+
+    auto dataArray = data.As<TypedArray>();
+    auto stateArray = state.As<TypedArrayOf<int32_t>>();
+    auto capacity = dataArray.ElementLength() / channels;
+    if (capacity == 0 || capacity > UINT32_MAX || (capacity & (capacity - 1)) != 0
+        || capacity * channels != dataArray.ElementLength()) {
+      throw RangeError::New(
+        env,
+        "data must hold a power of two number of samples for every channel");
+    }
+
+    if (stateArray.ElementLength() < StateFieldCount) {
+      throw RangeError::New(
+        env,
+        "state must have at least "s + std::to_string(StateFieldCount) + " elements"s);
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(int32_t));
+    this->capacity = capacity;
+    // ArrayBuffer() does not work with shared buffers, but the typed array info does
+    this->data = isFloat ? (char*) data.As<TypedArrayOf<float>>().Data()
+                         : (char*) data.As<TypedArrayOf<int32_t>>().Data();
+    this->state = (std::atomic<uint32_t>*) stateArray.Data();
+    dataRef = Persistent(dataArray.As<Object>());
+    stateRef = Persistent(stateArray.As<Object>());
+  }
+
+}
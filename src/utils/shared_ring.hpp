@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <napi.h>
+#include <thread>
+
+namespace flac_bindings {
+
+  /**
+   * Ring of samples in a SharedArrayBuffer, shared with other JS threads without going through
+   * the main thread. The positions are frame counters stored in a shared Int32Array, which wrap
+   * around at 2^32 (so the capacity must be a power of two). Only the producer updates the write
+   * position, and only the consumer updates the read position.
+   */
+  struct SharedSampleRing {
+    enum StateField {
+      WritePosition = 0,
+      ReadPosition = 1,
+      Flags = 2,
+      StateFieldCount,
+    };
+
+    enum Flag {
+      Ended = 1,
+      Cancelled = 2,
+    };
+
+    Napi::ObjectReference dataRef;
+    Napi::ObjectReference stateRef;
+    char* data = nullptr;
+    std::atomic<uint32_t>* state = nullptr;
+    // in frames
+    uint32_t capacity = 0;
+    uint32_t channels = 0;
+    bool planar = false;
+    bool isFloat = false;
+
+    /**
+     * Reads `data`, `state` and `planar` from the options object. The length of `data` must be
+     * `channels` times a power of two.
+     */
+    void fromJs(const Napi::Object& options, uint32_t channels);
+
+    inline uint32_t flags() const {
+      return state[Flags].load(std::memory_order_acquire);
+    }
+
+    inline void setFlag(Flag flag) {
+      state[Flags].fetch_or(flag, std::memory_order_release);
+    }
+
+    inline char* sampleAt(uint32_t channel, uint32_t position) const {
+      auto index = planar ? (uint64_t) channel * capacity + position
+                          : (uint64_t) position * channels + channel;
+      return data + index * 4;
+    }
+
+    /**
+     * Waits until `isReady` returns true, or returns false if the ring is cancelled. JS threads
+     * cannot wake up a native thread, so the wait is done by polling: first spinning, then
+     * sleeping a bit.
+     */
+    template<typename Fn>
+    bool wait(Fn isReady) const {
+      for (unsigned tries = 0;; tries += 1) {
+        if (flags() & Cancelled) {
+          return false;
+        }
+
+        if (isReady()) {
+          return true;
+        }
+
+        if (tries < 64) {
+          std::this_thread::yield();
+        } else {
+          std::this_thread::sleep_for(std::chrono::microseconds(250));
+        }
+      }
+    }
+  };
+
+}
@@ -0,0 +1,169 @@
+#include "stats.hpp"
+#include "converters.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace flac_bindings {
+
+  namespace stats {
+
+    thread_local uint64_t waitedTime = 0;
+
+    Stats& global() {
+      static Stats instance;
+      return instance;
+    }
+
+    static unsigned highestBit(uint64_t value) {
+      unsigned bit = 0;
+      for (unsigned shift = 32; shift > 0; shift /= 2) {
+        if (value >> shift) {
+          value >>= shift;
+          bit += shift;
+        }
+      }
+      return bit;
+    }
+
+    unsigned Histogram::bucketOf(uint64_t value) {
+      if (value < SubBuckets) {
+        return value;
+      }
+
+      // the highest bit selects the power of two, and the next bits the bucket inside it
+      const auto shift = highestBit(value) - SubBucketBits;
+      return (shift + 1) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+    }
+
+    uint64_t Histogram::bucketValue(unsigned bucket) {
+      if (bucket < SubBuckets) {
+        return bucket;
+      }
+
+      // the middle of the range of values of the bucket
+      const auto shift = bucket / SubBuckets - 1;
+      const auto lower = uint64_t(SubBuckets + bucket % SubBuckets) << shift;
+      return lower + ((uint64_t(1) << shift) >> 1);
+    }
+
+    void Histogram::record(uint64_t value) {
+      buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(value, std::memory_order_relaxed);
+      auto currentMax = max.load(std::memory_order_relaxed);
+      while (value > currentMax
+             && !max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+      }
+    }
+
+    void Histogram::reset() {
+      for (auto& bucket: buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      count.store(0, std::memory_order_relaxed);
+      sum.store(0, std::memory_order_relaxed);
+      max.store(0, std::memory_order_relaxed);
+    }
+
+    Napi::Object Histogram::toJs(const Napi::Env& env) const {
+      // the values are read while other threads may be recording, so they can be off by a few
+      uint64_t snapshot[BucketCount];
+      uint64_t total = 0;
+      for (unsigned i = 0; i < BucketCount; i += 1) {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+      }
+
+      const auto maxValue = max.load(std::memory_order_relaxed);
+      auto percentile = [&](double quantile) -> double {
+        const auto target = (uint64_t) std::ceil(quantile * total);
+        uint64_t accumulated = 0;
+        for (unsigned i = 0; i < BucketCount; i += 1) {
+          accumulated += snapshot[i];
+          if (accumulated >= target && accumulated > 0) {
+            return std::min(bucketValue(i), maxValue) / 1000.0;
+          }
+        }
+        return 0;
+      };
+
+      auto obj = Napi::Object::New(env);
+      obj["count"] = numberToJs(env, total);
+      obj["mean"] = total > 0 ? sum.load(std::memory_order_relaxed) / 1000.0 / total : 0.0;
+      obj["max"] = maxValue / 1000.0;
+      obj["p50"] = percentile(0.5);
+      obj["p90"] = percentile(0.9);
+      obj["p99"] = percentile(0.99);
+      obj["p999"] = percentile(0.999);
+      return obj;
+    }
+
+  }
+
+  using namespace Napi;
+
+  static Value enableStats(const CallbackInfo& info) {
+    stats::global().enabled = true;
+    return info.Env().Undefined();
+  }
+
+  static Value disableStats(const CallbackInfo& info) {
+    stats::global().enabled = false;
+    return info.Env().Undefined();
+  }
+
+  static Value isStatsEnabled(const CallbackInfo& info) {
+    return Boolean::New(info.Env(), stats::isEnabled());
+  }
+
+  static Value resetStats(const CallbackInfo& info) {
+    auto& global = stats::global();
+    global.callbackRoundTrip.reset();
+    global.queueWait.reset();
+    global.decoderProcess.reset();
+    global.encoderProcess.reset();
+    global.callbacks = 0;
+    global.decodedSamples = 0;
+    global.encodedSamples = 0;
+    global.bytesRead = 0;
+    global.bytesWritten = 0;
+    return info.Env().Undefined();
+  }
+
+  static Value statsSnapshot(const CallbackInfo& info) {
+    auto env = info.Env();
+    EscapableHandleScope scope(env);
+    const auto& global = stats::global();
+    auto obj = Object::New(env);
+    obj["enabled"] = Boolean::New(env, global.enabled);
+    obj["activeTasks"] = numberToJs(env, global.activeTasks.load());
+    obj["runningTasks"] = numberToJs(env, global.runningTasks.load());
+    obj["callbacks"] = numberToJs(env, global.callbacks.load());
+    obj["decodedSamples"] = numberToJs(env, global.decodedSamples.load());
+    obj["encodedSamples"] = numberToJs(env, global.encodedSamples.load());
+    obj["bytesRead"] = numberToJs(env, global.bytesRead.load());
+    obj["bytesWritten"] = numberToJs(env, global.bytesWritten.load());
+    obj["callbackRoundTrip"] = global.callbackRoundTrip.toJs(env);
+    obj["queueWait"] = global.queueWait.toJs(env);
+    obj["decoderProcess"] = global.decoderProcess.toJs(env);
+    obj["encoderProcess"] = global.encoderProcess.toJs(env);
+    return scope.Escape(obj);
+  }
+
+  Object initStats(Napi::Env env) {
+    EscapableHandleScope scope(env);
+
+    auto obj = Object::New(env);
+    obj.DefineProperties({
+      PropertyDescriptor::Function(env, obj, "enable", enableStats, napi_enumerable),
+      PropertyDescriptor::Function(env, obj, "disable", disableStats, napi_enumerable),
+      PropertyDescriptor::Function(env, obj, "isEnabled", isStatsEnabled, napi_enumerable),
+      PropertyDescriptor::Function(env, obj, "reset", resetStats, napi_enumerable),
+      PropertyDescriptor::Function(env, obj, "snapshot", statsSnapshot, napi_enumerable),
+    });
+
+    obj.Freeze();
+    return scope.Escape(obj).As<Object>();
+  }
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <napi.h>
+
+namespace flac_bindings {
+
+  namespace stats {
+
+    /**
+     * Lock-free histogram of latencies in nanoseconds. Each power of two is split into 8 linear
+     * buckets (like HDR histograms), so percentiles have an error below 12.5% using a fixed
+     * amount of memory. Recording is a couple of relaxed atomic increments.
+     */
+    class Histogram {
+      static constexpr unsigned SubBucketBits = 3;
+      static constexpr unsigned SubBuckets = 1 << SubBucketBits;
+      static constexpr unsigned BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+      std::atomic<uint64_t> buckets[BucketCount] = {};
+      std::atomic<uint64_t> count = 0;
+      std::atomic<uint64_t> sum = 0;
+      std::atomic<uint64_t> max = 0;
+
+      static unsigned bucketOf(uint64_t value);
+      static uint64_t bucketValue(unsigned bucket);
+
+    public:
+      void record(uint64_t value);
+      void reset();
+      Napi::Object toJs(const Napi::Env& env) const;
+    };
+
+    struct Stats {
+      std::atomic_bool enabled = false;
+
+      // from a background thread sending a request to JS until the answer comes back
+      Histogram callbackRoundTrip;
+      // from an async task being created until a thread of the pool starts running it
+      Histogram queueWait;
+      // inside libFLAC process (and seek) calls, without the time waiting for async callbacks
+      Histogram decoderProcess;
+      Histogram encoderProcess;
+
+      std::atomic<uint64_t> callbacks = 0;
+      std::atomic<uint64_t> decodedSamples = 0;
+      std::atomic<uint64_t> encodedSamples = 0;
+      std::atomic<uint64_t> bytesRead = 0;
+      std::atomic<uint64_t> bytesWritten = 0;
+
+      // always counted, so they are right even if the stats are enabled while tasks are alive
+      std::atomic<int64_t> activeTasks = 0;
+      std::atomic<int64_t> runningTasks = 0;
+    };
+
+    /** Stats of the whole process, shared between all the instances of the addon. */
+    Stats& global();
+
+    /**
+     * Time waiting for JS or measured by a nested `ProcessTimer` in the current thread, to take it
+     * out of the enclosing libFLAC timings.
+     */
+    extern thread_local uint64_t waitedTime;
+
+    inline bool isEnabled() {
+      return global().enabled.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    }
+
+    inline void add(std::atomic<uint64_t>& counter, uint64_t value) {
+      if (isEnabled()) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * Measures a libFLAC call from its creation until the end of the scope. The time of the timers
+     * created inside it (like an encoder called from a decoder callback) is not counted twice.
+     */
+    class ProcessTimer {
+      Histogram* histogram = nullptr;
+      uint64_t start = 0;
+      uint64_t waitedAtStart = 0;
+
+    public:
+      ProcessTimer(Histogram Stats::*member) {
+        if (isEnabled()) {
+          histogram = &(global().*member);
+          start = now();
+          waitedAtStart = waitedTime;
+        }
+      }
+
+      ProcessTimer(const ProcessTimer&) = delete;
+
+      ~ProcessTimer() {
+        if (histogram != nullptr) {
+          const auto elapsed = now() - start;
+          const auto waited = waitedTime - waitedAtStart;
+          histogram->record(elapsed > waited ? elapsed - waited : 0);
+          waitedTime = waitedAtStart + elapsed;
+        }
+      }
+    };
+
+    /** Measures the time waiting for JS from its creation until the end of the scope. */
+    class WaitTimer {
+      Histogram* histogram = nullptr;
+      uint64_t start = 0;
+
+    public:
+      WaitTimer(Histogram Stats::*member = nullptr) {
+        if (isEnabled()) {
+          histogram = member != nullptr ? &(global().*member) : nullptr;
+          start = now();
+        }
+      }
+
+      WaitTimer(const WaitTimer&) = delete;
+
+      ~WaitTimer() {
+        if (start != 0) {
+          const auto elapsed = now() - start;
+          waitedTime += elapsed;
+          if (histogram != nullptr) {
+            histogram->record(elapsed);
+          }
+        }
+      }
+    };
+
+  }
+
+  Napi::Object initStats(Napi::Env env);
+
+}
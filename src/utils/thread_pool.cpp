@@ -0,0 +1,115 @@
+#include "thread_pool.hpp"
+#include "converters.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <napi.h>
+#include <thread>
+
+namespace flac_bindings {
+
+  namespace thread_pool {
+
+    struct Pool {
+      std::mutex mutex;
+      std::condition_variable cond;
+      std::deque<std::function<void()>> queue;
+      // threads alive, and threads wanted
+      unsigned threads = 0;
+      unsigned target = std::max(std::thread::hardware_concurrency(), 4u);
+    };
+
+    static Pool& pool() {
+      // never destroyed: detached threads may still be waiting on it when the process exits
+      static auto instance = new Pool;
+      return *instance;
+    }
+
+    static void workerLoop() {
+      auto& p = pool();
+      std::unique_lock<std::mutex> lock(p.mutex);
+      while (true) {
+        p.cond.wait(lock, [&p]() { return !p.queue.empty() || p.threads > p.target; });
+        if (p.threads > p.target) {
+          p.threads -= 1;
+          return;
+        }
+
+        auto work = std::move(p.queue.front());
+        p.queue.pop_front();
+        lock.unlock();
+        work();
+        lock.lock();
+      }
+    }
+
+    // must be called with the lock held
+    static void startThreads(Pool& p) {
+      while (p.threads < p.target) {
+        std::thread(workerLoop).detach();
+        p.threads += 1;
+      }
+    }
+
+    void submit(std::function<void()> work) {
+      auto& p = pool();
+      {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        // threads are started the first time something is queued, not when the addon is loaded
+        startThreads(p);
+        p.queue.push_back(std::move(work));
+      }
+
+      p.cond.notify_one();
+    }
+
+    void setThreads(unsigned count) {
+      auto& p = pool();
+      {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.target = count;
+        if (p.threads > 0) {
+          startThreads(p);
+        }
+      }
+
+      p.cond.notify_all();
+    }
+
+    unsigned getThreads() {
+      auto& p = pool();
+      std::lock_guard<std::mutex> lock(p.mutex);
+      return p.target;
+    }
+
+  }
+
+  using namespace Napi;
+
+  static constexpr unsigned maxThreads = 1024;
+
+  Value configure(const CallbackInfo& info) {
+    auto env = info.Env();
+    if (info[0].IsObject()) {
+      auto obj = info[0].As<Object>();
+      auto threads = maybeNumberFromJs<unsigned>(obj.Get("threads"));
+      if (threads.has_value()) {
+        if (threads.value() == 0 || threads.value() > maxThreads) {
+          throw RangeError::New(
+            env,
+            "Number of threads must be between 1 and "s + std::to_string(maxThreads));
+        }
+
+        thread_pool::setThreads(threads.value());
+      }
+    } else if (!info[0].IsUndefined() && !info[0].IsNull()) {
+      throw TypeError::New(env, "Expected first argument to be object or undefined");
+    }
+
+    auto result = Object::New(env);
+    result["threads"] = numberToJs(env, thread_pool::getThreads());
+    return result;
+  }
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <functional>
+
+namespace flac_bindings {
+
+  /**
+   * Threads where the async work of the bindings runs, instead of the libuv threadpool. Async
+   * tasks may hold a thread for a long time (a whole decode, waiting for JS callbacks in between),
+   * so they would starve the fs, dns or zlib work of the rest of the process if they were there.
+   *
+   * There is one pool for the whole process, shared between all the instances of the addon.
+   */
+  namespace thread_pool {
+
+    /** Queues the function to be run in one of the threads of the pool. */
+    void submit(std::function<void()> work);
+
+    /**
+     * Changes the number of threads. New threads start immediately, and extra threads stop once
+     * they finish the work they are running.
+     */
+    void setThreads(unsigned count);
+
+    /** The number of threads the pool has (or will have once started). */
+    unsigned getThreads();
+
+  }
+
+}
@@ -1,5 +1,5 @@
 import { describe, expect, it } from 'vitest'
-import { _testAsync as testAsync } from '../lib/api.js'
+import { _testAsync as testAsync, configure } from '../lib/api.js'
 
 const progressValues = ['0', '1', '2', '3', '4', '5', '6', '7', '8', '9']
 
@@ -55,4 +55,40 @@ describe('async', () => {
       })
     })
   })
+
+  describe('configure', () => {
+    it('should return the current configuration', () => {
+      const config = configure()
+      expect(config.threads).toBeGreaterThanOrEqual(1)
+      expect(configure({})).toStrictEqual(config)
+    })
+
+    it('should change the number of threads', () => {
+      // the pool is shared with the other test files, so it is never made smaller
+      const { threads } = configure()
+      try {
+        expect(configure({ threads: threads + 1 })).toStrictEqual({ threads: threads + 1 })
+        expect(configure().threads).toBe(threads + 1)
+      } finally {
+        configure({ threads })
+      }
+    })
+
+    it('should run all the tasks when there are more tasks than threads', async () => {
+      const { threads } = configure()
+      const results = await Promise.all(
+        Array.from({ length: threads + 2 }, () => testAsync('resolve', () => Promise.resolve())),
+      )
+      expect(results).toStrictEqual(Array(threads + 2).fill(true))
+    })
+
+    it('should throw if the number of threads is not valid', () => {
+      expect(() => configure({ threads: 0 })).toThrow(RangeError)
+      expect(() => configure({ threads: -1 })).toThrow(RangeError)
+    })
+
+    it('should throw if the options is not an object', () => {
+      expect(() => configure(4)).toThrow(TypeError)
+    })
+  })
 })
@@ -12,6 +12,7 @@ import {
   pathForFile as fullPathForFile,
   createDeferredScope,
   comparePCM,
+  getPCMData,
   generateFlacCallbacks,
   joinIntoInterleaved,
   loopPcmAudio,
@@ -26,6 +27,94 @@ const {
 } = loopPcmAudio
 const temp = tempUntracked.track()
 
+const extensiblePcmGuid = Buffer.from('0100000000001000800000aa00389b71', 'hex')
+const w64Guid = (fourcc, suffix) => Buffer.concat([
+  Buffer.from(fourcc, 'ascii'),
+  Buffer.from(suffix, 'hex'),
+])
+const w64ChunkSuffix = 'f3acd3118cd100c04f8edb8a'
+const chunk = (fourcc, data, size = data.length) => {
+  const header = Buffer.alloc(8)
+  header.write(fourcc, 0, 'ascii')
+  header.writeUInt32LE(size, 4)
+  return Buffer.concat([header, data])
+}
+
+/** Builds an RF64 file with a WAVE_FORMAT_EXTENSIBLE fmt chunk, from 24 bit stereo samples. */
+const createRf64 = (data, channelMask) => {
+  const ds64 = Buffer.alloc(28)
+  ds64.writeBigUInt64LE(BigInt(data.length + 72), 0)
+  ds64.writeBigUInt64LE(BigInt(data.length), 8)
+  ds64.writeBigUInt64LE(BigInt(data.length / 6), 16)
+  const fmt = Buffer.alloc(40)
+  fmt.writeUInt16LE(0xFFFE, 0)
+  fmt.writeUInt16LE(2, 2)
+  fmt.writeUInt32LE(44100, 4)
+  fmt.writeUInt32LE(44100 * 6, 8)
+  fmt.writeUInt16LE(6, 12)
+  fmt.writeUInt16LE(24, 14)
+  fmt.writeUInt16LE(22, 16)
+  fmt.writeUInt16LE(24, 18)
+  fmt.writeUInt32LE(channelMask, 20)
+  extensiblePcmGuid.copy(fmt, 24)
+  return Buffer.concat([
+    Buffer.from('RF64\xff\xff\xff\xffWAVE', 'latin1'),
+    chunk('ds64', ds64),
+    chunk('fmt ', fmt),
+    chunk('data', data, 0xFFFFFFFF),
+  ])
+}
+
+/** Builds a Wave64 file from 24 bit stereo samples. */
+const createW64 = (data) => {
+  const w64Chunk = (guid, body) => {
+    const size = Buffer.alloc(8)
+    size.writeBigUInt64LE(BigInt(body.length + 24))
+    return Buffer.concat([guid, size, body])
+  }
+  const fmt = Buffer.alloc(16)
+  fmt.writeUInt16LE(1, 0)
+  fmt.writeUInt16LE(2, 2)
+  fmt.writeUInt32LE(44100, 4)
+  fmt.writeUInt32LE(44100 * 6, 8)
+  fmt.writeUInt16LE(6, 12)
+  fmt.writeUInt16LE(24, 14)
+  const body = Buffer.concat([
+    w64Guid('wave', w64ChunkSuffix),
+    w64Chunk(w64Guid('fmt ', w64ChunkSuffix), fmt),
+    w64Chunk(w64Guid('data', w64ChunkSuffix), data),
+  ])
+  return w64Chunk(w64Guid('riff', '2e91cf11a5d628db04c10000'), body)
+}
+
+/** Builds an AIFF file from 24 bit stereo samples. */
+const createAiff = (data) => {
+  const swapped = Buffer.alloc(data.length)
+  for (let i = 0; i < data.length; i += 3) {
+    swapped[i] = data[i + 2]
+    swapped[i + 1] = data[i + 1]
+    swapped[i + 2] = data[i]
+  }
+  const beChunk = (fourcc, body) => {
+    const header = Buffer.alloc(8)
+    header.write(fourcc, 0, 'ascii')
+    header.writeUInt32BE(body.length, 4)
+    return Buffer.concat([header, body])
+  }
+  const comm = Buffer.alloc(18)
+  comm.writeUInt16BE(2, 0)
+  comm.writeUInt32BE(data.length / 6, 2)
+  comm.writeUInt16BE(24, 6)
+  // 44100 as 80 bit extended float
+  Buffer.from('400eac44000000000000', 'hex').copy(comm, 8)
+  const body = Buffer.concat([
+    Buffer.from('AIFF', 'ascii'),
+    beChunk('COMM', comm),
+    beChunk('SSND', Buffer.concat([Buffer.alloc(8), swapped])),
+  ])
+  return beChunk('FORM', body)
+}
+
 let tmpFile
 let deferredScope = null
 
@@ -203,6 +292,877 @@ describe('encode & decode: async api', () => {
     comparePCM(okData, finalBuffer, 32)
   })
 
+  it('decode using file with mmap (non-ogg)', async () => {
+    const allBuffers = []
+    const dec = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      (_, buffers) => {
+        allBuffers.push(buffers.map((b) => Buffer.from(b)))
+        return 0
+      },
+      null,
+      // eslint-disable-next-line no-console
+      (errorCode) => console.error(api.Decoder.ErrorStatusString[errorCode], errorCode),
+      { mmap: true },
+    )
+
+    await expect(dec.processUntilEndOfMetadataAsync()).resolves.toBeTruthy()
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.seekAbsoluteAsync(totalSamples / 5)).resolves.toBeTruthy()
+    await expect(dec.getDecodePositionAsync()).resolves.toBe(157036)
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    const [finalBuffer, samples] = joinIntoInterleaved(allBuffers.slice(0, -1))
+    expect(samples).toStrictEqual(totalSamples)
+    comparePCM(okData, finalBuffer, 32)
+  })
+
+  it('decode using file with mmap rejects if the file does not exist', async () => {
+    await expect(new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('el.flac'),
+      () => 0,
+      null,
+      () => undefined,
+      { mmap: true },
+    )).rejects.toThrow(/ERROR_OPENING_FILE/)
+  })
+
+  it('decode using file with frameIndex seeks to the right sample', async () => {
+    const allBuffers = []
+    const frames = []
+    const dec = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      (frame, buffers) => {
+        frames.push(frame)
+        allBuffers.push(buffers.map((b) => Buffer.from(b)))
+        return 0
+      },
+      null,
+      // eslint-disable-next-line no-console
+      (errorCode) => console.error(api.Decoder.ErrorStatusString[errorCode], errorCode),
+      { frameIndex: true },
+    )
+
+    const target = 100000
+    await expect(dec.seekAbsoluteAsync(target)).resolves.toBeTruthy()
+    expect(frames).toHaveLength(1)
+    expect(frames[0].header.sampleNumber).toBe(target)
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.seekAbsoluteAsync(totalSamples / 5)).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    const [finalBuffer, samples] = joinIntoInterleaved(allBuffers.slice(0, -1))
+    expect(samples).toStrictEqual(totalSamples - target)
+    comparePCM(okData.subarray(target * 6), finalBuffer, 32)
+    expect(frames.at(-1).header.sampleNumber).toBe(totalSamples / 5)
+  })
+
+  it('decode using file with frameIndex saves the index and reuses it', async () => {
+    // an empty file is not a valid index, so it is built and saved there
+    const indexFile = temp.openSync('flac-bindings.encode-decode.async-api')
+    fs.closeSync(indexFile.fd)
+    const indexPath = indexFile.path
+    const build = (frameIndex) => new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      () => 0,
+      null,
+      () => undefined,
+      { frameIndex },
+    )
+
+    const dec1 = await build(indexPath)
+    const index = dec1.getFrameIndex()
+    expect(fs.readFileSync(indexPath)).toStrictEqual(index)
+    await dec1.finishAsync()
+
+    const dec2 = await build(indexPath)
+    expect(dec2.getFrameIndex()).toStrictEqual(index)
+    await dec2.finishAsync()
+
+    const dec3 = await build(index)
+    expect(dec3.getFrameIndex()).toStrictEqual(index)
+    await expect(dec3.seekAbsoluteAsync(totalSamples - 1)).resolves.toBeTruthy()
+    await dec3.finishAsync()
+  })
+
+  it('decode using file with a wrong frameIndex still seeks to the right sample', async () => {
+    const scanned = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      () => 0,
+      null,
+      () => undefined,
+      { frameIndex: true },
+    )
+    const index = scanned.getFrameIndex()
+    await scanned.finishAsync()
+
+    // every frame but the first points to the frame after it, the header still matches the file
+    const headerBytes = 64
+    const entryBytes = 20
+    const count = (index.length - headerBytes) / entryBytes
+    for (let i = 1; i < count; i += 1) {
+      const entry = headerBytes + i * entryBytes
+      const nextOffset = i + 1 < count
+        ? index.readBigUInt64LE(entry + entryBytes)
+        : index.readBigUInt64LE(entry) + 1n
+      index.writeBigUInt64LE(nextOffset, entry)
+    }
+
+    const allBuffers = []
+    const frames = []
+    const dec = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      (frame, buffers) => {
+        frames.push(frame)
+        allBuffers.push(buffers.map((b) => Buffer.from(b)))
+        return 0
+      },
+      null,
+      () => undefined,
+      { frameIndex: index },
+    )
+
+    const target = 100000
+    await expect(dec.seekAbsoluteAsync(target)).resolves.toBeTruthy()
+    expect(frames[0].header.sampleNumber).toBe(target)
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    const [finalBuffer, samples] = joinIntoInterleaved(allBuffers)
+    expect(samples).toStrictEqual(totalSamples - target)
+    comparePCM(okData.subarray(target * 6), finalBuffer, 32)
+  })
+
+  it('decode using file with incremental frameIndex records the decoded frames', async () => {
+    const scanned = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      () => 0,
+      null,
+      () => undefined,
+      { frameIndex: true },
+    )
+    const dec = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      () => 0,
+      null,
+      () => undefined,
+      { frameIndex: true, frameIndexMode: 'incremental' },
+    )
+
+    await expect(dec.processUntilEndOfMetadataAsync()).resolves.toBeTruthy()
+    const emptyIndex = dec.getFrameIndex()
+    await expect(dec.processSingleAsync()).resolves.toBeTruthy()
+    expect(dec.getFrameIndex().length).toBeGreaterThan(emptyIndex.length)
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    expect(dec.getFrameIndex()).toStrictEqual(scanned.getFrameIndex())
+
+    await dec.finishAsync()
+    await scanned.finishAsync()
+  })
+
+  it('decode using file with frameIndex throws for invalid options', () => {
+    const build = (options) => new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      () => 0,
+      null,
+      () => undefined,
+      options,
+    )
+
+    expect(() => new api.DecoderBuilder().buildWithOggFileAsync(
+      pathForFile('loop.oga'),
+      () => 0,
+      null,
+      () => undefined,
+      { frameIndex: true },
+    )).toThrow(/only supported for FLAC files/)
+    expect(() => build({ frameIndex: Buffer.from('FLIX') })).toThrow(/frame index is not valid/)
+    expect(() => build({ frameIndex: 1 })).toThrow(/Expected frameIndex to be/)
+    expect(() => build({ frameIndex: true, frameIndexMode: 'fast' }))
+      .toThrow(/Invalid frame index mode/)
+  })
+
+  it('decode using feed (non-ogg)', async () => {
+    const allBuffers = []
+    const dec = await new api.DecoderBuilder().buildWithFeedAsync(
+      (_, buffers) => {
+        allBuffers.push(buffers.map((b) => Buffer.from(b)))
+        return 0
+      },
+      null,
+      // eslint-disable-next-line no-console
+      (errorCode) => console.error(api.Decoder.ErrorStatusString[errorCode], errorCode),
+      16 * 1024,
+    )
+
+    const decoding = dec.processUntilEndOfStreamAsync()
+    const data = await fs.promises.readFile(pathForFile('loop.flac'))
+    for (let i = 0; i < data.length; i += 10000) {
+      // eslint-disable-next-line no-await-in-loop
+      await dec.feedAsync(data.subarray(i, i + 10000))
+    }
+    dec.feedEnd()
+
+    await expect(decoding).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    const [finalBuffer, samples] = joinIntoInterleaved(allBuffers)
+    expect(samples).toStrictEqual(totalSamples)
+    comparePCM(okData, finalBuffer, 32)
+  })
+
+  it('pending feedAsync is rejected when the decoding fails', async () => {
+    // the write callback aborts in the first frame, so the rest of the file is never read
+    const dec = await new api.DecoderBuilder()
+      .buildWithFeedAsync(() => 1, null, () => {}, 16 * 1024)
+
+    const decoding = dec.processUntilEndOfStreamAsync()
+    const data = await fs.promises.readFile(pathForFile('loop.flac'))
+    await expect(dec.feedAsync(data)).rejects.toThrow(/stopped reading from the feed/)
+    await expect(decoding).resolves.toBeFalsy()
+    await dec.finishAsync()
+  })
+
+  it('decoding feed reads as soon as there is data', async () => {
+    // the metadata blocks are a few KiB, they are read without waiting for more data
+    const data = await fs.promises.readFile(pathForFile('loop.flac'))
+    let onMetadata
+    const metadataRead = new Promise((resolve) => {
+      onMetadata = resolve
+    })
+    const dec = await new api.DecoderBuilder()
+      .buildWithFeedAsync(() => 0, () => onMetadata(), () => {}, 1024 * 1024)
+
+    const decoding = dec.processUntilEndOfStreamAsync()
+    await dec.feedAsync(data.subarray(0, 4000))
+    await metadataRead
+    await dec.feedAsync(data.subarray(4000))
+    dec.feedEnd()
+    await expect(decoding).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+  })
+
+  it('data fed after the end of the stream is discarded', async () => {
+    // the total samples are in the STREAMINFO, so the decoder stops after the last frame
+    const data = await fs.promises.readFile(pathForFile('loop.flac'))
+    let samples = 0
+    const dec = await new api.DecoderBuilder().buildWithFeedAsync(
+      (frame) => {
+        samples += frame.header.blocksize
+        return 0
+      },
+      null,
+      () => {},
+      16 * 1024,
+    )
+
+    const decoding = dec.processUntilEndOfStreamAsync()
+    const trailing = Buffer.alloc(64 * 1024)
+    await expect(dec.feedAsync(Buffer.concat([data, trailing]))).resolves.toBeUndefined()
+    await expect(decoding).resolves.toBeTruthy()
+    expect(dec.feed(trailing)).toBe(trailing.length)
+    await expect(dec.feedAsync(trailing)).resolves.toBeUndefined()
+    dec.feedEnd()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+    expect(samples).toBe(totalSamples)
+  })
+
+  it('decoding feeds waiting for data do not hold the threads', async () => {
+    // more decoders than threads, fed in reverse order: it would hang if each waiting decode
+    // kept a thread of the pool
+    const data = await fs.promises.readFile(pathForFile('loop.flac'))
+    const count = api.configure().threads + 2
+    const samples = new Array(count).fill(0)
+    const decoders = await Promise.all(samples.map((_, i) => new api.DecoderBuilder()
+      .setWriteBatch({ frames: 8 })
+      .buildWithFeedAsync(
+        (frames) => {
+          samples[i] += frames.reduce((sum, frame) => sum + frame.header.blocksize, 0)
+          return 0
+        },
+        null,
+        () => {},
+        16 * 1024,
+      )))
+
+    const decodings = decoders.map((dec) => dec.processUntilEndOfStreamAsync())
+    for (const dec of [...decoders].reverse()) {
+      for (let i = 0; i < data.length; i += 10000) {
+        // eslint-disable-next-line no-await-in-loop
+        await dec.feedAsync(data.subarray(i, i + 10000))
+      }
+      dec.feedEnd()
+    }
+
+    await expect(Promise.all(decodings)).resolves.toSatisfyAll((result) => !!result)
+    await Promise.all(decoders.map((dec) => dec.finishAsync()))
+    expect(samples).toSatisfyAll((value) => value === totalSamples)
+  })
+
+  it('decoder feed methods throw if not built with feed', async () => {
+    const dec = await new api.DecoderBuilder().buildWithFileAsync(
+      pathForFile('loop.flac'),
+      () => 0,
+      null,
+      () => {},
+    )
+
+    expect(() => dec.feed(Buffer.alloc(10))).toThrow(/feed/)
+    expect(() => dec.feedEnd()).toThrow(/feed/)
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+  })
+
+  it('decoder feed does not copy more than the buffer size', async () => {
+    const dec = await new api.DecoderBuilder().buildWithFeedAsync(() => 0, null, () => {}, 100)
+
+    expect(dec.feed(Buffer.alloc(150))).toBe(100)
+    expect(dec.feed(Buffer.alloc(10))).toBe(0)
+    dec.feedEnd()
+    expect(() => dec.feed(Buffer.alloc(10))).toThrow(/ended/)
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+  })
+
+  it('decode using file with write batch', async () => {
+    const allBuffers = []
+    let calls = 0
+    let frames = 0
+    const dec = await new api.DecoderBuilder()
+      .setWriteBatch({ frames: 8 })
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        (batchFrames, buffers) => {
+          calls += 1
+          frames += batchFrames.length
+          expect(batchFrames.length).toBeLessThanOrEqual(8)
+          allBuffers.push(buffers.map((b) => Buffer.from(b)))
+          return 0
+        },
+        null,
+        // eslint-disable-next-line no-console
+        (errorCode) => console.error(api.Decoder.ErrorStatusString[errorCode], errorCode),
+      )
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    expect(calls).toBe(Math.ceil(frames / 8))
+    const [finalBuffer, samples] = joinIntoInterleaved(allBuffers)
+    expect(samples).toStrictEqual(totalSamples)
+    comparePCM(okData, finalBuffer, 32)
+  })
+
+  it('decode using file with shared frame descriptors', async () => {
+    const allBuffers = []
+    const frames = new Set()
+    let subframes = null
+    let blocksizes = 0
+    const dec = await new api.DecoderBuilder()
+      .setFrameDescriptor('shared')
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        (frame, buffers) => {
+          frames.add(frame)
+          blocksizes += frame.header.blocksize
+          subframes ??= frame.subframes
+          allBuffers.push(buffers.map((b) => Buffer.from(b)))
+          return 0
+        },
+        null,
+        () => {},
+      )
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    expect(frames.size).toBe(1)
+    expect(blocksizes).toStrictEqual(totalSamples)
+    expect(subframes).toHaveLength(2)
+    expect(() => [...frames][0].subframes).toThrow()
+    const [finalBuffer] = joinIntoInterleaved(allBuffers)
+    comparePCM(okData, finalBuffer, 32)
+  })
+
+  it('decode using file with packed frame descriptors in batches', async () => {
+    const arrays = new Set()
+    let blocksizes = 0
+    const dec = await new api.DecoderBuilder()
+      .setFrameDescriptor('packed')
+      .setWriteBatch({ frames: 8 })
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        (packed) => {
+          arrays.add(packed)
+          expect(packed).toBeInstanceOf(Float64Array)
+          expect(packed.length % 9).toBe(0)
+          for (let i = 0; i < packed.length; i += 9) {
+            expect(packed[i + 2]).toBe(2)
+            expect(packed[i + 4]).toBe(24)
+            blocksizes += packed[i]
+          }
+          return 0
+        },
+        null,
+        () => {},
+      )
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    expect(blocksizes).toStrictEqual(totalSamples)
+    // the last batch may be smaller
+    expect(arrays.size).toBeLessThanOrEqual(2)
+  })
+
+  it('setFrameDescriptor throws with an invalid mode', () => {
+    expect(() => new api.DecoderBuilder().setFrameDescriptor('lazy')).toThrow(RangeError)
+  })
+
+  it('decode using file into a shared output ring', async () => {
+    const capacity = 4096
+    const data = new Int32Array(new SharedArrayBuffer(capacity * 2 * 4))
+    const state = new Int32Array(new SharedArrayBuffer(3 * 4))
+    const output = Buffer.alloc(totalSamples * 2 * 4)
+    const outputSamples = new Int32Array(output.buffer, output.byteOffset, totalSamples * 2)
+    let read = 0
+    const drain = () => {
+      const available = (Atomics.load(state, 0) - Atomics.load(state, 1)) >>> 0
+      for (let i = 0; i < available; i += 1) {
+        const position = ((read + i) & (capacity - 1)) * 2
+        outputSamples[(read + i) * 2] = data[position]
+        outputSamples[(read + i) * 2 + 1] = data[position + 1]
+      }
+      read += available
+      Atomics.store(state, 1, read)
+    }
+    // the ring is smaller than the file, so the decoder has to wait for the consumer
+    const interval = setInterval(drain, 1)
+    deferredScope.defer(() => clearInterval(interval))
+
+    const dec = await new api.DecoderBuilder()
+      .setSharedOutput({ data, state, channels: 2 })
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        null,
+        null,
+        // eslint-disable-next-line no-console
+        (errorCode) => console.error(api.Decoder.ErrorStatusString[errorCode], errorCode),
+      )
+
+    await expect(dec.processUntilEndOfMetadataAsync()).resolves.toBeTruthy()
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+    drain()
+
+    expect(Atomics.load(state, 2) & 1).toBe(1)
+    expect(read).toStrictEqual(totalSamples)
+    comparePCM(okData, output, 32)
+  })
+
+  it('decode into a wav file natively', async () => {
+    const dec = await new api.DecoderBuilder()
+      .setWavOutput({ path: tmpFile.path })
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        null,
+        null,
+        // eslint-disable-next-line no-console
+        (errorCode) => console.error(api.Decoder.ErrorStatusString[errorCode], errorCode),
+      )
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+
+    const wav = await fs.promises.readFile(tmpFile.path)
+    expect(wav.toString('ascii', 0, 4)).toBe('RIFF')
+    // 24 bits need WAVE_FORMAT_EXTENSIBLE, with the default stereo channel mask
+    expect(wav.readUInt16LE(20)).toBe(0xFFFE)
+    expect(wav.readUInt16LE(34)).toBe(24)
+    expect(wav.readUInt16LE(38)).toBe(24)
+    expect(wav.readUInt32LE(40)).toBe(0x3)
+    expect(wav.subarray(44, 60)).toStrictEqual(extensiblePcmGuid)
+    expect(wav.readUInt32LE(64)).toBe(okData.length)
+    comparePCM(okData, getPCMData(wav), 24)
+  })
+
+  it('decode into a wav file natively with other bits per sample', async () => {
+    const dec = new api.DecoderBuilder()
+      .setWavOutput({ path: tmpFile.path, bitsPerSample: 16 })
+      .buildWithFile(pathForFile('loop.flac'), null, null, () => {})
+
+    expect(dec.processUntilEndOfStream()).toBeTrue()
+    expect(dec.finish()).not.toBeNull()
+
+    const wav = await fs.promises.readFile(tmpFile.path)
+    const pcm = getPCMData(wav)
+    expect(wav.readUInt16LE(20)).toBe(1)
+    expect(wav.readUInt16LE(34)).toBe(16)
+    expect(pcm.length).toBe(totalSamples * 2 * 2)
+    for (let i = 0; i < totalSamples * 2; i += 1) {
+      if (pcm.readInt16LE(i * 2) !== okData.readIntLE(i * 3, 3) >> 8) {
+        expect(pcm.readInt16LE(i * 2)).toBe(okData.readIntLE(i * 3, 3) >> 8)
+      }
+    }
+  })
+
+  it('decode into a wav file natively rejects if the file cannot be written', async () => {
+    const dec = await new api.DecoderBuilder()
+      .setWavOutput({ path: '/non/existent/dir/out.wav' })
+      .buildWithFileAsync(pathForFile('loop.flac'), null, null, () => {})
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeFalse()
+    await expect(dec.finishAsync()).rejects.toThrow(/Could not open/)
+  })
+
+  it('setWavOutput throws if the options are not valid', () => {
+    expect(() => new api.DecoderBuilder().setWavOutput('out.wav')).toThrow(/object or null/)
+    expect(() => new api.DecoderBuilder().setWavOutput({})).toThrow()
+    expect(() => new api.DecoderBuilder().setWavOutput({ path: 'out.wav', bitsPerSample: 33 }))
+      .toThrow(/bitsPerSample/)
+    expect(() => new api.DecoderBuilder()
+      .setSharedOutput({
+        data: new Int32Array(new SharedArrayBuffer(16 * 4)),
+        state: new Int32Array(new SharedArrayBuffer(3 * 4)),
+        channels: 2,
+      })
+      .setWavOutput({ path: 'out.wav' })).toThrow(/at the same time/)
+  })
+
+  it('setSharedOutput throws if the arrays are not valid', () => {
+    const state = new Int32Array(new SharedArrayBuffer(3 * 4))
+    expect(() => new api.DecoderBuilder().setSharedOutput({
+      data: new Int32Array(16),
+      state,
+      channels: 2,
+    })).toThrow(/SharedArrayBuffer/)
+    expect(() => new api.DecoderBuilder().setSharedOutput({
+      data: new Int32Array(new SharedArrayBuffer(12 * 4)),
+      state,
+      channels: 2,
+    })).toThrow(/power of two/)
+    expect(() => new api.DecoderBuilder().setSharedOutput({
+      data: new Float32Array(new SharedArrayBuffer(16 * 4)),
+      state: new Int32Array(new SharedArrayBuffer(2 * 4)),
+      channels: 2,
+    })).toThrow(/state must have at least 3 elements/)
+  })
+
+  it('decoder write batch respects maxSamples', async () => {
+    const dec = await new api.DecoderBuilder()
+      .setWriteBatch({ frames: 100, maxSamples: 8192 })
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        (_, buffers) => {
+          expect(buffers[0].length / 4).toBeLessThanOrEqual(8192)
+          return 0
+        },
+        null,
+        () => {},
+      )
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+  })
+
+  it('decoder write batch of one frame still gives arrays of frames', async () => {
+    let samples = 0
+    const dec = await new api.DecoderBuilder()
+      .setWriteBatch({ frames: 1 })
+      .buildWithFileAsync(
+        pathForFile('loop.flac'),
+        (frames, buffers) => {
+          expect(frames).toBeArrayOfSize(1)
+          expect(buffers[0].length / 4).toBe(frames[0].header.blocksize)
+          samples += frames[0].header.blocksize
+          return 0
+        },
+        null,
+        () => {},
+      )
+
+    await expect(dec.processUntilEndOfStreamAsync()).resolves.toBeTruthy()
+    await expect(dec.finishAsync()).resolves.not.toBeNull()
+    expect(samples).toBe(totalSamples)
+  })
+
+  it('decode whole file natively (non-ogg)', async () => {
+    const result = await api.decodeFile(pathForFile('loop.flac'), { outBps: 4 })
+
+    expect(result.samples).toStrictEqual(totalSamples)
+    expect(result.channels).toBe(2)
+    expect(result.bitsPerSample).toBe(24)
+    expect(result.outBps).toBe(4)
+    comparePCM(okData, result.buffer, 32)
+  })
+
+  it('decode whole file natively (ogg)', async () => {
+    const result = await api.decodeFile(pathForFile('loop.oga'), { isOggStream: true })
+
+    expect(result.samples).toStrictEqual(totalSamples)
+    expect(result.outBps).toBe(3)
+    comparePCM(okData, result.buffer, 24)
+  })
+
+  it('decode whole file natively into non-interleaved buffers', async () => {
+    const result = await api.decodeFile(pathForFile('loop.flac'), { interleaved: false })
+
+    expect(result.buffers).toHaveLength(2)
+    const finalBuffer = api.fns.zipAudio({
+      buffers: result.buffers,
+      samples: result.samples,
+      inBps: 3,
+    })
+    expect(result.samples).toStrictEqual(totalSamples)
+    comparePCM(okData, finalBuffer, 32)
+  })
+
+  it('decode whole file natively rejects if the file does not exist', async () => {
+    await expect(api.decodeFile('/non/existent/file.flac')).rejects.toThrow()
+  })
+
+  it('transcode flac into wav natively', async () => {
+    const result = await api.transcode({
+      input: pathForFile('loop.flac'),
+      output: tmpFile.path,
+      outputFormat: 'wav',
+    })
+
+    expect(result).toStrictEqual({
+      samples: totalSamples,
+      channels: 2,
+      bitsPerSample: 24,
+      sampleRate: 44100,
+    })
+    const wav = await fs.promises.readFile(tmpFile.path)
+    expect(wav.toString('ascii', 0, 4)).toBe('RIFF')
+    comparePCM(okData, getPCMData(wav), 24)
+  })
+
+  it('transcode ogg into raw natively', async () => {
+    await api.transcode({
+      input: pathForFile('loop.oga'),
+      output: tmpFile.path,
+      outputFormat: 'raw',
+    })
+
+    comparePCM(okData, await fs.promises.readFile(tmpFile.path), 24)
+  })
+
+  it('transcode wav into flac natively with progress', async () => {
+    const progress = []
+    const result = await api.transcode({
+      input: pathForFile('loop.wav'),
+      output: tmpFile.path,
+      outputFormat: 'flac',
+      encoderOptions: { compressionLevel: 8 },
+      progress: (p) => progress.push(p),
+      progressInterval: 0,
+    })
+
+    expect(result.samples).toStrictEqual(totalSamples)
+    expect(progress.length).toBeGreaterThan(1)
+    expect(progress.at(-1)).toStrictEqual({ samples: totalSamples, totalSamples })
+    comparePCM(okData, tmpFile.path, 24)
+  })
+
+  it('transcode raw into flac natively', async () => {
+    const rawFile = temp.openSync('flac-bindings.encode-decode.async-api')
+    fs.writeSync(rawFile.fd, okData)
+    fs.closeSync(rawFile.fd)
+
+    await api.transcode({
+      input: rawFile.path,
+      output: tmpFile.path,
+      inputFormat: 'raw',
+      outputFormat: 'flac',
+      rawFormat: { channels: 2, bitsPerSample: 24, sampleRate: 44100 },
+    })
+
+    comparePCM(okData, tmpFile.path, 24)
+  })
+
+  it('transcode rejects if the progress callback throws', async () => {
+    await expect(api.transcode({
+      input: pathForFile('loop.flac'),
+      output: tmpFile.path,
+      outputFormat: 'wav',
+      progress: () => {
+        throw new Error('stop')
+      },
+    })).rejects.toThrow('stop')
+  })
+
+  it('transcode throws if the options are not valid', () => {
+    expect(() => api.transcode()).toThrow(/object/)
+    expect(() => api.transcode({ input: pathForFile('loop.flac'), output: tmpFile.path }))
+      .toThrow(/outputFormat/)
+    expect(() => api.transcode({ input: tmpFile.path, output: 'out.flac', inputFormat: 'raw' }))
+      .toThrow(/rawFormat/)
+    expect(() => api.transcode({
+      input: pathForFile('loop.flac'),
+      output: tmpFile.path,
+      outputFormat: 'mp3',
+    })).toThrow(/Invalid outputFormat/)
+  })
+
+  it('transcode rejects if the input does not exist', async () => {
+    await expect(api.transcode({
+      input: '/non/existent/file.wav',
+      output: tmpFile.path,
+      outputFormat: 'flac',
+    })).rejects.toThrow(/Could not open/)
+  })
+
+  it('transcode aiff into flac natively', async () => {
+    const aiffFile = temp.openSync('flac-bindings.encode-decode.async-api')
+    fs.writeSync(aiffFile.fd, createAiff(okData))
+    fs.closeSync(aiffFile.fd)
+
+    await api.transcode({
+      input: aiffFile.path,
+      output: tmpFile.path,
+      inputFormat: 'aiff',
+      outputFormat: 'flac',
+    })
+
+    comparePCM(okData, tmpFile.path, 24)
+    expect(() => api.transcode({ input: aiffFile.path, output: 'out.aiff' }))
+      .toThrow(/can only be read/)
+  })
+
+  it('encode wav file natively', async () => {
+    const enc = await new api.EncoderBuilder()
+      .setCompressionLevel(5)
+      .buildFromWavFileAsync(pathForFile('loop.wav'), tmpFile.path)
+
+    expect(enc.channels).toBe(2)
+    expect(enc.bitsPerSample).toBe(24)
+    expect(enc.sampleRate).toBe(44100)
+    expect(enc.totalSamplesEstimate).toBe(totalSamples)
+    await expect(enc.processInputAsync()).resolves.toBeTrue()
+    await expect(enc.finishAsync()).resolves.toBeTruthy()
+
+    comparePCM(okData, tmpFile.path, 24)
+  })
+
+  it.each([
+    ['rf64', () => createRf64(okData, 0x3)],
+    ['wave64', () => createW64(okData)],
+    ['aiff', () => createAiff(okData)],
+  ])('encode %s file natively', async (_, create) => {
+    const inputFile = temp.openSync('flac-bindings.encode-decode.async-api')
+    fs.writeSync(inputFile.fd, create())
+    fs.closeSync(inputFile.fd)
+
+    const enc = await new api.EncoderBuilder().buildFromWavFileAsync(inputFile.path, tmpFile.path)
+    expect(enc.totalSamplesEstimate).toBe(totalSamples)
+    await expect(enc.processInputAsync()).resolves.toBeTrue()
+    await expect(enc.finishAsync()).resolves.toBeTruthy()
+
+    comparePCM(okData, tmpFile.path, 24)
+    expect([...api.metadata0.getTags(tmpFile.path)]).toStrictEqual([])
+  })
+
+  it('encode wav file natively keeps the channel mask', async () => {
+    const inputFile = temp.openSync('flac-bindings.encode-decode.async-api')
+    fs.writeSync(inputFile.fd, createRf64(okData, 0x600))
+    fs.closeSync(inputFile.fd)
+
+    const enc = await new api.EncoderBuilder().buildFromWavFileAsync(inputFile.path, tmpFile.path)
+    await enc.processInputAsync()
+    await enc.finishAsync()
+
+    expect([...api.metadata0.getTags(tmpFile.path)])
+      .toStrictEqual(['WAVEFORMATEXTENSIBLE_CHANNEL_MASK=0x0600'])
+  })
+
+  it('encode wav file natively rejects if the input is not valid', async () => {
+    const builder = new api.EncoderBuilder()
+    await expect(builder.buildFromWavFileAsync(pathForFile('loop.flac'), tmpFile.path))
+      .rejects.toThrow(/not a WAV or AIFF file/)
+    await expect(builder.buildFromWavFileAsync('/non/existent/file.wav', tmpFile.path))
+      .rejects.toThrow(/Could not open/)
+  })
+
+  it('processInputAsync throws if the encoder is not built from a file', async () => {
+    const enc = await new api.EncoderBuilder()
+      .setChannels(2)
+      .setBitsPerSample(24)
+      .buildWithFileAsync(tmpFile.path)
+
+    expect(() => enc.processInputAsync()).toThrow(/not been built from a WAV or AIFF file/)
+    await enc.finishAsync()
+  })
+
+  it('encode file using several threads', async () => {
+    const enc = new api.ParallelEncoder(tmpFile.path, {
+      channels: 2,
+      bitsPerSample: 24,
+      sampleRate: 44100,
+      compressionLevel: 9,
+      segmentSamples: 8192,
+      seekPointSpacing: 44100,
+      threads: 4,
+    })
+
+    expect(enc.threads).toBe(4)
+    await expect(enc.processInterleavedAsync(encData)).resolves.toBeTruthy()
+    await expect(enc.finishAsync()).resolves.toBeTruthy()
+    expect(() => enc.finishAsync()).toThrow()
+
+    comparePCM(okData, tmpFile.path, 24)
+  })
+
+  it('decode whole file natively using several threads', async () => {
+    const result = await api.parallelDecodeFile(pathForFile('loop.flac'), {
+      threads: 4,
+      verifyMd5: true,
+    })
+
+    expect(result.samples).toStrictEqual(totalSamples)
+    expect(result.outBps).toBe(3)
+    comparePCM(okData, result.buffer, 24)
+  })
+
+  it('decode whole file natively using several threads into non-interleaved buffers', async () => {
+    const result = await api.parallelDecodeFile(pathForFile('loop.flac'), {
+      threads: 3,
+      interleaved: false,
+      outBps: 4,
+    })
+
+    const finalBuffer = api.fns.zipAudio({
+      buffers: result.buffers,
+      samples: result.samples,
+      inBps: 4,
+      outBps: 3,
+    })
+    expect(result.samples).toStrictEqual(totalSamples)
+    comparePCM(okData, finalBuffer, 24)
+  })
+
+  it('decode whole file using several threads when STREAMINFO tells less samples', async () => {
+    // the total samples are the 36 bits before the MD5, at the end of STREAMINFO
+    const understated = totalSamples - 5000
+    const data = await fs.promises.readFile(pathForFile('loop.flac'))
+    data[21] = (data[21] & 0xF0) | Math.floor(understated / 2 ** 32)
+    data.writeUInt32BE(understated % 2 ** 32, 22)
+    await fs.promises.writeFile(tmpFile.path, data)
+
+    const expected = await api.decodeFile(tmpFile.path)
+    const result = await api.parallelDecodeFile(tmpFile.path, { threads: 4 })
+
+    expect(expected.samples).toBeGreaterThan(understated)
+    expect(result.samples).toStrictEqual(expected.samples)
+    expect(result.buffer.equals(expected.buffer)).toBeTruthy()
+  })
+
+  it('decode whole file using several threads throws for an invalid number of threads', () => {
+    const decode = (threads) => api.parallelDecodeFile(pathForFile('loop.flac'), { threads })
+
+    expect(() => decode(0)).toThrow(/between 1 and 1024/)
+    expect(() => decode(1025)).toThrow(/between 1 and 1024/)
+  })
+
   it('decoder should be able to skip a frame', async () => {
     const dec = await new api.DecoderBuilder().buildWithFileAsync(
       pathForFile('loop.flac'),
@@ -410,6 +1370,125 @@ describe('encode & decode: async api', () => {
     expect(progressCallbackValues).toHaveLength(41)
   })
 
+  it('encode using drain (non-ogg)', async () => {
+    const enc = await new api.EncoderBuilder()
+      .setBitsPerSample(24)
+      .setChannels(2)
+      .setCompressionLevel(9)
+      .setSampleRate(44100)
+      .buildWithDrainAsync(null, 4096)
+
+    const chunks = []
+    const draining = (async () => {
+      for (;;) {
+        // eslint-disable-next-line no-await-in-loop
+        const chunk = await enc.drainAsync()
+        if (chunk === null) {
+          return
+        }
+
+        chunks.push(chunk)
+      }
+    })()
+
+    await expect(enc.processInterleavedAsync(encData)).resolves.toBeTruthy()
+    await expect(enc.finishAsync()).resolves.not.toBeNull()
+    await draining
+    expect(enc.drain()).toBeNull()
+
+    await fs.promises.writeFile(tmpFile.path, Buffer.concat(chunks))
+    comparePCM(okData, tmpFile.path, 24)
+  })
+
+  it('encode using file from a shared input ring', async () => {
+    const capacity = 4096
+    const data = new Int32Array(new SharedArrayBuffer(capacity * 2 * 4))
+    const state = new Int32Array(new SharedArrayBuffer(3 * 4))
+    const inputSamples = new Int32Array(encData.buffer, encData.byteOffset, totalSamples * 2)
+    let written = 0
+    const fill = () => {
+      const space = capacity - ((written - Atomics.load(state, 1)) >>> 0)
+      const count = Math.min(space, totalSamples - written)
+      for (let i = 0; i < count; i += 1) {
+        const position = ((written + i) & (capacity - 1)) * 2
+        data[position] = inputSamples[(written + i) * 2]
+        data[position + 1] = inputSamples[(written + i) * 2 + 1]
+      }
+      written += count
+      Atomics.store(state, 0, written)
+      if (written === totalSamples) {
+        Atomics.or(state, 2, 1)
+      }
+    }
+    // the ring is smaller than the audio, so the encoder has to wait for the producer
+    const interval = setInterval(fill, 1)
+    deferredScope.defer(() => clearInterval(interval))
+
+    const enc = await new api.EncoderBuilder()
+      .setBitsPerSample(24)
+      .setChannels(2)
+      .setCompressionLevel(9)
+      .setSampleRate(44100)
+      .buildWithFileAsync(tmpFile.path)
+
+    await expect(enc.processSharedInputAsync({ data, state })).resolves.toBeTruthy()
+    await expect(enc.finishAsync()).resolves.not.toBeNull()
+
+    expect(Atomics.load(state, 1)).toStrictEqual(totalSamples)
+    comparePCM(okData, tmpFile.path, 24)
+  })
+
+  it('encode from a shared input ring stops when cancelled', async () => {
+    const data = new Float32Array(new SharedArrayBuffer(1024 * 2 * 4))
+    const state = new Int32Array(new SharedArrayBuffer(3 * 4))
+    const enc = await new api.EncoderBuilder()
+      .setBitsPerSample(16)
+      .setChannels(2)
+      .setSampleRate(44100)
+      .buildWithFileAsync(tmpFile.path)
+
+    const promise = enc.processSharedInputAsync({ data, state, planar: true })
+    Atomics.store(state, 0, 512)
+    while (Atomics.load(state, 1) !== 512) {
+      // eslint-disable-next-line no-await-in-loop
+      await new Promise((resolve) => { setTimeout(resolve, 1) })
+    }
+
+    Atomics.or(state, 2, 2)
+    await expect(promise).resolves.toBeFalsy()
+    await enc.finishAsync()
+  })
+
+  it('processSharedInputAsync throws if the arrays are not valid', async () => {
+    const enc = await new api.EncoderBuilder()
+      .setChannels(2)
+      .buildWithFileAsync(tmpFile.path)
+    deferredScope.defer(() => enc.finishAsync())
+
+    expect(() => enc.processSharedInputAsync({
+      data: new Int32Array(16),
+      state: new Int32Array(new SharedArrayBuffer(3 * 4)),
+    })).toThrow(/SharedArrayBuffer/)
+    expect(() => enc.processSharedInputAsync({
+      data: new Int32Array(new SharedArrayBuffer(6 * 4)),
+      state: new Int32Array(new SharedArrayBuffer(3 * 4)),
+    })).toThrow(/power of two/)
+  })
+
+  it('encoder drain methods throw if not built with drain', async () => {
+    const callbacks = generateFlacCallbacks.sync(api.Encoder, tmpFile.path, 'w')
+    deferredScope.defer(() => callbacks.close())
+    const enc = await new api.EncoderBuilder()
+      .setBitsPerSample(24)
+      .setChannels(2)
+      .setSampleRate(44100)
+      .buildWithStreamAsync(callbacks.write, null, null, null)
+
+    expect(() => enc.drain()).toThrow('Encoder has not been built using drain')
+    expect(() => enc.drainAsync()).toThrow('Encoder has not been built using drain')
+    await enc.finishAsync()
+  })
+
   it('encoder should emit streaminfo metadata block', async () => {
     let metadataBlock = null
     const callbacks = generateFlacCallbacks.sync(api.Encoder, tmpFile.path, 'w')
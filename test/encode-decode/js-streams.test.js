@@ -88,6 +88,29 @@ describe('encode & decode: js streams', () => {
       comparePCM(okData, tmpFile.path, 24, true)
     })
 
+    it('encode/decode using stream with float samples', async () => {
+      const dec = new StreamDecoder({ outputAsFloat: true })
+      const enc = new StreamEncoder({
+        samplerate: 44100,
+        channels: 2,
+        bitsPerSample: 24,
+        compressionLevel: 9,
+        inputAsFloat: true,
+      })
+      const input = fs.createReadStream(pathForFile('loop.flac'))
+      const output = fs.createWriteStream(tmpFile.path)
+
+      input.pipe(dec)
+      dec.pipe(enc)
+      enc.pipe(output)
+      await events.once(output, 'close')
+
+      // 24 bit samples fit in a float, so the round trip is lossless
+      expect(dec.getOutputBitsPerSample()).toBe(32)
+      expect(enc.processedSamples).toStrictEqual(totalSamples)
+      comparePCM(okData, tmpFile.path, 24)
+    })
+
     it('decode using stream and file-bit output', async () => {
       const input = fs.createReadStream(pathForFile('loop.flac'))
       const dec = new StreamDecoder({ outputAs32: false })
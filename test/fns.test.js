@@ -114,6 +114,111 @@ describe('fns', () => {
 
       expect(returnedBuffer).toStrictEqual(expectedBuffer)
     })
+
+    it('converts long buffers with negative samples', () => {
+      // 37 samples: not a multiple of any vector size, so the tail is also exercised
+      const samples = 37
+      for (const [inBps, outBps] of [[2, 4], [3, 4], [4, 2], [4, 3]]) {
+        const buffer = Buffer.alloc(samples * inBps)
+        const expected = Buffer.alloc(samples * outBps)
+        for (let i = 0; i < samples; i += 1) {
+          const value = (i % 2 ? -1 : 1) * i * 97
+          buffer.writeIntLE(value, i * inBps, inBps)
+          expected.writeIntLE(value, i * outBps, outBps)
+        }
+
+        const returnedBuffer = fns.convertSampleFormat({ buffer, inBps, outBps })
+
+        expect(returnedBuffer).toStrictEqual(expected)
+      }
+    })
+    it('writes into the output buffer', () => {
+      const buffer = Buffer.from([1, 0, 2, 0, 3, 0])
+      const output = Buffer.alloc(16, 0xAA)
+
+      const returnedBuffer = fns.convertSampleFormat({ buffer, inBps: 2, output })
+
+      expect(returnedBuffer.buffer).toBe(output.buffer)
+      expect(returnedBuffer).toStrictEqual(Buffer.from([1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0]))
+      expect(output.subarray(12)).toStrictEqual(Buffer.alloc(4, 0xAA))
+    })
+
+    it('converts in place if outBps <= inBps', () => {
+      const buffer = Buffer.from([1, 0, 0, 0, 2, 0, 0, 0, -1, -1, -1, -1])
+
+      const returnedBuffer = fns.convertSampleFormat({ buffer, outBps: 2, output: buffer })
+
+      expect(returnedBuffer.buffer).toBe(buffer.buffer)
+      expect(returnedBuffer).toStrictEqual(Buffer.from([1, 0, 2, 0, 0xFF, 0xFF]))
+    })
+
+    it('converts from and to float', () => {
+      const buffer = Buffer.alloc(4 * 2)
+      buffer.writeInt16LE(-32768, 0)
+      buffer.writeInt16LE(16384, 2)
+      buffer.writeInt16LE(-1, 4)
+      buffer.writeInt16LE(32767, 6)
+
+      const floats = fns.convertSampleFormat({ buffer, inBps: 2, outFloat: true })
+      const values = [...Array(4)].map((_, i) => floats.readFloatLE(i * 4))
+
+      expect(values).toStrictEqual([-1, 0.5, -1 / 32768, 32767 / 32768])
+
+      const ints = fns.convertSampleFormat({ buffer: floats, inFloat: true, outBps: 2 })
+
+      expect(ints).toStrictEqual(buffer)
+    })
+
+    it('clamps and rounds when converting from float', () => {
+      const buffer = Buffer.alloc(4 * 5)
+      const values = [2, -2, NaN, 0.3 / 128, 0.7 / 128]
+      values.forEach((value, i) => buffer.writeFloatLE(value, i * 4))
+
+      const returnedBuffer = fns.convertSampleFormat({ buffer, inFloat: true, outBps: 1 })
+
+      expect([...returnedBuffer.values()]).toStrictEqual([127, 0x80, 0x80, 0, 1])
+      expect(() => fns.convertSampleFormat({
+        buffer,
+        inFloat: true,
+        outBps: 2,
+        bitsPerSample: 17,
+      })).toThrow(/Unsupported bitsPerSample 17 for 2 bytes per sample/)
+    })
+
+    it('keeps the error under 1 LSB when using dither', () => {
+      const samples = 1000
+      const buffer = Buffer.alloc(samples * 4)
+      for (let i = 0; i < samples; i += 1) {
+        buffer.writeFloatLE(Math.sin(i / 10) * 0.9, i * 4)
+      }
+
+      const returnedBuffer = fns.convertSampleFormat({
+        buffer,
+        inFloat: true,
+        outBps: 2,
+        dither: true,
+      })
+
+      for (let i = 0; i < samples; i += 1) {
+        const expected = buffer.readFloatLE(i * 4) * 32768
+        expect(Math.abs(returnedBuffer.readInt16LE(i * 2) - expected)).toBeLessThan(1.5)
+      }
+    })
+
+    it('throws if output is invalid', () => {
+      const buffer = Buffer.from([1, 0, 2, 0, 0, 0, 0, 0])
+
+      expect(() => fns.convertSampleFormat({ buffer, inBps: 2, samples: 2, output: [] }))
+        .toThrow(/Expected output to be a Buffer/)
+      expect(() => fns.convertSampleFormat({
+        buffer,
+        inBps: 2,
+        samples: 2,
+        output: Buffer.alloc(7),
+      })).toThrow(/Output buffer has size 7 but expected to be at least 8/)
+      expect(() => fns.convertSampleFormat({ buffer, inBps: 2, samples: 2, output: buffer }))
+        .toThrow(/Output buffer can only overlap/)
+    })
   })
 
   describe('zipAudio', () => {
@@ -259,6 +364,66 @@ describe('fns', () => {
 
       expect(returnedBuffer).toStrictEqual(expectedBuffer)
     })
+
+    it('returns interleaved audio for long buffers', () => {
+      const samples = 37
+      for (const channels of [2, 6]) {
+        for (const outBps of [2, 3, 4]) {
+          const buffers = [...Array(channels)].map(() => Buffer.alloc(samples * 4))
+          const expected = Buffer.alloc(samples * channels * outBps)
+          for (let i = 0; i < samples; i += 1) {
+            for (let c = 0; c < channels; c += 1) {
+              const value = (c % 2 ? -1 : 1) * (i * 31 + c)
+              buffers[c].writeInt32LE(value, i * 4)
+              expected.writeIntLE(value, (i * channels + c) * outBps, outBps)
+            }
+          }
+
+          const returnedBuffer = fns.zipAudio({ buffers, samples, outBps })
+
+          expect(returnedBuffer).toStrictEqual(expected)
+        }
+      }
+    })
+    it('returns interleaved float audio', () => {
+      const samples = 37
+      const buffers = [Buffer.alloc(samples * 4), Buffer.alloc(samples * 4)]
+      const expected = Buffer.alloc(samples * 2 * 4)
+      for (let i = 0; i < samples; i += 1) {
+        for (let c = 0; c < 2; c += 1) {
+          const value = (c % 2 ? -1 : 1) * (i * 1021 + c)
+          buffers[c].writeInt32LE(value, i * 4)
+          expected.writeFloatLE(value / 2 ** 23, (i * 2 + c) * 4)
+        }
+      }
+
+      const returnedBuffer = fns.zipAudio({
+        buffers,
+        samples,
+        outFloat: true,
+        bitsPerSample: 24,
+      })
+
+      expect(returnedBuffer).toStrictEqual(expected)
+      expect(fns.unzipAudio({
+        buffer: returnedBuffer,
+        channels: 2,
+        inFloat: true,
+        bitsPerSample: 24,
+      })).toStrictEqual(buffers)
+    })
+
+    it('writes into the output buffer', () => {
+      const buffers = [Buffer.from([1, 0, 2, 0]), Buffer.from([3, 0, 4, 0])]
+      const output = Buffer.alloc(8)
+
+      const returnedBuffer = fns.zipAudio({ buffers, samples: 2, inBps: 2, outBps: 2, output })
+
+      expect(returnedBuffer).toBe(output)
+      expect(output).toStrictEqual(Buffer.from([1, 0, 3, 0, 2, 0, 4, 0]))
+      expect(() => fns.zipAudio({ buffers, samples: 2, inBps: 2, output }))
+        .toThrow(/Output buffer has size 8 but expected to be at least 16/)
+    })
   })
 
   describe('unzipAudio', () => {
@@ -406,5 +571,51 @@ describe('fns', () => {
 
       expect(returnedBuffer).toStrictEqual(expectedBuffers)
     })
+
+    it('returns deinterleaved audio for long buffers', () => {
+      const samples = 37
+      for (const channels of [2, 6]) {
+        for (const inBps of [2, 3, 4]) {
+          const buffer = Buffer.alloc(samples * channels * inBps)
+          const expected = [...Array(channels)].map(() => Buffer.alloc(samples * 4))
+          for (let i = 0; i < samples; i += 1) {
+            for (let c = 0; c < channels; c += 1) {
+              const value = (c % 2 ? -1 : 1) * (i * 31 + c)
+              buffer.writeIntLE(value, (i * channels + c) * inBps, inBps)
+              expected[c].writeInt32LE(value, i * 4)
+            }
+          }
+
+          const returnedBuffers = fns.unzipAudio({ buffer, channels, inBps })
+
+          expect(returnedBuffers).toStrictEqual(expected)
+        }
+      }
+    })
+
+    it('writes into the output buffers', () => {
+      const buffer = Buffer.from([1, 0, 3, 0, 2, 0, 4, 0])
+      const output = [Buffer.alloc(4), Buffer.alloc(4)]
+
+      const returnedBuffers = fns.unzipAudio({
+        buffer,
+        channels: 2,
+        inBps: 2,
+        outBps: 2,
+        output,
+      })
+
+      expect(returnedBuffers[0]).toBe(output[0])
+      expect(returnedBuffers[1]).toBe(output[1])
+      expect(output).toStrictEqual([Buffer.from([1, 0, 2, 0]), Buffer.from([3, 0, 4, 0])])
+      expect(() => fns.unzipAudio({
+        buffer,
+        channels: 2,
+        inBps: 2,
+        outBps: 2,
+        output: [output[0]],
+      }))
+        .toThrow(/Expected 2 output buffers but got 1/)
+    })
   })
 })
@@ -363,6 +363,39 @@ describe('metadata0', () => {
     })
   })
 
+  describe('scanMetadata', () => {
+    it('should throw if paths is not an array', () => {
+      expect(() => metadata0.scanMetadata('vc-p.flac')).toThrow()
+    })
+
+    it('should read the requested blocks of all files', async () => {
+      const paths = ['vc-cs.flac', 'vc-p.flac', 'el.flac', 'no.flac'].map((p) => pathForFile(p))
+
+      const results = []
+      const scan = metadata0.scanMetadata(paths, {
+        types: [format.MetadataType.STREAMINFO, format.MetadataType.VORBIS_COMMENT],
+        concurrency: 2,
+        batchSize: 3,
+      })
+      for await (const batch of scan) {
+        expect(batch.length).toBeLessThanOrEqual(3)
+        results.push(...batch)
+      }
+
+      results.sort((a, b) => a.index - b.index)
+      expect(results.map((r) => r.path)).toStrictEqual(paths)
+      expect(results[0].blocks.map((b) => b.type)).toStrictEqual([
+        format.MetadataType.STREAMINFO,
+        format.MetadataType.VORBIS_COMMENT,
+      ])
+      expect(results[1].blocks[1]).toBeInstanceOf(metadata.VorbisCommentMetadata)
+      expect(results[2].error).toBeDefined()
+      expect(results[2].blocks).toHaveLength(0)
+      expect(results[3].error).toBeUndefined()
+      expect(results[3].blocks.map((b) => b.type)).toStrictEqual([format.MetadataType.STREAMINFO])
+    })
+  })
+
   describe('gc', () => {
     it('gc should work', () => {
       expect(gc).not.toThrow()
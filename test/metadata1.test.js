@@ -100,6 +100,35 @@ describe('simpleIterator', () => {
   })
 
   describe('asyncIterator', () => {
+    it('should iterate over all blocks one by one', async () => {
+      const filePath = pathForFile('vc-cs.flac')
+      const si = new SimpleIterator()
+
+      await si.initAsync(filePath)
+      const types = []
+      const e = si[Symbol.asyncIterator](1)
+      for (let m = await e.next(); !m.done; m = await e.next()) {
+        types.push(m.value.type)
+      }
+
+      expect(types).toStrictEqual([
+        format.MetadataType.STREAMINFO,
+        format.MetadataType.SEEKTABLE,
+        format.MetadataType.VORBIS_COMMENT,
+        format.MetadataType.CUESHEET,
+      ])
+      await expect(e.next()).resolves.toStrictEqual({ done: true })
+    })
+
+    it('should reuse the iterator class', async () => {
+      const si = new SimpleIterator()
+      await si.initAsync(pathForFile('vc-cs.flac'))
+
+      const a = si[Symbol.asyncIterator]()
+      const b = si[Symbol.asyncIterator]()
+      expect(Object.getPrototypeOf(a)).toBe(Object.getPrototypeOf(b))
+    })
+
     it('should iterate over all blocks', async () => {
       const filePath = pathForFile('vc-cs.flac')
       const si = new SimpleIterator()
@@ -127,6 +156,27 @@ describe('simpleIterator', () => {
       expect(m.done).toBeTruthy()
       expect(m.value).toBeUndefined()
     })
+
+    it('should reject the whole batch if a block cannot be read', async () => {
+      const tmpFile = temp.openSync('flac-bindings.metadata1.simpleiterator')
+      try {
+        oldfs.closeSync(tmpFile.fd)
+        oldfs.copyFileSync(pathForFile('vc-cs.flac'), tmpFile.path)
+
+        // cut the file inside the data of the last block (the CUESHEET)
+        const si = new SimpleIterator()
+        si.init(tmpFile.path)
+        // eslint-disable-next-line curly
+        while (si.next());
+        await fs.truncate(tmpFile.path, si.getBlockOffset() + 4 + 8)
+
+        await si.initAsync(tmpFile.path)
+        const e = si[Symbol.asyncIterator](8)
+        await expect(e.next()).rejects.toThrow(/Operation failed/)
+      } finally {
+        temp.cleanupSync()
+      }
+    })
   })
 
   describe('iterate and get*', () => {
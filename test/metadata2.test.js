@@ -9,7 +9,7 @@ import {
   it,
 } from 'vitest'
 import {
-  Chain, Iterator, metadata, format,
+  Chain, Iterator, metadata, format, buildSeekTable,
 } from '../lib/api.js'
 import {
   pathForFile as fullPathForFile,
@@ -77,6 +77,31 @@ describe('chain & Iterator', () => {
       expect(ch.status()).toStrictEqual(Chain.Status.OK)
       await fs.access(filePath)
     })
+
+    it('throws if the file does not exist (mmap)', async () => {
+      const filePath = pathForFile('el.flac')
+      const ch = new Chain()
+
+      await expect(() => ch.readAsync(filePath, { mmap: true })).rejects.toThrow(/Chain operation failed: ERROR_OPENING_FILE/)
+      expect(() => ch.read(filePath, { mmap: true })).toThrow(/Chain operation failed: ERROR_OPENING_FILE/)
+    })
+
+    it('reads the same blocks using mmap', async () => {
+      const filePath = pathForFile('vc-cs.flac')
+      const ch = new Chain()
+      const mappedCh = new Chain()
+
+      ch.read(filePath)
+      await mappedCh.readAsync(filePath, { mmap: true })
+
+      expect(mappedCh.status()).toStrictEqual(Chain.Status.OK)
+      expect(Array.from(mappedCh.createIterator()).map((i) => i.type))
+        .toStrictEqual(Array.from(ch.createIterator()).map((i) => i.type))
+    })
+
+    it('throws if the options are not an object', () => {
+      expect(() => new Chain().read(pathForFile('no.flac'), 7)).toThrow(/Expected 7 to be object/)
+    })
   })
 
   describe('readWithCallbacks', () => {
@@ -552,6 +577,61 @@ describe('chain & Iterator', () => {
         format.MetadataType.PADDING,
       ])
     })
+
+    it('modify the blocks and write should modify the file correctly (mmap)', async () => {
+      const ch = new Chain()
+      await ch.readAsync(tmpFile.path, { mmap: true })
+      const si = ch.createIterator()
+
+      const vc = new metadata.VorbisCommentMetadata()
+      vc.vendorString = 'flac-bindings 2.0.0'
+      expect(si.insertBlockAfter(vc)).toBeTruthy()
+
+      expect(si.insertBlockAfter(new metadata.PaddingMetadata(50))).toBeTruthy()
+      expect(si.insertBlockAfter(new metadata.ApplicationMetadata())).toBeTruthy()
+      expect(si.next()).toBeTruthy()
+
+      expect(ch.checkIfTempFileIsNeeded()).toBeFalsy()
+      await ch.writeAsync()
+
+      const ch2 = new Chain()
+      ch2.read(tmpFile.path)
+      expect(Array.from(ch2.createIterator()).map((i) => i.type)).toStrictEqual([
+        format.MetadataType.STREAMINFO,
+        format.MetadataType.VORBIS_COMMENT,
+        format.MetadataType.PADDING,
+        format.MetadataType.APPLICATION,
+        format.MetadataType.PADDING,
+      ])
+    })
+
+    it('modify the blocks and write should modify the file correctly (mmap + tempfile)', async () => {
+      const ch = new Chain()
+      ch.read(tmpFile.path, { mmap: true })
+      const si = ch.createIterator()
+
+      const vc = new metadata.VorbisCommentMetadata()
+      vc.vendorString = 'flac-bindings 2.0.0'
+      expect(si.insertBlockAfter(vc)).toBeTruthy()
+
+      expect(si.insertBlockAfter(new metadata.PaddingMetadata(50))).toBeTruthy()
+      expect(si.insertBlockAfter(new metadata.ApplicationMetadata())).toBeTruthy()
+      expect(si.next()).toBeTruthy()
+
+      expect(ch.checkIfTempFileIsNeeded(false)).toBeTruthy()
+      ch.write(false, true)
+
+      const ch2 = new Chain()
+      ch2.read(tmpFile.path)
+      expect(Array.from(ch2.createIterator()).map((i) => i.type)).toStrictEqual([
+        format.MetadataType.STREAMINFO,
+        format.MetadataType.VORBIS_COMMENT,
+        format.MetadataType.PADDING,
+        format.MetadataType.APPLICATION,
+        format.MetadataType.PADDING,
+      ])
+      await expect(() => fs.access(`${tmpFile.path}.metadata_edit.tmp`)).rejects.toThrow(/^ENOENT/)
+    })
   })
 
   describe('other', () => {
@@ -570,3 +650,89 @@ describe('chain & Iterator', () => {
     })
   })
 })
+
+describe('buildSeekTable', () => {
+  let tmpFile
+  beforeEach(() => {
+    tmpFile = temp.openSync('flac-bindings.metadata2.build-seektable')
+    oldfs.closeSync(tmpFile.fd)
+  })
+
+  afterEach(() => {
+    temp.cleanupSync()
+  })
+
+  const readSeekPoints = (filePath) => {
+    const ch = new Chain()
+    ch.read(filePath)
+    const seekTable = Array.from(ch.createIterator())
+      .find((block) => block.type === format.MetadataType.SEEKTABLE)
+    return Array.from(seekTable).map(({ sampleNumber, streamOffset, frameSamples }) => ({
+      sampleNumber,
+      streamOffset,
+      frameSamples,
+    }))
+  }
+
+  it('writes the same points as libFLAC', async () => {
+    oldfs.copyFileSync(pathForFile('vc-cs.flac'), tmpFile.path)
+    const expected = readSeekPoints(tmpFile.path)
+
+    await expect(buildSeekTable(tmpFile.path, { spacingSamples: 16384 })).resolves.toStrictEqual({
+      frames: 108,
+      points: 27,
+      rewritten: true,
+    })
+
+    const points = readSeekPoints(tmpFile.path)
+    expect(points).toHaveLength(27)
+    expect(points.slice(0, 2)).toStrictEqual(expected)
+    points.forEach((point, i) => {
+      expect(point.sampleNumber).toBe(i * 16384)
+      expect(point.frameSamples).toBe(4096)
+    })
+  })
+
+  it('reuses the padding and keeps the audio as is', async () => {
+    oldfs.copyFileSync(fullPathForFile.audio('loop.flac'), tmpFile.path)
+    const original = oldfs.readFileSync(tmpFile.path)
+    const audio = original.subarray(4247)
+
+    await expect(buildSeekTable(tmpFile.path, { spacingSamples: 44100 })).resolves.toStrictEqual({
+      frames: 41,
+      points: 4,
+      rewritten: false,
+    })
+
+    const modified = oldfs.readFileSync(tmpFile.path)
+    expect(modified).toHaveLength(original.length)
+    expect(modified.subarray(4247)).toStrictEqual(audio)
+    for (const point of readSeekPoints(tmpFile.path)) {
+      // every point is a frame header
+      expect(audio.readUInt16BE(point.streamOffset) & 0xFFFE).toBe(0xFFF8)
+    }
+  })
+
+  it('uses a point every 10 seconds by default', async () => {
+    oldfs.copyFileSync(pathForFile('vc-p.flac'), tmpFile.path)
+
+    await expect(buildSeekTable(tmpFile.path)).resolves.toStrictEqual({
+      frames: 3,
+      points: 1,
+      rewritten: false,
+    })
+    expect(readSeekPoints(tmpFile.path)).toStrictEqual([
+      { sampleNumber: 0, streamOffset: 0, frameSamples: 4096 },
+    ])
+  })
+
+  it('rejects if the file is not a FLAC file', async () => {
+    await expect(buildSeekTable(fullPathForFile.audio('loop.oga')))
+      .rejects.toThrow(/NOT_A_FLAC_FILE/)
+  })
+
+  it('throws if spacingSamples is 0', () => {
+    expect(() => buildSeekTable(tmpFile.path, { spacingSamples: 0 }))
+      .toThrow(/spacingSamples must be greater than 0/)
+  })
+})
@@ -0,0 +1,132 @@
+import fs from 'node:fs'
+import { afterEach, describe, expect, it } from 'vitest'
+import {
+  _testAsync as testAsync,
+  DecoderBuilder,
+  EncoderBuilder,
+  stats,
+} from '../lib/api.js'
+import { pathForFile as fullPathForFile } from './helper/index.js'
+
+const { audio: pathForFile } = fullPathForFile
+
+// other test files may run in the same process, so values are only checked to have grown
+const snapshotNumber = (key) => Number(stats.snapshot()[key])
+const histogramCount = (key) => Number(stats.snapshot()[key].count)
+
+describe('stats', () => {
+  afterEach(() => {
+    stats.disable()
+  })
+
+  it('should be disabled by default', () => {
+    expect(stats.isEnabled()).toBeFalse()
+    expect(stats.snapshot().enabled).toBeFalse()
+  })
+
+  it('enable and disable should change the state', () => {
+    stats.enable()
+    expect(stats.isEnabled()).toBeTrue()
+    stats.disable()
+    expect(stats.isEnabled()).toBeFalse()
+  })
+
+  it('snapshot should have all the stats', () => {
+    const snapshot = stats.snapshot()
+    expect(snapshot).toContainAllKeys([
+      'enabled',
+      'activeTasks',
+      'runningTasks',
+      'callbacks',
+      'decodedSamples',
+      'encodedSamples',
+      'bytesRead',
+      'bytesWritten',
+      'callbackRoundTrip',
+      'queueWait',
+      'decoderProcess',
+      'encoderProcess',
+    ])
+    expect(snapshot.queueWait)
+      .toContainAllKeys(['count', 'mean', 'max', 'p50', 'p90', 'p99', 'p999'])
+  })
+
+  it('should count callbacks and queue waits of async tasks', async () => {
+    stats.enable()
+    const callbacks = snapshotNumber('callbacks')
+    const roundTrips = histogramCount('callbackRoundTrip')
+    const queueWaits = histogramCount('queueWait')
+
+    await testAsync('resolve', () => Promise.resolve())
+
+    expect(snapshotNumber('callbacks')).toBeGreaterThanOrEqual(callbacks + 10)
+    expect(histogramCount('callbackRoundTrip')).toBeGreaterThanOrEqual(roundTrips + 10)
+    expect(histogramCount('queueWait')).toBeGreaterThan(queueWaits)
+    const { callbackRoundTrip } = stats.snapshot()
+    expect(callbackRoundTrip.p50).toBeLessThanOrEqual(callbackRoundTrip.max)
+  })
+
+  it('should count decoded samples and bytes read', async () => {
+    const data = fs.readFileSync(pathForFile('loop.flac'))
+    stats.enable()
+    const samples = snapshotNumber('decodedSamples')
+    const bytes = snapshotNumber('bytesRead')
+    const processCalls = histogramCount('decoderProcess')
+
+    let position = 0
+    const dec = await new DecoderBuilder().buildWithStreamAsync(
+      (buffer) => {
+        const read = data.copy(buffer, 0, position)
+        position += read
+        return { bytes: read, returnValue: read === 0 ? 1 : 0 }
+      },
+      null,
+      null,
+      null,
+      null,
+      () => 0,
+      null,
+      () => {},
+    )
+    await dec.processUntilEndOfStreamAsync()
+    const totalSamples = dec.getTotalSamples()
+    await dec.finishAsync()
+
+    expect(snapshotNumber('decodedSamples')).toBeGreaterThanOrEqual(samples + Number(totalSamples))
+    expect(snapshotNumber('bytesRead')).toBeGreaterThanOrEqual(bytes + data.length)
+    expect(histogramCount('decoderProcess')).toBeGreaterThan(processCalls)
+  })
+
+  it('should count encoded samples and bytes written', () => {
+    stats.enable()
+    const samples = snapshotNumber('encodedSamples')
+    const bytes = snapshotNumber('bytesWritten')
+    const processCalls = histogramCount('encoderProcess')
+
+    let written = 0
+    const enc = new EncoderBuilder()
+      .setBitsPerSample(16)
+      .setChannels(2)
+      .setSampleRate(44100)
+      .buildWithStream((buffer) => {
+        written += buffer.length
+        return 0
+      })
+    enc.processInterleaved(Buffer.alloc(4096 * 2 * 4), 4096)
+    enc.finish()
+
+    expect(snapshotNumber('encodedSamples')).toBeGreaterThanOrEqual(samples + 4096)
+    expect(snapshotNumber('bytesWritten')).toBeGreaterThanOrEqual(bytes + written)
+    expect(histogramCount('encoderProcess')).toBeGreaterThan(processCalls)
+  })
+
+  it('should not record anything while disabled', async () => {
+    stats.disable()
+    stats.reset()
+
+    await testAsync('resolve', () => {})
+
+    expect(snapshotNumber('callbacks')).toBe(0)
+    expect(histogramCount('callbackRoundTrip')).toBe(0)
+  })
+})